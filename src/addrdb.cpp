@@ -118,6 +118,7 @@ bool CBanDB::Read(banmap_t& banSet)
 CAddrDB::CAddrDB()
 {
     pathAddr = GetDataDir() / "peers.dat";
+    pathJournal = GetDataDir() / "peers.journal";
 }
 
 bool CAddrDB::Write(const CAddrMan& addr)
@@ -215,4 +216,97 @@ bool CAddrDB::Read(CAddrMan& addr, CDataStream& ssPeers)
     }
 
     return true;
-}
\ No newline at end of file
+}
+
+bool CAddrDB::AppendJournal(const std::vector<CAddrManJournalEntry>& vEntries)
+{
+    if (vEntries.empty())
+        return true;
+
+    // serialize the batch behind the network magic, then checksum it
+    CDataStream ssBatch(SER_DISK, CLIENT_VERSION);
+    ssBatch << FLATDATA(Params().MessageStart());
+    ssBatch << vEntries;
+    std::vector<unsigned char> vchData(ssBatch.begin(), ssBatch.end());
+    uint256 hash = Hash(vchData.begin(), vchData.end());
+
+    FILE* file = fsbridge::fopen(pathJournal, "ab");
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return error("%s : Failed to open file %s", __func__, pathJournal.string());
+
+    try {
+        fileout << vchData;
+        fileout << hash;
+    } catch (const std::exception& e) {
+        return error("%s : Serialize or I/O error - %s", __func__, e.what());
+    }
+    FileCommit(fileout.Get());
+    fileout.fclose();
+
+    return true;
+}
+
+bool CAddrDB::ReadJournal(std::vector<CAddrManJournalEntry>& vEntries)
+{
+    vEntries.clear();
+    if (!fs::exists(pathJournal))
+        return true;
+
+    FILE* file = fsbridge::fopen(pathJournal, "rb");
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s : Failed to open file %s", __func__, pathJournal.string());
+
+    while (true) {
+        std::vector<unsigned char> vchData;
+        uint256 hashIn;
+        try {
+            filein >> vchData;
+            filein >> hashIn;
+        } catch (const std::exception& e) {
+            // end of file, or a batch that was only partially written
+            break;
+        }
+
+        if (hashIn != Hash(vchData.begin(), vchData.end())) {
+            LogPrintf("%s : Checksum mismatch, ignoring the rest of %s\n", __func__, pathJournal.string());
+            break;
+        }
+
+        CDataStream ssBatch(vchData, SER_DISK, CLIENT_VERSION);
+        unsigned char pchMsgTmp[4];
+        std::vector<CAddrManJournalEntry> vBatch;
+        try {
+            ssBatch >> FLATDATA(pchMsgTmp);
+            if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)))
+                return error("%s : Invalid network magic number", __func__);
+            ssBatch >> vBatch;
+        } catch (const std::exception& e) {
+            LogPrintf("%s : Deserialize error - %s\n", __func__, e.what());
+            break;
+        }
+        vEntries.insert(vEntries.end(), vBatch.begin(), vBatch.end());
+    }
+
+    return true;
+}
+
+bool CAddrDB::ClearJournal()
+{
+    try {
+        fs::remove(pathJournal);
+    } catch (const fs::filesystem_error& e) {
+        return error("%s : Failed to remove %s - %s", __func__, pathJournal.string(), e.what());
+    }
+    return true;
+}
+
+uint64_t CAddrDB::GetJournalSize() const
+{
+    try {
+        return fs::exists(pathJournal) ? fs::file_size(pathJournal) : 0;
+    } catch (const fs::filesystem_error&) {
+        return 0;
+    }
+}
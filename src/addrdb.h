@@ -15,11 +15,16 @@
 
 #include <string>
 #include <map>
+#include <vector>
 
 class CSubNet;
 class CAddrMan;
+class CAddrManJournalEntry;
 class CDataStream;
 
+/** Size above which peers.journal is folded back into a rewritten peers.dat */
+static const uint64_t ADDRMAN_JOURNAL_MAX_SIZE = 4 * 1024 * 1024;
+
 typedef enum BanReason
 {
     BanReasonUnknown          = 0,
@@ -80,17 +85,26 @@ public:
 
 typedef std::map<CSubNet, CBanEntry> banmap_t;
 
-/** Access to the (IP) address database (peers.dat) */
+/** Access to the (IP) address database (peers.dat) and its change journal (peers.journal) */
 class CAddrDB
 {
 private:
     fs::path pathAddr;
+    fs::path pathJournal;
 
 public:
     CAddrDB();
     bool Write(const CAddrMan& addr);
     bool Read(CAddrMan& addr);
     bool Read(CAddrMan& addr, CDataStream& ssPeers);
+
+    //! Append one checksummed batch of changes to the journal
+    bool AppendJournal(const std::vector<CAddrManJournalEntry>& vEntries);
+    //! Read all intact batches from the journal; a torn or corrupt batch ends it
+    bool ReadJournal(std::vector<CAddrManJournalEntry>& vEntries);
+    //! Remove the journal, once its changes are part of peers.dat
+    bool ClearJournal();
+    uint64_t GetJournalSize() const;
 };
 
 /** Access to the banlist database (banlist.dat) */
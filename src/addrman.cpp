@@ -96,6 +96,7 @@ CAddrInfo* CAddrMan::Create(const CAddress& addr, const CNetAddr& addrSource, in
     mapAddr[addr] = nId;
     mapInfo[nId].nRandomPos = vRandom.size();
     vRandom.push_back(nId);
+    JournalInfo(nId);
     if (pnId)
         *pnId = nId;
     return &mapInfo[nId];
@@ -144,6 +145,7 @@ void CAddrMan::ClearNew(int nUBucket, int nUBucketPos)
         assert(infoDelete.nRefCount > 0);
         infoDelete.nRefCount--;
         vvNew[nUBucket][nUBucketPos] = -1;
+        JournalNew(nUBucket, nUBucketPos);
         if (infoDelete.nRefCount == 0) {
             Delete(nIdDelete);
         }
@@ -157,6 +159,7 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
         int pos = info.GetBucketPosition(nKey, true, bucket);
         if (vvNew[bucket][pos] == nId) {
             vvNew[bucket][pos] = -1;
+            JournalNew(bucket, pos);
             info.nRefCount--;
         }
     }
@@ -178,6 +181,7 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
         // Remove the to-be-evicted item from the tried set.
         infoOld.fInTried = false;
         vvTried[nKBucket][nKBucketPos] = -1;
+        JournalTried(nKBucket, nKBucketPos);
         nTried--;
 
         // find which new bucket it belongs to
@@ -189,11 +193,13 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
         // Enter it into the new set again.
         infoOld.nRefCount = 1;
         vvNew[nUBucket][nUBucketPos] = nIdEvict;
+        JournalNew(nUBucket, nUBucketPos);
         nNew++;
     }
     assert(vvTried[nKBucket][nKBucketPos] == -1);
 
     vvTried[nKBucket][nKBucketPos] = nId;
+    JournalTried(nKBucket, nKBucketPos);
     nTried++;
     info.fInTried = true;
 }
@@ -220,6 +226,7 @@ void CAddrMan::Good_(const CService& addr, bool test_before_evict, int64_t nTime
     info.nLastSuccess = nTime;
     info.nLastTry = nTime;
     info.nAttempts = 0;
+    JournalInfo(nId);
     // nTime is not updated here, to avoid leaking information about
     // currently-connected peers.
 
@@ -277,6 +284,9 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
     }
 
     if (pinfo) {
+        const unsigned int nTimeBefore = pinfo->nTime;
+        const ServiceFlags nServicesBefore = pinfo->nServices;
+
         // periodically update nTime
         bool fCurrentlyOnline = (GetAdjustedTime() - addr.nTime < 24 * 60 * 60);
         int64_t nUpdateInterval = (fCurrentlyOnline ? 60 * 60 : 24 * 60 * 60);
@@ -285,6 +295,8 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
 
         // add services
         pinfo->nServices = ServiceFlags(pinfo->nServices | addr.nServices);
+        if (pinfo->nTime != nTimeBefore || pinfo->nServices != nServicesBefore)
+            JournalInfo(nId);
 
         // do not update if no new information is present
         if (!addr.nTime || (pinfo->nTime && addr.nTime <= pinfo->nTime))
@@ -326,6 +338,7 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
             ClearNew(nUBucket, nUBucketPos);
             pinfo->nRefCount++;
             vvNew[nUBucket][nUBucketPos] = nId;
+            JournalNew(nUBucket, nUBucketPos);
         } else {
             if (pinfo->nRefCount == 0) {
                 Delete(nId);
@@ -337,7 +350,8 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
 
 void CAddrMan::Attempt_(const CService& addr, bool fCountFailure, int64_t nTime)
 {
-    CAddrInfo* pinfo = Find(addr);
+    int nId;
+    CAddrInfo* pinfo = Find(addr, &nId);
 
     // if not found, bail out
     if (!pinfo)
@@ -354,6 +368,7 @@ void CAddrMan::Attempt_(const CService& addr, bool fCountFailure, int64_t nTime)
     if (fCountFailure && info.nLastCountAttempt < nLastGood) {
         info.nLastCountAttempt = nTime;
         info.nAttempts++;
+        JournalInfo(nId);
     }
 }
 
@@ -504,7 +519,8 @@ void CAddrMan::GetAddr_(std::vector<CAddress>& vAddr)
 
 void CAddrMan::Connected_(const CService& addr, int64_t nTime)
 {
-    CAddrInfo* pinfo = Find(addr);
+    int nId;
+    CAddrInfo* pinfo = Find(addr, &nId);
 
     // if not found, bail out
     if (!pinfo)
@@ -518,13 +534,16 @@ void CAddrMan::Connected_(const CService& addr, int64_t nTime)
 
     // update info
     int64_t nUpdateInterval = 20 * 60;
-    if (nTime - info.nTime > nUpdateInterval)
+    if (nTime - info.nTime > nUpdateInterval) {
         info.nTime = nTime;
+        JournalInfo(nId);
+    }
 }
 
 void CAddrMan::SetServices_(const CService& addr, ServiceFlags nServices)
 {
-    CAddrInfo* pinfo = Find(addr);
+    int nId;
+    CAddrInfo* pinfo = Find(addr, &nId);
 
     // if not found, bail out
     if (!pinfo)
@@ -538,6 +557,7 @@ void CAddrMan::SetServices_(const CService& addr, ServiceFlags nServices)
 
     // update info
     info.nServices = nServices;
+    JournalInfo(nId);
 }
 
 int CAddrMan::RandomInt(int nMax){
@@ -622,3 +642,132 @@ CAddrInfo CAddrMan::SelectTriedCollision_()
 
     return mapInfo[id_old];
 }
+
+void CAddrMan::JournalInfo(int nId)
+{
+    if (fJournal)
+        setJournalInfo.insert(nId);
+}
+
+void CAddrMan::JournalNew(int nBucket, int nPos)
+{
+    if (fJournal)
+        setJournalNew.insert(nBucket * ADDRMAN_BUCKET_SIZE + nPos);
+}
+
+void CAddrMan::JournalTried(int nBucket, int nPos)
+{
+    if (fJournal)
+        setJournalTried.insert(nBucket * ADDRMAN_BUCKET_SIZE + nPos);
+}
+
+bool CAddrMan::TakeJournal(std::vector<CAddrManJournalEntry>& vEntries)
+{
+    LOCK(cs);
+    vEntries.clear();
+    bool fComplete = setJournalInfo.size() + setJournalNew.size() + setJournalTried.size() <= ADDRMAN_JOURNAL_MAX_PENDING;
+    if (fComplete) {
+        // entries that were deleted in the meantime are dropped by Replay once no position refers to them
+        for (int nId : setJournalInfo) {
+            std::map<int, CAddrInfo>::const_iterator it = mapInfo.find(nId);
+            if (it != mapInfo.end())
+                vEntries.emplace_back(CAddrManJournalEntry::INFO, it->second);
+        }
+        for (int nSlot : setJournalNew) {
+            int nBucket = nSlot / ADDRMAN_BUCKET_SIZE;
+            int nPos = nSlot % ADDRMAN_BUCKET_SIZE;
+            int nId = vvNew[nBucket][nPos];
+            vEntries.emplace_back(CAddrManJournalEntry::NEW_SLOT, nId == -1 ? CAddrInfo() : mapInfo[nId], nBucket, nPos);
+        }
+        for (int nSlot : setJournalTried) {
+            int nBucket = nSlot / ADDRMAN_BUCKET_SIZE;
+            int nPos = nSlot % ADDRMAN_BUCKET_SIZE;
+            int nId = vvTried[nBucket][nPos];
+            vEntries.emplace_back(CAddrManJournalEntry::TRIED_SLOT, nId == -1 ? CAddrInfo() : mapInfo[nId], nBucket, nPos);
+        }
+    }
+    setJournalInfo.clear();
+    setJournalNew.clear();
+    setJournalTried.clear();
+    return fComplete;
+}
+
+int CAddrMan::Restore(const CAddrInfo& info)
+{
+    int nId;
+    CAddrInfo* pinfo = Find(info, &nId);
+    if (!pinfo)
+        pinfo = Create(info, info.source, &nId);
+
+    // the table references follow from the journaled positions
+    *(CAddress*)pinfo = info;
+    pinfo->source = info.source;
+    pinfo->nLastSuccess = info.nLastSuccess;
+    pinfo->nAttempts = info.nAttempts;
+    return nId;
+}
+
+void CAddrMan::Replay(const std::vector<CAddrManJournalEntry>& vEntries)
+{
+    LOCK(cs);
+    Check();
+    for (const CAddrManJournalEntry& entry : vEntries) {
+        if (entry.nType == CAddrManJournalEntry::INFO) {
+            if (entry.info.IsValid())
+                Restore(entry.info);
+            continue;
+        }
+
+        bool fTried = entry.nType == CAddrManJournalEntry::TRIED_SLOT;
+        if (!fTried && entry.nType != CAddrManJournalEntry::NEW_SLOT)
+            continue;
+        if (entry.nBucket < 0 || entry.nBucket >= (fTried ? ADDRMAN_TRIED_BUCKET_COUNT : ADDRMAN_NEW_BUCKET_COUNT) ||
+            entry.nPos < 0 || entry.nPos >= ADDRMAN_BUCKET_SIZE)
+            continue;
+        // skip positions that don't match the key of the loaded tables
+        if (entry.info.IsValid()) {
+            if (fTried && entry.info.GetTriedBucket(nKey) != entry.nBucket)
+                continue;
+            if (entry.info.GetBucketPosition(nKey, !fTried, entry.nBucket) != entry.nPos)
+                continue;
+        }
+
+        int& nSlot = fTried ? vvTried[entry.nBucket][entry.nPos] : vvNew[entry.nBucket][entry.nPos];
+        if (nSlot != -1) {
+            CAddrInfo& infoOld = mapInfo[nSlot];
+            if (fTried)
+                infoOld.fInTried = false;
+            else
+                infoOld.nRefCount--;
+            nSlot = -1;
+        }
+        if (entry.info.IsValid()) {
+            nSlot = Restore(entry.info);
+            CAddrInfo& info = mapInfo[nSlot];
+            if (fTried)
+                info.fInTried = true;
+            else
+                info.nRefCount++;
+        }
+    }
+
+    // Drop the entries no position refers to anymore and recount the tables
+    std::vector<int> vDelete;
+    for (const auto& item : mapInfo) {
+        if (!item.second.fInTried && item.second.nRefCount <= 0)
+            vDelete.push_back(item.first);
+    }
+    for (int nId : vDelete) {
+        mapInfo[nId].nRefCount = 0;
+        Delete(nId);
+    }
+    nNew = 0;
+    nTried = 0;
+    for (const auto& item : mapInfo) {
+        if (item.second.fInTried)
+            nTried++;
+        else
+            nNew++;
+    }
+    Check();
+}
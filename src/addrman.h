@@ -17,6 +17,7 @@
 #include "util.h"
 
 #include <map>
+#include <unordered_map>
 #include <set>
 #include <stdint.h>
 #include <vector>
@@ -184,6 +185,47 @@ public:
 //! the maximum number of tried addr collisions to store
 #define ADDRMAN_SET_TRIED_COLLISION_SIZE 10
 
+//! the maximum number of changed entries and positions appended as one journal batch
+#define ADDRMAN_JOURNAL_MAX_PENDING 50000
+
+/**
+ * The resulting state of one part of the address tables: the stored fields of
+ * an entry, or the entry occupying one position of a new or tried bucket (an
+ * unset address for an empty position). The states changed since the last
+ * dump are appended to an on-disk journal next to peers.dat, so the periodic
+ * dump doesn't have to rewrite the whole file, and are restored on top of
+ * peers.dat at startup without depending on randomness or the clock.
+ */
+class CAddrManJournalEntry
+{
+public:
+    enum Type : unsigned char {
+        INFO = 0,
+        NEW_SLOT = 1,
+        TRIED_SLOT = 2,
+    };
+
+    unsigned char nType;
+    CAddrInfo info;
+    int nBucket;        // slots only
+    int nPos;           // slots only
+
+    CAddrManJournalEntry() : nType(INFO), nBucket(0), nPos(0) {}
+    CAddrManJournalEntry(Type nTypeIn, const CAddrInfo& infoIn, int nBucketIn = 0, int nPosIn = 0) :
+        nType(nTypeIn), info(infoIn), nBucket(nBucketIn), nPos(nPosIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(nType);
+        READWRITE(info);
+        READWRITE(nBucket);
+        READWRITE(nPos);
+    }
+};
+
 /**
  * Stochastical (IP) address manager
  */
@@ -223,6 +265,24 @@ private:
     //! Holds addrs inserted into tried table that collide with existing entries. Test-before-evict discpline used to resolve these collisions.
     std::set<int> m_tried_collisions;
 
+    //! whether changes are recorded for the on-disk journal
+    bool fJournal;
+
+    //! nIds whose stored fields changed since the last TakeJournal()
+    std::set<int> setJournalInfo;
+
+    //! new and tried positions (bucket * ADDRMAN_BUCKET_SIZE + position) changed since the last TakeJournal()
+    std::set<int> setJournalNew;
+    std::set<int> setJournalTried;
+
+    //! Record that an entry, or a position in the new or tried table, changed.
+    void JournalInfo(int nId);
+    void JournalNew(int nBucket, int nPos);
+    void JournalTried(int nBucket, int nPos);
+
+    //! Find or create the entry for a journaled state and take over its stored fields.
+    int Restore(const CAddrInfo& info);
+
 protected:
     //! secret key to randomize bucket select with
     uint256 nKey;
@@ -328,7 +388,8 @@ public:
 
         int nUBuckets = ADDRMAN_NEW_BUCKET_COUNT ^ (1 << 30);
         s << nUBuckets;
-        std::map<int, int> mapUnkIds;
+        std::unordered_map<int, int> mapUnkIds;
+        mapUnkIds.reserve(mapInfo.size());
         int nIds = 0;
         for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
             mapUnkIds[(*it).first] = nIds;
@@ -357,7 +418,7 @@ public:
             s << nSize;
             for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
                 if (vvNew[bucket][i] != -1) {
-                    int nIndex = mapUnkIds[vvNew[bucket][i]];
+                    int nIndex = mapUnkIds.at(vvNew[bucket][i]);
                     s << nIndex;
                 }
             }
@@ -485,9 +546,12 @@ public:
         nLastGood = 1; //Initially at 1 so that "never" is strictly worse.
         mapInfo.clear();
         mapAddr.clear();
+        setJournalInfo.clear();
+        setJournalNew.clear();
+        setJournalTried.clear();
     }
 
-    CAddrMan()
+    CAddrMan() : fJournal(false)
     {
         Clear();
     }
@@ -628,6 +692,26 @@ public:
         SetServices_(addr, nServices);
         Check();
     }
+
+    //! Start or stop recording changes for the on-disk journal.
+    void SetJournaling(bool fEnable)
+    {
+        LOCK(cs);
+        fJournal = fEnable;
+        setJournalInfo.clear();
+        setJournalNew.clear();
+        setJournalTried.clear();
+    }
+
+    /**
+     * Hand over the current state of everything changed since the last call.
+     * Returns false if more than ADDRMAN_JOURNAL_MAX_PENDING states changed,
+     * in which case the caller has to write out the full tables instead.
+     */
+    bool TakeJournal(std::vector<CAddrManJournalEntry>& vEntries);
+
+    //! Restore the states read back from the journal on top of the loaded tables.
+    void Replay(const std::vector<CAddrManJournalEntry>& vEntries);
 };
 
 #endif // BITCOIN_ADDRMAN_H
@@ -0,0 +1,109 @@
+// Copyright (c) 2025 The Concordia Cash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "addrman.h"
+#include "clientversion.h"
+#include "random.h"
+#include "streams.h"
+
+#include <vector>
+
+// These Benchmarks measure the address manager of a large seed node,
+// which knows about ADDRESSES addresses learned from many sources.
+static const size_t ADDRESSES = 100000;
+static const size_t SOURCES = 250;
+
+static CNetAddr RandomIPv4(FastRandomContext& insecure_rand)
+{
+    struct in_addr ip;
+    uint32_t n = insecure_rand.rand32();
+    // Stay out of the non-routable 0/8, 10/8 and 127/8 ranges
+    unsigned char first = 1 + (n >> 24) % 200;
+    if (first == 10 || first == 127)
+        first++;
+    n = (n & 0x00ffffff) | ((uint32_t)first << 24);
+    ip.s_addr = htonl(n);
+    return CNetAddr(ip);
+}
+
+static void FillAddrMan(CAddrMan& addrman)
+{
+    FastRandomContext insecure_rand(true);
+    std::vector<CNetAddr> vSources;
+    for (size_t i = 0; i < SOURCES; ++i)
+        vSources.push_back(RandomIPv4(insecure_rand));
+
+    int64_t nNow = GetAdjustedTime();
+    for (size_t i = 0; i < ADDRESSES; ++i) {
+        CAddress addr(CService(RandomIPv4(insecure_rand), 51472), NODE_NETWORK);
+        addr.nTime = nNow - insecure_rand.randrange(7 * 24 * 60 * 60);
+        addrman.Add(addr, vSources[i % SOURCES]);
+        // Promote a small share of them to the tried table
+        if (i % 16 == 0)
+            addrman.Good(addr);
+    }
+}
+
+static void AddrManSelect(benchmark::State& state)
+{
+    CAddrMan addrman;
+    FillAddrMan(addrman);
+
+    while (state.KeepRunning()) {
+        CAddrInfo addr = addrman.Select();
+        assert(addr.IsValid());
+    }
+}
+
+static void AddrManGetAddr(benchmark::State& state)
+{
+    CAddrMan addrman;
+    FillAddrMan(addrman);
+
+    while (state.KeepRunning()) {
+        std::vector<CAddress> vAddr = addrman.GetAddr();
+        assert(!vAddr.empty());
+    }
+}
+
+static void AddrManSerialize(benchmark::State& state)
+{
+    CAddrMan addrman;
+    FillAddrMan(addrman);
+
+    while (state.KeepRunning()) {
+        CDataStream ssPeers(SER_DISK, CLIENT_VERSION);
+        ssPeers << addrman;
+        assert(!ssPeers.empty());
+    }
+}
+
+static void AddrManJournal(benchmark::State& state)
+{
+    CAddrMan addrman;
+    FillAddrMan(addrman);
+    addrman.SetJournaling(true);
+
+    // What a periodic dump pays for instead of a full serialization:
+    // draining and serializing the changes of a busy interval
+    FastRandomContext insecure_rand(true);
+    std::vector<CAddrManJournalEntry> vEntries;
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000; ++i) {
+            CAddrInfo addr = addrman.Select();
+            addrman.Attempt(addr, true);
+            addrman.Add(CAddress(CService(RandomIPv4(insecure_rand), 51472), NODE_NETWORK), addr);
+        }
+        addrman.TakeJournal(vEntries);
+        CDataStream ssJournal(SER_DISK, CLIENT_VERSION);
+        ssJournal << vEntries;
+        assert(!ssJournal.empty());
+    }
+}
+
+BENCHMARK(AddrManSelect);
+BENCHMARK(AddrManGetAddr);
+BENCHMARK(AddrManSerialize);
+BENCHMARK(AddrManJournal);
@@ -0,0 +1,110 @@
+// Copyright (c) 2025 The Concordia Cash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "main.h"
+#include "miner.h"
+#include "random.h"
+#include "txmempool.h"
+#include "utiltime.h"
+
+#include <vector>
+
+// This Benchmark fills a mempool with 50k transactions, a fifth of them in
+// short chains whose low fee parents are paid for by their children, and
+// assembles block templates from it the way CreateNewBlock does.
+static const size_t MEMPOOL_TXS = 50000;
+static const size_t CHAIN_LENGTH = 5;
+static const size_t CHAINED_TXS = MEMPOOL_TXS / 5;
+
+static CMutableTransaction MakeTx(const COutPoint& prevout, CAmount nValue)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout;
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_1;
+    tx.vout[0].nValue = nValue;
+    return tx;
+}
+
+static void FillMemPool(CTxMemPool& pool)
+{
+    FastRandomContext insecure_rand(true);
+    const int64_t nTime = GetTime();
+    for (size_t i = 0; i < MEMPOOL_TXS - CHAINED_TXS; i++) {
+        CMutableTransaction tx = MakeTx(COutPoint(insecure_rand.rand256(), 0), 10 * COIN);
+        CAmount nFee = 1000 + insecure_rand.randrange(50000);
+        pool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, nFee, nTime, 0, 1, true, 0, false, 1));
+    }
+    for (size_t i = 0; i < CHAINED_TXS / CHAIN_LENGTH; i++) {
+        COutPoint prevout(insecure_rand.rand256(), 0);
+        for (size_t j = 0; j < CHAIN_LENGTH; j++) {
+            CMutableTransaction tx = MakeTx(prevout, 10 * COIN);
+            // Only the last transaction of a chain pays enough to be mined
+            CAmount nFee = j + 1 < CHAIN_LENGTH ? 100 : 100000 + insecure_rand.randrange(200000);
+            pool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, nFee, nTime, 0, 1, j == 0, 0, false, 1));
+            prevout = COutPoint(tx.GetHash(), 0);
+        }
+    }
+}
+
+static void StartTemplate(CBlockTemplate& blocktemplate)
+{
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout.resize(1);
+    blocktemplate.block.vtx.emplace_back(coinbase);
+    blocktemplate.vTxFees.push_back(-1);
+    blocktemplate.vTxSigOps.push_back(-1);
+}
+
+static void AssembleBlock(benchmark::State& state)
+{
+    CTxMemPool pool(::minRelayTxFee);
+    FillMemPool(pool);
+
+    LOCK(pool.cs);
+    while (state.KeepRunning()) {
+        CBlockTemplate blocktemplate;
+        StartTemplate(blocktemplate);
+
+        BlockAssembler assembler(pool);
+        assembler.AddTransactions(&blocktemplate, 2);
+        assert(assembler.GetBlockTx() > 0);
+    }
+}
+
+// Same pool, but a transaction arrives before every template, as happens
+// between the attempts of a staker: the cached selection is only topped up.
+static void AssembleBlockIncremental(benchmark::State& state)
+{
+    CTxMemPool pool(::minRelayTxFee);
+    FillMemPool(pool);
+    CBlockTemplateCache cache(pool);
+
+    uint256 hashTip = GetRandHash();
+    CBlockIndex indexPrev;
+    indexPrev.phashBlock = &hashTip;
+    indexPrev.nHeight = 1;
+
+    FastRandomContext insecure_rand(true);
+    LOCK2(cs_main, pool.cs);
+    while (state.KeepRunning()) {
+        CMutableTransaction tx = MakeTx(COutPoint(insecure_rand.rand256(), 0), 10 * COIN);
+        pool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, 1000 + insecure_rand.randrange(50000), GetTime(), 0, 1, true, 0, false, 1));
+
+        CBlockTemplate blocktemplate;
+        StartTemplate(blocktemplate);
+        CAmount nFees = 0;
+        uint64_t nBlockSize = 0;
+        cache.FillBlock(&blocktemplate, &indexPrev, nFees, nBlockSize);
+        assert(blocktemplate.block.vtx.size() > 1);
+    }
+}
+
+BENCHMARK(AssembleBlock);
+BENCHMARK(AssembleBlockIncremental);
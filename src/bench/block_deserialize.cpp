@@ -0,0 +1,92 @@
+// Copyright (c) 2025 The Concordia Cash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "main.h"
+#include "random.h"
+#include "streams.h"
+#include "util.h"
+
+#include <vector>
+
+// This Benchmark reads BENCH_BLOCKS blocks of TXS_PER_BLOCK pay-to-pubkey-hash
+// transactions (about 110 kB each) back from a block file. The streaming
+// variant deserializes every field straight from the file, as
+// ReadBlockFromDisk used to do; the other one calls ReadBlockFromDisk.
+// A year of one minute blocks takes 365 * 1440 / BENCH_BLOCKS iterations.
+static const int BENCH_BLOCKS = 100;
+static const int TXS_PER_BLOCK = 500;
+
+struct BlockFileSetup {
+    fs::path pathTemp;
+    std::vector<CDiskBlockPos> vPos;
+
+    BlockFileSetup()
+    {
+        SelectParams(CBaseChainParams::REGTEST);
+        ClearDatadirCache();
+        pathTemp = GetTempPath() / strprintf("bench_concordia_%lu_%i", (unsigned long)GetTime(), (int)GetRand(100000));
+        fs::create_directories(pathTemp);
+        mapArgs["-datadir"] = pathTemp.string();
+
+        CBlock block;
+        for (int i = 0; i < TXS_PER_BLOCK; i++) {
+            CMutableTransaction tx;
+            tx.vin.emplace_back(COutPoint(GetRandHash(), 0));
+            // A DER signature and a compressed public key
+            tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 0x30) << std::vector<unsigned char>(33, 0x02);
+            for (int n = 0; n < 2; n++) {
+                CScript scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, n) << OP_EQUALVERIFY << OP_CHECKSIG;
+                tx.vout.emplace_back(COIN, scriptPubKey);
+            }
+            block.vtx.emplace_back(tx);
+        }
+
+        unsigned int nFilePos = 0;
+        for (int i = 0; i < BENCH_BLOCKS; i++) {
+            CDiskBlockPos pos(0, nFilePos);
+            if (!WriteBlockToDisk(block, pos))
+                throw std::runtime_error("WriteBlockToDisk failed");
+            vPos.push_back(pos);
+            nFilePos = pos.nPos + ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+        }
+    }
+
+    ~BlockFileSetup()
+    {
+        mapArgs.erase("-datadir");
+        ClearDatadirCache();
+        fs::remove_all(pathTemp);
+    }
+};
+
+static void ReadBlocksStreaming(benchmark::State& state)
+{
+    BlockFileSetup setup;
+    while (state.KeepRunning()) {
+        for (const CDiskBlockPos& pos : setup.vPos) {
+            CBlock block;
+            CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+            filein >> block;
+            assert(block.vtx.size() == TXS_PER_BLOCK);
+        }
+    }
+}
+
+static void ReadBlocksFromDisk(benchmark::State& state)
+{
+    BlockFileSetup setup;
+    while (state.KeepRunning()) {
+        for (const CDiskBlockPos& pos : setup.vPos) {
+            CBlock block;
+            bool fRead = ReadBlockFromDisk(block, pos);
+            assert(fRead && block.vtx.size() == TXS_PER_BLOCK);
+        }
+    }
+}
+
+BENCHMARK(ReadBlocksStreaming);
+BENCHMARK(ReadBlocksFromDisk);
@@ -0,0 +1,115 @@
+// Copyright (c) 2025 The Concordia Cash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "blockfilter.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "main.h"
+#include "random.h"
+#include "streams.h"
+#include "util.h"
+
+#include <set>
+#include <vector>
+
+// This Benchmark rescans BENCH_BLOCKS blocks of TXS_PER_BLOCK pay-to-pubkey-hash
+// transactions for a wallet of three addresses, none of them paid in the blocks.
+// Without a filter index every block is read from disk and its outputs are
+// looked up; with one only the serialized filters are decoded and matched.
+static const int BENCH_BLOCKS = 100;
+static const int TXS_PER_BLOCK = 500;
+
+static CScript AddressScript(unsigned char n)
+{
+    return CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, n) << OP_EQUALVERIFY << OP_CHECKSIG;
+}
+
+struct RescanSetup {
+    fs::path pathTemp;
+    std::vector<CDiskBlockPos> vPos;
+    std::vector<CDataStream> vFilters;
+    std::set<CScript> setWalletScripts;
+
+    RescanSetup()
+    {
+        SelectParams(CBaseChainParams::REGTEST);
+        ClearDatadirCache();
+        pathTemp = GetTempPath() / strprintf("bench_concordia_%lu_%i", (unsigned long)GetTime(), (int)GetRand(100000));
+        fs::create_directories(pathTemp);
+        mapArgs["-datadir"] = pathTemp.string();
+
+        for (unsigned char n = 0; n < 3; n++)
+            setWalletScripts.insert(AddressScript(0xf0 + n));
+
+        unsigned int nFilePos = 0;
+        for (int i = 0; i < BENCH_BLOCKS; i++) {
+            CBlock block;
+            block.nNonce = i;
+            for (int j = 0; j < TXS_PER_BLOCK; j++) {
+                CMutableTransaction tx;
+                tx.vin.emplace_back(COutPoint(GetRandHash(), 0));
+                tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 0x30) << std::vector<unsigned char>(33, 0x02);
+                tx.vout.emplace_back(COIN, AddressScript(j % 200));
+                tx.vout.emplace_back(COIN, AddressScript(200 + j % 3));
+                block.vtx.emplace_back(tx);
+            }
+
+            CDiskBlockPos pos(0, nFilePos);
+            if (!WriteBlockToDisk(block, pos))
+                throw std::runtime_error("WriteBlockToDisk failed");
+            vPos.push_back(pos);
+            nFilePos = pos.nPos + ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+
+            vFilters.emplace_back(SER_DISK, CLIENT_VERSION);
+            vFilters.back() << BlockFilter(BLOCK_FILTER_BASIC, block, CBlockUndo());
+        }
+    }
+
+    ~RescanSetup()
+    {
+        mapArgs.erase("-datadir");
+        ClearDatadirCache();
+        fs::remove_all(pathTemp);
+    }
+};
+
+static void RescanReadBlocks(benchmark::State& state)
+{
+    RescanSetup setup;
+    while (state.KeepRunning()) {
+        int nMatches = 0;
+        for (const CDiskBlockPos& pos : setup.vPos) {
+            CBlock block;
+            bool fRead = ReadBlockFromDisk(block, pos);
+            assert(fRead);
+            for (const CTransaction& tx : block.vtx) {
+                for (const CTxOut& txout : tx.vout)
+                    nMatches += setup.setWalletScripts.count(txout.scriptPubKey);
+            }
+        }
+        assert(nMatches == 0);
+    }
+}
+
+static void RescanBlockFilters(benchmark::State& state)
+{
+    RescanSetup setup;
+    GCSFilter::ElementSet elements;
+    for (const CScript& script : setup.setWalletScripts)
+        elements.emplace(script.begin(), script.end());
+    while (state.KeepRunning()) {
+        int nMatches = 0;
+        for (const CDataStream& ssFilter : setup.vFilters) {
+            CDataStream ss(ssFilter);
+            BlockFilter filter;
+            ss >> filter;
+            nMatches += filter.GetFilter().MatchAny(elements);
+        }
+        assert(nMatches == 0);
+    }
+}
+
+BENCHMARK(RescanReadBlocks);
+BENCHMARK(RescanBlockFilters);
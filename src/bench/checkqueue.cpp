@@ -7,6 +7,7 @@
 #include "bench.h"
 #include "util.h"
 #include "checkqueue.h"
+#include "crypto/sha256.h"
 #include "prevector.h"
 #include "random.h"
 
@@ -101,5 +102,55 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     tg.interrupt_all();
     tg.join_all();
 }
+
+// This Benchmark runs checks that take a few microseconds each, about the
+// cost of a cached signature lookup plus script execution, with a fixed
+// number of threads (including the master) from 1 up to 32. Comparing the
+// results shows how the queue scales with the number of cores.
+static const size_t SCALING_CHECKS = 20000;
+static const int SCALING_HASH_ROUNDS = 8;
+static void CCheckQueueScaling(benchmark::State& state, int nThreads)
+{
+    struct HashJob {
+        unsigned char data[32];
+        HashJob() { memset(data, 0, sizeof(data)); }
+        bool operator()()
+        {
+            for (int i = 0; i < SCALING_HASH_ROUNDS; i++)
+                CSHA256().Write(data, sizeof(data)).Finalize(data);
+            return true;
+        }
+        void swap(HashJob& x) { std::swap(data, x.data); };
+    };
+    CCheckQueue<HashJob> queue {QUEUE_BATCH_SIZE};
+    boost::thread_group tg;
+    for (auto x = 0; x < nThreads - 1; ++x) {
+       tg.create_thread([&]{queue.Thread();});
+    }
+    while (state.KeepRunning()) {
+        CCheckQueueControl<HashJob> control(&queue);
+        // One Add per transaction of a block with a few inputs each
+        for (size_t n = 0; n < SCALING_CHECKS; n += 3) {
+            std::vector<HashJob> vChecks(3);
+            control.Add(vChecks);
+        }
+        control.Wait();
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+static void CCheckQueueScaling1(benchmark::State& state) { CCheckQueueScaling(state, 1); }
+static void CCheckQueueScaling2(benchmark::State& state) { CCheckQueueScaling(state, 2); }
+static void CCheckQueueScaling4(benchmark::State& state) { CCheckQueueScaling(state, 4); }
+static void CCheckQueueScaling8(benchmark::State& state) { CCheckQueueScaling(state, 8); }
+static void CCheckQueueScaling16(benchmark::State& state) { CCheckQueueScaling(state, 16); }
+static void CCheckQueueScaling32(benchmark::State& state) { CCheckQueueScaling(state, 32); }
+
 BENCHMARK(CCheckQueueSpeed);
 BENCHMARK(CCheckQueueSpeedPrevectorJob);
+BENCHMARK(CCheckQueueScaling1);
+BENCHMARK(CCheckQueueScaling2);
+BENCHMARK(CCheckQueueScaling4);
+BENCHMARK(CCheckQueueScaling8);
+BENCHMARK(CCheckQueueScaling16);
+BENCHMARK(CCheckQueueScaling32);
@@ -0,0 +1,90 @@
+// Copyright (c) 2012-2017 The Bitcoin Core developers
+// Copyright (c) 2025 The Concordia Cash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "chainparams.h"
+#include "random.h"
+#include "wallet/wallet.h"
+
+#include <iostream>
+#include <memory>
+#include <set>
+#include <vector>
+
+// This Benchmark selects coins for a payment from synthetic wallets: 100k
+// staking rewards of 1 to 2 coins, or 10k coins spread from 0.001 to 1000
+// coins on a log scale. The knapsack benchmarks run SelectCoinsToSpend, the
+// branch and bound ones SelectCoinsChangeless, on a pool sorted beforehand
+// as CreateTransaction does. Each prints the number of inputs it selected.
+static const CFeeRate BENCH_FEE_RATE(10000);
+
+struct CoinSelectionSetup {
+    CWallet wallet;
+    std::vector<std::unique_ptr<CWalletTx> > vTxs;
+    std::vector<COutput> vCoins;
+
+    explicit CoinSelectionSetup(bool fStakeRewards)
+    {
+        SelectParams(CBaseChainParams::REGTEST);
+        FastRandomContext rand(uint256S("01"));
+        const int nCoins = fStakeRewards ? 100000 : 10000;
+        for (int i = 0; i < nCoins; i++) {
+            CMutableTransaction tx;
+            tx.nLockTime = i; // so all transactions get different hashes
+            CAmount nValue;
+            if (fStakeRewards) {
+                nValue = COIN + rand.randrange(COIN);
+            } else {
+                nValue = COIN / 1000;
+                for (int nShift = rand.randrange(35); nShift > 0; nShift--)
+                    nValue = nValue * 3 / 2;
+                nValue += rand.randrange(nValue);
+            }
+            tx.vout.emplace_back(nValue, CScript() << OP_TRUE);
+            vTxs.emplace_back(new CWalletTx(&wallet, tx));
+            vCoins.emplace_back(vTxs.back().get(), 0, 100, true, true);
+        }
+    }
+};
+
+static void CoinSelection(benchmark::State& state, bool fStakeRewards, bool fChangeless, const CAmount& nTarget)
+{
+    CoinSelectionSetup setup(fStakeRewards);
+    const std::vector<CInputCoin> vCoinPool = MakeCoinPool(setup.vCoins, BENCH_FEE_RATE);
+    CMutableTransaction txNoInputs;
+    txNoInputs.vout.emplace_back(nTarget, CScript() << OP_TRUE);
+
+    LOCK(setup.wallet.cs_wallet);
+    std::set<std::pair<const CWalletTx*, unsigned int> > setCoins;
+    CAmount nValueIn = 0;
+    size_t nInputs = 0;
+    while (state.KeepRunning()) {
+        setCoins.clear();
+        nValueIn = 0;
+        const bool fSelected = fChangeless ? setup.wallet.SelectCoinsChangeless(vCoinPool, nTarget, txNoInputs, BENCH_FEE_RATE, setCoins, nValueIn) :
+                                             setup.wallet.SelectCoinsToSpend(vCoinPool, nTarget, setCoins, nValueIn);
+        nInputs = fSelected ? setCoins.size() : 0;
+    }
+    std::cout << "# " << (fChangeless ? "BnB" : "Knapsack") << (fStakeRewards ? " stake rewards" : " mixed values")
+              << ": " << nInputs << " inputs" << std::endl;
+}
+
+static void CoinSelectionPool(benchmark::State& state)
+{
+    CoinSelectionSetup setup(true);
+    while (state.KeepRunning())
+        MakeCoinPool(setup.vCoins, BENCH_FEE_RATE);
+}
+
+static void CoinSelectionKnapsackStake(benchmark::State& state) { CoinSelection(state, true, false, 100 * COIN); }
+static void CoinSelectionBnBStake(benchmark::State& state) { CoinSelection(state, true, true, 100 * COIN); }
+static void CoinSelectionKnapsackMixed(benchmark::State& state) { CoinSelection(state, false, false, 250 * COIN); }
+static void CoinSelectionBnBMixed(benchmark::State& state) { CoinSelection(state, false, true, 250 * COIN); }
+
+BENCHMARK(CoinSelectionPool);
+BENCHMARK(CoinSelectionKnapsackStake);
+BENCHMARK(CoinSelectionBnBStake);
+BENCHMARK(CoinSelectionKnapsackMixed);
+BENCHMARK(CoinSelectionBnBMixed);
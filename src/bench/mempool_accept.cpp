@@ -0,0 +1,122 @@
+// Copyright (c) 2025 The Concordia Cash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "chainparams.h"
+#include "coins.h"
+#include "key.h"
+#include "keystore.h"
+#include "main.h"
+#include "random.h"
+#include "script/sigcache.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "txmempool.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <vector>
+
+#include <boost/thread/thread.hpp>
+
+// This Benchmark admits BATCH_TXS independent, signed transactions to an
+// empty mempool, one at a time through AcceptToMemoryPool and all at once
+// through AcceptToMemoryPoolBatch. BATCH_TXS divided by the time of one
+// iteration gives the accepted tx/sec. The signature and script execution
+// caches are kept at their minimum size, so every iteration verifies all
+// signatures.
+static const size_t BATCH_TXS = 200;
+static const int MIN_CORES = 2;
+
+struct MempoolAcceptSetup {
+    CCoinsView coinsDummy;
+    CCoinsViewCache coins;
+    uint256 hashTip;
+    CBlockIndex indexTip;
+    boost::thread_group threadGroup;
+    std::vector<CTransaction> vtx;
+
+    MempoolAcceptSetup() : coins(&coinsDummy)
+    {
+        static bool fSigCacheInitialized = false;
+        if (!fSigCacheInitialized) {
+            mapArgs["-maxsigcachesize"] = "0";
+            InitSignatureCache();
+            InitScriptExecutionCache();
+            fSigCacheInitialized = true;
+        }
+        SelectParams(CBaseChainParams::REGTEST);
+
+        // A one block chain whose coins are all in memory
+        hashTip = GetRandHash();
+        indexTip.phashBlock = &hashTip;
+        indexTip.nHeight = 1;
+        indexTip.nTime = GetTime();
+        mapBlockIndex.emplace(hashTip, &indexTip);
+        chainActive.SetTip(&indexTip);
+        pindexBestHeader = &indexTip;
+        coins.SetBestBlock(hashTip);
+        pcoinsTip = &coins;
+
+        CKey key;
+        key.MakeNewKey(true);
+        CBasicKeyStore keystore;
+        keystore.AddKey(key);
+        const CScript script = GetScriptForDestination(key.GetPubKey().GetID());
+        for (size_t i = 0; i < BATCH_TXS; i++) {
+            COutPoint prevout(GetRandHash(), 0);
+            coins.AddCoin(prevout, Coin(CTxOut(10 * COIN, script), 1, false, false), false);
+            CMutableTransaction tx;
+            tx.vin.emplace_back(prevout);
+            tx.vout.emplace_back(10 * COIN - COIN / 100, script);
+            SignSignature(keystore, script, tx, 0, 10 * COIN, SIGHASH_ALL);
+            vtx.emplace_back(tx);
+        }
+
+        nScriptCheckThreads = std::max(MIN_CORES, GetNumCores());
+        for (int i = 0; i < nScriptCheckThreads - 1; i++)
+            threadGroup.create_thread(&ThreadScriptCheck);
+    }
+
+    ~MempoolAcceptSetup()
+    {
+        threadGroup.interrupt_all();
+        threadGroup.join_all();
+        nScriptCheckThreads = 0;
+        pcoinsTip = nullptr;
+        pindexBestHeader = nullptr;
+        chainActive.SetTip(nullptr);
+        mapBlockIndex.erase(hashTip);
+    }
+};
+
+static void MempoolAcceptSerial(benchmark::State& state)
+{
+    MempoolAcceptSetup setup;
+    CTxMemPool pool(::minRelayTxFee);
+    while (state.KeepRunning()) {
+        for (const CTransaction& tx : setup.vtx) {
+            CValidationState valstate;
+            bool fAccepted = AcceptToMemoryPool(pool, valstate, tx, false, nullptr);
+            assert(fAccepted);
+        }
+        pool.clear();
+    }
+}
+
+static void MempoolAcceptBatch(benchmark::State& state)
+{
+    MempoolAcceptSetup setup;
+    CTxMemPool pool(::minRelayTxFee);
+    std::vector<CTxAdmission> vResults;
+    while (state.KeepRunning()) {
+        AcceptToMemoryPoolBatch(pool, setup.vtx, vResults, false);
+        for (const CTxAdmission& result : vResults)
+            assert(result.fAccepted);
+        pool.clear();
+    }
+}
+
+BENCHMARK(MempoolAcceptSerial);
+BENCHMARK(MempoolAcceptBatch);
@@ -0,0 +1,61 @@
+// Copyright (c) 2025 The Concordia Cash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "chainparams.h"
+#include "net.h"
+#include "netmessagemaker.h"
+#include "random.h"
+#include "version.h"
+
+#include <vector>
+
+// This Benchmark pumps a stream of small synthetic messages through
+// CNode::ReceiveMsgBytes and drains them the way the message handler
+// does, so the cost of queueing and (re)allocating CNetMessages shows up.
+static const size_t MESSAGES = 1000;
+static const size_t PAYLOAD_SIZE = 100;
+static const size_t CHUNK_SIZE = 0x10000;
+
+static void ReceiveMsgBytesSmall(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::MAIN);
+
+    // Build the wire representation of MESSAGES mnp-sized messages
+    FastRandomContext insecure_rand(true);
+    std::vector<char> vWire;
+    for (size_t i = 0; i < MESSAGES; ++i) {
+        std::vector<unsigned char> payload(PAYLOAD_SIZE);
+        for (unsigned char& c : payload)
+            c = insecure_rand.rand32() & 0xff;
+        CMessageHeader hdr(Params().MessageStart(), NetMsgType::MNPING, payload.size());
+        uint256 hash = Hash(payload.begin(), payload.end());
+        memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << hdr;
+        vWire.insert(vWire.end(), ss.begin(), ss.end());
+        vWire.insert(vWire.end(), payload.begin(), payload.end());
+    }
+
+    CAddress addr(CService("127.0.0.1", Params().GetDefaultPort()), NODE_NETWORK);
+    CNode node(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, "", true);
+
+    while (state.KeepRunning()) {
+        size_t nReceived = 0;
+        for (size_t nPos = 0; nPos < vWire.size(); nPos += CHUNK_SIZE) {
+            bool complete = false;
+            unsigned int nBytes = std::min(CHUNK_SIZE, vWire.size() - nPos);
+            node.ReceiveMsgBytes(&vWire[nPos], nBytes, complete);
+
+            std::unique_ptr<CNetMessage> msg;
+            while (node.PopProcessMsg(msg)) {
+                nReceived++;
+                node.RecycleMsg(std::move(msg));
+            }
+        }
+        assert(nReceived == MESSAGES);
+    }
+}
+
+BENCHMARK(ReceiveMsgBytesSmall);
@@ -0,0 +1,96 @@
+// Copyright (c) 2025 The Concordia Cash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "base58.h"
+#include "bench.h"
+#include "chainparams.h"
+#include "random.h"
+#include "util.h"
+#include "wallet/wallet.h"
+#include "wallet/walletdb.h"
+
+#include <string>
+#include <vector>
+
+// This Benchmark compares the Berkeley DB and SQLite wallet backends. The
+// write benchmarks store one address book entry per iteration through a new
+// CWalletDB handle, as CWallet::SetAddressBook does. The load benchmarks
+// read a wallet of WALLET_RECORDS address book entries with LoadWallet.
+static const int WALLET_RECORDS = 5000;
+
+struct WalletDBSetup {
+    fs::path pathTemp;
+    std::vector<std::string> vAddresses;
+
+    explicit WalletDBSetup(const std::string& strBackend)
+    {
+        SelectParams(CBaseChainParams::REGTEST);
+        ClearDatadirCache();
+        pathTemp = GetTempPath() / strprintf("bench_concordia_%lu_%i", (unsigned long)GetTime(), (int)GetRand(100000));
+        fs::create_directories(pathTemp);
+        mapArgs["-datadir"] = pathTemp.string();
+        mapArgs["-walletbackend"] = strBackend;
+        if (!bitdb.Open(GetDataDir()))
+            throw std::runtime_error("Can't open the wallet database environment");
+
+        std::vector<unsigned char> vchKeyID(20);
+        for (int i = 0; i < WALLET_RECORDS; i++) {
+            GetRandBytes(vchKeyID.data(), vchKeyID.size());
+            vAddresses.push_back(EncodeDestination(CKeyID(uint160(vchKeyID))));
+        }
+    }
+
+    void FillWallet(const std::string& strFile)
+    {
+        CWalletDB walletdb(strFile, "cr+");
+        for (const std::string& strAddress : vAddresses) {
+            walletdb.WritePurpose(strAddress, "receive");
+            walletdb.WriteName(strAddress, "bench");
+        }
+    }
+
+    ~WalletDBSetup()
+    {
+        bitdb.Flush(true);
+        bitdb.Reset();
+        mapArgs.erase("-walletbackend");
+        mapArgs.erase("-datadir");
+        ClearDatadirCache();
+        fs::remove_all(pathTemp);
+    }
+};
+
+static void WalletWrite(benchmark::State& state, const std::string& strBackend)
+{
+    WalletDBSetup setup(strBackend);
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        CWalletDB walletdb("wallet.dat", "cr+");
+        walletdb.WriteName(setup.vAddresses[i++ % setup.vAddresses.size()], "bench");
+    }
+}
+
+static void WalletLoad(benchmark::State& state, const std::string& strBackend)
+{
+    WalletDBSetup setup(strBackend);
+    setup.FillWallet("wallet.dat");
+    while (state.KeepRunning()) {
+        // Closing the files makes every load read them from disk
+        bitdb.Flush(false);
+        CWallet wallet("wallet.dat");
+        bool fFirstRun;
+        DBErrors nLoadWalletRet = wallet.LoadWallet(fFirstRun);
+        assert(nLoadWalletRet == DB_LOAD_OK && wallet.mapAddressBook.size() == WALLET_RECORDS);
+    }
+}
+
+static void WalletWriteBDB(benchmark::State& state) { WalletWrite(state, "bdb"); }
+static void WalletWriteSQLite(benchmark::State& state) { WalletWrite(state, "sqlite"); }
+static void WalletLoadBDB(benchmark::State& state) { WalletLoad(state, "bdb"); }
+static void WalletLoadSQLite(benchmark::State& state) { WalletLoad(state, "sqlite"); }
+
+BENCHMARK(WalletWriteBDB);
+BENCHMARK(WalletWriteSQLite);
+BENCHMARK(WalletLoadBDB);
+BENCHMARK(WalletLoadSQLite);
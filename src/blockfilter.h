@@ -0,0 +1,128 @@
+// Copyright (c) 2025 The Concordia Cash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILTER_H
+#define BITCOIN_BLOCKFILTER_H
+
+#include "coins.h"
+#include "primitives/block.h"
+#include "serialize.h"
+#include "uint256.h"
+#include "undo.h"
+
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/** Default for -blockfilterindex */
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
+/** Maximum number of filters served for one getcfilters request */
+static const unsigned int MAX_GETCFILTERS_SIZE = 1000;
+
+/**
+ * Golomb-coded set (BIP158): a compact probabilistic set of byte strings.
+ * Every element is hashed with SipHash into [0, N * M), the sorted hashes
+ * are delta encoded with Golomb-Rice parameter P.
+ */
+class GCSFilter
+{
+public:
+    typedef std::vector<unsigned char> Element;
+    typedef std::set<Element> ElementSet;
+
+    struct Params {
+        uint64_t nSipHashK0;
+        uint64_t nSipHashK1;
+        uint8_t nP;  //!< Golomb-Rice coding parameter
+        uint32_t nM; //!< Inverse false positive rate
+
+        Params(uint64_t nSipHashK0In = 0, uint64_t nSipHashK1In = 0, uint8_t nPIn = 0, uint32_t nMIn = 1)
+            : nSipHashK0(nSipHashK0In), nSipHashK1(nSipHashK1In), nP(nPIn), nM(nMIn) {}
+    };
+
+private:
+    Params params;
+    uint32_t nN; //!< Number of elements in the filter
+    uint64_t nF; //!< Range of element hashes, nN * nM
+    std::vector<unsigned char> vEncoded;
+
+    uint64_t HashToRange(const Element& element) const;
+    std::vector<uint64_t> BuildHashedSet(const ElementSet& elements) const;
+    bool MatchInternal(const uint64_t* pQuery, size_t nQuery) const;
+
+public:
+    explicit GCSFilter(const Params& paramsIn = Params());
+    /** Decode an encoded filter, throws std::ios_base::failure if it is malformed. */
+    GCSFilter(const Params& paramsIn, std::vector<unsigned char> vEncodedIn);
+    GCSFilter(const Params& paramsIn, const ElementSet& elements);
+
+    uint32_t GetN() const { return nN; }
+    const Params& GetParams() const { return params; }
+    const std::vector<unsigned char>& GetEncoded() const { return vEncoded; }
+
+    /** Whether the element may be in the set. False positives happen at a rate of 1/M. */
+    bool Match(const Element& element) const;
+    /** Whether any of the elements may be in the set, faster than calling Match for each. */
+    bool MatchAny(const ElementSet& elements) const;
+};
+
+enum BlockFilterType : uint8_t {
+    BLOCK_FILTER_BASIC = 0,
+};
+
+/** Name of a filter type for RPC, empty if unknown */
+std::string BlockFilterTypeName(BlockFilterType filterType);
+/** Filter type of a name, returns false if unknown */
+bool BlockFilterTypeByName(const std::string& strName, BlockFilterType& filterType);
+
+/** Elements of the basic filter: the output scripts of a block and the scripts its inputs spend */
+GCSFilter::ElementSet BasicFilterElements(const CBlock& block, const CBlockUndo& blockUndo);
+
+/** Filter of the scripts of one block, keyed with the block hash */
+class BlockFilter
+{
+private:
+    BlockFilterType filterType;
+    uint256 hashBlock;
+    GCSFilter filter;
+
+    bool BuildParams(GCSFilter::Params& params) const;
+
+public:
+    BlockFilter() : filterType(BLOCK_FILTER_BASIC) {}
+    BlockFilter(BlockFilterType filterTypeIn, const uint256& hashBlockIn, std::vector<unsigned char> vEncoded);
+    BlockFilter(BlockFilterType filterTypeIn, const CBlock& block, const CBlockUndo& blockUndo);
+
+    BlockFilterType GetFilterType() const { return filterType; }
+    const uint256& GetBlockHash() const { return hashBlock; }
+    const GCSFilter& GetFilter() const { return filter; }
+    const std::vector<unsigned char>& GetEncodedFilter() const { return filter.GetEncoded(); }
+
+    /** Double SHA256 of the encoded filter */
+    uint256 GetHash() const;
+    /** Filter header, committing to this filter and to the header of the previous block */
+    uint256 ComputeHeader(const uint256& prevHeader) const;
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        s << (uint8_t)filterType << hashBlock << filter.GetEncoded();
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        uint8_t nType;
+        std::vector<unsigned char> vEncoded;
+        s >> nType >> hashBlock >> vEncoded;
+        filterType = (BlockFilterType)nType;
+        GCSFilter::Params params;
+        if (!BuildParams(params))
+            throw std::ios_base::failure("unknown block filter type");
+        filter = GCSFilter(params, std::move(vEncoded));
+    }
+};
+
+#endif // BITCOIN_BLOCKFILTER_H
@@ -0,0 +1,98 @@
+// Copyright (c) 2025 The Concordia Cash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockprefetch.h"
+
+#include <set>
+#include <vector>
+
+#include <boost/thread/locks.hpp>
+
+CBlockInputPrefetcher blockInputPrefetcher;
+
+//! Number of outpoints a worker reads before publishing them
+static const size_t PREFETCH_BATCH_SIZE = 32;
+
+void CBlockInputPrefetcher::Prefetch(const CBlock& block, const CCoinsViewCache& tip)
+{
+    std::set<uint256> setBlockTxids;
+    std::vector<COutPoint> vMissing;
+    for (const CTransaction& tx : block.vtx) {
+        if (!tx.IsCoinBase()) {
+            for (const CTxIn& txin : tx.vin) {
+                if (!setBlockTxids.count(txin.prevout.hash) && !tip.HaveCoinInCache(txin.prevout))
+                    vMissing.push_back(txin.prevout);
+            }
+        }
+        setBlockTxids.insert(tx.GetHash());
+    }
+    if (vMissing.empty())
+        return;
+
+    boost::unique_lock<boost::mutex> lock(cs);
+    for (const COutPoint& outpoint : vMissing) {
+        if (queue.size() + mapCoins.size() >= MAX_PREFETCHED_COINS)
+            break;
+        if (!mapCoins.count(outpoint))
+            queue.push_back(PrefetchItem{outpoint, tip.GetBackend(), nGeneration});
+    }
+    condWorker.notify_all();
+}
+
+bool CBlockInputPrefetcher::Take(const COutPoint& outpoint, Coin& coin)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    CCoinsMap::iterator it = mapCoins.find(outpoint);
+    if (it == mapCoins.end())
+        return false;
+    coin = std::move(it->second.coin);
+    mapCoins.erase(it);
+    return true;
+}
+
+void CBlockInputPrefetcher::Invalidate()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    nGeneration++;
+    queue.clear();
+    mapCoins.clear();
+}
+
+size_t CBlockInputPrefetcher::Size()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    return mapCoins.size();
+}
+
+void CBlockInputPrefetcher::Thread()
+{
+    std::vector<PrefetchItem> vItems;
+    std::vector<Coin> vCoins;
+    while (true) {
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            while (queue.empty())
+                condWorker.wait(lock);
+            vItems.clear();
+            while (!queue.empty() && vItems.size() < PREFETCH_BATCH_SIZE) {
+                vItems.push_back(queue.front());
+                queue.pop_front();
+            }
+        }
+
+        vCoins.assign(vItems.size(), Coin());
+        for (size_t i = 0; i < vItems.size(); i++) {
+            if (!vItems[i].pview->GetCoin(vItems[i].outpoint, vCoins[i]))
+                vCoins[i].Clear();
+        }
+
+        boost::unique_lock<boost::mutex> lock(cs);
+        for (size_t i = 0; i < vItems.size(); i++) {
+            // The database may have changed while we were reading
+            if (vItems[i].nGeneration != nGeneration || vCoins[i].IsSpent())
+                continue;
+            mapCoins.emplace(std::piecewise_construct, std::forward_as_tuple(vItems[i].outpoint), std::forward_as_tuple(std::move(vCoins[i])));
+        }
+    }
+}
@@ -0,0 +1,70 @@
+// Copyright (c) 2025 The Concordia Cash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKPREFETCH_H
+#define BITCOIN_BLOCKPREFETCH_H
+
+#include "coins.h"
+#include "primitives/block.h"
+
+#include <deque>
+#include <stdint.h>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/** Maximum number of coins held by the block input prefetcher */
+static const size_t MAX_PREFETCHED_COINS = 200000;
+/** Maximum number of block input prefetch threads */
+static const int MAX_BLOCK_PREFETCH_THREADS = 4;
+
+/**
+ * Warms up the inputs of blocks that passed CheckBlock but are not connected
+ * yet. Their prevouts that are not cached in the coins tip are read from the
+ * tip's backing database view on worker threads, into a side cache that the
+ * connect step takes them from.
+ *
+ * A prefetched coin is only valid while the database is not written to:
+ * Invalidate() has to be called after every flush of the coins tip.
+ */
+class CBlockInputPrefetcher
+{
+private:
+    struct PrefetchItem {
+        COutPoint outpoint;
+        const CCoinsView* pview;
+        uint64_t nGeneration;
+    };
+
+    boost::mutex cs;
+    boost::condition_variable condWorker;
+    //! Outpoints waiting to be read
+    std::deque<PrefetchItem> queue;
+    //! Coins read so far
+    CCoinsMap mapCoins;
+    //! Raised by Invalidate, reads started before are thrown away
+    uint64_t nGeneration;
+
+public:
+    CBlockInputPrefetcher() : nGeneration(0) {}
+
+    /** Queue the inputs of block missing from tip for reading. The caller holds cs_main. */
+    void Prefetch(const CBlock& block, const CCoinsViewCache& tip);
+
+    /** Move a prefetched coin out of the side cache. */
+    bool Take(const COutPoint& outpoint, Coin& coin);
+
+    /** Drop all prefetched coins and queued reads. */
+    void Invalidate();
+
+    /** Number of coins held, for tests */
+    size_t Size();
+
+    /** Worker thread */
+    void Thread();
+};
+
+extern CBlockInputPrefetcher blockInputPrefetcher;
+
+#endif // BITCOIN_BLOCKPREFETCH_H
@@ -8,6 +8,11 @@
 #define BITCOIN_CHECKQUEUE_H
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
@@ -17,7 +22,7 @@
 template <typename T>
 class CCheckQueueControl;
 
-/** 
+/**
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
   * operator(), returning a bool.
@@ -26,110 +31,154 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker has a queue of its own, and the master spreads the
+  * verifications it adds over all of them. A worker takes from the back of
+  * its own queue, and once that is empty steals from the front of the
+  * others, so workers only contend when they run out of work. Idle workers
+  * sleep on a condition variable, which is a boost interruption point: the
+  * worker threads are stopped by interrupting them.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! A worker's own share of the queue
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<T> checks;
+        //! Size of checks, to skip empty queues without locking them
+        std::atomic<size_t> nSize;
+
+        WorkerQueue() : nSize(0) {}
+    };
+
+    //! Queues of the master (index 0) and the workers
+    std::vector<std::unique_ptr<WorkerQueue>> vQueues;
+
+    //! Number of worker threads that claimed a queue
+    std::atomic<unsigned int> nWorkers;
+
+    //! Queue the next Add starts spreading checks at (master only)
+    unsigned int nNextQueue;
+
+    //! Mutex for sleeping and waking up, also protects fMasterBusy
     boost::mutex mutex;
 
+    //! Raised under mutex by every Add, so workers can tell whether work arrived while they looked
+    std::atomic<uint64_t> nGeneration;
+
     //! Worker threads block on this when out of work
     boost::condition_variable condWorker;
 
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
-
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
-
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! Whether the master is waiting for the verifications to finish.
+    bool fMasterBusy;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
-     * This includes elements that are not anymore in queue, but still in
+     * This includes elements that are not anymore in a queue, but still in
      * worker's own batches.
      */
-    unsigned int nTodo;
-
-    //! Whether we're shutting down.
-    bool fQuit;
+    std::atomic<unsigned int> nTodo;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! Add does not split a batch into smaller pieces than this
+    static const size_t MIN_CHUNK_SIZE = 4;
+
+    /** Move up to nBatchSize checks into vChecks, from our own queue or else stolen from another one. */
+    unsigned int Take(unsigned int nOwn, std::vector<T>& vChecks)
+    {
+        const unsigned int nQueues = std::min<unsigned int>(vQueues.size(), nWorkers + 1);
+        for (unsigned int i = 0; i < nQueues; i++) {
+            const bool fOwn = i == 0;
+            WorkerQueue& wq = *vQueues[(nOwn + i) % nQueues];
+            if (wq.nSize == 0)
+                continue;
+            std::lock_guard<std::mutex> lock(wq.mutex);
+            if (wq.checks.empty())
+                continue;
+            // Leave part of the queue for the others, so all workers finish
+            // approximately simultaneously. A thief takes half of what is left.
+            unsigned int nNow = std::max<unsigned int>(1, std::min<unsigned int>(nBatchSize, wq.checks.size() / 2));
+            vChecks.resize(nNow);
+            for (unsigned int j = 0; j < nNow; j++) {
+                // Swap instead of copying, to hold the lock as short as possible
+                if (fOwn) {
+                    vChecks[j].swap(wq.checks.back());
+                    wq.checks.pop_back();
+                } else {
+                    vChecks[j].swap(wq.checks.front());
+                    wq.checks.pop_front();
+                }
+            }
+            wq.nSize = wq.checks.size();
+            return nNow;
+        }
+        return 0;
+    }
+
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
         boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        const unsigned int nOwn = fMaster ? 0 : 1 + (nWorkers++ % (vQueues.size() - 1));
+        if (fMaster) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fMasterBusy = true;
+        }
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master he can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
+            const uint64_t nSeen = nGeneration;
+            unsigned int nNow = Take(nOwn, vChecks);
+            if (nNow) {
                 // Check whether we need to do work at all
-                fOk = fAllOk;
+                bool fOk = fAllOk;
+                for (T& check : vChecks)
+                    if (fOk)
+                        fOk = check();
+                vChecks.clear();
+                if (!fOk)
+                    fAllOk = false;
+                if (nTodo.fetch_sub(nNow) == nNow && !fMaster) {
+                    // We processed the last element; inform the master he can exit and return the result
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    condMaster.notify_one();
+                }
+                continue;
+            }
+
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fMaster && nTodo == 0) {
+                fMasterBusy = false;
+                bool fRet = fAllOk;
+                // reset the status for new work later
+                fAllOk = true;
+                // return the current status
+                return fRet;
             }
-            // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
+            // Nothing to take: sleep, unless an Add happened since we looked
+            if (fMaster || nGeneration == nSeen)
+                cond.wait(lock); // wait
         } while (true);
     }
 
 public:
-    //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    //! Create a new check queue, with room for up to nMaxWorkers worker threads that don't share a queue
+    CCheckQueue(unsigned int nBatchSizeIn, unsigned int nMaxWorkers = 64) :
+        nWorkers(0), nNextQueue(0), nGeneration(0), fMasterBusy(false), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn)
+    {
+        for (unsigned int i = 0; i <= std::max(1U, nMaxWorkers); i++)
+            vQueues.emplace_back(new WorkerQueue());
+    }
 
     //! Worker thread
     void Thread()
@@ -146,16 +195,33 @@ public:
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty())
+            return;
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
+
+        // Spread the batch over the queues in contiguous chunks
+        const unsigned int nQueues = std::min<unsigned int>(vQueues.size(), nWorkers + 1);
+        const size_t nChunk = std::max<size_t>(MIN_CHUNK_SIZE, (vChecks.size() + nQueues - 1) / nQueues);
+        unsigned int nChunks = 0;
+        for (size_t nPos = 0; nPos < vChecks.size(); nPos += nChunk, nChunks++) {
+            WorkerQueue& wq = *vQueues[nNextQueue++ % nQueues];
+            std::lock_guard<std::mutex> lock(wq.mutex);
+            for (size_t i = nPos; i < std::min(nPos + nChunk, vChecks.size()); i++) {
+                wq.checks.emplace_back();
+                vChecks[i].swap(wq.checks.back());
+            }
+            wq.nSize = wq.checks.size();
+        }
+
+        // Wake up about one worker per chunk, the others can steal from them
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nGeneration++;
+        if (nChunks >= nQueues - 1) {
             condWorker.notify_all();
+        } else {
+            for (unsigned int i = 0; i < nChunks; i++)
+                condWorker.notify_one();
+        }
     }
 
     ~CCheckQueue()
@@ -165,11 +231,11 @@ public:
     bool IsIdle()
     {
         boost::unique_lock<boost::mutex> lock(mutex);
-        return (nTotal == nIdle && nTodo == 0 && fAllOk == true);
+        return (!fMasterBusy && nTodo == 0 && fAllOk == true);
     }
 };
 
-/** 
+/**
  * RAII-style controller object for a CCheckQueue that guarantees the passed
  * queue is finished before continuing.
  */
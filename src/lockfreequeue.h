@@ -0,0 +1,102 @@
+// Copyright (c) 2025 The Concordia Cash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_LOCKFREEQUEUE_H
+#define BITCOIN_LOCKFREEQUEUE_H
+
+#include <atomic>
+#include <utility>
+
+/**
+ * Unbounded single-producer/single-consumer FIFO queue.
+ *
+ * Exactly one thread may call Push() and exactly one (other) thread may call
+ * Pop()/Empty(). Neither side ever blocks or takes a lock. Nodes released by
+ * the consumer are recycled by the producer, so once the queue has reached its
+ * working size no further heap allocations take place.
+ *
+ * T must be default constructible and movable.
+ */
+template <typename T>
+class CSPSCQueue
+{
+private:
+    struct Node {
+        std::atomic<Node*> next;
+        T value;
+        Node() : next(nullptr) {}
+    };
+
+    // Consumer side: the last node that was popped (its value is stale).
+    std::atomic<Node*> head;
+
+    // Producer side.
+    Node* tail;     // last pushed node
+    Node* first;    // oldest node still allocated, may be recycled up to headCopy
+    Node* headCopy; // cached value of head, refreshed when running out of nodes
+
+    Node* AllocNode()
+    {
+        if (first == headCopy) {
+            headCopy = head.load(std::memory_order_acquire);
+            if (first == headCopy)
+                return new Node();
+        }
+        Node* node = first;
+        first = first->next.load(std::memory_order_relaxed);
+        node->next.store(nullptr, std::memory_order_relaxed);
+        return node;
+    }
+
+    CSPSCQueue(const CSPSCQueue&) = delete;
+    CSPSCQueue& operator=(const CSPSCQueue&) = delete;
+
+public:
+    CSPSCQueue()
+    {
+        Node* node = new Node();
+        head.store(node, std::memory_order_relaxed);
+        tail = first = headCopy = node;
+    }
+
+    ~CSPSCQueue()
+    {
+        Node* node = first;
+        while (node) {
+            Node* next = node->next.load(std::memory_order_relaxed);
+            delete node;
+            node = next;
+        }
+    }
+
+    //! Producer only.
+    void Push(T&& value)
+    {
+        Node* node = AllocNode();
+        node->value = std::move(value);
+        tail->next.store(node, std::memory_order_release);
+        tail = node;
+    }
+
+    //! Consumer only. Returns false if the queue was empty.
+    bool Pop(T& value)
+    {
+        Node* h = head.load(std::memory_order_relaxed);
+        Node* next = h->next.load(std::memory_order_acquire);
+        if (!next)
+            return false;
+        value = std::move(next->value);
+        next->value = T();
+        head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    //! Consumer only.
+    bool Empty() const
+    {
+        return head.load(std::memory_order_relaxed)->next.load(std::memory_order_acquire) == nullptr;
+    }
+};
+
+#endif // BITCOIN_LOCKFREEQUEUE_H
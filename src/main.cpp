@@ -15,6 +15,7 @@
 #include "addrman.h"
 #include "amount.h"
 #include "blocksignature.h"
+#include "blockprefetch.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
@@ -22,6 +23,8 @@
 #include "consensus/merkle.h"
 #include "consensus/tx_verify.h"
 #include "consensus/validation.h"
+#include "crypto/sha256.h"
+#include "cuckoocache.h"
 #include "fs.h"
 #include "init.h"
 #include "kernel.h"
@@ -34,12 +37,14 @@
 #include "netbase.h"
 #include "policy/policy.h"
 #include "pow.h"
+#include "random.h"
 #include "reverse_iterate.h"
 #include "rewards.h"
 #include "spork.h"
 #include "sporkdb.h"
 #include "txdb.h"
 #include "txmempool.h"
+#include "txreconciliation.h"
 #include "guiinterface.h"
 #include "util.h"
 #include "utilmoneystr.h"
@@ -52,6 +57,9 @@
 #include <boost/thread.hpp>
 #include <boost/foreach.hpp>
 #include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
 #include <queue>
 #include <regex>
 
@@ -90,9 +98,12 @@ uint256 g_best_block;
 int nScriptCheckThreads = 0;
 std::atomic<bool> fImporting{false};
 std::atomic<bool> fReindex{false};
+std::atomic<bool> fMempoolLoaded{false};
 bool fTxIndex = true;
+bool fBlockFilterIndex = DEFAULT_BLOCKFILTERINDEX;
 bool fCheckBlockIndex = false;
 bool fVerifyingBlocks = false;
+bool fTxReconciliation = DEFAULT_TXRECONCILIATION_ENABLE;
 size_t nCoinCacheUsage = 5000 * 300;
 
 /* If the tip is older than this (in seconds), the node is considered to be in initial block download. */
@@ -124,6 +135,7 @@ CScript COINBASE_FLAGS;
 const std::string strMessageMagic = "DarkNet Signed Message:\n";
 
 static const uint64_t RANDOMIZER_ID_ADDRESS_RELAY = 0x3cac0035b5866b90ULL; // SHA256("main address relay")[0:8]
+static const uint64_t RANDOMIZER_ID_TX_FANOUT = 0x6f5d5f3b1d6a9c47ULL; // per transaction choice of flooded outbound peers
 
 // Internal stuff
 namespace
@@ -670,6 +682,7 @@ CBlockIndex* GetChainTip()
 
 CCoinsViewCache* pcoinsTip = NULL;
 CBlockTreeDB* pblocktree = NULL;
+CBlockFilterDB* pblockfilterdb = NULL;
 CSporkDB* pSporkDB = NULL;
 
 //////////////////////////////////////////////////////////////////////////////
@@ -827,9 +840,26 @@ std::string FormatStateMessage(const CValidationState &state)
         state.GetRejectCode());
 }
 
-bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-                              bool* pfMissingInputs, bool fOverrideMempoolLimit, bool fRejectAbsurdFee, bool ignoreFees,
-                              std::vector<COutPoint>& coins_to_uncache)
+namespace {
+/** What the policy checks learnt about a transaction, kept for its script checks and mempool insertion */
+struct MemPoolAcceptState {
+    CCoinsView dummy;
+    CCoinsViewCache view;
+    std::unique_ptr<CTxMemPoolEntry> entry;
+    CTxMemPool::setEntries setAncestors;
+    PrecomputedTransactionData precomTxData;
+    std::vector<COutPoint> coins_to_uncache;
+    //! Set by the parallel script checks of a batch admission, see CScriptCheck::pfFailed
+    std::atomic<bool> fScriptFailed;
+
+    explicit MemPoolAcceptState(const CTransaction& tx) : view(&dummy), precomTxData(tx), fScriptFailed(false) {}
+};
+} // namespace
+
+/** All checks of a transaction that come before script verification. On success ws holds its inputs, entry and ancestors. */
+static bool PreChecks(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+                      bool* pfMissingInputs, int64_t nAcceptTime, bool fRejectAbsurdFee, bool ignoreFees,
+                      MemPoolAcceptState& ws)
 {
     AssertLockHeld(cs_main);
     if (pfMissingInputs)
@@ -879,8 +909,8 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
     }
 
     {
-        CCoinsView dummy;
-        CCoinsViewCache view(&dummy);
+        CCoinsViewCache& view = ws.view;
+        std::vector<COutPoint>& coins_to_uncache = ws.coins_to_uncache;
 
         CAmount nValueIn = 0;
 
@@ -919,7 +949,7 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
         nValueIn = view.GetValueIn(tx);
 
         // we have all inputs cached now, so switch back to dummy, so we don't need to keep lock on mempool
-        view.SetBackend(dummy);
+        view.SetBackend(ws.dummy);
 
         // Check for non-standard pay-to-script-hash in inputs
         if (!Params().IsRegTestNet() && !AreInputsStandard(tx, view))
@@ -955,7 +985,8 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
             }
         }
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainHeight, pool.HasNoInputsOf(tx), inChainInputValue, fSpendsCoinbaseOrCoinstake, nSigOps);
+        ws.entry.reset(new CTxMemPoolEntry(tx, nFees, nAcceptTime, dPriority, chainHeight, pool.HasNoInputsOf(tx), inChainInputValue, fSpendsCoinbaseOrCoinstake, nSigOps));
+        const CTxMemPoolEntry& entry = *ws.entry;
         unsigned int nSize = entry.GetTxSize();
 
         // Don't accept it if it can't get into a block
@@ -1007,7 +1038,7 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
         }
 
         // Calculate in-mempool ancestors, up to a limit.
-        CTxMemPool::setEntries setAncestors;
+        CTxMemPool::setEntries& setAncestors = ws.setAncestors;
         size_t nLimitAncestors = GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
         size_t nLimitAncestorSize = GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT)*1000;
         size_t nLimitDescendants = GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
@@ -1016,44 +1047,65 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
         if (!pool.CalculateMemPoolAncestors(entry, setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, errString)) {
             return state.DoS(0, error("%s : %s", __func__, errString), REJECT_NONSTANDARD, "too-long-mempool-chain", false);
         }
+    }
 
-        // Check against previous transactions
-        // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        int flags = STANDARD_SCRIPT_VERIFY_FLAGS | SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
+    return true;
+}
 
-        PrecomputedTransactionData precomTxData(tx);
-        if (!CheckInputs(tx, state, view, true, flags, true, precomTxData)) {
-            return false;
-        }
+/** Script checks of a transaction that passed PreChecks. Failures set state. */
+static bool CheckInputScripts(const CTransaction &tx, CValidationState &state, MemPoolAcceptState& ws)
+{
+    // Check against previous transactions
+    // This is done last to help prevent CPU exhaustion denial-of-service attacks.
+    const unsigned int flags = STANDARD_SCRIPT_VERIFY_FLAGS | SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
+    if (!CheckInputs(tx, state, ws.view, true, flags, true, false, ws.precomTxData)) {
+        return false;
+    }
 
-        // Check again against just the consensus-critical mandatory script
-        // verification flags, in case of bugs in the standard flags that cause
-        // transactions to pass as valid when they're actually invalid. For
-        // instance the STRICTENC flag was incorrectly allowing certain
-        // CHECKSIG NOT scripts to pass, even though they were invalid.
-        //
-        // There is a similar check in CreateNewBlock() to prevent creating
-        // invalid blocks, however allowing such transactions into the mempool
-        // can be exploited as a DoS attack.
-        flags = MANDATORY_SCRIPT_VERIFY_FLAGS | SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
-        if (!CheckInputs(tx, state, view, true, flags, true, precomTxData)) {
-            return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s, %s",
-                    __func__, hash.ToString(), FormatStateMessage(state));
-        }
+    // Check again against just the consensus-critical mandatory script
+    // verification flags, in case of bugs in the standard flags that cause
+    // transactions to pass as valid when they're actually invalid. For
+    // instance the STRICTENC flag was incorrectly allowing certain
+    // CHECKSIG NOT scripts to pass, even though they were invalid.
+    //
+    // There is a similar check in CreateNewBlock() to prevent creating
+    // invalid blocks, however allowing such transactions into the mempool
+    // can be exploited as a DoS attack.
+    //
+    // The block flags are a superset of the mandatory ones, and checking
+    // against them stores the result in the script-execution cache, so
+    // ConnectBlock does not run these scripts again. The signatures are
+    // in the signature cache by now, which makes this check cheap.
+    if (!CheckInputs(tx, state, ws.view, true, BLOCK_SCRIPT_VERIFY_FLAGS, true, true, ws.precomTxData)) {
+        return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s, %s",
+                __func__, tx.GetHash().ToString(), FormatStateMessage(state));
+    }
+    return true;
+}
+
+/** Insert a fully checked transaction into the mempool. With fTrim the mempool is trimmed to its limits right away. */
+static bool FinalizeAccept(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, MemPoolAcceptState& ws,
+                           bool fOverrideMempoolLimit, bool fTrim = true)
+{
+    const uint256& hash = tx.GetHash();
+    {
+        LOCK(pool.cs);
 
         // Store transaction in memory
-        pool.addUnchecked(hash, entry, setAncestors, !IsInitialBlockDownload());
+        pool.addUnchecked(hash, *ws.entry, ws.setAncestors, !IsInitialBlockDownload());
 
         // trim mempool and check if tx was trimmed
-        if (!fOverrideMempoolLimit) {
-            LimitMempoolSize(pool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+        if (fTrim) {
+            if (!fOverrideMempoolLimit) {
+                LimitMempoolSize(pool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+                if (!pool.exists(hash))
+                    return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
+            }
+
+            pool.TrimToSize(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
             if (!pool.exists(hash))
                 return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
         }
-
-        pool.TrimToSize(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
-        if (!pool.exists(tx.GetHash()))
-            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
     }
 
     GetMainSignals().SyncTransaction(tx, nullptr, CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK);
@@ -1061,12 +1113,25 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
     return true;
 }
 
-bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-                        bool* pfMissingInputs, bool fOverrideMempoolLimit, bool fRejectAbsurdFee, bool fIgnoreFees)
+bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+                              bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit, bool fRejectAbsurdFee, bool ignoreFees,
+                              std::vector<COutPoint>& coins_to_uncache)
+{
+    AssertLockHeld(cs_main);
+    MemPoolAcceptState ws(tx);
+    bool fOk = PreChecks(pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime, fRejectAbsurdFee, ignoreFees, ws) &&
+               CheckInputScripts(tx, state, ws) &&
+               FinalizeAccept(pool, state, tx, ws, fOverrideMempoolLimit);
+    coins_to_uncache.insert(coins_to_uncache.end(), ws.coins_to_uncache.begin(), ws.coins_to_uncache.end());
+    return fOk;
+}
+
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+                                bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit, bool fRejectAbsurdFee, bool fIgnoreFees)
 {
     LOCK(cs_main);
     std::vector<COutPoint> coins_to_uncache;
-    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, fOverrideMempoolLimit, fRejectAbsurdFee, fIgnoreFees, coins_to_uncache);
+    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime, fOverrideMempoolLimit, fRejectAbsurdFee, fIgnoreFees, coins_to_uncache);
     if (!res) {
         for (const COutPoint& outpoint: coins_to_uncache)
             pcoinsTip->Uncache(outpoint);
@@ -1074,6 +1139,12 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     return res;
 }
 
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+                        bool* pfMissingInputs, bool fOverrideMempoolLimit, bool fRejectAbsurdFee, bool fIgnoreFees)
+{
+    return AcceptToMemoryPoolWithTime(pool, state, tx, fLimitFree, pfMissingInputs, GetTime(), fOverrideMempoolLimit, fRejectAbsurdFee, fIgnoreFees);
+}
+
 bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee, bool isDSTX)
 {
     AssertLockHeld(cs_main);
@@ -1230,7 +1301,7 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
         int flags = STANDARD_SCRIPT_VERIFY_FLAGS | SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
 
         PrecomputedTransactionData precomTxData(tx);
-        if (!CheckInputs(tx, state, view, false, flags, true, precomTxData)) {
+        if (!CheckInputs(tx, state, view, false, flags, true, false, precomTxData)) {
             return error("AcceptableInputs: : ConnectInputs failed %s", hash.ToString());
         }
 
@@ -1244,7 +1315,7 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
         // invalid blocks, however allowing such transactions into the mempool
         // can be exploited as a DoS attack.
         // for any real tx this will be checked on AcceptToMemoryPool anyway
-        //        if (!CheckInputs(tx, state, view, false, MANDATORY_SCRIPT_VERIFY_FLAGS, true, precomTxData))
+        //        if (!CheckInputs(tx, state, view, false, MANDATORY_SCRIPT_VERIFY_FLAGS, true, false, precomTxData))
         //        {
         //            return error("AcceptableInputs: : BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s", hash.ToString());
         //        }
@@ -1361,14 +1432,25 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    // Open history file to read, at the size written in front of the block
+    if (pos.nPos < sizeof(unsigned int))
+        return error("ReadBlockFromDisk : invalid block position %u in file %d", pos.nPos, pos.nFile);
+    CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - sizeof(unsigned int)), true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull())
         return error("ReadBlockFromDisk : OpenBlockFile failed");
 
-    // Read block
+    // Read block with a single read into a buffer the thread keeps for the
+    // next block, and deserialize it from memory
+    static thread_local CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
     try {
-        filein >> block;
+        unsigned int nSize;
+        filein >> nSize;
+        if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT)
+            return error("%s : invalid block size %u at position %u in file %d", __func__, nSize, pos.nPos, pos.nFile);
+        ssBlock.clear();
+        ssBlock.resize(nSize);
+        filein.read(&ssBlock[0], nSize);
+        ssBlock >> block;
     } catch (const std::exception& e) {
         return error("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
@@ -1613,7 +1695,13 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache &inputs, int nHeight)
 bool CScriptCheck::operator()()
 {
     const CScript& scriptSig = ptxTo->vin[nIn].scriptSig;
-    return VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, amount, cacheStore, *precomTxData), &error);
+    if (VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, amount, cacheStore, *precomTxData), &error))
+        return true;
+    if (pfFailed) {
+        *pfFailed = true;
+        return true;
+    }
+    return false;
 }
 
 int GetSpendHeight(const CCoinsViewCache& inputs)
@@ -1674,7 +1762,37 @@ bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CCoins
 }
 }// namespace Consensus
 
-bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, PrecomputedTransactionData& precomTxData, std::vector<CScriptCheck> *pvChecks)
+static CuckooCache::cache<uint256, SignatureCacheHasher> scriptExecutionCache;
+static uint256 scriptExecutionCacheNonce(GetRandHash());
+
+void InitScriptExecutionCache()
+{
+    // nMaxCacheSize is unsigned. If -maxsigcachesize is set to zero,
+    // setup_bytes creates the minimum possible cache (2 elements).
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) / 2), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
+    size_t nElems = scriptExecutionCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu/2 requested for script execution cache, able to store %zu elements\n",
+            (nElems * sizeof(uint256)) >> 20, (nMaxCacheSize * 2) >> 20, nElems);
+}
+
+/** Key of a transaction in the script-execution cache. The txid commits to every input's prevout, and so to the coins spent. */
+static uint256 ScriptExecutionCacheEntry(const CTransaction& tx, unsigned int flags)
+{
+    uint256 hashCacheEntry;
+    // We only use the first 19 bytes of nonce to avoid a second SHA
+    // round - giving us 19 + 32 + 4 = 55 bytes (+ 8 + 1 = 64)
+    static_assert(55 - sizeof(flags) - 32 >= 128/8, "Want at least 128 bits of nonce for script execution cache");
+    CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+    return hashCacheEntry;
+}
+
+void AddToScriptExecutionCache(const CTransaction& tx, unsigned int flags)
+{
+    AssertLockHeld(cs_main);
+    scriptExecutionCache.insert(ScriptExecutionCacheEntry(tx, flags));
+}
+
+bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& precomTxData, std::vector<CScriptCheck> *pvChecks)
 {
     if (!tx.IsCoinBase()) {
 
@@ -1692,6 +1810,17 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
         // before the last block chain checkpoint. This is safe because block merkle hashes are
         // still computed and checked, and any change will be caught at the next checkpoint.
         if (fScriptChecks) {
+            // First check if script executions have been cached with the same
+            // flags. Note that this assumes that the inputs provided are
+            // correct (ie that the transaction hash which is in tx's prevouts
+            // properly commits to the scriptPubKey in the inputs view of that
+            // transaction).
+            AssertLockHeld(cs_main);
+            const uint256 hashCacheEntry = ScriptExecutionCacheEntry(tx, flags);
+            if (scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore)) {
+                return true;
+            }
+
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint& prevout = tx.vin[i].prevout;
                 const Coin& coin = inputs.AccessCoin(prevout);
@@ -1706,7 +1835,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                 const CAmount amount = coin.out.nValue;
 
                 // Verify signature
-                CScriptCheck check(scriptPubKey, amount, tx, i, flags, cacheStore, &precomTxData);
+                CScriptCheck check(scriptPubKey, amount, tx, i, flags, cacheSigStore, &precomTxData);
                 if (pvChecks) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
@@ -1719,7 +1848,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
                         CScriptCheck check2(scriptPubKey, amount, tx, i,
-                            flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, &precomTxData);
+                            flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheSigStore, &precomTxData);
                         if (check2())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
                     }
@@ -1733,6 +1862,12 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                     return state.DoS(100, false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
                 }
             }
+
+            if (cacheFullScriptStore && !pvChecks) {
+                // We executed all of the provided scripts, and were told to
+                // cache the result. Do so now.
+                scriptExecutionCache.insert(hashCacheEntry);
+            }
         }
     }
 
@@ -1975,6 +2110,239 @@ void ThreadScriptCheck()
     scriptcheckqueue.Thread();
 }
 
+/** Reads one coin from a view that is safe to use from several threads, for the coin fetch queue. */
+class CCoinFetch
+{
+private:
+    const CCoinsView* pview;
+    COutPoint outpoint;
+    Coin* pcoin;
+
+public:
+    CCoinFetch() : pview(nullptr), pcoin(nullptr) {}
+    CCoinFetch(const CCoinsView* pviewIn, const COutPoint& outpointIn, Coin* pcoinIn) : pview(pviewIn), outpoint(outpointIn), pcoin(pcoinIn) {}
+
+    bool operator()()
+    {
+        // A missing coin is left spent; ConnectBlock reports it
+        if (!pview->GetCoin(outpoint, *pcoin))
+            pcoin->Clear();
+        return true;
+    }
+
+    void swap(CCoinFetch& fetch)
+    {
+        std::swap(pview, fetch.pview);
+        std::swap(outpoint, fetch.outpoint);
+        std::swap(pcoin, fetch.pcoin);
+    }
+};
+
+static CCheckQueue<CCoinFetch> coinfetchqueue(16);
+
+void ThreadCoinFetch()
+{
+    util::ThreadRename("pivx-coinfetch");
+    coinfetchqueue.Thread();
+}
+
+void ThreadBlockPrefetch()
+{
+    util::ThreadRename("pivx-prefetch");
+    blockInputPrefetcher.Thread();
+}
+
+//! Inputs PrefetchBlockInputs found missing from pcoinsTip, and how many of them blockInputPrefetcher had
+static uint64_t nPrefetchInputs = 0;
+static uint64_t nPrefetchHits = 0;
+
+/**
+ * Load the coins spent by a block that are not in pcoinsTip yet. They are
+ * taken from blockInputPrefetcher when it read them ahead, the rest is read
+ * from the backing database view on the coin fetch threads, so connecting the
+ * block does not wait for one database read after the other.
+ */
+static void PrefetchBlockInputs(const CBlock& block)
+{
+    AssertLockHeld(cs_main);
+    if (!nScriptCheckThreads)
+        return;
+
+    std::set<uint256> setBlockTxids;
+    std::vector<COutPoint> vMissing;
+    size_t nInputs = 0, nHits = 0;
+    for (const CTransaction& tx : block.vtx) {
+        if (!tx.IsCoinBase()) {
+            for (const CTxIn& txin : tx.vin) {
+                if (setBlockTxids.count(txin.prevout.hash) || pcoinsTip->HaveCoinInCache(txin.prevout))
+                    continue;
+                nInputs++;
+                Coin coin;
+                if (blockInputPrefetcher.Take(txin.prevout, coin)) {
+                    pcoinsTip->AddFetchedCoin(txin.prevout, std::move(coin));
+                    nHits++;
+                } else {
+                    vMissing.push_back(txin.prevout);
+                }
+            }
+        }
+        setBlockTxids.insert(tx.GetHash());
+    }
+    nPrefetchInputs += nInputs;
+    nPrefetchHits += nHits;
+    LogPrint(BCLog::BENCH, "    - %u of %u uncached inputs prefetched (%.1f%%) [%.1f%% overall]\n", nHits, nInputs,
+        nInputs ? 100.0 * nHits / nInputs : 0.0, nPrefetchInputs ? 100.0 * nPrefetchHits / nPrefetchInputs : 0.0);
+    if (vMissing.empty())
+        return;
+
+    // Nothing writes to the database while cs_main is held, and the coins not
+    // cached in pcoinsTip are the same there as in the database
+    std::vector<Coin> vCoins(vMissing.size());
+    std::vector<CCoinFetch> vFetches;
+    vFetches.reserve(vMissing.size());
+    for (size_t i = 0; i < vMissing.size(); i++)
+        vFetches.emplace_back(pcoinsTip->GetBackend(), vMissing[i], &vCoins[i]);
+    CCheckQueueControl<CCoinFetch> control(&coinfetchqueue);
+    control.Add(vFetches);
+    control.Wait();
+
+    for (size_t i = 0; i < vMissing.size(); i++)
+        pcoinsTip->AddFetchedCoin(vMissing[i], std::move(vCoins[i]));
+}
+
+void AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransaction>& vtx, std::vector<CTxAdmission>& vResults, bool fLimitFree, const std::vector<int64_t>* pvAcceptTime, bool fRejectInsaneFee)
+{
+    LOCK(cs_main);
+    vResults.assign(vtx.size(), CTxAdmission());
+    const int64_t nNow = GetTime();
+    const bool fParallel = nScriptCheckThreads > 0;
+
+    // Batch members that have not been accepted or rejected yet
+    std::set<uint256> setPending;
+    std::vector<size_t> vTodo;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        setPending.insert(vtx[i].GetHash());
+        vTodo.push_back(i);
+    }
+
+    std::vector<COutPoint> coins_to_uncache;
+    bool fAnyAccepted = false;
+    while (!vTodo.empty()) {
+        // Policy checks. Anything spending an output of a pending member
+        // waits for a later round, when that member is in the mempool.
+        std::vector<size_t> vRound, vDeferred;
+        std::vector<std::unique_ptr<MemPoolAcceptState> > vWork;
+        for (size_t i : vTodo) {
+            const CTransaction& tx = vtx[i];
+            CTxAdmission& result = vResults[i];
+            std::unique_ptr<MemPoolAcceptState> ws(new MemPoolAcceptState(tx));
+            const int64_t nAcceptTime = pvAcceptTime ? (*pvAcceptTime)[i] : nNow;
+            if (PreChecks(pool, result.state, tx, fLimitFree, &result.fMissingInputs, nAcceptTime, fRejectInsaneFee, false, *ws)) {
+                vRound.push_back(i);
+                vWork.push_back(std::move(ws));
+                continue;
+            }
+            coins_to_uncache.insert(coins_to_uncache.end(), ws->coins_to_uncache.begin(), ws->coins_to_uncache.end());
+            if (result.fMissingInputs) {
+                bool fWaiting = false;
+                for (const CTxIn& txin : tx.vin)
+                    fWaiting |= txin.prevout.hash != tx.GetHash() && setPending.count(txin.prevout.hash);
+                if (fWaiting) {
+                    result.fMissingInputs = false;
+                    vDeferred.push_back(i);
+                    continue;
+                }
+            }
+            setPending.erase(tx.GetHash());
+        }
+        if (vRound.empty()) {
+            // Nothing left that the deferred ones could be waiting for
+            for (size_t i : vDeferred)
+                vResults[i].fMissingInputs = true;
+            break;
+        }
+
+        // Script checks of the whole round in parallel, against the same
+        // standard and block flags CheckInputScripts uses
+        if (fParallel) {
+            CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+            for (size_t k = 0; k < vRound.size(); k++) {
+                const CTransaction& tx = vtx[vRound[k]];
+                MemPoolAcceptState& ws = *vWork[k];
+                std::vector<CScriptCheck> vChecks;
+                if (!CheckInputs(tx, vResults[vRound[k]].state, ws.view, true, STANDARD_SCRIPT_VERIFY_FLAGS | SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY, true, false, ws.precomTxData, &vChecks) ||
+                    !CheckInputs(tx, vResults[vRound[k]].state, ws.view, true, BLOCK_SCRIPT_VERIFY_FLAGS, true, false, ws.precomTxData, &vChecks)) {
+                    continue;
+                }
+                for (CScriptCheck& check : vChecks)
+                    check.SetFailureFlag(&ws.fScriptFailed);
+                control.Add(vChecks);
+            }
+            control.Wait();
+        }
+
+        // Insertion, one at a time in batch order
+        for (size_t k = 0; k < vRound.size(); k++) {
+            const CTransaction& tx = vtx[vRound[k]];
+            CTxAdmission& result = vResults[vRound[k]];
+            MemPoolAcceptState& ws = *vWork[k];
+            setPending.erase(tx.GetHash());
+            // Without script check threads, or to learn why a parallel check
+            // failed, the scripts are checked here
+            bool fOk = result.state.IsValid() &&
+                       ((fParallel && !ws.fScriptFailed) || CheckInputScripts(tx, result.state, ws));
+            if (fOk && fParallel)
+                AddToScriptExecutionCache(tx, BLOCK_SCRIPT_VERIFY_FLAGS);
+            if (fOk) {
+                // Earlier members of this round may spend the same outputs or
+                // have used up the ancestor and descendant limits since PreChecks
+                LOCK(pool.cs);
+                for (const CTxIn& txin : tx.vin) {
+                    if (pool.mapNextTx.count(txin.prevout)) {
+                        fOk = result.state.Invalid(false, REJECT_CONFLICT, "txn-mempool-conflict");
+                        break;
+                    }
+                }
+                std::string errString;
+                ws.setAncestors.clear();
+                if (fOk && !pool.CalculateMemPoolAncestors(*ws.entry, ws.setAncestors,
+                        GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT), GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT) * 1000,
+                        GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT), GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000, errString)) {
+                    fOk = result.state.DoS(0, error("%s : %s", __func__, errString), REJECT_NONSTANDARD, "too-long-mempool-chain", false);
+                }
+            }
+            // The mempool is trimmed once for the whole batch
+            result.fAccepted = fOk && FinalizeAccept(pool, result.state, tx, ws, true, false);
+            fAnyAccepted |= result.fAccepted;
+            if (!result.fAccepted)
+                coins_to_uncache.insert(coins_to_uncache.end(), ws.coins_to_uncache.begin(), ws.coins_to_uncache.end());
+        }
+        vTodo.swap(vDeferred);
+    }
+
+    if (fAnyAccepted) {
+        LimitMempoolSize(pool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+        for (size_t i = 0; i < vtx.size(); i++) {
+            if (vResults[i].fAccepted && !pool.exists(vtx[i].GetHash())) {
+                vResults[i].fAccepted = false;
+                vResults[i].state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
+            }
+        }
+    }
+    for (const COutPoint& outpoint : coins_to_uncache)
+        pcoinsTip->Uncache(outpoint);
+}
+
+/** Write the filter of a connected block, chaining its header to the one of the previous block */
+static bool WriteBlockFilter(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    const BlockFilter filter(BLOCK_FILTER_BASIC, block, blockundo);
+    uint256 prevHeader;
+    if (pindex->pprev && !pblockfilterdb->ReadFilterHeader(pindex->pprev->GetBlockHash(), prevHeader))
+        prevHeader.SetNull();
+    return pblockfilterdb->WriteFilter(filter, filter.ComputeHeader(prevHeader));
+}
+
 static int64_t nTimeVerify = 0;
 static int64_t nTimeConnect = 0;
 static int64_t nTimeIndex = 0;
@@ -2015,8 +2383,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     // Special case for the genesis block, skipping connection of its transactions
     // (its coinbase is unspendable)
     if (block.GetHash() == consensus.hashGenesisBlock) {
-        if (!fJustCheck)
+        if (!fJustCheck) {
             view.SetBestBlock(pindex->GetBlockHash());
+            if (fBlockFilterIndex && !WriteBlockFilter(block, CBlockUndo(), pindex))
+                return AbortNode(state, "Failed to write block filter");
+        }
         return true;
     }
 
@@ -2076,15 +2447,14 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         precomTxData.emplace_back(tx);
 
         if (!tx.IsCoinBase()) {
+            const CAmount nTxValueIn = view.GetValueIn(tx);
             if (!tx.IsCoinStake())
-                nFees += view.GetValueIn(tx) - tx.GetValueOut();
-            nValueIn += view.GetValueIn(tx);
+                nFees += nTxValueIn - tx.GetValueOut();
+            nValueIn += nTxValueIn;
 
             std::vector<CScriptCheck> vChecks;
-            unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG | SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
-
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, precomTxData[i], nScriptCheckThreads ? &vChecks : NULL))
+            if (!CheckInputs(tx, state, view, fScriptChecks, BLOCK_SCRIPT_VERIFY_FLAGS, fCacheResults, fCacheResults, precomTxData[i], nScriptCheckThreads ? &vChecks : NULL))
                 return error("%s: Check inputs on %s failed with %s", __func__, tx.GetHash().ToString(), FormatStateMessage(state));
             control.Add(vChecks);
         }
@@ -2153,6 +2523,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
 
+    if (fBlockFilterIndex)
+        if (!WriteBlockFilter(block, blockundo, pindex))
+            return AbortNode(state, "Failed to write block filter");
+
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -2267,7 +2641,10 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
             if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
             // Flush the chainstate (which may refer to block index entries).
-            if (!pcoinsTip->Flush())
+            bool fFlushed = pcoinsTip->Flush();
+            // What was prefetched from the database may be outdated now
+            blockInputPrefetcher.Invalidate();
+            if (!fFlushed)
                 return AbortNode(state, "Failed to write to coin database");
             nLastFlush = nNow;
         }
@@ -2383,6 +2760,7 @@ bool static DisconnectTip(CValidationState& state)
 }
 
 static int64_t nTimeReadFromDisk = 0;
+static int64_t nTimePrefetch = 0;
 static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
@@ -2413,6 +2791,11 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, const CB
     int64_t nTime3;
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
     {
+        PrefetchBlockInputs(*pblock);
+        int64_t nTimePrefetched = GetTimeMicros();
+        nTimePrefetch += nTimePrefetched - nTime2;
+        LogPrint(BCLog::BENCH, "  - Prefetch inputs: %.2fms [%.2fs]\n", (nTimePrefetched - nTime2) * 0.001, nTimePrefetch * 0.000001);
+
         CCoinsViewCache view(pcoinsTip);
         bool rv = ConnectBlock(*pblock, state, pindexNew, view, false, fAlreadyChecked);
         GetMainSignals().BlockChecked(*pblock, state);
@@ -3628,6 +4011,10 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, const CBlock* pblock
             return error ("%s : CheckBlock FAILED for block %s, %s", __func__, pblock->GetHash().GetHex(), FormatStateMessage(state));
         }
 
+        // Start loading the inputs while the block is stored and waits to be connected
+        if (nScriptCheckThreads)
+            blockInputPrefetcher.Prefetch(*pblock, *pcoinsTip);
+
         // Store to disk
         bool ret = AcceptBlock(*pblock, state, &pindex, dbp, checked);
         if (pindex && pfrom) {
@@ -3666,9 +4053,12 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, const CBlock* pblock
 
     if (pwalletMain) {
         // If turned on Auto Combine will scan wallet for dust to combine
-        // Combine dust every 10 blocks
-        if (pwalletMain->fCombineDust && pindex->nHeight % 10 == 0)
-            pwalletMain->AutoCombineDust(connman);
+        // Combine dust every COMBINE_DUST_INTERVAL blocks, in the background
+        if (pwalletMain->fCombineDust && pindex->nHeight % COMBINE_DUST_INTERVAL == 0)
+            pwalletMain->RequestCombineDust(pindex->nHeight, connman);
+        // Move deep, fully spent transactions out of memory, in the background
+        if (GetBoolArg("-walletarchive", DEFAULT_WALLET_ARCHIVE) && pindex->nHeight % WALLET_ARCHIVE_INTERVAL == 0)
+            pwalletMain->RequestArchiveSpentTransactions(pindex->nHeight);
     }
 
     return true;
@@ -3862,6 +4252,10 @@ bool static LoadBlockIndexDB(std::string& strError)
     pblocktree->ReadFlag("txindex", fTxIndex);
     LogPrintf("LoadBlockIndexDB(): transaction index %s\n", fTxIndex ? "enabled" : "disabled");
 
+    // Check whether we have a block filter index
+    pblocktree->ReadFlag("blockfilterindex", fBlockFilterIndex);
+    LogPrintf("LoadBlockIndexDB(): block filter index %s\n", fBlockFilterIndex ? "enabled" : "disabled");
+
     // If this is written true before the next client init, then we know the shutdown process failed
     pblocktree->WriteFlag("shutdown", false);
 
@@ -4202,6 +4596,8 @@ bool InitBlockIndex()
     // Use the provided setting for -txindex in the new database
     fTxIndex = GetBoolArg("-txindex", true);
     pblocktree->WriteFlag("txindex", fTxIndex);
+    fBlockFilterIndex = GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX);
+    pblocktree->WriteFlag("blockfilterindex", fBlockFilterIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -4230,13 +4626,15 @@ bool InitBlockIndex()
 }
 
 
-bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
-{
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
-    int64_t nStart = GetTimeMillis();
+// Map of disk positions for blocks with unknown parent (only used for reindex)
+static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
 
-    int nLoaded = 0;
+/**
+ * Find the blocks in a block file and pass each one to fnBlock, with dbp set
+ * to its position. Scanning stops when fnBlock returns false.
+ */
+static void ScanBlockFile(FILE* fileIn, CDiskBlockPos* dbp, const std::function<bool(CBlock&, unsigned int)>& fnBlock)
+{
     try {
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
         CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE_CURRENT, MAX_BLOCK_SIZE_CURRENT + 8, SER_DISK, CLIENT_VERSION);
@@ -4275,49 +4673,8 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
                 blkdat >> block;
                 nRewind = blkdat.GetPos();
 
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != Params().GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__,
-                            hash.GetHex(), block.hashPrevBlock.GetHex());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
-
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    CValidationState state;
-                    if (ProcessNewBlock(state, nullptr, &block, dbp, nullptr))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != Params().GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
-                }
-
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(block, it->second)) {
-                            LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
-                                head.ToString());
-                            CValidationState dummy;
-                            if (ProcessNewBlock(dummy, nullptr, &block, &it->second, nullptr)) {
-                                nLoaded++;
-                                queue.push_back(block.GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                    }
-                }
+                if (!fnBlock(block, nSize))
+                    break;
             } catch (const std::exception& e) {
                 LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
             }
@@ -4325,11 +4682,275 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
     } catch (const std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
     }
+}
+
+/**
+ * Process a block read from a block file, followed by the blocks read
+ * earlier that were waiting for it as their parent. Returns false after an
+ * error that should stop the import of the file.
+ */
+static bool ProcessBlockFromFile(const CBlock& block, CDiskBlockPos* dbp, int& nLoaded)
+{
+    // detect out of order blocks, and store them for later
+    uint256 hash = block.GetHash();
+    if (hash != Params().GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+        LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__,
+                hash.GetHex(), block.hashPrevBlock.GetHex());
+        if (dbp)
+            mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+        return true;
+    }
+
+    // process in case the block isn't known yet
+    if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+        CValidationState state;
+        if (ProcessNewBlock(state, nullptr, &block, dbp, nullptr))
+            nLoaded++;
+        if (state.IsError())
+            return false;
+    } else if (hash != Params().GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+        LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+    }
+
+    // Recursively process earlier encountered successors of this block
+    std::deque<uint256> queue;
+    queue.push_back(hash);
+    while (!queue.empty()) {
+        uint256 head = queue.front();
+        queue.pop_front();
+        std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+        while (range.first != range.second) {
+            std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+            CBlock child;
+            if (ReadBlockFromDisk(child, it->second)) {
+                LogPrintf("%s: Processing out of order child %s of %s\n", __func__, child.GetHash().ToString(),
+                        head.ToString());
+                CValidationState dummy;
+                if (ProcessNewBlock(dummy, nullptr, &child, &it->second, nullptr)) {
+                    nLoaded++;
+                    queue.push_back(child.GetHash());
+                }
+            }
+            range.first++;
+            mapBlocksUnknownParent.erase(it);
+        }
+    }
+    return true;
+}
+
+bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
+{
+    int64_t nStart = GetTimeMillis();
+
+    int nLoaded = 0;
+    ScanBlockFile(fileIn, dbp, [&](CBlock& block, unsigned int nSize) {
+        return ProcessBlockFromFile(block, dbp, nLoaded);
+    });
     if (nLoaded > 0)
         LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
     return nLoaded > 0;
 }
 
+/** Maximum size of the blocks a reindex reader holds for one block file */
+static const size_t MAX_REINDEX_QUEUE_BYTES = 16 * 1000 * 1000;
+/** Maximum number of blocks a reindex reader holds for one block file */
+static const size_t MAX_REINDEX_QUEUE_BLOCKS = 1000;
+
+namespace {
+/** Blocks of one block file, read ahead of the import thread by a reindex reader */
+struct ReindexFile {
+    struct Item {
+        CBlock block;
+        CDiskBlockPos pos;
+        unsigned int nSize;
+    };
+    std::deque<Item> queue;
+    size_t nQueuedBytes;
+    bool fDone;
+    bool fMissing;
+
+    ReindexFile() : nQueuedBytes(0), fDone(false), fMissing(false) {}
+};
+
+/** Reads and hashes the blocks of consecutive block files on several threads */
+class CReindexReader
+{
+private:
+    boost::mutex cs;
+    boost::condition_variable cond;
+    //! Files claimed by a reader and not fully imported yet
+    std::map<int, ReindexFile> mapFiles;
+    //! Next file for a reader to claim
+    int nNextFile;
+    //! File being imported
+    int nImportFile;
+    //! Set when a file turned out to be missing, so no later ones are claimed
+    bool fNoMoreFiles;
+    bool fStop;
+    const int nThreads;
+    boost::thread_group threadGroup;
+
+    void Thread()
+    {
+        while (true) {
+            int nFile;
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                // Read no more than one file ahead per reader
+                while (!fStop && !fNoMoreFiles && nNextFile > nImportFile + nThreads)
+                    cond.wait(lock);
+                if (fStop || fNoMoreFiles)
+                    return;
+                nFile = nNextFile++;
+                mapFiles[nFile];
+            }
+            CDiskBlockPos pos(nFile, 0);
+            FILE* file = fs::exists(GetBlockPosFilename(pos, "blk")) ? OpenBlockFile(pos, true) : NULL;
+            if (!file) {
+                boost::unique_lock<boost::mutex> lock(cs);
+                mapFiles[nFile].fMissing = true;
+                mapFiles[nFile].fDone = true;
+                fNoMoreFiles = true;
+                cond.notify_all();
+                return;
+            }
+            ScanBlockFile(file, &pos, [&](CBlock& block, unsigned int nSize) {
+                // Hash the header here, GetHash() on the import thread finds it cached
+                block.GetHash();
+                boost::unique_lock<boost::mutex> lock(cs);
+                ReindexFile& reindexFile = mapFiles[nFile];
+                while (!fStop && (reindexFile.nQueuedBytes >= MAX_REINDEX_QUEUE_BYTES || reindexFile.queue.size() >= MAX_REINDEX_QUEUE_BLOCKS))
+                    cond.wait(lock);
+                if (fStop)
+                    return false;
+                reindexFile.queue.emplace_back();
+                ReindexFile::Item& item = reindexFile.queue.back();
+                std::swap(item.block, block);
+                item.pos = pos;
+                item.nSize = nSize;
+                reindexFile.nQueuedBytes += nSize;
+                cond.notify_all();
+                return true;
+            });
+            boost::unique_lock<boost::mutex> lock(cs);
+            mapFiles[nFile].fDone = true;
+            cond.notify_all();
+        }
+    }
+
+public:
+    CReindexReader(int nThreadsIn) : nNextFile(0), nImportFile(0), fNoMoreFiles(false), fStop(false), nThreads(nThreadsIn)
+    {
+        for (int i = 0; i < nThreads; i++)
+            threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "reindex", boost::function<void()>(boost::bind(&CReindexReader::Thread, this))));
+    }
+
+    ~CReindexReader()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            fStop = true;
+            cond.notify_all();
+        }
+        threadGroup.interrupt_all();
+        threadGroup.join_all();
+    }
+
+    /** Start importing file nFile. Returns false if it does not exist. */
+    bool BeginFile(int nFile)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        nImportFile = nFile;
+        cond.notify_all();
+        while (!mapFiles.count(nFile))
+            cond.wait(lock);
+        return !mapFiles[nFile].fMissing;
+    }
+
+    /** Take the next block of file nFile. Returns false once all were taken. */
+    bool Next(int nFile, ReindexFile::Item& item)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        ReindexFile& reindexFile = mapFiles[nFile];
+        while (reindexFile.queue.empty() && !reindexFile.fDone)
+            cond.wait(lock);
+        if (reindexFile.queue.empty()) {
+            mapFiles.erase(nFile);
+            return false;
+        }
+        std::swap(item, reindexFile.queue.front());
+        reindexFile.queue.pop_front();
+        reindexFile.nQueuedBytes -= item.nSize;
+        cond.notify_all();
+        return true;
+    }
+};
+} // namespace
+
+void ReindexBlockFiles(int nThreads)
+{
+    const int64_t nStart = GetTimeMicros();
+    int nLoaded = 0;
+    uint64_t nBlocks = 0;
+    uint64_t nBytes = 0;
+    int nFile = 0;
+    std::unique_ptr<CReindexReader> reader;
+    if (nThreads > 0) {
+        LogPrintf("Reindexing with %d block file reader threads\n", nThreads);
+        reader.reset(new CReindexReader(nThreads));
+    }
+    for (; ; nFile++) {
+        CDiskBlockPos pos(nFile, 0);
+        FILE* file = NULL;
+        if (reader) {
+            if (!reader->BeginFile(nFile))
+                break;
+        } else {
+            if (!fs::exists(GetBlockPosFilename(pos, "blk")))
+                break; // No block files left to reindex
+            file = OpenBlockFile(pos, true);
+            if (!file)
+                break; // This error is logged in OpenBlockFile
+        }
+        LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
+        const int64_t nFileStart = GetTimeMicros();
+        uint64_t nFileBlocks = 0;
+        uint64_t nFileBytes = 0;
+        auto fnBlock = [&](CBlock& block, const CDiskBlockPos& posBlock, unsigned int nSize) {
+            nFileBlocks++;
+            nFileBytes += nSize;
+            CDiskBlockPos dbp(posBlock);
+            return ProcessBlockFromFile(block, &dbp, nLoaded);
+        };
+        if (reader) {
+            ReindexFile::Item item;
+            bool fContinue = true;
+            while (reader->Next(nFile, item)) {
+                // Keep taking the blocks after an error, for the reader to finish the file
+                if (!fContinue)
+                    continue;
+                try {
+                    fContinue = fnBlock(item.block, item.pos, item.nSize);
+                } catch (const std::exception& e) {
+                    LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
+                }
+            }
+        } else {
+            ScanBlockFile(file, &pos, [&](CBlock& block, unsigned int nSize) {
+                return fnBlock(block, pos, nSize);
+            });
+        }
+        const double dFileSeconds = std::max(GetTimeMicros() - nFileStart, (int64_t)1) * 0.000001;
+        LogPrintf("Reindexed blk%05u.dat: %u blocks, %.1f MB in %.1fs (%.1f blocks/s, %.1f MB/s)\n", (unsigned int)nFile,
+                nFileBlocks, nFileBytes / 1e6, dFileSeconds, nFileBlocks / dFileSeconds, nFileBytes / 1e6 / dFileSeconds);
+        nBlocks += nFileBlocks;
+        nBytes += nFileBytes;
+    }
+    const double dSeconds = std::max(GetTimeMicros() - nStart, (int64_t)1) * 0.000001;
+    LogPrintf("Reindexed %u blocks (%i new), %.1f MB from %d files in %.1fs (%.1f blocks/s, %.1f MB/s)\n",
+            nBlocks, nLoaded, nBytes / 1e6, nFile, dSeconds, nBlocks / dSeconds, nBytes / 1e6 / dSeconds);
+}
+
 void static CheckBlockIndex()
 {
     if (!fCheckBlockIndex) {
@@ -4553,12 +5174,61 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 static void RelayTransaction(const CTransaction& tx, CConnman& connman)
 {
     CInv inv(MSG_TX, tx.GetHash());
-    connman.ForEachNode([&inv](CNode* pnode)
+
+    // Peers we reconcile with get the transaction added to their
+    // reconciliation set, except for a few outbound ones (picked per
+    // transaction) that it is still flooded to so it propagates quickly.
+    std::vector<std::pair<uint64_t, NodeId> > vFanout;
+    if (fTxReconciliation) {
+        const CSipHasher hasher = connman.GetDeterministicRandomizer(RANDOMIZER_ID_TX_FANOUT).Write(inv.hash.GetCheapHash());
+        connman.ForEachNode([&vFanout, &hasher](CNode* pnode) {
+            if (!pnode->fInbound && pnode->IsReconciling())
+                vFanout.emplace_back(CSipHasher(hasher).Write(pnode->id).Finalize(), pnode->id);
+        });
+        if (vFanout.size() > (size_t)OUTBOUND_FANOUT_DESTINATIONS) {
+            std::partial_sort(vFanout.begin(), vFanout.begin() + OUTBOUND_FANOUT_DESTINATIONS, vFanout.end());
+            vFanout.resize(OUTBOUND_FANOUT_DESTINATIONS);
+        }
+    }
+
+    connman.ForEachNode([&inv, &vFanout](CNode* pnode)
     {
+        bool fFlood = std::any_of(vFanout.begin(), vFanout.end(), [pnode](const std::pair<uint64_t, NodeId>& p) { return p.second == pnode->id; });
+        if (!fFlood && pnode->AddToReconSet(inv.hash))
+            return;
         pnode->PushInventory(inv);
     });
 }
 
+// Drop transactions the peer has learnt about since they were queued. Requires pnode->cs_inventory.
+static void PruneReconSet(CNode* pnode, std::map<uint32_t, uint256>& mapSet)
+{
+    for (auto it = mapSet.begin(); it != mapSet.end();) {
+        if (pnode->filterInventoryKnown.contains(it->second))
+            it = mapSet.erase(it);
+        else
+            ++it;
+    }
+}
+
+// Announce the outcome of a reconciliation round right away instead of
+// waiting for the next trickle.
+static void PushReconciledInv(CNode* pnode, const std::vector<uint256>& vHashes, CConnman& connman)
+{
+    CNetMsgMaker msgMaker(pnode->GetSendVersion());
+    std::vector<CInv> vInv;
+    vInv.reserve(std::min<size_t>(vHashes.size(), MAX_INV_SZ));
+    for (const uint256& hash : vHashes) {
+        vInv.emplace_back(MSG_TX, hash);
+        if (vInv.size() >= MAX_INV_SZ) {
+            connman.PushMessage(pnode, msgMaker.Make(NetMsgType::INV, vInv));
+            vInv.clear();
+        }
+    }
+    if (!vInv.empty())
+        connman.PushMessage(pnode, msgMaker.Make(NetMsgType::INV, vInv));
+}
+
 static void RelayAddress(const CAddress& addr, bool fReachable, CConnman& connman)
 {
     int nRelayNodes = fReachable ? 2 : 1; // limited relaying of addresses outside our network(s)
@@ -4625,14 +5295,24 @@ void static ProcessGetData(CNode* pfrom, CConnman& connman, std::atomic<bool>& i
                 }
                 // Don't send not-validated blocks
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second))
-                        assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
-                        connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, block));
-                    else // MSG_FILTERED_BLOCK)
+                    if (inv.type == MSG_BLOCK) {
+                        // A new tip is requested by most peers at once: serialize it a single time
+                        CSharedNetPayloadRef payload = FindRelayPayload(inv);
+                        if (!payload) {
+                            CBlock block;
+                            if (!ReadBlockFromDisk(block, (*mi).second))
+                                assert(!"cannot load block from disk");
+                            payload = MakeSharedNetPayload(PROTOCOL_VERSION, block);
+                            if (mi->second == chainActive.Tip())
+                                AddRelayPayload(inv, payload);
+                        }
+                        connman.PushMessage(pfrom, msgMaker.MakeShared(NetMsgType::BLOCK, payload));
+                    } else // MSG_FILTERED_BLOCK)
                     {
+                        // Send block from disk
+                        CBlock block;
+                        if (!ReadBlockFromDisk(block, (*mi).second))
+                            assert(!"cannot load block from disk");
                         bool send = false;
                         CMerkleBlock merkleBlock;
                         {
@@ -4670,57 +5350,31 @@ void static ProcessGetData(CNode* pfrom, CConnman& connman, std::atomic<bool>& i
                     }
                 }
             } else if (inv.IsKnownType()) {
-                // Send stream from relay memory
-                bool pushed = false;
-                {
-                    LOCK(cs_mapRelay);
-                    std::map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
-                    if (mi != mapRelay.end()) {
-                        connman.PushMessage(pfrom, msgMaker.Make(inv.GetCommand(), (*mi).second));
-                        pushed = true;
-                    }
-                }
+                // Send stream from relay memory, serializing it there on the first request
+                CSharedNetPayloadRef payload = FindRelayPayload(inv);
 
-                if (!pushed && inv.type == MSG_TX) {
+                if (!payload && inv.type == MSG_TX) {
                     CTransaction tx;
-                    if (mempool.lookup(inv.hash, tx)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << tx;
-                        connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::TX, ss));
-                        pushed = true;
-                    }
+                    if (mempool.lookup(inv.hash, tx))
+                        payload = MakeSharedNetPayload(PROTOCOL_VERSION, tx);
                 }
-                if (!pushed && inv.type == MSG_SPORK) {
-                    if (mapSporks.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapSporks[inv.hash];
-                        connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::SPORK, ss));
-                        pushed = true;
-                    }
+                if (!payload && inv.type == MSG_SPORK) {
+                    if (mapSporks.count(inv.hash))
+                        payload = MakeSharedNetPayload(PROTOCOL_VERSION, mapSporks[inv.hash]);
                 }
-                if (!pushed && inv.type == MSG_MASTERNODE_ANNOUNCE) {
-                    if (mnodeman.mapSeenMasternodeBroadcast.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mnodeman.mapSeenMasternodeBroadcast[inv.hash];
-                        connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::MNBROADCAST, ss));
-                        pushed = true;
-                    }
+                if (!payload && inv.type == MSG_MASTERNODE_ANNOUNCE) {
+                    if (mnodeman.mapSeenMasternodeBroadcast.count(inv.hash))
+                        payload = MakeSharedNetPayload(PROTOCOL_VERSION, mnodeman.mapSeenMasternodeBroadcast[inv.hash]);
                 }
-
-                if (!pushed && inv.type == MSG_MASTERNODE_PING) {
-                    if (mnodeman.mapSeenMasternodePing.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mnodeman.mapSeenMasternodePing[inv.hash];
-                        connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::MNPING, ss));
-                        pushed = true;
-                    }
+                if (!payload && inv.type == MSG_MASTERNODE_PING) {
+                    if (mnodeman.mapSeenMasternodePing.count(inv.hash))
+                        payload = MakeSharedNetPayload(PROTOCOL_VERSION, mnodeman.mapSeenMasternodePing[inv.hash]);
                 }
 
-                if (!pushed) {
+                if (payload) {
+                    AddRelayPayload(inv, payload);
+                    connman.PushMessage(pfrom, msgMaker.MakeShared(inv.GetCommand(), payload));
+                } else {
                     vNotFound.push_back(inv);
                 }
             }
@@ -4867,6 +5521,15 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         pfrom->SetSendVersion(nSendVersion);
         pfrom->nVersion = nVersion;
 
+        // Offer transaction reconciliation; it is only used once the peer offers it too
+        if (fTxReconciliation && fRelay) {
+            uint64_t nSalt = 0;
+            while (nSalt == 0)
+                nSalt = GetRand(std::numeric_limits<uint64_t>::max());
+            WITH_LOCK(pfrom->cs_inventory, pfrom->nReconLocalSalt = nSalt);
+            connman.PushMessage(pfrom, CNetMsgMaker(nSendVersion).Make(NetMsgType::SENDRECON, TXRECONCILIATION_VERSION, nSalt));
+        }
+
         {
             LOCK(cs_main);
             // Potentially mark this peer as a preferred download peer.
@@ -4961,6 +5624,126 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     }
 
 
+    else if (strCommand == NetMsgType::SENDRECON) {
+        uint32_t nReconVersion;
+        uint64_t nRemoteSalt;
+        vRecv >> nReconVersion >> nRemoteSalt;
+
+        LOCK(pfrom->cs_inventory);
+        if (pfrom->nReconLocalSalt != 0 && !pfrom->txReconState && nReconVersion >= TXRECONCILIATION_VERSION) {
+            // Outbound connections initiate, inbound ones respond with sketches
+            pfrom->txReconState.reset(new CTxReconState(!pfrom->fInbound, pfrom->nReconLocalSalt, nRemoteSalt));
+            LogPrint(BCLog::NET, "reconciling transactions with peer=%d as %s\n", pfrom->id, pfrom->fInbound ? "responder" : "initiator");
+        }
+    }
+
+
+    else if (strCommand == NetMsgType::REQRECON) {
+        uint32_t nRemoteSize;
+        vRecv >> nRemoteSize;
+
+        CReconSketch sketch;
+        {
+            LOCK(pfrom->cs_inventory);
+            CTxReconState* recon = pfrom->txReconState.get();
+            if (!recon || recon->fInitiator)
+                return true;
+            // A round the peer never concluded is abandoned, its transactions are reconciled again
+            recon->mapLocalSet.insert(recon->mapSnapshot.begin(), recon->mapSnapshot.end());
+            recon->mapSnapshot.clear();
+            PruneReconSet(pfrom, recon->mapLocalSet);
+            // An empty sketch tells the initiator we have nothing it could be missing
+            if (!recon->mapLocalSet.empty()) {
+                size_t nCells = CTxReconState::EstimateSketchCells(recon->mapLocalSet.size(), nRemoteSize);
+                sketch = CTxReconState::BuildSketch(recon->mapLocalSet, nCells);
+                recon->mapSnapshot.swap(recon->mapLocalSet);
+            }
+        }
+        connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::SKETCH, sketch));
+    }
+
+
+    else if (strCommand == NetMsgType::SKETCH) {
+        CReconSketch sketch;
+        vRecv >> sketch;
+        if (!sketch.IsValid()) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 20);
+            return error("sketch with %u cells from peer=%d", sketch.Cells(), pfrom->id);
+        }
+
+        std::vector<uint256> vAnnounce;
+        std::vector<uint32_t> vAsk;
+        bool fDecoded = true;
+        {
+            LOCK(pfrom->cs_inventory);
+            CTxReconState* recon = pfrom->txReconState.get();
+            if (!recon || !recon->fInitiator || recon->nRequestSent == 0)
+                return true;
+            recon->nRequestSent = 0;
+            PruneReconSet(pfrom, recon->mapLocalSet);
+
+            std::vector<uint32_t> vDiff;
+            if (sketch.Cells() != 0) {
+                CReconSketch local = CTxReconState::BuildSketch(recon->mapLocalSet, sketch.Cells());
+                local.Merge(sketch);
+                fDecoded = local.Decode(vDiff);
+            }
+            if (sketch.Cells() == 0 || !fDecoded) {
+                // Either the peer has nothing we lack, or we fall back to
+                // announcing our whole set like flooding would have.
+                for (const auto& it : recon->mapLocalSet)
+                    vAnnounce.push_back(it.second);
+            } else {
+                for (uint32_t id : vDiff) {
+                    auto it = recon->mapLocalSet.find(id);
+                    if (it != recon->mapLocalSet.end())
+                        vAnnounce.push_back(it->second);
+                    else
+                        vAsk.push_back(id);
+                }
+            }
+            recon->mapLocalSet.clear();
+            for (const uint256& hash : vAnnounce)
+                pfrom->filterInventoryKnown.insert(hash);
+        }
+        LogPrint(BCLog::NET, "reconciliation with peer=%d: %u cells, %s, announcing %u, asking %u\n", pfrom->id,
+            sketch.Cells(), fDecoded ? "decoded" : "failed", vAnnounce.size(), vAsk.size());
+        if (sketch.Cells() != 0)
+            connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::RECONCILDIFF, fDecoded, vAsk));
+        PushReconciledInv(pfrom, vAnnounce, connman);
+    }
+
+
+    else if (strCommand == NetMsgType::RECONCILDIFF) {
+        bool fDecoded;
+        std::vector<uint32_t> vAsk;
+        vRecv >> fDecoded >> vAsk;
+
+        std::vector<uint256> vAnnounce;
+        {
+            LOCK(pfrom->cs_inventory);
+            CTxReconState* recon = pfrom->txReconState.get();
+            if (!recon || recon->fInitiator)
+                return true;
+            if (!fDecoded) {
+                for (const auto& it : recon->mapSnapshot)
+                    vAnnounce.push_back(it.second);
+            } else {
+                for (uint32_t id : vAsk) {
+                    auto it = recon->mapSnapshot.find(id);
+                    if (it != recon->mapSnapshot.end())
+                        vAnnounce.push_back(it->second);
+                }
+            }
+            recon->mapSnapshot.clear();
+            for (const uint256& hash : vAnnounce)
+                pfrom->filterInventoryKnown.insert(hash);
+        }
+        PushReconciledInv(pfrom, vAnnounce, connman);
+    }
+
+
     else if (strCommand == NetMsgType::ADDR) {
         std::vector<CAddress> vAddr;
         vRecv >> vAddr;
@@ -5149,6 +5932,46 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     }
 
 
+    else if (strCommand == NetMsgType::GETCFILTERS) {
+        uint8_t nFilterType;
+        uint32_t nStartHeight;
+        uint256 hashStop;
+        vRecv >> nFilterType >> nStartHeight >> hashStop;
+
+        if (!(pfrom->GetLocalServices() & NODE_COMPACT_FILTERS) || nFilterType != BLOCK_FILTER_BASIC) {
+            LogPrint(BCLog::NET, "getcfilters for unsupported filter type %d, disconnect peer=%d\n", nFilterType, pfrom->GetId());
+            pfrom->fDisconnect = true;
+            return true;
+        }
+
+        std::vector<uint256> vHashes;
+        {
+            LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(hashStop);
+            if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second))
+                return true;
+            const CBlockIndex* pindexStop = mi->second;
+            if ((int)nStartHeight > pindexStop->nHeight || pindexStop->nHeight - nStartHeight >= MAX_GETCFILTERS_SIZE) {
+                LogPrint(BCLog::NET, "getcfilters range %u to %d is invalid, disconnect peer=%d\n", nStartHeight, pindexStop->nHeight, pfrom->GetId());
+                pfrom->fDisconnect = true;
+                return true;
+            }
+            for (const CBlockIndex* pindex = pindexStop; pindex && pindex->nHeight >= (int)nStartHeight; pindex = pindex->pprev)
+                vHashes.push_back(pindex->GetBlockHash());
+        }
+
+        // The filter index is written by ConnectBlock, read it without holding cs_main
+        for (std::vector<uint256>::reverse_iterator it = vHashes.rbegin(); it != vHashes.rend(); ++it) {
+            BlockFilter filter;
+            if (!pblockfilterdb->ReadFilter(*it, filter)) {
+                LogPrint(BCLog::NET, "getcfilters: no filter for block %s\n", it->ToString());
+                break;
+            }
+            connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::CFILTER, filter));
+        }
+    }
+
+
     else if (strCommand == NetMsgType::TX) {
         std::vector<uint256> vWorkQueue;
         std::vector<uint256> vEraseQueue;
@@ -5184,50 +6007,58 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
                     __func__, pfrom->id, pfrom->cleanSubVer, tx.GetHash().ToString(),
                     mempool.size(), mempool.DynamicMemoryUsage() / 1000);
 
-                // Recursively process any orphan transactions that depended on this one
-                std::set<NodeId> setMisbehaving;
+                // Orphan transactions that depended on this one, and on these in
+                // turn, are admitted as one batch with their scripts checked in parallel
+                std::vector<CTransaction> vOrphans;
+                std::vector<NodeId> vFromPeer;
+                std::set<uint256> setOrphansQueued;
                 for (unsigned int i = 0; i < vWorkQueue.size(); i++) {
                     std::map<uint256, std::set<uint256> >::iterator itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue[i]);
                     if (itByPrev == mapOrphanTransactionsByPrev.end())
                         continue;
-                    for (std::set<uint256>::iterator mi = itByPrev->second.begin();
-                        mi != itByPrev->second.end();
-                        ++mi) {
-                        const uint256& orphanHash = *mi;
-                        const CTransaction& orphanTx = mapOrphanTransactions[orphanHash].tx;
-                        NodeId fromPeer = mapOrphanTransactions[orphanHash].fromPeer;
-                        bool fMissingInputs2 = false;
-                        // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
-                        // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
-                        // anyone relaying LegitTxX banned)
-                        CValidationState stateDummy;
-
-
-                        if (setMisbehaving.count(fromPeer))
+                    for (const uint256& orphanHash : itByPrev->second) {
+                        if (!setOrphansQueued.insert(orphanHash).second)
                             continue;
-                        if (AcceptToMemoryPool(mempool, stateDummy, orphanTx, true, &fMissingInputs2)) {
-                            LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n", orphanHash.ToString());
-                            RelayTransaction(orphanTx, connman);
-                            vWorkQueue.push_back(orphanHash);
-                            vEraseQueue.push_back(orphanHash);
-                        } else if (!fMissingInputs2) {
-                            int nDos = 0;
-                            if (stateDummy.IsInvalid(nDos) && nDos > 0) {
-                                // Punish peer that gave us an invalid orphan tx
-                                Misbehaving(fromPeer, nDos);
-                                setMisbehaving.insert(fromPeer);
-                                LogPrint(BCLog::MEMPOOL, "   invalid orphan tx %s\n", orphanHash.ToString());
-                            }
-                            // Has inputs but not accepted to mempool
-                            // Probably non-standard or insufficient fee/priority
-                            LogPrint(BCLog::MEMPOOL, "   removed orphan tx %s\n", orphanHash.ToString());
-                            vEraseQueue.push_back(orphanHash);
-                            assert(recentRejects);
-                            recentRejects->insert(orphanHash);
+                        vOrphans.push_back(mapOrphanTransactions[orphanHash].tx);
+                        vFromPeer.push_back(mapOrphanTransactions[orphanHash].fromPeer);
+                        vWorkQueue.push_back(orphanHash);
+                    }
+                }
+
+                std::vector<CTxAdmission> vResults;
+                if (!vOrphans.empty())
+                    AcceptToMemoryPoolBatch(mempool, vOrphans, vResults, true);
+                std::set<NodeId> setMisbehaving;
+                for (size_t i = 0; i < vOrphans.size(); i++) {
+                    const uint256& orphanHash = vOrphans[i].GetHash();
+                    const NodeId fromPeer = vFromPeer[i];
+                    // The states are dummies as far as the relaying peer is concerned, so
+                    // someone can't setup nodes to counter-DoS based on orphan resolution
+                    // (that is, feeding people an invalid transaction based on LegitTxX in
+                    // order to get anyone relaying LegitTxX banned)
+                    const CTxAdmission& result = vResults[i];
+                    if (result.fAccepted) {
+                        LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n", orphanHash.ToString());
+                        RelayTransaction(vOrphans[i], connman);
+                        vEraseQueue.push_back(orphanHash);
+                    } else if (!result.fMissingInputs && !setMisbehaving.count(fromPeer)) {
+                        int nDos = 0;
+                        if (result.state.IsInvalid(nDos) && nDos > 0) {
+                            // Punish peer that gave us an invalid orphan tx
+                            Misbehaving(fromPeer, nDos);
+                            setMisbehaving.insert(fromPeer);
+                            LogPrint(BCLog::MEMPOOL, "   invalid orphan tx %s\n", orphanHash.ToString());
                         }
-                        mempool.check(pcoinsTip);
+                        // Has inputs but not accepted to mempool
+                        // Probably non-standard or insufficient fee/priority
+                        LogPrint(BCLog::MEMPOOL, "   removed orphan tx %s\n", orphanHash.ToString());
+                        vEraseQueue.push_back(orphanHash);
+                        assert(recentRejects);
+                        recentRejects->insert(orphanHash);
                     }
                 }
+                if (!vOrphans.empty())
+                    mempool.check(pcoinsTip);
 
                 for (uint256 hash : vEraseQueue)
                     EraseOrphanTx(hash);
@@ -5636,18 +6467,12 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, std::atomic<bool>& interru
     if (pfrom->fPauseSend)
         return false;
 
-    std::list<CNetMessage> msgs;
-    {
-        LOCK(pfrom->cs_vProcessMsg);
-        if (pfrom->vProcessMsg.empty())
-            return false;
-        // Just take one message
-        msgs.splice(msgs.begin(), pfrom->vProcessMsg, pfrom->vProcessMsg.begin());
-        pfrom->nProcessQueueSize -= msgs.front().vRecv.size() + CMessageHeader::HEADER_SIZE;
-        pfrom->fPauseRecv = pfrom->nProcessQueueSize > connman.GetReceiveFloodSize();
-        fMoreWork = !pfrom->vProcessMsg.empty();
-    }
-    CNetMessage& msg(msgs.front());
+    // Just take one message
+    std::unique_ptr<CNetMessage> pmsg;
+    if (!pfrom->PopProcessMsg(pmsg))
+        return false;
+    fMoreWork = !pfrom->vProcessMsg.Empty();
+    CNetMessage& msg(*pmsg);
 
     msg.SetVersion(pfrom->GetRecvVersion());
     // Scan for message start
@@ -5708,6 +6533,7 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, std::atomic<bool>& interru
     if (!fRet)
         LogPrintf("ProcessMessage(%s, %u bytes) FAILED peer=%d\n", SanitizeString(strCommand), nMessageSize, pfrom->id);
 
+    pfrom->RecycleMsg(std::move(pmsg));
     return fMoreWork;
 }
 
@@ -5842,41 +6668,63 @@ bool SendMessages(CNode* pto, CConnman& connman, std::atomic<bool>& interruptMsg
             }
             LOCK(pto->cs_vSend);
             LOCK(pto->cs_inventory);
-            vInv.reserve(pto->vInventoryToSend.size());
+            vInv.reserve(std::min<size_t>(pto->vInventoryToSend.size(), MAX_INV_SZ));
             vInvWait.reserve(pto->vInventoryToSend.size());
+            // Transactions are batched on the Poisson timer and capped per
+            // trickle. Everything else goes out right away, so the masternode
+            // entries of a sync reply follow their SYNCSTATUSCOUNT closely.
+            unsigned int nRelayBudget = INVENTORY_BROADCAST_MAX;
             for (const CInv& inv : pto->vInventoryToSend) {
-                if (inv.type == MSG_TX && pto->filterInventoryKnown.contains(inv.hash))
-                    continue;
-
-                // trickle out tx inv to protect privacy
-                if (inv.type == MSG_TX && !fSendTrickle) {
-                    // 1/4 of tx invs blast to all immediately
-                    static uint256 hashSalt;
-                    if (hashSalt.IsNull())
-                        hashSalt = GetRandHash();
-                    uint256 hashRand = inv.hash ^ hashSalt;
-                    hashRand = Hash(BEGIN(hashRand), END(hashRand));
-                    bool fTrickleWait = ((hashRand & 3) != 0);
-
-                    if (fTrickleWait) {
+                if (inv.type == MSG_TX) {
+                    if (pto->filterInventoryKnown.contains(inv.hash)) {
+                        pto->setInventoryQueued.erase(inv.hash);
+                        continue;
+                    }
+                    if (!fSendTrickle || nRelayBudget == 0) {
                         vInvWait.push_back(inv);
                         continue;
                     }
+                    nRelayBudget--;
                 }
 
+                pto->setInventoryQueued.erase(inv.hash);
                 pto->filterInventoryKnown.insert(inv.hash);
 
                 vInv.push_back(inv);
-                if (vInv.size() >= 1000) {
+                if (vInv.size() >= MAX_INV_SZ) {
                     connman.PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
                     vInv.clear();
                 }
             }
-            pto->vInventoryToSend = vInvWait;
+            pto->vInventoryToSend.swap(vInvWait);
         }
         if (!vInv.empty())
             connman.PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
 
+        //
+        // Message: reqrecon
+        //
+        {
+            bool fRequest = false;
+            uint32_t nSetSize = 0;
+            {
+                LOCK(pto->cs_inventory);
+                CTxReconState* recon = pto->txReconState.get();
+                if (recon && recon->fInitiator) {
+                    if (recon->nRequestSent != 0 && recon->nRequestSent < nNow - RECON_RESPONSE_TIMEOUT * 1000000LL)
+                        recon->nRequestSent = 0;
+                    if (recon->nRequestSent == 0 && recon->nNextRequest < nNow) {
+                        recon->nNextRequest = PoissonNextSend(nNow, RECON_REQUEST_INTERVAL);
+                        recon->nRequestSent = nNow;
+                        nSetSize = recon->mapLocalSet.size();
+                        fRequest = true;
+                    }
+                }
+            }
+            if (fRequest)
+                connman.PushMessage(pto, msgMaker.Make(NetMsgType::REQRECON, nSetSize));
+        }
+
         // Detect whether we're stalling
         nNow = GetTimeMicros();
         if (state.nStallingSince && state.nStallingSince < nNow - 1000000 * BLOCK_STALLING_TIMEOUT) {
@@ -5941,6 +6789,149 @@ bool SendMessages(CNode* pto, CConnman& connman, std::atomic<bool>& interruptMsg
     return true;
 }
 
+static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+//! Transactions handed to AcceptToMemoryPoolBatch at a time while loading the mempool
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 1000;
+
+bool LoadMempool()
+{
+    const int64_t nExpiryTimeout = GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
+    FILE* filestr = fsbridge::fopen(GetDataDir() / "mempool.dat", "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open mempool file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    int64_t count = 0;
+    int64_t skipped = 0;
+    int64_t failed = 0;
+    const int64_t nNow = GetTime();
+
+    std::vector<CTransaction> vtx;
+    std::vector<int64_t> vAcceptTime;
+    std::vector<CTxAdmission> vResults;
+    auto acceptBatch = [&]() {
+        AcceptToMemoryPoolBatch(mempool, vtx, vResults, true, &vAcceptTime);
+        for (const CTxAdmission& result : vResults) {
+            if (result.fAccepted) {
+                ++count;
+            } else {
+                ++failed;
+            }
+        }
+        vtx.clear();
+        vAcceptTime.clear();
+    };
+
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != MEMPOOL_DUMP_VERSION) {
+            LogPrintf("Unknown mempool file version %d. Continuing anyway.\n", version);
+            return false;
+        }
+        uint64_t num;
+        file >> num;
+        while (num--) {
+            CTransaction tx;
+            int64_t nTime;
+            int64_t nFeeDelta;
+            file >> tx;
+            file >> nTime;
+            file >> nFeeDelta;
+
+            // Re-applied before acceptance, so the entry carries it from the start
+            if (nFeeDelta) {
+                mempool.PrioritiseTransaction(tx.GetHash(), tx.GetHash().ToString(), 0, nFeeDelta);
+            }
+            if (nTime + nExpiryTimeout > nNow) {
+                vtx.push_back(tx);
+                vAcceptTime.push_back(nTime);
+            } else {
+                ++skipped;
+            }
+            if (vtx.size() >= MEMPOOL_LOAD_BATCH_SIZE)
+                acceptBatch();
+            if (ShutdownRequested())
+                return false;
+        }
+        acceptBatch();
+
+        // Deltas of transactions that were not in the mempool when it was dumped
+        std::map<uint256, CAmount> mapDeltas;
+        file >> mapDeltas;
+        for (const auto& it : mapDeltas) {
+            mempool.PrioritiseTransaction(it.first, it.first.ToString(), 0, it.second);
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    LogPrintf("Imported mempool transactions from disk: %i successes, %i failed, %i expired\n", count, failed, skipped);
+    return true;
+}
+
+bool DumpMempool()
+{
+    const int64_t start = GetTimeMicros();
+
+    std::map<uint256, CAmount> mapDeltas;
+    std::vector<CTransaction> vtx;
+    std::vector<std::pair<int64_t, int64_t> > vTimeDelta;
+    {
+        LOCK(mempool.cs);
+        for (const auto& it : mempool.mapDeltas) {
+            if (it.second.second)
+                mapDeltas[it.first] = it.second.second;
+        }
+        // Parents before children, so they load in as few rounds as possible
+        std::vector<CTxMemPool::txiter> vEntries;
+        vEntries.reserve(mempool.mapTx.size());
+        for (CTxMemPool::txiter it = mempool.mapTx.begin(); it != mempool.mapTx.end(); ++it)
+            vEntries.push_back(it);
+        std::sort(vEntries.begin(), vEntries.end(), [](const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) {
+            return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+        });
+        vtx.reserve(vEntries.size());
+        vTimeDelta.reserve(vEntries.size());
+        for (const CTxMemPool::txiter& it : vEntries) {
+            vtx.push_back(it->GetTx());
+            vTimeDelta.emplace_back(it->GetTime(), it->GetModifiedFee() - it->GetFee());
+        }
+    }
+
+    const int64_t mid = GetTimeMicros();
+
+    try {
+        FILE* filestr = fsbridge::fopen(GetDataDir() / "mempool.dat.new", "wb");
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        file << MEMPOOL_DUMP_VERSION;
+        file << (uint64_t)vtx.size();
+        for (size_t i = 0; i < vtx.size(); i++) {
+            file << vtx[i];
+            file << vTimeDelta[i].first;
+            file << vTimeDelta[i].second;
+            mapDeltas.erase(vtx[i].GetHash());
+        }
+        file << mapDeltas;
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(GetDataDir() / "mempool.dat.new", GetDataDir() / "mempool.dat");
+        const int64_t last = GetTimeMicros();
+        LogPrintf("Dumped mempool: %gs to copy, %gs to dump\n", (mid - start) * 0.000001, (last - mid) * 0.000001);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump mempool: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
 std::string CBlockFileInfo::ToString() const
 {
     return strprintf("CBlockFileInfo(blocks=%u, size=%u, heights=%u...%u, time=%s...%s)", nBlocks, nSize, nHeightFirst, nHeightLast, DateTimeStrFormat("%Y-%m-%d", nTimeFirst), DateTimeStrFormat("%Y-%m-%d", nTimeLast));
@@ -46,6 +46,7 @@
 #include <vector>
 
 class CBlockIndex;
+class CBlockFilterDB;
 class CBlockTreeDB;
 class CSporkDB;
 class CBloomFilter;
@@ -71,6 +72,8 @@ static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
 static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
 /** Default for -mempoolexpiry, expiration time for mempool transactions in hours */
 static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 72;
+/** Default for -persistmempool */
+static const bool DEFAULT_PERSIST_MEMPOOL = true;
 /** Default for -txindex */
 static const bool DEFAULT_TXINDEX = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
@@ -96,6 +99,10 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Maximum number of block file reader threads during -reindex */
+static const int MAX_REINDEX_THREADS = 8;
+/** -reindexthreads default (number of block file reader threads, 0 = read on the import thread) */
+static const int DEFAULT_REINDEX_THREADS = 2;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -118,9 +125,13 @@ static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
 static const unsigned int AVG_LOCAL_ADDRESS_BROADCAST_INTERVAL = 24 * 24 * 60;
 /** Average delay between peer address broadcasts in seconds. */
 static const unsigned int AVG_ADDRESS_BROADCAST_INTERVAL = 30;
-/** Average delay between trickled inventory broadcasts in seconds.
- *  Blocks, whitelisted receivers, and a random 25% of transactions bypass this. */
+/** Average delay between trickled transaction inventory broadcasts in seconds.
+ *  Whitelisted receivers bypass this. */
 static const unsigned int AVG_INVENTORY_BROADCAST_INTERVAL = 5;
+/** Maximum rate (items per second) of transaction inventory announced to a single peer. */
+static const unsigned int INVENTORY_BROADCAST_PER_SECOND = 200;
+/** Maximum number of transaction inventory items announced to a single peer per trickle. */
+static const unsigned int INVENTORY_BROADCAST_MAX = INVENTORY_BROADCAST_PER_SECOND * AVG_INVENTORY_BROADCAST_INTERVAL;
 
 /** Enable bloom filter */
  static const bool DEFAULT_PEERBLOOMFILTERS = true;
@@ -157,13 +168,18 @@ extern uint256 g_best_block;
 
 extern std::atomic<bool> fImporting;
 extern std::atomic<bool> fReindex;
+/** Whether mempool.dat was loaded (or skipped); until then the mempool must not be dumped over it */
+extern std::atomic<bool> fMempoolLoaded;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+/** Whether block filters are built for connected blocks (-blockfilterindex) */
+extern bool fBlockFilterIndex;
 extern bool fCheckBlockIndex;
 extern size_t nCoinCacheUsage;
 extern CFeeRate minRelayTxFee;
 extern int64_t nMaxTipAge;
 extern bool fVerifyingBlocks;
+extern bool fTxReconciliation;
 
 extern bool fLargeWorkForkFound;
 extern bool fLargeWorkInvalidChainFound;
@@ -203,6 +219,8 @@ FILE* OpenUndoFile(const CDiskBlockPos& pos, bool fReadOnly = false);
 fs::path GetBlockPosFilename(const CDiskBlockPos& pos, const char* prefix);
 /** Import blocks from an external file */
 bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp = NULL);
+/** Import the blocks of all block files for -reindex, read ahead by nThreads reader threads */
+void ReindexBlockFiles(int nThreads);
 /** Initialize a new block tree database + block data on disk */
 bool InitBlockIndex();
 /** Load the block tree and coins database from disk */
@@ -224,6 +242,10 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, std::atomic<bool>& interru
 bool SendMessages(CNode* pto, CConnman& connman, std::atomic<bool>& interrupt);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the coin fetch thread */
+void ThreadCoinFetch();
+/** Run an instance of the block input prefetch thread */
+void ThreadBlockPrefetch();
 
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
@@ -249,10 +271,36 @@ void Misbehaving(NodeId nodeid, int howmuch) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
 
+/** Dump the mempool to disk. */
+bool DumpMempool();
+/** Load the mempool from disk. */
+bool LoadMempool();
+
 
 /** (try to) add transaction to memory pool **/
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fOverrideMempoolLimit = false, bool fRejectInsaneFee = false, bool ignoreFees = false);
 
+/** Outcome of one transaction of AcceptToMemoryPoolBatch */
+struct CTxAdmission {
+    CValidationState state;
+    bool fAccepted;
+    bool fMissingInputs;
+
+    CTxAdmission() : fAccepted(false), fMissingInputs(false) {}
+};
+
+/**
+ * (try to) add a batch of transactions to memory pool. The policy checks and
+ * the insertion are done one transaction at a time, the script checks of all
+ * transactions whose inputs are available run in parallel on the script check
+ * threads. Transactions spending outputs of others in the batch are taken in
+ * later rounds. pvAcceptTime optionally gives the acceptance time of each.
+ */
+void AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransaction>& vtx, std::vector<CTxAdmission>& vResults, bool fLimitFree, const std::vector<int64_t>* pvAcceptTime = nullptr, bool fRejectInsaneFee = false);
+
+/** (try to) add transaction to memory pool with a specified acceptance time **/
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit = false, bool fRejectInsaneFee = false, bool ignoreFees = false);
+
 bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee = false, bool isDSTX = false);
 
 /** Convert CValidationState to a human-readable message for logging */
@@ -279,12 +327,25 @@ CAmount GetMinRelayFee(const CTransaction& tx, const CTxMemPool& pool, unsigned
  *   DUP CHECKSIG DROP ... repeated 100 times... OP_1
  */
 
+/** Script verification flags ConnectBlock checks transactions against */
+static const unsigned int BLOCK_SCRIPT_VERIFY_FLAGS = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG | SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
+
+/** Initializes the script-execution cache, sized from -maxsigcachesize */
+void InitScriptExecutionCache();
+
 /**
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set. If pvChecks is not NULL, script checks are pushed onto it
  * instead of being performed inline.
+ *
+ * Transactions whose scripts already passed with the same flags are found in the
+ * script-execution cache and not checked again. With cacheFullScriptStore a successful
+ * inline check is added to that cache, without it a cache hit is removed.
  */
-bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, bool fScriptChecks, unsigned int flags, bool cacheStore, PrecomputedTransactionData& precomTxData, std::vector<CScriptCheck>* pvChecks = NULL);
+bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& precomTxData, std::vector<CScriptCheck>* pvChecks = NULL);
+
+/** Add a transaction whose scripts were checked with flags, e.g. through a check queue, to the script-execution cache */
+void AddToScriptExecutionCache(const CTransaction& tx, unsigned int flags);
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight);
@@ -317,9 +378,11 @@ private:
     bool cacheStore;
     ScriptError error;
     PrecomputedTransactionData *precomTxData;
+    //! If set, a failure is recorded here and the check passes, so the other transactions of a batch are unaffected
+    std::atomic<bool>* pfFailed;
 
 public:
-    CScriptCheck() : amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
+    CScriptCheck() : amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), pfFailed(nullptr) {}
     CScriptCheck(const CScript& scriptPubKeyIn, const CAmount amountIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* cachedHashesIn) :
         scriptPubKey(scriptPubKeyIn),
         amount(amountIn),
@@ -328,7 +391,8 @@ public:
         nFlags(nFlagsIn),
         cacheStore(cacheIn),
         error(SCRIPT_ERR_UNKNOWN_ERROR),
-        precomTxData(cachedHashesIn) {}
+        precomTxData(cachedHashesIn),
+        pfFailed(nullptr) {}
 
     bool operator()();
 
@@ -342,8 +406,11 @@ public:
         std::swap(cacheStore, check.cacheStore);
         std::swap(error, check.error);
         std::swap(precomTxData, check.precomTxData);
+        std::swap(pfFailed, check.pfFailed);
     }
 
+    void SetFailureFlag(std::atomic<bool>* pfFailedIn) { pfFailed = pfFailedIn; }
+
     ScriptError GetScriptError() const { return error; }
 };
 
@@ -429,6 +496,13 @@ extern CCoinsViewCache* pcoinsTip;
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB* pblocktree;
 
+/**
+ * Global variable that points to the block filter index, NULL unless -blockfilterindex.
+ * It is only set and reset during init and shutdown, when no other thread uses it, and
+ * the database is internally thread-safe, so it is read without cs_main.
+ */
+extern CBlockFilterDB* pblockfilterdb;
+
 /** Global variable that points to the spork database (protected by cs_main) */
 extern CSporkDB* pSporkDB;
 
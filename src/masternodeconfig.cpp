@@ -17,6 +17,7 @@ CMasternodeConfig::CMasternodeEntry* CMasternodeConfig::add(std::string alias, s
 {
     CMasternodeEntry cme(alias, ip, privKey, txHash, outputIndex);
     entries.push_back(cme);
+    nUpdates++;
     return &(entries[entries.size()-1]);
 }
 
@@ -30,6 +31,7 @@ void CMasternodeConfig::remove(std::string alias) {
         }
     }
     entries.erase(entries.begin() + pos);
+    nUpdates++;
 }
 
 bool CMasternodeConfig::read(std::string& strErr)
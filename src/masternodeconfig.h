@@ -11,6 +11,7 @@
 #include "fs.h"
 #include "primitives/transaction.h"
 
+#include <atomic>
 #include <string>
 #include <vector>
 
@@ -107,7 +108,11 @@ public:
         entries = std::vector<CMasternodeEntry>();
     }
 
-    void clear() { entries.clear(); }
+    void clear()
+    {
+        entries.clear();
+        nUpdates++;
+    }
     bool read(std::string& strErr);
     CMasternodeConfig::CMasternodeEntry* add(std::string alias, std::string ip, std::string privKey, std::string txHash, std::string outputIndex);
     void remove(std::string alias);
@@ -136,8 +141,12 @@ public:
 
     bool exportActiveMasternodes(std::string filename);
 
+    //! Raised whenever entries are added or removed, so cached collateral lookups can be refreshed
+    uint64_t GetUpdateCount() const { return nUpdates; }
+
 private:
     std::vector<CMasternodeEntry> entries;
+    std::atomic<uint64_t> nUpdates{0};
 };
 
 
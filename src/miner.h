@@ -10,9 +10,13 @@
 #define BITCOIN_MINER_H
 
 #include "primitives/block.h"
+#include "txmempool.h"
 
 #include <stdint.h>
 
+#include "boost/multi_index_container.hpp"
+#include "boost/multi_index/ordered_index.hpp"
+
 class CBlock;
 class CBlockHeader;
 class CBlockIndex;
@@ -53,4 +57,217 @@ struct CBlockTemplate {
 
 uint64_t GetNetworkHashPS();
 
+// Container for tracking updates to ancestor feerate as we include (parent)
+// transactions in a block
+struct CTxMemPoolModifiedEntry {
+    CTxMemPoolModifiedEntry(CTxMemPool::txiter entry)
+    {
+        iter = entry;
+        nSizeWithAncestors = entry->GetSizeWithAncestors();
+        nModFeesWithAncestors = entry->GetModFeesWithAncestors();
+        nSigOpCountWithAncestors = entry->GetSigOpCountWithAncestors();
+    }
+
+    CTxMemPool::txiter iter;
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+    unsigned int nSigOpCountWithAncestors;
+};
+
+/** Comparator for CTxMemPool::txiter objects.
+ *  It simply compares the internal memory address of the CTxMemPoolEntry object
+ *  pointed to. This means it has no meaning, and is only useful for using them
+ *  as key in other indexes.
+ */
+struct CompareCTxMemPoolIter {
+    bool operator()(const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) const
+    {
+        return &(*a) < &(*b);
+    }
+};
+
+struct modifiedentry_iter {
+    typedef CTxMemPool::txiter result_type;
+    result_type operator() (const CTxMemPoolModifiedEntry &entry) const
+    {
+        return entry.iter;
+    }
+};
+
+// This matches the calculation in CompareTxMemPoolEntryByAncestorFee,
+// except operating on CTxMemPoolModifiedEntry.
+struct CompareModifiedEntry {
+    bool operator()(const CTxMemPoolModifiedEntry& a, const CTxMemPoolModifiedEntry& b) const
+    {
+        double f1 = (double)a.nModFeesWithAncestors * b.nSizeWithAncestors;
+        double f2 = (double)b.nModFeesWithAncestors * a.nSizeWithAncestors;
+        if (f1 == f2) {
+            return CTxMemPool::CompareIteratorByHash()(a.iter, b.iter);
+        }
+        return f1 > f2;
+    }
+};
+
+// A comparator that sorts transactions based on number of ancestors.
+// This is sufficient to sort an ancestor package in an order that is valid
+// to appear in a block.
+struct CompareTxIterByAncestorCount {
+    bool operator()(const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) const
+    {
+        if (a->GetCountWithAncestors() != b->GetCountWithAncestors())
+            return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+        return CTxMemPool::CompareIteratorByHash()(a, b);
+    }
+};
+
+typedef boost::multi_index_container<
+    CTxMemPoolModifiedEntry,
+    boost::multi_index::indexed_by<
+        boost::multi_index::ordered_unique<
+            modifiedentry_iter,
+            CompareCTxMemPoolIter
+        >,
+        // sorted by modified ancestor fee rate
+        boost::multi_index::ordered_non_unique<
+            boost::multi_index::identity<CTxMemPoolModifiedEntry>,
+            CompareModifiedEntry
+        >
+    >
+> indexed_modified_transaction_set;
+
+typedef indexed_modified_transaction_set::nth_index<0>::type::iterator modtxiter;
+typedef indexed_modified_transaction_set::nth_index<1>::type::iterator modtxscoreiter;
+
+struct update_for_parent_inclusion
+{
+    update_for_parent_inclusion(CTxMemPool::txiter it) : iter(it) {}
+
+    void operator() (CTxMemPoolModifiedEntry &e)
+    {
+        e.nModFeesWithAncestors -= iter->GetModifiedFee();
+        e.nSizeWithAncestors -= iter->GetTxSize();
+        e.nSigOpCountWithAncestors -= iter->GetSigOpCount();
+    }
+
+    CTxMemPool::txiter iter;
+};
+
+/**
+ * Selects the mempool transactions of a new block.
+ *
+ * After an optional coin-age priority phase, transactions are picked as
+ * packages with their unconfirmed ancestors, by the ancestor feerate the
+ * mempool keeps indexed, so a high fee child pulls in its low fee parents
+ * (CPFP). No coins are looked up: everything needed is cached in the entries.
+ * The caller must hold mempool.cs.
+ */
+class BlockAssembler
+{
+private:
+    const CTxMemPool& mempool;
+
+    // The template being filled, and a convenience pointer to its block
+    CBlockTemplate* pblocktemplate;
+    CBlock* pblock;
+
+    // Configuration parameters for the block size
+    unsigned int nBlockMaxSize, nBlockMinSize, nBlockPrioritySize;
+    bool fPrintPriority;
+
+    // Information on the current status of the block
+    uint64_t nBlockSize;
+    uint64_t nBlockTx;
+    unsigned int nBlockSigOps;
+    CAmount nFees;
+    CTxMemPool::setEntries inBlock;
+
+    // Chain context for the block
+    int nHeight;
+
+    // Variables used for addPriorityTxs
+    int lastFewTxs;
+    bool blockFinished;
+
+public:
+    BlockAssembler(const CTxMemPool& mempoolIn);
+    /** Append mempool transactions for a block at nHeightIn to the template, whose block holds the coinbase or coinstake already.
+     *  If pvKeep is given, those entries are added first, in order, in place of the priority phase. */
+    void AddTransactions(CBlockTemplate* pblocktemplateIn, int nHeightIn, const std::vector<CTxMemPool::txiter>* pvKeep = nullptr);
+
+    unsigned int GetBlockMaxSize() const { return nBlockMaxSize; }
+    CAmount GetFees() const { return nFees; }
+    uint64_t GetBlockSize() const { return nBlockSize; }
+    uint64_t GetBlockTx() const { return nBlockTx; }
+
+private:
+    /** Clear the block's state and prepare for assembling a new block */
+    void resetBlock();
+    /** Add a tx to the block */
+    void AddToBlock(CTxMemPool::txiter iter);
+
+    /** Add transactions based on tx "priority" */
+    void addPriorityTxs();
+    /** Add transactions based on feerate including unconfirmed ancestors */
+    void addPackageTxs();
+
+    // helper functions for addPriorityTxs()
+    /** Test if tx will still "fit" in the block */
+    bool TestForBlock(CTxMemPool::txiter iter);
+    /** Test if tx still has unconfirmed parents not yet in block */
+    bool isStillDependent(CTxMemPool::txiter iter);
+
+    // helper functions for addPackageTxs()
+    /** Remove confirmed (inBlock) entries from given set */
+    void onlyUnconfirmed(CTxMemPool::setEntries& testSet);
+    /** Test if a new package would "fit" in the block */
+    bool TestPackage(uint64_t packageSize, unsigned int packageSigOps);
+    /** Test if a set of transactions are all final */
+    bool TestPackageFinality(const CTxMemPool::setEntries& package);
+    /** Return true if given transaction from mapTx has already been evaluated,
+      * or if the transaction's cached data in mapTx is incorrect. */
+    bool SkipMapTxEntry(CTxMemPool::txiter it, indexed_modified_transaction_set& mapModifiedTx, CTxMemPool::setEntries& failedTx);
+    /** Sort the package in an order that is valid to appear in a block */
+    void SortForBlock(const CTxMemPool::setEntries& package, std::vector<CTxMemPool::txiter>& sortedEntries);
+    /** Add descendants of given transactions to mapModifiedTx with ancestor
+      * state updated assuming given transactions are inBlock. */
+    void UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set& mapModifiedTx);
+};
+
+/** Seconds after which a cached selection is rebuilt from scratch even on an unchanged tip */
+static const int64_t BLOCK_TEMPLATE_REBUILD_INTERVAL = 10;
+
+/**
+ * Mempool transactions selected for the next block, kept between calls.
+ *
+ * The selection is keyed by the tip and the mempool sequence number
+ * (GetTransactionsUpdated()). While both match it is handed out as is. When
+ * only the mempool moved, transactions that left it are dropped along with
+ * their dependents and the space left is topped up with new packages. A new
+ * tip, another block size limit or a selection older than
+ * BLOCK_TEMPLATE_REBUILD_INTERVAL is rebuilt from scratch. Guarded by cs_main.
+ */
+class CBlockTemplateCache
+{
+private:
+    CTxMemPool& mempool;
+    //! Selected transactions with their fees and sigops, without coinbase
+    CBlockTemplate selection;
+    uint64_t nSelectionSize;
+    uint256 hashTip;
+    unsigned int nMempoolSequence;
+    unsigned int nBlockMaxSize;
+    int64_t nTimeBuilt;
+
+public:
+    CBlockTemplateCache(CTxMemPool& mempoolIn);
+
+    /** Append the selection for a block on top of pindexPrev to the template, skipping anything that
+     *  conflicts with the coinbase or coinstake already in it. Requires cs_main and mempool.cs. */
+    void FillBlock(CBlockTemplate* pblocktemplate, const CBlockIndex* pindexPrev, CAmount& nFeesRet, uint64_t& nBlockSizeRet);
+    /** Forget the selection, so the next call rebuilds it */
+    void Clear();
+};
+
+extern CBlockTemplateCache blockTemplateCache;
+
 #endif // BITCOIN_MINER_H
@@ -32,6 +32,7 @@
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef USE_UPNP
@@ -87,7 +88,7 @@ static bool vfLimited[NET_MAX] = {};
 static CNode* pnodeLocalHost = NULL;
 std::string strSubVersion;
 
-std::map<CInv, CDataStream> mapRelay;
+std::map<CInv, CSharedNetPayloadRef> mapRelay;
 std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
 RecursiveMutex cs_mapRelay;
 limitedmap<CInv, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
@@ -722,6 +723,13 @@ void CNode::copyStats(CNodeStats& stats)
         X(nRecvBytes);
     }
     X(fWhitelisted);
+    {
+        LOCK(cs_inventory);
+        stats.nInvQueueSize = vInventoryToSend.size();
+        stats.nAskForQueueSize = mapAskFor.size();
+        stats.fTxReconciliation = txReconState != nullptr;
+        stats.nReconSetSize = txReconState ? txReconState->mapLocalSet.size() : 0;
+    }
 
     // It is common for nodes with good ping times to suddenly become lagged,
     // due to a new block arriving or other large transfer.
@@ -752,12 +760,11 @@ bool CNode::ReceiveMsgBytes(const char* pch, unsigned int nBytes, bool& complete
     nLastRecv = nTimeMicros / 1000000;
     nRecvBytes += nBytes;
     while (nBytes > 0) {
-        // get current incomplete message, or create a new one
-        if (vRecvMsg.empty() ||
-            vRecvMsg.back().complete())
-            vRecvMsg.push_back(CNetMessage(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION));
+        // get current incomplete message, or start a new one
+        if (!msgRecv)
+            msgRecv = GetRecvMsg();
 
-        CNetMessage& msg = vRecvMsg.back();
+        CNetMessage& msg = *msgRecv;
 
         // absorb network data
         int handled;
@@ -788,6 +795,8 @@ bool CNode::ReceiveMsgBytes(const char* pch, unsigned int nBytes, bool& complete
             i->second += msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE;
 
             msg.nTime = nTimeMicros;
+            nProcessQueueSize += msg.vRecv.size() + CMessageHeader::HEADER_SIZE;
+            vProcessMsg.Push(std::move(msgRecv));
             complete = true;
         }
     }
@@ -795,6 +804,34 @@ bool CNode::ReceiveMsgBytes(const char* pch, unsigned int nBytes, bool& complete
     return true;
 }
 
+std::unique_ptr<CNetMessage> CNode::GetRecvMsg()
+{
+    std::unique_ptr<CNetMessage> msg;
+    if (vRecycledMsg.Pop(msg)) {
+        nRecycledMsgs--;
+        msg->Reset(Params().MessageStart(), INIT_PROTO_VERSION);
+        return msg;
+    }
+    return std::unique_ptr<CNetMessage>(new CNetMessage(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION));
+}
+
+bool CNode::PopProcessMsg(std::unique_ptr<CNetMessage>& msg)
+{
+    if (!vProcessMsg.Pop(msg))
+        return false;
+    nProcessQueueSize -= msg->vRecv.size() + CMessageHeader::HEADER_SIZE;
+    return true;
+}
+
+void CNode::RecycleMsg(std::unique_ptr<CNetMessage>&& msg)
+{
+    // Don't hold on to the buffers of big messages
+    if (!msg || msg->hdr.nMessageSize > MAX_RECYCLED_MSG_SIZE || nRecycledMsgs >= MAX_RECYCLED_MSGS)
+        return;
+    nRecycledMsgs++;
+    vRecycledMsg.Push(std::move(msg));
+}
+
 void CNode::SetSendVersion(int nVersionIn)
 {
     // Send version may only be changed in the version message, and
@@ -875,27 +912,56 @@ size_t CConnman::SocketSendData(CNode* pnode)
     size_t nSentSize = 0;
 
     while (it != pnode->vSendMsg.end()) {
-        const auto& data = *it;
-        assert(data.size() > pnode->nSendOffset);
+        assert((*it)->size() > pnode->nSendOffset);
+        // Gather as many queued buffers as possible into a single syscall
+        size_t nRequested = 0;
         int nBytes = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
-            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#ifdef WIN32
+            const auto& data = **it;
+            nRequested = data.size() - pnode->nSendOffset;
+            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, nRequested, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+            struct iovec iov[MAX_SEND_IOV];
+            int nIov = 0;
+            size_t nOffset = pnode->nSendOffset;
+            for (auto itIov = it; itIov != pnode->vSendMsg.end() && nIov < MAX_SEND_IOV; ++itIov, ++nIov) {
+                const auto& data = **itIov;
+                iov[nIov].iov_base = const_cast<unsigned char*>(data.data()) + nOffset;
+                iov[nIov].iov_len = data.size() - nOffset;
+                nRequested += iov[nIov].iov_len;
+                nOffset = 0;
+            }
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = nIov;
+            nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         }
         if (nBytes > 0) {
             pnode->nLastSend = GetTime();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
+            // Advance over the buffers that were fully written
+            size_t nRemaining = nBytes;
+            while (nRemaining > 0) {
+                const size_t nLeft = (*it)->size() - pnode->nSendOffset;
+                if (nRemaining < nLeft) {
+                    pnode->nSendOffset += nRemaining;
+                    break;
+                }
+                nRemaining -= nLeft;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
-                pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+                pnode->nSendSize -= (*it)->size();
                 it++;
-            } else {
-                // could not send full message; stop sending more
+            }
+            pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+            if ((size_t)nBytes < nRequested) {
+                // could not send everything; stop sending more
                 break;
             }
         } else {
@@ -1285,6 +1351,9 @@ void CConnman::ThreadSocketHandler()
                 // * Hand off all complete messages to the processor, to be handled without
                 //   blocking here.
 
+                // Only this thread updates fPauseRecv; the message handler
+                // just drains nProcessQueueSize
+                pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
                 bool select_recv = !pnode->fPauseRecv;
                 bool select_send;
                 {
@@ -1383,19 +1452,7 @@ void CConnman::ThreadSocketHandler()
                                 pnode->CloseSocketDisconnect();
                             RecordBytesRecv(nBytes);
                             if (notify) {
-                                size_t nSizeAdded = 0;
-                                auto it(pnode->vRecvMsg.begin());
-                                for (; it != pnode->vRecvMsg.end(); ++it) {
-                                    if (!it->complete())
-                                        break;
-                                    nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
-                                }
-                                {
-                                    LOCK(pnode->cs_vProcessMsg);
-                                    pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
-                                    pnode->nProcessQueueSize += nSizeAdded;
-                                    pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
-                                }
+                                pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
                                 WakeMessageHandler();
                             }
                         } else if (nBytes == 0) {
@@ -1673,8 +1730,20 @@ void CConnman::DumpAddresses()
 {
     int64_t nStart = GetTimeMillis();
 
+    // Normally only the changes since the last dump are appended to
+    // peers.journal; the full tables are written when the journal got too
+    // big or changes were dropped.
     CAddrDB adb;
-    adb.Write(addrman);
+    std::vector<CAddrManJournalEntry> vEntries;
+    if (addrman.TakeJournal(vEntries) && adb.GetJournalSize() < ADDRMAN_JOURNAL_MAX_SIZE &&
+        adb.AppendJournal(vEntries)) {
+        LogPrint(BCLog::NET, "Appended %d address changes to peers.journal  %dms\n",
+            vEntries.size(), GetTimeMillis() - nStart);
+        return;
+    }
+
+    if (adb.Write(addrman))
+        adb.ClearJournal();
 
     LogPrint(BCLog::NET, "Flushed %d addresses to peers.dat  %dms\n",
         addrman.size(), GetTimeMillis() - nStart);
@@ -2189,13 +2258,25 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
     int64_t nStart = GetTimeMillis();
     {
         CAddrDB adb;
-        if (adb.Read(addrman))
+        bool fLoaded = adb.Read(addrman);
+        if (fLoaded)
             LogPrintf("Loaded %i addresses from peers.dat  %dms\n", addrman.size(), GetTimeMillis() - nStart);
         else {
             addrman.Clear(); // Addrman can be in an inconsistent state after failure, reset it
             LogPrintf("Invalid or missing peers.dat; recreating\n");
-            DumpAddresses();
         }
+
+        // Restore the states journaled since peers.dat was last written, then
+        // compact them into a fresh peers.dat. The journal only applies on top
+        // of the tables it was recorded against.
+        std::vector<CAddrManJournalEntry> vEntries;
+        if (fLoaded && adb.ReadJournal(vEntries) && !vEntries.empty()) {
+            addrman.Replay(vEntries);
+            LogPrintf("Replayed %u address table states from peers.journal  %dms\n", vEntries.size(), GetTimeMillis() - nStart);
+        }
+        if (adb.Write(addrman))
+            adb.ClearJournal();
+        addrman.SetJournaling(true);
     }
     if (clientInterface)
         clientInterface->InitMessage(_("Loading banlist..."));
@@ -2582,6 +2663,7 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     nNextLocalAddrSend = 0;
     nNextAddrSend = 0;
     nNextInvSend = 0;
+    nReconLocalSalt = 0;
     fRelayTxes = false;
     pfilter = new CBloomFilter();
     nPingNonceSent = 0;
@@ -2592,6 +2674,7 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     fPauseRecv = false;
     fPauseSend = false;
     nProcessQueueSize = 0;
+    nRecycledMsgs = 0;
 
     for (const std::string &msg : getAllNetMessageTypes())
         mapRecvBytesPerMsgCmd[msg] = 0;
@@ -2648,18 +2731,26 @@ bool CConnman::NodeFullyConnected(const CNode* pnode)
 
 void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 {
-    size_t nMessageSize = msg.data.size();
+    const std::vector<unsigned char>& data = msg.payload ? msg.payload->data : msg.data;
+    size_t nMessageSize = data.size();
     size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
     LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->id);
 
     std::vector<unsigned char> serializedHeader;
     serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
-    uint256 hash = Hash(msg.data.data(), msg.data.data() + nMessageSize);
+    uint256 hash = msg.payload ? msg.payload->hash : Hash(data.data(), data.data() + nMessageSize);
     CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), nMessageSize);
     memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
 
     CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, serializedHeader, 0, hdr};
 
+    // Shared payloads are queued by reference, everything else is moved in
+    CSendBufferRef body;
+    if (msg.payload)
+        body = CSendBufferRef(msg.payload, &msg.payload->data);
+    else if (nMessageSize)
+        body = std::make_shared<const std::vector<unsigned char>>(std::move(msg.data));
+
     size_t nBytesSent = 0;
     {
         LOCK(pnode->cs_vSend);
@@ -2671,9 +2762,9 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
+        pnode->vSendMsg.push_back(std::make_shared<const std::vector<unsigned char>>(std::move(serializedHeader)));
         if (nMessageSize)
-            pnode->vSendMsg.push_back(std::move(msg.data));
+            pnode->vSendMsg.push_back(std::move(body));
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
@@ -2683,6 +2774,30 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
         RecordBytesSent(nBytesSent);
 }
 
+void AddRelayPayload(const CInv& inv, const CSharedNetPayloadRef& payload)
+{
+    int64_t nNow = GetTime();
+    LOCK(cs_mapRelay);
+
+    // Expire old relay messages
+    while (!vRelayExpiration.empty() && vRelayExpiration.front().first < nNow) {
+        mapRelay.erase(vRelayExpiration.front().second);
+        vRelayExpiration.pop_front();
+    }
+
+    if (mapRelay.emplace(inv, payload).second)
+        vRelayExpiration.push_back(std::make_pair(nNow + RELAY_EXPIRY_TIME, inv));
+}
+
+CSharedNetPayloadRef FindRelayPayload(const CInv& inv)
+{
+    LOCK(cs_mapRelay);
+    auto mi = mapRelay.find(inv);
+    if (mi == mapRelay.end())
+        return CSharedNetPayloadRef();
+    return mi->second;
+}
+
 bool CConnman::ForNode(NodeId id, std::function<bool(CNode* pnode)> func)
 {
     CNode* found = nullptr;
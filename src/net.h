@@ -16,6 +16,7 @@
 #include "fs.h"
 #include "hash.h"
 #include "limitedmap.h"
+#include "lockfreequeue.h"
 #include "netaddress.h"
 #include "protocol.h"
 #include "random.h"
@@ -24,6 +25,7 @@
 #include "uint256.h"
 #include "utilstrencodings.h"
 #include "threadinterrupt.h"
+#include "txreconciliation.h"
 
 #include <atomic>
 #include <deque>
@@ -76,6 +78,14 @@ static const bool DEFAULT_UPNP = USE_UPNP;
 #else
 static const bool DEFAULT_UPNP = true;
 #endif
+/** Time (in seconds) a serialized payload is kept in mapRelay */
+static const int64_t RELAY_EXPIRY_TIME = 15 * 60;
+/** The maximum number of processed messages a peer keeps around for reuse */
+static const size_t MAX_RECYCLED_MSGS = 64;
+/** Processed messages larger than this are freed rather than recycled */
+static const unsigned int MAX_RECYCLED_MSG_SIZE = 256 * 1024;
+/** The maximum number of buffers handed to a single scatter-gather send */
+static const int MAX_SEND_IOV = 64;
 /** The maximum number of entries in mapAskFor */
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
 /** The maximum number of peer connections to maintain. */
@@ -110,6 +120,20 @@ class CTransaction;
 class CNodeStats;
 class CClientUIInterface;
 
+/** Immutable serialized message body, shared by the send queues of every peer it is pushed to. */
+class CSharedNetPayload
+{
+public:
+    explicit CSharedNetPayload(std::vector<unsigned char>&& dataIn) : data(std::move(dataIn)), hash(Hash(data.begin(), data.end())) {}
+
+    const std::vector<unsigned char> data;
+    const uint256 hash; // checksum source for the message header
+};
+typedef std::shared_ptr<const CSharedNetPayload> CSharedNetPayloadRef;
+
+/** A chunk of bytes queued for sending; payloads are reference counted so they are never copied per peer. */
+typedef std::shared_ptr<const std::vector<unsigned char>> CSendBufferRef;
+
 struct CSerializedNetMsg
 {
     CSerializedNetMsg() = default;
@@ -120,6 +144,7 @@ struct CSerializedNetMsg
     CSerializedNetMsg& operator=(const CSerializedNetMsg&) = delete;
 
     std::vector<unsigned char> data;
+    CSharedNetPayloadRef payload; // if set, sent instead of data
     std::string command;
 };
 
@@ -457,10 +482,15 @@ extern bool fDiscover;
 extern bool fListen;
 extern CService sHostIp;
 
-extern std::map<CInv, CDataStream> mapRelay;
+extern std::map<CInv, CSharedNetPayloadRef> mapRelay;
 extern std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
 extern RecursiveMutex cs_mapRelay;
 
+/** Keep the serialized payload of a relayed item for RELAY_EXPIRY_TIME, to answer every peer's getdata from one buffer. */
+void AddRelayPayload(const CInv& inv, const CSharedNetPayloadRef& payload);
+/** Return the cached payload of a relayed item, or an empty reference. */
+CSharedNetPayloadRef FindRelayPayload(const CInv& inv);
+
 extern limitedmap<CInv, int64_t> mapAlreadyAskedFor;
 
 /** Subversion as sent to the P2P network in `version` messages */
@@ -497,6 +527,10 @@ public:
     double dPingTime;
     double dPingWait;
     std::string addrLocal;
+    size_t nInvQueueSize;
+    size_t nAskForQueueSize;
+    bool fTxReconciliation;
+    size_t nReconSetSize;
 };
 
 
@@ -535,6 +569,20 @@ public:
         vRecv.SetVersion(nVersionIn);
     }
 
+    //! Make a processed message ready to receive again, keeping its buffers allocated
+    void Reset(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nVersionIn)
+    {
+        hdrbuf.clear();
+        hdrbuf.resize(24);
+        hdr = CMessageHeader(pchMessageStartIn);
+        vRecv.clear();
+        SetVersion(nVersionIn);
+        in_data = false;
+        nHdrPos = 0;
+        nDataPos = 0;
+        nTime = 0;
+    }
+
     int readHeader(const char* pch, unsigned int nBytes);
     int readData(const char* pch, unsigned int nBytes);
 };
@@ -552,14 +600,15 @@ public:
     size_t nSendSize;   // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<std::vector<unsigned char>> vSendMsg;
+    std::deque<CSendBufferRef> vSendMsg;
     RecursiveMutex cs_vSend;
     RecursiveMutex cs_hSocket;
     RecursiveMutex cs_vRecv;
 
-    RecursiveMutex cs_vProcessMsg;
-    std::list<CNetMessage> vProcessMsg;
-    size_t nProcessQueueSize;
+    // Complete messages, handed from the SocketHandler thread to the
+    // message handler thread without locking
+    CSPSCQueue<std::unique_ptr<CNetMessage>> vProcessMsg;
+    std::atomic<size_t> nProcessQueueSize;
 
     RecursiveMutex cs_sendProcessing;
 
@@ -622,10 +671,14 @@ public:
     // inventory based relay
     CRollingBloomFilter filterInventoryKnown;
     std::vector<CInv> vInventoryToSend;
+    std::set<uint256> setInventoryQueued; // hashes currently in vInventoryToSend
     RecursiveMutex cs_inventory;
     std::multimap<int64_t, CInv> mapAskFor;
     std::vector<uint256> vBlockRequested;
     int64_t nNextInvSend;
+    // reconciliation based tx relay, guarded by cs_inventory
+    uint64_t nReconLocalSalt; // salt we sent in sendrecon, 0 if we did not offer it
+    std::unique_ptr<CTxReconState> txReconState;
 
     // Ping time measurement:
     // The pong reply we're expecting, or 0 if no pong expected.
@@ -652,7 +705,14 @@ private:
     const ServiceFlags nLocalServices;
     const int nMyStartingHeight;
     int nSendVersion;
-    std::list<CNetMessage> vRecvMsg;  // Used only by SocketHandler thread
+    std::unique_ptr<CNetMessage> msgRecv;  // Used only by SocketHandler thread
+
+    // Processed messages returned by the message handler thread, so the
+    // SocketHandler thread can reuse them instead of allocating new ones
+    CSPSCQueue<std::unique_ptr<CNetMessage>> vRecycledMsg;
+    std::atomic<size_t> nRecycledMsgs;
+
+    std::unique_ptr<CNetMessage> GetRecvMsg();
 
     mutable RecursiveMutex cs_addrName;
     std::string addrName;
@@ -681,13 +741,15 @@ public:
 
     unsigned int GetTotalRecvSize()
     {
-        unsigned int total = 0;
-        for (const CNetMessage& msg : vRecvMsg)
-            total += msg.vRecv.size() + 24;
-        return total;
+        return msgRecv ? msgRecv->vRecv.size() + 24 : 0;
     }
 
+    //! SocketHandler thread only: parse received bytes, queueing complete messages in vProcessMsg
     bool ReceiveMsgBytes(const char* pch, unsigned int nBytes, bool& complete);
+    //! Message handler thread only: take the next complete message
+    bool PopProcessMsg(std::unique_ptr<CNetMessage>& msg);
+    //! Message handler thread only: give back a processed message so its buffers are reused
+    void RecycleMsg(std::unique_ptr<CNetMessage>&& msg);
 
     void SetRecvVersion(int nVersionIn)
     {
@@ -748,12 +810,36 @@ public:
     {
         {
             LOCK(cs_inventory);
+            // Transactions are skipped when the peer already knows about them.
+            // Anything else is announced even if redundant: blocks, and the
+            // masternode entries a repeated sync request asks for again.
             if (inv.type == MSG_TX && filterInventoryKnown.contains(inv.hash))
                 return;
+            // Only queue each hash once until it is flushed by SendMessages
+            if (!setInventoryQueued.insert(inv.hash).second)
+                return;
             vInventoryToSend.push_back(inv);
         }
     }
 
+    bool IsReconciling()
+    {
+        LOCK(cs_inventory);
+        return txReconState != nullptr;
+    }
+
+    // Queue a transaction for the next reconciliation round instead of
+    // announcing it. Returns false if it has to be announced by inv.
+    bool AddToReconSet(const uint256& hash)
+    {
+        LOCK(cs_inventory);
+        if (!txReconState)
+            return false;
+        if (filterInventoryKnown.contains(hash))
+            return true;
+        return txReconState->AddTx(hash);
+    }
+
     void AskFor(const CInv& inv);
 
     bool HasFulfilledRequest(std::string strRequest)
@@ -31,8 +31,26 @@ public:
         return Make(0, std::move(sCommand), std::forward<Args>(args)...);
     }
 
+    /** Wrap an already serialized, shareable payload without copying it. */
+    CSerializedNetMsg MakeShared(std::string sCommand, const CSharedNetPayloadRef& payload)
+    {
+        CSerializedNetMsg msg;
+        msg.command = std::move(sCommand);
+        msg.payload = payload;
+        return msg;
+    }
+
 private:
     const int nVersion;
 };
 
+/** Serialize a message body once so it can be pushed to many peers. */
+template <typename... Args>
+CSharedNetPayloadRef MakeSharedNetPayload(int nVersion, Args&&... args)
+{
+    std::vector<unsigned char> data;
+    CVectorWriter{ SER_NETWORK, nVersion, data, 0, std::forward<Args>(args)... };
+    return std::make_shared<const CSharedNetPayload>(std::move(data));
+}
+
 #endif // BITCOIN_NETMESSAGEMAKER_H
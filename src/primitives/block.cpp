@@ -15,6 +15,62 @@
 #include "utilstrencodings.h"
 #include "util.h"
 
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+/**
+ * Recently computed X11KVS header hashes, keyed by the double SHA256 of the
+ * header. An X11KVS hash costs hundreds of X11 rounds, and the same header
+ * is hashed several times while a block is checked and stored; -reindex
+ * also hashes headers ahead on its reader threads.
+ */
+class CHeaderHashCache
+{
+private:
+    struct CheapHasher {
+        size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
+    };
+
+    static const size_t MAX_ENTRIES = 16384;
+
+    std::mutex cs;
+    std::unordered_map<uint256, uint256, CheapHasher> mapHashes;
+    std::deque<uint256> queueKeys;
+
+public:
+    bool Get(const uint256& key, uint256& hash)
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        std::unordered_map<uint256, uint256, CheapHasher>::const_iterator it = mapHashes.find(key);
+        if (it == mapHashes.end())
+            return false;
+        hash = it->second;
+        return true;
+    }
+
+    void Add(const uint256& key, const uint256& hash)
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (!mapHashes.emplace(key, hash).second)
+            return;
+        queueKeys.push_back(key);
+        if (queueKeys.size() > MAX_ENTRIES) {
+            mapHashes.erase(queueKeys.front());
+            queueKeys.pop_front();
+        }
+    }
+};
+
+/** Constructed on first use: genesis headers are hashed during static initialization */
+CHeaderHashCache& GetHeaderHashCache()
+{
+    static CHeaderHashCache cache;
+    return cache;
+}
+} // namespace
+
 // TODO: Change X11KVS algorithm call to whatever the coin being adapted is used.
 uint256 CBlockHeader::GetHash() const
 {
@@ -27,11 +83,18 @@ uint256 CBlockHeader::GetHash() const
         WriteLE32(&data[68], nTime);
         WriteLE32(&data[72], nBits);
         WriteLE32(&data[76], nNonce);
-
-        return HashX11KVS(data, data + 80);
+        const char* pbegin = (const char*)data;
 #else // Can take shortcut for little endian
-        return HashX11KVS(BEGIN(nVersion), END(nNonce));
+        const char* pbegin = BEGIN(nVersion);
 #endif
+        const uint256 key = Hash(pbegin, pbegin + 80);
+        CHeaderHashCache& cache = GetHeaderHashCache();
+        uint256 hash;
+        if (!cache.Get(key, hash)) {
+            hash = HashX11KVS(pbegin, pbegin + 80);
+            cache.Add(key, hash);
+        }
+        return hash;
     }
 	
     return SerializeHash(*this); // nVersion >= 4
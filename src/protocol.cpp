@@ -40,6 +40,12 @@ const char* FILTERADD = "filteradd";
 const char* FILTERCLEAR = "filterclear";
 const char* REJECT = "reject";
 const char* SENDHEADERS = "sendheaders";
+const char* GETCFILTERS = "getcfilters";
+const char* CFILTER = "cfilter";
+const char* SENDRECON = "sendrecon";
+const char* REQRECON = "reqrecon";
+const char* SKETCH = "sketch";
+const char* RECONCILDIFF = "reconcildiff";
 const char* IX = "ix";
 const char* IXLOCKVOTE = "txlvote";
 const char* SPORK = "spork";
@@ -103,6 +109,12 @@ const static std::string allNetMessageTypes[] = {
     NetMsgType::FILTERCLEAR,
     NetMsgType::REJECT,
     NetMsgType::SENDHEADERS,
+    NetMsgType::GETCFILTERS,
+    NetMsgType::CFILTER,
+    NetMsgType::SENDRECON,
+    NetMsgType::REQRECON,
+    NetMsgType::SKETCH,
+    NetMsgType::RECONCILDIFF,
     NetMsgType::IX,
     NetMsgType::IXLOCKVOTE,
     NetMsgType::SPORK,
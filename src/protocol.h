@@ -222,6 +222,34 @@ extern const char* REJECT;
  * @see https://bitcoin.org/en/developer-reference#sendheaders
  */
 extern const char* SENDHEADERS;
+/**
+ * Asks a NODE_COMPACT_FILTERS peer for the block filters of a range of
+ * blocks (filter type, start height, stop hash).
+ */
+extern const char* GETCFILTERS;
+/**
+ * A block filter (filter type, block hash, encoded filter), answering a
+ * getcfilters.
+ */
+extern const char* CFILTER;
+/**
+ * Offers transaction reconciliation (version, salt); it is used on a link
+ * once both sides have sent it.
+ */
+extern const char* SENDRECON;
+/**
+ * Sent by the initiator of a reconciliation round with the size of its set.
+ */
+extern const char* REQRECON;
+/**
+ * The responder's set sketch, answering a reqrecon.
+ */
+extern const char* SKETCH;
+/**
+ * Concludes a reconciliation round: whether the sketch could be decoded and
+ * the short ids of the transactions the initiator is missing.
+ */
+extern const char* RECONCILDIFF;
 /**
  * The spork message is used to send spork values to connected
  * peers
@@ -299,6 +327,10 @@ enum ServiceFlags : uint64_t {
     // that the node doesn't want to receive master nodes messages. (the 1<<3 was not picked as constant because on bitcoin 0.14 is witness and we want that update here )
     NODE_BLOOM_WITHOUT_MN = (1 << 4),
 
+    // NODE_COMPACT_FILTERS means the node keeps the block filter index (-blockfilterindex)
+    // and answers getcfilters requests.
+    NODE_COMPACT_FILTERS = (1 << 6),
+
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
     // bitcoin-development mailing list. Remember that service bits are just
@@ -366,12 +366,9 @@ UniValue mempoolToJSON(bool fVerbose = false)
             info.push_back(Pair("descendantcount", e.GetCountWithDescendants()));
             info.push_back(Pair("descendantsize", e.GetSizeWithDescendants()));
             info.push_back(Pair("descendantfees", e.GetFeesWithDescendants()));
-            const CTransaction& tx = e.GetTx();
             std::set<std::string> setDepends;
-            for (const CTxIn& txin : tx.vin) {
-                if (mempool.exists(txin.prevout.hash))
-                    setDepends.insert(txin.prevout.hash.ToString());
-            }
+            for (const CTxMemPool::txiter& parent : mempool.GetMemPoolParents(mempool.mapTx.iterator_to(e)))
+                setDepends.insert(parent->GetTx().GetHash().ToString());
 
             UniValue depends(UniValue::VARR);
             for (const std::string& dep : setDepends) {
@@ -590,6 +587,52 @@ UniValue getblockheader(const JSONRPCRequest& request)
     return blockheaderToJSON(pblockindex);
 }
 
+UniValue getblockfilter(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "getblockfilter \"blockhash\" ( \"filtertype\" )\n"
+            "\nReturns the compact filter of a block, needs -blockfilterindex.\n"
+
+            "\nArguments:\n"
+            "1. \"blockhash\"       (string, required) The block hash\n"
+            "2. \"filtertype\"      (string, optional, default=\"basic\") The type of the filter\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\" : \"hex\",   (string) The hex encoded filter\n"
+            "  \"header\" : \"hex\"    (string) The hex encoded filter header\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getblockfilter", "\"00000000000fd08c2fb661d2fcb0d49abb3a91e5f27082ce64feed3b4dede2e2\" \"basic\"") +
+            HelpExampleRpc("getblockfilter", "\"00000000000fd08c2fb661d2fcb0d49abb3a91e5f27082ce64feed3b4dede2e2\", \"basic\""));
+
+    uint256 hash(ParseHashV(request.params[0], "blockhash"));
+
+    BlockFilterType filterType = BLOCK_FILTER_BASIC;
+    if (request.params.size() > 1 && !BlockFilterTypeByName(request.params[1].get_str(), filterType))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown filtertype");
+
+    LOCK(cs_main);
+
+    if (!fBlockFilterIndex || !pblockfilterdb)
+        throw JSONRPCError(RPC_MISC_ERROR, "Block filters are not enabled, restart with -blockfilterindex -reindex");
+
+    if (mapBlockIndex.count(hash) == 0)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+
+    BlockFilter filter;
+    uint256 header;
+    if (!pblockfilterdb->ReadFilter(hash, filter) || !pblockfilterdb->ReadFilterHeader(hash, header) || filter.GetFilterType() != filterType)
+        throw JSONRPCError(RPC_MISC_ERROR, "Filter not found, the block was never connected");
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("filter", HexStr(filter.GetEncodedFilter())));
+    ret.push_back(Pair("header", header.GetHex()));
+    return ret;
+}
+
 struct CCoinsStats
 {
     int nHeight;
@@ -1097,6 +1140,25 @@ UniValue getmempoolinfo(const JSONRPCRequest& request)
     return mempoolInfoToJSON();
 }
 
+UniValue savemempool(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "savemempool\n"
+            "\nDumps the mempool to disk.\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("savemempool", "") + HelpExampleRpc("savemempool", ""));
+
+    if (!fMempoolLoaded)
+        throw JSONRPCError(RPC_MISC_ERROR, "The mempool was not loaded yet");
+
+    if (!DumpMempool())
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to dump mempool to disk");
+
+    return NullUniValue;
+}
+
 UniValue invalidateblock(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -540,18 +540,18 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     }
 
     // Update block
+    // CreateNewBlock only tops up the cached selection when the mempool moved,
+    // so there is no need to hold back mempool changes here.
     static CBlockIndex* pindexPrev;
-    static int64_t nStart;
     static CBlockTemplate* pblocktemplate;
     if (pindexPrev != chainActive.Tip() ||
-        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5)) {
+        mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast) {
         // Clear pindexPrev so future calls make a new block, despite any failures from here on
         pindexPrev = NULL;
 
         // Store the chainActive.Tip() used before CreateNewBlock, to avoid races
         nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
         CBlockIndex* pindexPrevNew = chainActive.Tip();
-        nStart = GetTime();
 
         // Create new block
         if (pblocktemplate) {
@@ -129,6 +129,10 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
             "    ]\n"
+            "    \"inv_queue\": n,            (numeric) Inventory items waiting to be announced to this peer\n"
+            "    \"askfor_queue\": n,         (numeric) Inventory items waiting to be requested from this peer\n"
+            "    \"txreconciliation\": true|false, (boolean) Whether transactions are reconciled with this peer instead of flooded\n"
+            "    \"recon_set\": n,            (numeric) Transactions waiting for the next reconciliation with this peer\n"
             "    \"bytessent_per_msg\": {\n"
             "       \"addr\": n,             (numeric) The total bytes sent aggregated by message type\n"
             "       ...\n"
@@ -188,6 +192,10 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             obj.push_back(Pair("inflight", heights));
         }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
+        obj.push_back(Pair("inv_queue", (uint64_t)stats.nInvQueueSize));
+        obj.push_back(Pair("askfor_queue", (uint64_t)stats.nAskForQueueSize));
+        obj.push_back(Pair("txreconciliation", stats.fTxReconciliation));
+        obj.push_back(Pair("recon_set", (uint64_t)stats.nReconSetSize));
 
         UniValue sendPerMsgCmd(UniValue::VOBJ);
         for (const mapMsgCmdSize::value_type &i : stats.mapSendBytesPerMsgCmd) {
@@ -309,6 +309,7 @@ static const CRPCCommand vRPCCommands[] =
         {"blockchain", "getblockcount", &getblockcount, true },
         {"blockchain", "getblock", &getblock, true },
         {"blockchain", "getblockhash", &getblockhash, true },
+        {"blockchain", "getblockfilter", &getblockfilter, true },
         {"blockchain", "getblockheader", &getblockheader, false },
         {"blockchain", "getchaintips", &getchaintips, true },
         {"blockchain", "getdifficulty", &getdifficulty, true },
@@ -319,6 +320,7 @@ static const CRPCCommand vRPCCommands[] =
         {"blockchain", "gettxoutsetinfo", &gettxoutsetinfo, true },
         {"blockchain", "invalidateblock", &invalidateblock, true },
         {"blockchain", "reconsiderblock", &reconsiderblock, true },
+        {"blockchain", "savemempool", &savemempool, true },
         {"blockchain", "verifychain", &verifychain, true },
         {"blockchain", "rewindblockindex", &rewindblockindex, true },
 
@@ -236,9 +236,11 @@ extern UniValue waitforblock(const JSONRPCRequest& request);
 extern UniValue waitforblockheight(const JSONRPCRequest& request);
 extern UniValue getdifficulty(const JSONRPCRequest& request);
 extern UniValue getmempoolinfo(const JSONRPCRequest& request);
+extern UniValue savemempool(const JSONRPCRequest& request);
 extern UniValue getrawmempool(const JSONRPCRequest& request);
 extern UniValue getblockhash(const JSONRPCRequest& request);
 extern UniValue getblock(const JSONRPCRequest& request);
+extern UniValue getblockfilter(const JSONRPCRequest& request);
 extern UniValue getblockheader(const JSONRPCRequest& request);
 extern UniValue getfeeinfo(const JSONRPCRequest& request);
 extern UniValue gettxoutsetinfo(const JSONRPCRequest& request);
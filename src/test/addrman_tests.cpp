@@ -711,4 +711,77 @@ BOOST_AUTO_TEST_CASE(addrman_evictionworks)
 }
 
 
+BOOST_AUTO_TEST_CASE(addrman_journal_replay)
+{
+    CAddrManTest addrman;
+    addrman.MakeDeterministic();
+    std::vector<CAddrManJournalEntry> vEntries;
+
+    CNetAddr source = ResolveIP("252.2.2.2");
+    CService addr1 = ResolveService("250.1.1.1", 8333);
+    CService addr2 = ResolveService("250.1.1.2", 8333);
+    CService addr3 = ResolveService("250.2.1.1", 8333);
+
+    // Nothing is recorded until journaling is switched on.
+    addrman.Add(CAddress(addr1, NODE_NONE), source);
+    BOOST_CHECK(addrman.TakeJournal(vEntries));
+    BOOST_CHECK(vEntries.empty());
+
+    // The journal applies on top of the tables as written to peers.dat.
+    CDataStream ssPeers(SER_DISK, CLIENT_VERSION);
+    ssPeers << addrman;
+    addrman.SetJournaling(true);
+
+    addrman.Add(CAddress(addr2, NODE_NONE), source);
+    addrman.Add(CAddress(addr3, NODE_NONE), source);
+    // Refreshing a known address changes its time and services only.
+    CAddress addr3Seen(addr3, NODE_NETWORK);
+    addr3Seen.nTime = GetAdjustedTime();
+    BOOST_CHECK(!addrman.Add(addr3Seen, source));
+    addrman.Good(addr2);
+    addrman.Attempt(addr3, true);
+
+    // Enough addresses from a few groups to overwrite new positions and to
+    // evict tried entries back to new. Half of them go to tried with a
+    // success long ago and a recent failure, so that the collisions of the
+    // later ones are resolved by swapping them out.
+    for (int i = 0; i < 2000; i++) {
+        CService addr = ResolveService(strprintf("251.%i.%i.%i", i % 4, i / 250, i % 250 + 1), 8333);
+        addrman.Add(CAddress(addr, NODE_NONE), ResolveIP(strprintf("253.%i.1.1", i % 8)));
+        if (i % 2 == 0) {
+            addrman.Good(addr, false, 1);
+            addrman.Attempt(addr, false, GetAdjustedTime() - 61);
+        } else if (i % 3 == 0) {
+            addrman.Good(addr);
+        }
+    }
+    // Moves made while resolving collisions are journaled like any other.
+    addrman.ResolveCollisions();
+    BOOST_CHECK(addrman.TakeJournal(vEntries));
+    BOOST_CHECK(!vEntries.empty());
+
+    // The journal is drained by TakeJournal.
+    std::vector<CAddrManJournalEntry> vEmpty;
+    BOOST_CHECK(addrman.TakeJournal(vEmpty));
+    BOOST_CHECK(vEmpty.empty());
+
+    // Entries survive serialization.
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << vEntries;
+    std::vector<CAddrManJournalEntry> vRead;
+    ss >> vRead;
+    BOOST_CHECK_EQUAL(vRead.size(), vEntries.size());
+
+    // Restoring them on top of peers.dat rebuilds the same tables.
+    CAddrManTest addrman2;
+    ssPeers >> addrman2;
+    addrman2.Replay(vRead);
+    BOOST_CHECK_EQUAL(addrman2.size(), addrman.size());
+    CDataStream ssExpected(SER_DISK, CLIENT_VERSION);
+    CDataStream ssReplayed(SER_DISK, CLIENT_VERSION);
+    ssExpected << addrman;
+    ssReplayed << addrman2;
+    BOOST_CHECK(ssExpected.str() == ssReplayed.str());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
@@ -0,0 +1,111 @@
+// Copyright (c) 2025 The Concordia Cash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+
+#include "streams.h"
+#include "test/test_pivx.h"
+#include "version.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilter_tests, BasicTestingSetup)
+
+static GCSFilter::Element RandomElement()
+{
+    uint256 hash = InsecureRand256();
+    return GCSFilter::Element(hash.begin(), hash.end());
+}
+
+BOOST_AUTO_TEST_CASE(gcsfilter_test)
+{
+    GCSFilter::ElementSet included, excluded;
+    for (int i = 0; i < 100; i++) {
+        included.insert(RandomElement());
+        excluded.insert(RandomElement());
+    }
+
+    const GCSFilter::Params params(0, 0, 10, 1 << 10);
+    GCSFilter filter(params, included);
+    BOOST_CHECK_EQUAL(filter.GetN(), 100U);
+    for (const GCSFilter::Element& element : included) {
+        BOOST_CHECK(filter.Match(element));
+
+        GCSFilter::ElementSet query(excluded);
+        query.insert(element);
+        BOOST_CHECK(filter.MatchAny(query));
+    }
+    BOOST_CHECK(!filter.MatchAny(GCSFilter::ElementSet()));
+
+    // Decoding gives the same set
+    GCSFilter decoded(params, filter.GetEncoded());
+    BOOST_CHECK_EQUAL(decoded.GetN(), 100U);
+    for (const GCSFilter::Element& element : included)
+        BOOST_CHECK(decoded.Match(element));
+
+    // An empty filter matches nothing
+    GCSFilter empty(params);
+    BOOST_CHECK_EQUAL(empty.GetN(), 0U);
+    BOOST_CHECK(!empty.MatchAny(included));
+}
+
+BOOST_AUTO_TEST_CASE(gcsfilter_malformed_test)
+{
+    const GCSFilter::Params params(0, 0, 10, 1 << 10);
+    GCSFilter::ElementSet elements;
+    for (int i = 0; i < 10; i++)
+        elements.insert(RandomElement());
+    std::vector<unsigned char> vEncoded = GCSFilter(params, elements).GetEncoded();
+    vEncoded.resize(vEncoded.size() / 2);
+    BOOST_CHECK_THROW(GCSFilter(params, vEncoded), std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_basic_test)
+{
+    const CScript included1 = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG;
+    const CScript included2 = CScript() << std::vector<unsigned char>(33, 2) << OP_CHECKSIG;
+    const CScript includedSpent = CScript() << OP_HASH160 << std::vector<unsigned char>(20, 3) << OP_EQUAL;
+    const CScript excludedReturn = CScript() << OP_RETURN << std::vector<unsigned char>(4, 4);
+    const CScript excluded = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 5) << OP_EQUALVERIFY << OP_CHECKSIG;
+
+    CMutableTransaction tx;
+    tx.vin.emplace_back(COutPoint(InsecureRand256(), 0));
+    tx.vout.emplace_back(100, included1);
+    tx.vout.emplace_back(200, included2);
+    tx.vout.emplace_back(0, excludedReturn);
+    tx.vout.emplace_back(0, CScript());
+    CBlock block;
+    block.vtx.emplace_back(tx);
+
+    CBlockUndo blockUndo;
+    blockUndo.vtxundo.emplace_back();
+    blockUndo.vtxundo.back().vprevout.emplace_back(CTxOut(500, includedSpent), 1000, false, false);
+    blockUndo.vtxundo.back().vprevout.emplace_back(CTxOut(600, CScript()), 1000, false, false);
+
+    BlockFilter blockFilter(BLOCK_FILTER_BASIC, block, blockUndo);
+    const GCSFilter& filter = blockFilter.GetFilter();
+    BOOST_CHECK_EQUAL(filter.GetN(), 3U);
+    BOOST_CHECK(filter.Match(GCSFilter::Element(included1.begin(), included1.end())));
+    BOOST_CHECK(filter.Match(GCSFilter::Element(included2.begin(), included2.end())));
+    BOOST_CHECK(filter.Match(GCSFilter::Element(includedSpent.begin(), includedSpent.end())));
+    BOOST_CHECK(!filter.Match(GCSFilter::Element(excludedReturn.begin(), excludedReturn.end())));
+    BOOST_CHECK(!filter.Match(GCSFilter::Element(excluded.begin(), excluded.end())));
+
+    // Serialization round trip, as stored in the index and sent in cfilter messages
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << blockFilter;
+    BlockFilter decoded;
+    ss >> decoded;
+    BOOST_CHECK_EQUAL(decoded.GetFilterType(), blockFilter.GetFilterType());
+    BOOST_CHECK(decoded.GetBlockHash() == blockFilter.GetBlockHash());
+    BOOST_CHECK(decoded.GetEncodedFilter() == blockFilter.GetEncodedFilter());
+    BOOST_CHECK(decoded.GetFilter().Match(GCSFilter::Element(included1.begin(), included1.end())));
+
+    // Headers chain: they commit to the previous header
+    const uint256 header = blockFilter.ComputeHeader(uint256());
+    BOOST_CHECK(decoded.ComputeHeader(uint256()) == header);
+    BOOST_CHECK(blockFilter.ComputeHeader(header) != header);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
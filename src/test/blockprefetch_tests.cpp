@@ -0,0 +1,95 @@
+// Copyright (c) 2025 The Concordia Cash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockprefetch.h"
+
+#include "test/test_pivx.h"
+
+#include <map>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockprefetch_tests, BasicTestingSetup)
+
+namespace {
+//! Coins view holding a few coins, readable from several threads
+class CCoinsViewMap : public CCoinsView
+{
+public:
+    std::map<COutPoint, Coin> mapCoins;
+
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const override
+    {
+        std::map<COutPoint, Coin>::const_iterator it = mapCoins.find(outpoint);
+        if (it == mapCoins.end())
+            return false;
+        coin = it->second;
+        return true;
+    }
+};
+} // namespace
+
+static void WaitForCoins(CBlockInputPrefetcher& prefetcher, size_t nCoins)
+{
+    for (int i = 0; i < 1000 && prefetcher.Size() < nCoins; i++)
+        MilliSleep(5);
+}
+
+BOOST_AUTO_TEST_CASE(prefetch_block_inputs)
+{
+    CCoinsViewMap base;
+    CCoinsViewCache tip(&base);
+    CBlockInputPrefetcher prefetcher;
+    boost::thread_group tg;
+    tg.create_thread([&] { prefetcher.Thread(); });
+    tg.create_thread([&] { prefetcher.Thread(); });
+
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.resize(1);
+    block.vtx.emplace_back(coinbase);
+    std::vector<COutPoint> vPrevouts;
+    for (int i = 0; i < 10; i++) {
+        COutPoint prevout(InsecureRand256(), 0);
+        base.mapCoins[prevout] = Coin(CTxOut(i + 1, CScript() << OP_TRUE), 1, false, false);
+        vPrevouts.push_back(prevout);
+    }
+    // The first coin is cached in the tip already, the last one is spent
+    tip.AccessCoin(vPrevouts[0]);
+    base.mapCoins.erase(vPrevouts[9]);
+    for (const COutPoint& prevout : vPrevouts) {
+        CMutableTransaction tx;
+        tx.vin.emplace_back(prevout);
+        tx.vout.emplace_back(1, CScript() << OP_TRUE);
+        block.vtx.emplace_back(tx);
+    }
+    // Spending an output of the block itself needs no prefetch either
+    CMutableTransaction child;
+    child.vin.emplace_back(block.vtx[1].GetHash(), 0);
+    child.vout.emplace_back(1, CScript() << OP_TRUE);
+    block.vtx.emplace_back(child);
+
+    prefetcher.Prefetch(block, tip);
+    WaitForCoins(prefetcher, 8);
+    BOOST_CHECK_EQUAL(prefetcher.Size(), 8U);
+
+    Coin coin;
+    BOOST_CHECK(!prefetcher.Take(vPrevouts[0], coin));
+    BOOST_CHECK(!prefetcher.Take(vPrevouts[9], coin));
+    BOOST_CHECK(prefetcher.Take(vPrevouts[5], coin));
+    BOOST_CHECK_EQUAL(coin.out.nValue, 6);
+    BOOST_CHECK(!prefetcher.Take(vPrevouts[5], coin));
+
+    // A flush of the tip makes everything that was read before useless
+    prefetcher.Invalidate();
+    BOOST_CHECK_EQUAL(prefetcher.Size(), 0U);
+    BOOST_CHECK(!prefetcher.Take(vPrevouts[1], coin));
+
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
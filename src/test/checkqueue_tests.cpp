@@ -0,0 +1,84 @@
+// Copyright (c) 2025 The Concordia Cash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+
+#include "test/test_pivx.h"
+
+#include <atomic>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(checkqueue_tests, BasicTestingSetup)
+
+static std::atomic<size_t> nChecksRun;
+
+struct CountingCheck {
+    bool fOk;
+    CountingCheck() : fOk(true) {}
+    bool operator()()
+    {
+        nChecksRun++;
+        return fOk;
+    }
+    void swap(CountingCheck& x) { std::swap(fOk, x.fOk); }
+};
+
+BOOST_AUTO_TEST_CASE(checkqueue_all_checks_run)
+{
+    for (int nWorkers : {0, 1, 3, 8}) {
+        CCheckQueue<CountingCheck> queue(16, 4);
+        boost::thread_group tg;
+        for (int i = 0; i < nWorkers; i++)
+            tg.create_thread([&] { queue.Thread(); });
+
+        for (size_t nRound = 0; nRound < 200; nRound++) {
+            nChecksRun = 0;
+            size_t nTotal = 0;
+            CCheckQueueControl<CountingCheck> control(&queue);
+            for (size_t nAdd = 0; nAdd < nRound % 17 + 1; nAdd++) {
+                std::vector<CountingCheck> vChecks((nRound * 31 + nAdd) % 40 + 1);
+                nTotal += vChecks.size();
+                control.Add(vChecks);
+            }
+            BOOST_CHECK(control.Wait());
+            BOOST_CHECK_EQUAL(nChecksRun, nTotal);
+            BOOST_CHECK(queue.IsIdle());
+        }
+        tg.interrupt_all();
+        tg.join_all();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_failure)
+{
+    CCheckQueue<CountingCheck> queue(16);
+    boost::thread_group tg;
+    for (int i = 0; i < 3; i++)
+        tg.create_thread([&] { queue.Thread(); });
+
+    for (size_t nFail : {0, 1, 99, 999}) {
+        CCheckQueueControl<CountingCheck> control(&queue);
+        for (size_t n = 0; n < 1000; n += 10) {
+            std::vector<CountingCheck> vChecks(10);
+            if (nFail >= n && nFail < n + 10)
+                vChecks[nFail - n].fOk = false;
+            control.Add(vChecks);
+        }
+        BOOST_CHECK(!control.Wait());
+    }
+
+    // A failure does not stick to the next round
+    {
+        CCheckQueueControl<CountingCheck> control(&queue);
+        std::vector<CountingCheck> vChecks(100);
+        control.Add(vChecks);
+        BOOST_CHECK(control.Wait());
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
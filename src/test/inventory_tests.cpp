@@ -0,0 +1,85 @@
+// Copyright (c) 2025 The Concordia Cash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+#include "net.h"
+#include "random.h"
+
+#include "test/test_pivx.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(inventory_tests, TestingSetup)
+
+static size_t QueuedInventory(CNode& node)
+{
+    LOCK(node.cs_inventory);
+    return node.vInventoryToSend.size();
+}
+
+static bool KnownInventory(CNode& node, const uint256& hash)
+{
+    LOCK(node.cs_inventory);
+    return node.filterInventoryKnown.contains(hash);
+}
+
+BOOST_AUTO_TEST_CASE(inventory_trickle_and_cap)
+{
+    std::atomic<bool> interruptDummy(false);
+
+    CAddress addr(CService("1.2.3.4", Params().GetDefaultPort()), NODE_NONE);
+    CNode node(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, "", true);
+    node.SetSendVersion(PROTOCOL_VERSION);
+    GetNodeSignals().InitializeNode(&node, *connman);
+    node.nVersion = 1;
+    node.fSuccessfullyConnected = true;
+    // No trickle until the test asks for one
+    node.nNextInvSend = GetTimeMicros() + 3600 * 1000000LL;
+
+    // Transactions are queued once per hash
+    std::vector<uint256> vTxHashes;
+    for (unsigned int i = 0; i < INVENTORY_BROADCAST_MAX + 10; i++) {
+        vTxHashes.push_back(GetRandHash());
+        node.PushInventory(CInv(MSG_TX, vTxHashes.back()));
+    }
+    node.PushInventory(CInv(MSG_TX, vTxHashes[0]));
+    BOOST_CHECK_EQUAL(QueuedInventory(node), INVENTORY_BROADCAST_MAX + 10);
+
+    // Masternode entries go out right away, transactions wait for the trickle
+    const uint256 hashMasternode = GetRandHash();
+    node.PushInventory(CInv(MSG_MASTERNODE_ANNOUNCE, hashMasternode));
+    SendMessages(&node, *connman, interruptDummy);
+    BOOST_CHECK(KnownInventory(node, hashMasternode));
+    BOOST_CHECK(!KnownInventory(node, vTxHashes[0]));
+    BOOST_CHECK_EQUAL(QueuedInventory(node), INVENTORY_BROADCAST_MAX + 10);
+
+    // and are sent again when asked for again, as by a repeated masternode list sync
+    node.PushInventory(CInv(MSG_MASTERNODE_ANNOUNCE, hashMasternode));
+    BOOST_CHECK_EQUAL(QueuedInventory(node), INVENTORY_BROADCAST_MAX + 11);
+    SendMessages(&node, *connman, interruptDummy);
+    BOOST_CHECK_EQUAL(QueuedInventory(node), INVENTORY_BROADCAST_MAX + 10);
+
+    // A trickle announces at most INVENTORY_BROADCAST_MAX transactions, in queue order
+    node.nNextInvSend = 0;
+    SendMessages(&node, *connman, interruptDummy);
+    BOOST_CHECK_EQUAL(QueuedInventory(node), 10U);
+    BOOST_CHECK(KnownInventory(node, vTxHashes[0]));
+    BOOST_CHECK(KnownInventory(node, vTxHashes[INVENTORY_BROADCAST_MAX - 1]));
+    BOOST_CHECK(!KnownInventory(node, vTxHashes[INVENTORY_BROADCAST_MAX]));
+
+    // Transactions the peer knows about are not queued again
+    node.PushInventory(CInv(MSG_TX, vTxHashes[0]));
+    BOOST_CHECK_EQUAL(QueuedInventory(node), 10U);
+
+    // The next trickle sends the rest
+    node.nNextInvSend = 0;
+    SendMessages(&node, *connman, interruptDummy);
+    BOOST_CHECK_EQUAL(QueuedInventory(node), 0U);
+    BOOST_CHECK(KnownInventory(node, vTxHashes.back()));
+
+    bool fUpdateConnectionTime = false;
+    GetNodeSignals().FinalizeNode(node.GetId(), fUpdateConnectionTime);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
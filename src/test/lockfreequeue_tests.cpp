@@ -0,0 +1,64 @@
+// Copyright (c) 2025 The Concordia Cash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "lockfreequeue.h"
+
+#include <memory>
+#include <thread>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(lockfreequeue_tests)
+
+BOOST_AUTO_TEST_CASE(spscqueue_basics)
+{
+    CSPSCQueue<std::unique_ptr<int>> queue;
+    std::unique_ptr<int> value;
+
+    BOOST_CHECK(queue.Empty());
+    BOOST_CHECK(!queue.Pop(value));
+
+    // FIFO order, interleaved with pops so nodes get recycled
+    for (int round = 0; round < 3; ++round) {
+        for (int i = 0; i < 10; ++i)
+            queue.Push(std::unique_ptr<int>(new int(i)));
+        BOOST_CHECK(!queue.Empty());
+        for (int i = 0; i < 10; ++i) {
+            BOOST_CHECK(queue.Pop(value));
+            BOOST_CHECK_EQUAL(*value, i);
+        }
+        BOOST_CHECK(queue.Empty());
+        BOOST_CHECK(!queue.Pop(value));
+    }
+
+    // Items left in the queue are released by its destructor
+    queue.Push(std::unique_ptr<int>(new int(42)));
+}
+
+BOOST_AUTO_TEST_CASE(spscqueue_threads)
+{
+    static const int COUNT = 200000;
+    CSPSCQueue<int> queue;
+
+    std::thread producer([&queue] {
+        for (int i = 1; i <= COUNT; ++i)
+            queue.Push(int(i));
+    });
+
+    int expected = 1;
+    int value = 0;
+    while (expected <= COUNT) {
+        if (!queue.Pop(value))
+            continue;
+        if (value != expected)
+            break;
+        ++expected;
+    }
+    producer.join();
+
+    BOOST_CHECK_EQUAL(expected, COUNT + 1);
+    BOOST_CHECK(queue.Empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
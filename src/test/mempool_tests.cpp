@@ -10,6 +10,7 @@
 #include "util.h"
 
 #include <boost/test/unit_test.hpp>
+#include <algorithm>
 #include <list>
 #include <vector>
 
@@ -320,6 +321,125 @@ BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
 }
 
 
+BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    entry.hadNoDependencies = true;
+
+    /* 3rd highest fee */
+    CMutableTransaction tx1 = CMutableTransaction();
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx1.GetHash(), entry.Fee(10000LL).Priority(10.0).FromTx(tx1));
+
+    /* highest fee */
+    CMutableTransaction tx2 = CMutableTransaction();
+    tx2.vout.resize(1);
+    tx2.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx2.vout[0].nValue = 2 * COIN;
+    pool.addUnchecked(tx2.GetHash(), entry.Fee(20000LL).Priority(9.0).FromTx(tx2));
+    uint64_t tx2Size = ::GetSerializeSize(tx2, SER_NETWORK, PROTOCOL_VERSION);
+
+    /* lowest fee */
+    CMutableTransaction tx3 = CMutableTransaction();
+    tx3.vout.resize(1);
+    tx3.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx3.vout[0].nValue = 5 * COIN;
+    pool.addUnchecked(tx3.GetHash(), entry.Fee(0LL).Priority(100.0).FromTx(tx3));
+
+    /* 2nd highest fee */
+    CMutableTransaction tx4 = CMutableTransaction();
+    tx4.vout.resize(1);
+    tx4.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx4.vout[0].nValue = 6 * COIN;
+    pool.addUnchecked(tx4.GetHash(), entry.Fee(15000LL).Priority(1.0).FromTx(tx4));
+
+    /* equal fee rate to tx1, but newer */
+    CMutableTransaction tx5 = CMutableTransaction();
+    tx5.vout.resize(1);
+    tx5.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx5.vout[0].nValue = 11 * COIN;
+    entry.nTime = 1;
+    entry.dPriority = 10.0;
+    pool.addUnchecked(tx5.GetHash(), entry.Fee(10000LL).FromTx(tx5));
+    BOOST_CHECK_EQUAL(pool.size(), 5);
+
+    std::vector<std::string> sortedOrder;
+    sortedOrder.resize(5);
+    sortedOrder[0] = tx2.GetHash().ToString(); // 20000
+    sortedOrder[1] = tx4.GetHash().ToString(); // 15000
+    // tx1 and tx5 are both 10000
+    // Ties are broken by hash, not timestamp, so determine which
+    // hash comes first.
+    if (tx1.GetHash() < tx5.GetHash()) {
+        sortedOrder[2] = tx1.GetHash().ToString();
+        sortedOrder[3] = tx5.GetHash().ToString();
+    } else {
+        sortedOrder[2] = tx5.GetHash().ToString();
+        sortedOrder[3] = tx1.GetHash().ToString();
+    }
+    sortedOrder[4] = tx3.GetHash().ToString(); // 0
+    CheckSort<4>(pool, sortedOrder);
+
+    /* low fee parent with high fee child */
+    /* tx6 (0) -> tx7 (high) */
+    CMutableTransaction tx6 = CMutableTransaction();
+    tx6.vout.resize(1);
+    tx6.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx6.vout[0].nValue = 20 * COIN;
+    uint64_t tx6Size = ::GetSerializeSize(tx6, SER_NETWORK, PROTOCOL_VERSION);
+    pool.addUnchecked(tx6.GetHash(), entry.Fee(0LL).FromTx(tx6));
+    BOOST_CHECK_EQUAL(pool.size(), 6);
+    // tx3 and tx6 both pay nothing
+    if (tx3.GetHash() < tx6.GetHash()) {
+        sortedOrder.push_back(tx6.GetHash().ToString());
+    } else {
+        sortedOrder.insert(sortedOrder.end() - 1, tx6.GetHash().ToString());
+    }
+    CheckSort<4>(pool, sortedOrder);
+
+    CMutableTransaction tx7 = CMutableTransaction();
+    tx7.vin.resize(1);
+    tx7.vin[0].prevout = COutPoint(tx6.GetHash(), 0);
+    tx7.vin[0].scriptSig = CScript() << OP_11;
+    tx7.vout.resize(1);
+    tx7.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx7.vout[0].nValue = 10 * COIN;
+    uint64_t tx7Size = ::GetSerializeSize(tx7, SER_NETWORK, PROTOCOL_VERSION);
+
+    /* set the fee to just below tx2's feerate when including ancestor */
+    CAmount fee = (20000 / tx2Size) * (tx7Size + tx6Size) - 1;
+    pool.addUnchecked(tx7.GetHash(), entry.Fee(fee).FromTx(tx7));
+    BOOST_CHECK_EQUAL(pool.size(), 7);
+    sortedOrder.insert(sortedOrder.begin() + 1, tx7.GetHash().ToString());
+    CheckSort<4>(pool, sortedOrder);
+
+    CTxMemPool::txiter it7 = pool.mapTx.find(tx7.GetHash());
+    BOOST_CHECK_EQUAL(it7->GetCountWithAncestors(), 2U);
+    BOOST_CHECK_EQUAL(it7->GetSizeWithAncestors(), tx6Size + tx7Size);
+    BOOST_CHECK_EQUAL(it7->GetModFeesWithAncestors(), fee);
+
+    /* after tx6 is mined, tx7 should move up in the sort */
+    std::vector<CTransaction> vtx;
+    vtx.push_back(tx6);
+    std::list<CTransaction> conflicts;
+    pool.removeForBlock(vtx, 1, conflicts);
+
+    sortedOrder.erase(sortedOrder.begin() + 1);
+    sortedOrder.erase(std::find(sortedOrder.begin(), sortedOrder.end(), tx6.GetHash().ToString()));
+    sortedOrder.insert(sortedOrder.begin(), tx7.GetHash().ToString());
+    CheckSort<4>(pool, sortedOrder);
+    BOOST_CHECK_EQUAL(it7->GetCountWithAncestors(), 1U);
+    BOOST_CHECK_EQUAL(it7->GetSizeWithAncestors(), tx7Size);
+
+    /* fee deltas are part of the ancestor score */
+    pool.PrioritiseTransaction(tx1.GetHash(), tx1.GetHash().ToString(), 0, 5000);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx1.GetHash())->GetModFeesWithAncestors(), 15000);
+}
+
+
 BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
 {
     CTxMemPool pool(CFeeRate(1000));
@@ -475,4 +595,58 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolSpentOutPointIndexTest)
+{
+    // Enough inputs for the index to grow a few times, and for erase to shift
+    // back entries that collided with each other
+    std::vector<CTransaction> vtx;
+    std::map<COutPoint, CInPoint> mapExpected;
+    for (int i = 0; i < 200; i++) {
+        CMutableTransaction tx;
+        for (uint32_t n = 0; n < 3; n++)
+            tx.vin.emplace_back(COutPoint(InsecureRand256(), InsecureRandRange(4)));
+        tx.vout.resize(1);
+        vtx.push_back(tx);
+    }
+    CSpentOutPointIndex index;
+    for (const CTransaction& tx : vtx) {
+        for (uint32_t n = 0; n < tx.vin.size(); n++) {
+            index.insert(CInPoint(&tx, n));
+            mapExpected[tx.vin[n].prevout] = CInPoint(&tx, n);
+        }
+    }
+    BOOST_CHECK_EQUAL(index.size(), mapExpected.size());
+
+    // Erase about half of them, in random order
+    for (const CTransaction& tx : vtx) {
+        for (const CTxIn& txin : tx.vin) {
+            if (InsecureRandBool()) {
+                BOOST_CHECK_EQUAL(index.erase(txin.prevout), 1U);
+                BOOST_CHECK_EQUAL(index.erase(txin.prevout), 0U);
+                mapExpected.erase(txin.prevout);
+            }
+        }
+    }
+    BOOST_CHECK_EQUAL(index.size(), mapExpected.size());
+    for (const CTransaction& tx : vtx) {
+        for (const CTxIn& txin : tx.vin) {
+            const CInPoint* pinpoint = index.find(txin.prevout);
+            std::map<COutPoint, CInPoint>::const_iterator it = mapExpected.find(txin.prevout);
+            BOOST_CHECK_EQUAL(pinpoint != NULL, it != mapExpected.end());
+            if (pinpoint && it != mapExpected.end())
+                BOOST_CHECK(pinpoint->ptx == it->second.ptx && pinpoint->n == it->second.n);
+        }
+    }
+    size_t nIterated = 0;
+    for (const CInPoint& inpoint : index) {
+        BOOST_CHECK(mapExpected.count(inpoint.ptx->vin[inpoint.n].prevout));
+        nIterated++;
+    }
+    BOOST_CHECK_EQUAL(nIterated, mapExpected.size());
+
+    index.clear();
+    BOOST_CHECK_EQUAL(index.size(), 0U);
+    BOOST_CHECK(!index.count(vtx[0].vin[0].prevout));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
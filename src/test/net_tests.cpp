@@ -9,6 +9,8 @@
 #include "hash.h"
 #include "net.h"
 #include "netbase.h"
+#include "netmessagemaker.h"
+#include "random.h"
 #include "serialize.h"
 #include "streams.h"
 
@@ -178,4 +180,27 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+BOOST_AUTO_TEST_CASE(shared_payload_relay)
+{
+    CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+    uint64_t nonce = GetRand(std::numeric_limits<uint64_t>::max());
+
+    // A shared payload serializes exactly like a regular message body
+    CSerializedNetMsg plain = msgMaker.Make(NetMsgType::PING, nonce);
+    CSharedNetPayloadRef payload = MakeSharedNetPayload(PROTOCOL_VERSION, nonce);
+    BOOST_CHECK(payload->data == plain.data);
+    BOOST_CHECK(payload->hash == Hash(plain.data.begin(), plain.data.end()));
+
+    CSerializedNetMsg shared = msgMaker.MakeShared(NetMsgType::PING, payload);
+    BOOST_CHECK(shared.data.empty());
+    BOOST_CHECK(shared.payload == payload);
+
+    // Relay memory hands out the very same buffer to every requester
+    CInv inv(MSG_TX, GetRandHash());
+    BOOST_CHECK(!FindRelayPayload(inv));
+    AddRelayPayload(inv, payload);
+    BOOST_CHECK(FindRelayPayload(inv) == payload);
+    BOOST_CHECK(!FindRelayPayload(CInv(MSG_TX, GetRandHash())));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
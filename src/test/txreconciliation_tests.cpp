@@ -0,0 +1,113 @@
+// Copyright (c) 2025 The Concordia Cash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txreconciliation.h"
+
+#include "random.h"
+#include "streams.h"
+#include "version.h"
+
+#include <algorithm>
+#include <set>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(txreconciliation_tests)
+
+BOOST_AUTO_TEST_CASE(sketch_decode_difference)
+{
+    FastRandomContext rand(true);
+    for (size_t nDiff : {0, 1, 2, 10, 100, 1000}) {
+        // Both sides share 500 elements, the difference is split between them
+        std::map<uint32_t, uint256> mapOurs, mapTheirs;
+        std::set<uint32_t> setExpected;
+        for (size_t i = 0; i < 500 + nDiff; i++) {
+            uint32_t id = rand.rand32();
+            if (id == 0 || mapOurs.count(id) || mapTheirs.count(id))
+                continue;
+            if (i < 500 || i % 2)
+                mapOurs.emplace(id, uint256());
+            if (i < 500 || !(i % 2))
+                mapTheirs.emplace(id, uint256());
+            if (i >= 500)
+                setExpected.insert(id);
+        }
+
+        size_t nCells = CReconSketch::CellsForDifference(setExpected.size());
+        CReconSketch theirs = CTxReconState::BuildSketch(mapTheirs, nCells);
+
+        // Ship it over the wire like the responder does
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << theirs;
+        BOOST_CHECK_EQUAL(ss.size(), GetSizeOfCompactSize(nCells) + 8 * nCells);
+        CReconSketch received;
+        ss >> received;
+        BOOST_CHECK(received.IsValid());
+
+        CReconSketch ours = CTxReconState::BuildSketch(mapOurs, received.Cells());
+        BOOST_CHECK(ours.Merge(received));
+        std::vector<uint32_t> vDiff;
+        BOOST_CHECK(ours.Decode(vDiff));
+        BOOST_CHECK(std::set<uint32_t>(vDiff.begin(), vDiff.end()) == setExpected);
+        BOOST_CHECK_EQUAL(vDiff.size(), setExpected.size());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sketch_size_estimate)
+{
+    // Always room for at least one difference, and enough for the size gap
+    BOOST_CHECK(CTxReconState::EstimateSketchCells(0, 0) >= CReconSketch::CellsForDifference(1));
+    BOOST_CHECK(CTxReconState::EstimateSketchCells(0, 100) >= CReconSketch::CellsForDifference(100));
+    BOOST_CHECK(CTxReconState::EstimateSketchCells(100, 0) >= CReconSketch::CellsForDifference(100));
+    BOOST_CHECK(CTxReconState::EstimateSketchCells(1000, 1000) >= CReconSketch::CellsForDifference(250));
+    BOOST_CHECK_EQUAL(CTxReconState::EstimateSketchCells(1000000, 0), MAX_SKETCH_CELLS);
+    for (size_t n : {0, 1, 2, 3, 50, 1000})
+        BOOST_CHECK_EQUAL(CReconSketch::CellsForDifference(n) % SKETCH_TABLES, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(sketch_decode_overflow)
+{
+    FastRandomContext rand(true);
+    // Far more differences than the sketch was sized for must be reported, not half-decoded
+    CReconSketch sketch(CReconSketch::CellsForDifference(1));
+    for (int i = 0; i < 200; i++)
+        sketch.Add(rand.rand32() | 1);
+    std::vector<uint32_t> vDiff;
+    BOOST_CHECK(!sketch.Decode(vDiff));
+
+    // Sketches of different sizes cannot be combined
+    CReconSketch other(CReconSketch::CellsForDifference(100));
+    BOOST_CHECK(!sketch.Merge(other));
+
+    // Malformed sizes are rejected
+    CReconSketch bad(10);
+    BOOST_CHECK(!bad.IsValid());
+    BOOST_CHECK(!bad.Decode(vDiff));
+}
+
+BOOST_AUTO_TEST_CASE(recon_state_salts)
+{
+    // Both ends of a link derive the same short ids
+    CTxReconState a(true, 0x1234, 0x5678);
+    CTxReconState b(false, 0x5678, 0x1234);
+    BOOST_CHECK_EQUAL(a.k0, b.k0);
+    BOOST_CHECK_EQUAL(a.k1, b.k1);
+
+    CTxReconState c(true, 0x1234, 0x5679);
+    BOOST_CHECK(a.k0 != c.k0 || a.k1 != c.k1);
+
+    FastRandomContext rand(true);
+    uint256 txid = rand.rand256();
+    BOOST_CHECK(a.AddTx(txid));
+    BOOST_CHECK(a.AddTx(txid));
+    BOOST_CHECK_EQUAL(a.mapLocalSet.size(), 1U);
+    BOOST_CHECK(a.mapLocalSet.count(ComputeReconShortId(b.k0, b.k1, txid)));
+
+    // A full set makes the caller fall back to flooding
+    while (a.mapLocalSet.size() < MAX_RECON_SET_SIZE)
+        a.AddTx(rand.rand256());
+    BOOST_CHECK(!a.AddTx(rand.rand256()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
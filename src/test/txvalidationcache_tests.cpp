@@ -0,0 +1,98 @@
+// Copyright (c) 2025 The Concordia Cash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "key.h"
+#include "keystore.h"
+#include "main.h"
+#include "policy/policy.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "test/test_pivx.h"
+#include "txmempool.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txvalidationcache_tests, TestingSetup)
+
+static CTransaction SpendCoin(const CKeyStore& keystore, const COutPoint& prevout, const CScript& script)
+{
+    CMutableTransaction tx;
+    tx.vin.emplace_back(prevout);
+    tx.vout.emplace_back(10 * COIN - COIN / 100, script);
+    BOOST_CHECK(SignSignature(keystore, script, tx, 0, 10 * COIN, SIGHASH_ALL));
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(script_execution_cache)
+{
+    LOCK(cs_main);
+    CKey key;
+    key.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+    const CScript script = GetScriptForDestination(key.GetPubKey().GetID());
+
+    CCoinsViewCache view(pcoinsTip);
+    COutPoint prevout(InsecureRand256(), 0);
+    view.AddCoin(prevout, Coin(CTxOut(10 * COIN, script), 1, false, false), false);
+    CTransaction tx = SpendCoin(keystore, prevout, script);
+    PrecomputedTransactionData txdata(tx);
+    CValidationState state;
+    std::vector<CScriptCheck> vChecks;
+
+    // Nothing cached yet, the script checks are handed to the caller
+    BOOST_CHECK(CheckInputs(tx, state, view, true, BLOCK_SCRIPT_VERIFY_FLAGS, false, false, txdata, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+    vChecks.clear();
+
+    // Queued checks are not cached, inline ones are
+    BOOST_CHECK(CheckInputs(tx, state, view, true, BLOCK_SCRIPT_VERIFY_FLAGS, true, true, txdata, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+    vChecks.clear();
+    BOOST_CHECK(CheckInputs(tx, state, view, true, BLOCK_SCRIPT_VERIFY_FLAGS, true, true, txdata));
+    BOOST_CHECK(CheckInputs(tx, state, view, true, BLOCK_SCRIPT_VERIFY_FLAGS, false, false, txdata, &vChecks));
+    BOOST_CHECK(vChecks.empty());
+
+    // The entry only covers the flags it was checked with
+    BOOST_CHECK(CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, false, false, txdata, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+    vChecks.clear();
+
+    // A failing transaction is never cached
+    CMutableTransaction badtx(tx);
+    badtx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 1) << ToByteVector(key.GetPubKey());
+    CTransaction bad(badtx);
+    PrecomputedTransactionData baddata(bad);
+    BOOST_CHECK(!CheckInputs(bad, state, view, true, BLOCK_SCRIPT_VERIFY_FLAGS, true, true, baddata));
+    BOOST_CHECK(CheckInputs(bad, state, view, true, BLOCK_SCRIPT_VERIFY_FLAGS, false, false, baddata, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+    vChecks.clear();
+}
+
+BOOST_AUTO_TEST_CASE(script_execution_cache_mempool)
+{
+    LOCK(cs_main);
+    CKey key;
+    key.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+    const CScript script = GetScriptForDestination(key.GetPubKey().GetID());
+
+    COutPoint prevout(InsecureRand256(), 0);
+    pcoinsTip->AddCoin(prevout, Coin(CTxOut(10 * COIN, script), 1, false, false), false);
+    CTransaction tx = SpendCoin(keystore, prevout, script);
+
+    // Mempool acceptance leaves the block flag result behind for ConnectBlock
+    CValidationState state;
+    BOOST_CHECK(AcceptToMemoryPool(mempool, state, tx, false, nullptr));
+    PrecomputedTransactionData txdata(tx);
+    std::vector<CScriptCheck> vChecks;
+    BOOST_CHECK(CheckInputs(tx, state, *pcoinsTip, true, BLOCK_SCRIPT_VERIFY_FLAGS, false, false, txdata, &vChecks));
+    BOOST_CHECK(vChecks.empty());
+
+    mempool.clear();
+    pcoinsTip->SpendCoin(prevout);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -26,6 +26,7 @@ static const char DB_BEST_BLOCK = 'B';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_BLOCK_FILTER = 'b';
 
 namespace {
 
@@ -403,3 +404,30 @@ bool CCoinsViewDB::Upgrade() {
     db.WriteBatch(batch);
     return true;
 }
+
+CBlockFilterDB::CBlockFilterDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "filter", nCacheSize, fMemory, fWipe)
+{
+}
+
+bool CBlockFilterDB::WriteFilter(const BlockFilter& filter, const uint256& header)
+{
+    return Write(std::make_pair(DB_BLOCK_FILTER, filter.GetBlockHash()), std::make_pair(header, filter));
+}
+
+bool CBlockFilterDB::ReadFilter(const uint256& hashBlock, BlockFilter& filter)
+{
+    std::pair<uint256, BlockFilter> value;
+    if (!Read(std::make_pair(DB_BLOCK_FILTER, hashBlock), value))
+        return false;
+    filter = std::move(value.second);
+    return true;
+}
+
+bool CBlockFilterDB::ReadFilterHeader(const uint256& hashBlock, uint256& header)
+{
+    std::pair<uint256, BlockFilter> value;
+    if (!Read(std::make_pair(DB_BLOCK_FILTER, hashBlock), value))
+        return false;
+    header = value.first;
+    return true;
+}
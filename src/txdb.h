@@ -9,6 +9,7 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "blockfilter.h"
 #include "coins.h"
 #include "chain.h"
 #include "dbwrapper.h"
@@ -133,4 +134,20 @@ public:
     bool LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex);
 };
 
+/** Access to the block filter index (blocks/filter/) */
+class CBlockFilterDB : public CDBWrapper
+{
+public:
+    CBlockFilterDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+private:
+    CBlockFilterDB(const CBlockFilterDB&);
+    void operator=(const CBlockFilterDB&);
+
+public:
+    bool WriteFilter(const BlockFilter& filter, const uint256& header);
+    bool ReadFilter(const uint256& hashBlock, BlockFilter& filter);
+    bool ReadFilterHeader(const uint256& hashBlock, uint256& header);
+};
+
 #endif // BITCOIN_TXDB_H
@@ -9,11 +9,14 @@
 #ifndef BITCOIN_TXMEMPOOL_H
 #define BITCOIN_TXMEMPOOL_H
 
+#include <iterator>
 #include <list>
 #include <set>
+#include <vector>
 
 #include "amount.h"
 #include "coins.h"
+#include "prevector.h"
 #include "primitives/transaction.h"
 #include "sync.h"
 #include "random.h"
@@ -71,10 +74,21 @@ class CTxMemPool;
  * nTxFee. (This can potentially happen during a reorg, where we limit the
  * amount of work we're willing to do to avoid consuming too much CPU.)
  *
+ * Likewise every entry tracks its in-mempool ancestors (nCountWithAncestors,
+ * nSizeWithAncestors, nModFeesWithAncestors and nSigOpCountWithAncestors),
+ * which the block assembler uses to select packages by ancestor feerate.
+ * The ancestor state is never left dirty.
+ *
  */
 class CTxMemPoolEntry
 {
+public:
+    //! Direct in-mempool parents or children of an entry
+    typedef prevector<2, const CTxMemPoolEntry*> Links;
+
 private:
+    friend class CTxMemPool;
+
     CTransaction tx;
     CAmount nFee;         //! Cached to avoid expensive parent-transaction lookups
     size_t nTxSize;       //! ... and avoid recomputing tx size
@@ -99,6 +113,16 @@ private:
     uint64_t nSizeWithDescendants;  //! ... and size
     CAmount nFeesWithDescendants;  //! ... and total fees (all including us)
 
+    // Analogous statistics for ancestor transactions
+    uint64_t nCountWithAncestors;
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+    unsigned int nSigOpCountWithAncestors;
+
+    // In-mempool direct parents and children, maintained by CTxMemPool
+    mutable Links parents;
+    mutable Links children;
+
 public:
     CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
             int64_t _nTime, double _entryPriority, unsigned int _entryHeight,
@@ -123,6 +147,8 @@ public:
 
     // Adjusts the descendant state, if this entry is not dirty.
     void UpdateState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount);
+    // Adjusts the ancestor state
+    void UpdateAncestorState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount, int modifySigOps);
     // Updates the fee delta used for mining priority score
     void UpdateFeeDelta(int64_t feeDelta);
 
@@ -137,6 +163,11 @@ public:
     uint64_t GetSizeWithDescendants() const { return nSizeWithDescendants; }
     CAmount GetFeesWithDescendants() const { return nFeesWithDescendants; }
 
+    uint64_t GetCountWithAncestors() const { return nCountWithAncestors; }
+    uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
+    CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
+    unsigned int GetSigOpCountWithAncestors() const { return nSigOpCountWithAncestors; }
+
     bool GetSpendsCoinbaseOrCoinstake() const { return spendsCoinbaseOrCoinstake; }
 };
 
@@ -156,6 +187,22 @@ struct update_descendant_state
         int64_t modifyCount;
 };
 
+struct update_ancestor_state
+{
+    update_ancestor_state(int64_t _modifySize, CAmount _modifyFee, int64_t _modifyCount, int _modifySigOps) :
+        modifySize(_modifySize), modifyFee(_modifyFee), modifyCount(_modifyCount), modifySigOps(_modifySigOps)
+    {}
+
+    void operator() (CTxMemPoolEntry &e)
+        { e.UpdateAncestorState(modifySize, modifyFee, modifyCount, modifySigOps); }
+
+    private:
+        int64_t modifySize;
+        CAmount modifyFee;
+        int64_t modifyCount;
+        int modifySigOps;
+};
+
 struct set_dirty
 {
     void operator() (CTxMemPoolEntry &e)
@@ -237,6 +284,33 @@ public:
     }
 };
 
+/** \class CompareTxMemPoolEntryByAncestorFee
+ *
+ *  Sort an entry by its feerate with all in-mempool ancestors (modified by any
+ *  fee deltas), highest first, so a parent is ranked by what its best child pays.
+ */
+class CompareTxMemPoolEntryByAncestorFee
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        double aFees = a.GetModFeesWithAncestors();
+        double aSize = a.GetSizeWithAncestors();
+
+        double bFees = b.GetModFeesWithAncestors();
+        double bSize = b.GetSizeWithAncestors();
+
+        // Avoid division by rewriting (a/b > c/d) as (a*d > c*b).
+        double f1 = aFees * bSize;
+        double f2 = aSize * bFees;
+
+        if (f1 == f2) {
+            return a.GetTx().GetHash() < b.GetTx().GetHash();
+        }
+        return f1 > f2;
+    }
+};
+
 class CompareTxMemPoolEntryByEntryTime
 {
 public:
@@ -271,6 +345,67 @@ public:
     size_t DynamicMemoryUsage() const { return 0; }
 };
 
+/**
+ * Index of the mempool inputs by the outpoint they spend.
+ *
+ * An open addressing hash table with linear probing. A slot holds a salted
+ * 64-bit hash of the outpoint next to the CInPoint; the outpoint itself is
+ * read back from the spending input, so an indexed transaction must stay
+ * alive until its inputs are erased.
+ */
+class CSpentOutPointIndex
+{
+private:
+    struct Slot {
+        uint64_t nKey;
+        CInPoint inpoint; //! Null for an empty slot
+    };
+
+    const uint64_t k0, k1;
+    std::vector<Slot> vSlots;
+    size_t nSize;
+
+    static const size_t NOT_FOUND = (size_t)-1;
+    static const size_t MIN_CAPACITY = 16;
+
+    uint64_t Key(const COutPoint& outpoint) const { return SipHashUint256Extra(k0, k1, outpoint.hash, outpoint.n); }
+    static const COutPoint& OutPoint(const Slot& slot) { return slot.inpoint.ptx->vin[slot.inpoint.n].prevout; }
+    size_t Find(const COutPoint& outpoint) const;
+    void Place(uint64_t nKey, const CInPoint& inpoint);
+    void Resize(size_t nCapacity);
+
+public:
+    class const_iterator
+    {
+    private:
+        const Slot* p;
+        const Slot* pend;
+        void SkipEmpty() { while (p != pend && p->inpoint.ptx == NULL) ++p; }
+
+    public:
+        const_iterator(const Slot* pIn, const Slot* pendIn) : p(pIn), pend(pendIn) { SkipEmpty(); }
+        const CInPoint& operator*() const { return p->inpoint; }
+        const CInPoint* operator->() const { return &p->inpoint; }
+        const_iterator& operator++() { ++p; SkipEmpty(); return *this; }
+        bool operator==(const const_iterator& other) const { return p == other.p; }
+        bool operator!=(const const_iterator& other) const { return p != other.p; }
+    };
+
+    CSpentOutPointIndex();
+
+    /** Return the input spending outpoint, or NULL if it is unspent */
+    const CInPoint* find(const COutPoint& outpoint) const;
+    size_t count(const COutPoint& outpoint) const { return Find(outpoint) != NOT_FOUND; }
+    /** Index inpoint under the outpoint it spends, replacing a previous spender */
+    void insert(const CInPoint& inpoint);
+    size_t erase(const COutPoint& outpoint);
+    void clear();
+    size_t size() const { return nSize; }
+    const_iterator begin() const { return const_iterator(vSlots.data(), vSlots.data() + vSlots.size()); }
+    const_iterator end() const { return const_iterator(vSlots.data() + vSlots.size(), vSlots.data() + vSlots.size()); }
+    size_t DynamicMemoryUsage() const;
+};
+
 /**
  * CTxMemPool stores valid-according-to-the-current-best-chain
  * transactions that may be included in the next block.
@@ -283,11 +418,12 @@ public:
  *
  * CTxMemPool::mapTx, and CTxMemPoolEntry bookkeeping:
  *
- * mapTx is a boost::multi_index that sorts the mempool on 4 criteria:
+ * mapTx is a boost::multi_index that sorts the mempool on 5 criteria:
  * - transaction hash
  * - feerate [we use max(feerate of tx, feerate of tx with all descendants)]
  * - time in mempool
  * - mining score (feerate modified by any fee deltas from PrioritiseTransaction)
+ * - ancestor score (modified feerate of tx with all its in-mempool ancestors)
 
  *
  * Note: the term "descendant" refers to in-mempool transactions that depend on
@@ -296,20 +432,24 @@ public:
  *
  * In order for the feerate sort to remain correct, we must update transactions
  * in the mempool when new descendants arrive.  To facilitate this, we track
- * the set of in-mempool direct parents and direct children in mapLinks.  Within
- * each CTxMemPoolEntry, we track the size and fees of all descendants.
+ * the in-mempool direct parents and direct children of every entry.  Within
+ * each CTxMemPoolEntry, we track the size and fees of all descendants, and of
+ * all ancestors.
  *
  * Usually when a new transaction is added to the mempool, it has no in-mempool
  * children (because any such children would be an orphan).  So in
  * addUnchecked(), we:
- * - update a new entry's setMemPoolParents to include all in-mempool parents
+ * - update a new entry's parents to include all in-mempool parents
  * - update the new entry's direct parents to include the new tx as a child
  * - update all ancestors of the transaction to include the new tx's size/fee
+ * - update the new entry's ancestor state to include all of its ancestors
  *
  * When a transaction is removed from the mempool, we must:
- * - update all in-mempool parents to not track the tx in setMemPoolChildren
+ * - update all in-mempool parents to not track the tx in their children
  * - update all ancestors to not include the tx's size/fees in descendant state
  * - update all in-mempool children to not include it as a parent
+ * - update all descendants staying in the mempool to not include the tx's
+ *   size/fees in ancestor state
  *
  * These happen in UpdateForRemoveFromMempool().  (Note that when removing a
  * transaction along with its descendants, we must calculate that set of
@@ -329,7 +469,7 @@ public:
  * state, to account for in-mempool, out-of-block descendants for all the
  * in-block transactions by calling UpdateTransactionsFromBlock().  Note that
  * until this is called, the mempool state is not consistent, and in particular
- * mapLinks may not be correct (and therefore functions like
+ * the parent and child links may not be correct (and therefore functions like
  * CalculateMemPoolAncestors() and CalculateDescendants() that rely
  * on them to walk the mempool are not generally safe to use).
  *
@@ -391,6 +531,11 @@ public:
             boost::multi_index::ordered_unique<
                     boost::multi_index::identity<CTxMemPoolEntry>,
                     CompareTxMemPoolEntryByScore
+            >,
+            // sorted by fee rate with ancestors (for package selection)
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByAncestorFee
             >
         >
     > indexed_transaction_set;
@@ -425,6 +570,7 @@ public:
     mutable RecursiveMutex cs;
     indexed_transaction_set mapTx;
     typedef indexed_transaction_set::nth_index<0>::type::iterator txiter;
+    typedef indexed_transaction_set::nth_index<4>::type::iterator ancestorscoreiter;
     struct CompareIteratorByHash {
         bool operator()(const txiter &a, const txiter &b) const {
             return a->GetTx().GetHash() < b->GetTx().GetHash();
@@ -432,24 +578,51 @@ public:
     };
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
 
-    const setEntries & GetMemPoolParents(txiter entry) const;
-    const setEntries & GetMemPoolChildren(txiter entry) const;
-private:
-    typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
-
-    struct TxLinks {
-        setEntries parents;
-        setEntries children;
+    /** The direct parents or children of an entry, iterated as txiters */
+    class LinkRange
+    {
+    private:
+        const CTxMemPoolEntry::Links& links;
+        const indexed_transaction_set& set;
+
+    public:
+        class const_iterator
+        {
+        private:
+            CTxMemPoolEntry::Links::const_iterator it;
+            const indexed_transaction_set* pset;
+
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef txiter value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const txiter* pointer;
+            typedef txiter reference;
+
+            const_iterator(CTxMemPoolEntry::Links::const_iterator itIn, const indexed_transaction_set* psetIn) : it(itIn), pset(psetIn) {}
+            txiter operator*() const { return pset->iterator_to(**it); }
+            const_iterator& operator++() { ++it; return *this; }
+            bool operator==(const const_iterator& other) const { return it == other.it; }
+            bool operator!=(const const_iterator& other) const { return it != other.it; }
+        };
+
+        LinkRange(const CTxMemPoolEntry::Links& linksIn, const indexed_transaction_set& setIn) : links(linksIn), set(setIn) {}
+        const_iterator begin() const { return const_iterator(links.begin(), &set); }
+        const_iterator end() const { return const_iterator(links.end(), &set); }
+        size_t size() const { return links.size(); }
+        bool empty() const { return links.empty(); }
     };
 
-    typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
-    txlinksMap mapLinks;
+    LinkRange GetMemPoolParents(txiter entry) const;
+    LinkRange GetMemPoolChildren(txiter entry) const;
+private:
+    typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
 
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
 public:
-    std::map<COutPoint, CInPoint> mapNextTx;
+    CSpentOutPointIndex mapNextTx;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
 
     /** Create a new CTxMemPool.
@@ -499,8 +672,9 @@ public:
 
     /** Remove a set of transactions from the mempool.
      *  If a transaction is in this set, then all in-mempool descendants must
-     *  also be in the set.*/
-    void RemoveStaged(setEntries &stage);
+     *  also be in the set, unless updateDescendants is true, in which case
+     *  the ancestor state of the descendants left behind is updated. */
+    void RemoveStaged(setEntries &stage, bool updateDescendants = false);
 
     /** When adding transactions from a disconnected block back to the mempool,
      *  new mempool entries may have children in the mempool (which is generally
@@ -521,9 +695,14 @@ public:
      *  limitDescendantSize = max size of descendants any ancestor can have
      *  errString = populated with error reason if any limits are hit
      *  fSearchForParents = whether to search a tx's vin for in-mempool parents, or
-     *    look up parents from mapLinks. Must be true for entries not in the mempool
+     *    look up parents from the entry links. Must be true for entries not in the mempool
      */
-    bool CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents = true);
+    bool CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents = true) const;
+
+    /** Populate setDescendants with all in-mempool descendants of hash.
+     *  Assumes that setDescendants includes all in-mempool descendants of anything
+     *  already in it.  */
+    void CalculateDescendants(txiter it, setEntries &setDescendants) const;
 
     /** The minimum fee to get into the mempool, which may itself not be enough
      *  for larger-sized transactions.
@@ -615,14 +794,13 @@ private:
             const std::set<uint256> &setExclude);
     /** Update ancestors of hash to add/remove it as a descendant transaction. */
     void UpdateAncestorsOf(bool add, txiter hash, setEntries &setAncestors);
-    /** For each transaction being removed, update ancestors and any direct children. */
-    void UpdateForRemoveFromMempool(const setEntries &entriesToRemove);
+    /** Set ancestor state for an entry */
+    void UpdateEntryForAncestors(txiter it, const setEntries &setAncestors);
+    /** For each transaction being removed, update ancestors and any direct children.
+     *  If updateDescendants is true, also update in-mempool descendants' ancestor state. */
+    void UpdateForRemoveFromMempool(const setEntries &entriesToRemove, bool updateDescendants);
     /** Sever link between specified transaction and direct children. */
     void UpdateChildrenForRemoval(txiter entry);
-    /** Populate setDescendants with all in-mempool descendants of hash.
-     *  Assumes that setDescendants includes all in-mempool descendants of anything
-     *  already in it.  */
-    void CalculateDescendants(txiter it, setEntries &setDescendants);
 
     /** Before calling removeUnchecked for a given transaction,
      *  UpdateForRemoveFromMempool must be called on the entire (dependent) set
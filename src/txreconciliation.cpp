@@ -0,0 +1,158 @@
+// Copyright (c) 2025 The Concordia Cash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txreconciliation.h"
+
+#include "hash.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+//! Finalizer of MurmurHash3, used to spread short ids over the cells
+inline uint32_t Mix32(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+inline uint32_t CheckSum(uint32_t id)
+{
+    return Mix32(id ^ 0x9e3779b9);
+}
+
+const uint32_t TABLE_SEEDS[SKETCH_TABLES] = {0x1b873593, 0xcc9e2d51, 0xe6546b64, 0x27d4eb2f};
+
+} // namespace
+
+uint32_t ComputeReconShortId(uint64_t k0, uint64_t k1, const uint256& txid)
+{
+    return (uint32_t)SipHashUint256(k0, k1, txid);
+}
+
+CReconSketch::CReconSketch(size_t nCells) : vCells(nCells)
+{
+}
+
+size_t CReconSketch::CellsForDifference(size_t nDiff)
+{
+    // With four sub-tables this decodes better than 99% of the time across
+    // all difference sizes; small ones need the constant slack.
+    size_t nCells = nDiff + nDiff / 2 + 16;
+    nCells += (SKETCH_TABLES - nCells % SKETCH_TABLES) % SKETCH_TABLES;
+    return std::min(nCells, MAX_SKETCH_CELLS);
+}
+
+size_t CReconSketch::CellIndex(uint32_t id, unsigned int nTable) const
+{
+    const size_t nTableSize = vCells.size() / SKETCH_TABLES;
+    return nTable * nTableSize + Mix32(id ^ TABLE_SEEDS[nTable]) % nTableSize;
+}
+
+void CReconSketch::Toggle(uint32_t id)
+{
+    if (vCells.empty())
+        return;
+    const uint32_t nCheck = CheckSum(id);
+    for (unsigned int i = 0; i < SKETCH_TABLES; i++) {
+        Cell& cell = vCells[CellIndex(id, i)];
+        cell.keySum ^= id;
+        cell.checkSum ^= nCheck;
+    }
+}
+
+bool CReconSketch::Merge(const CReconSketch& other)
+{
+    if (other.vCells.size() != vCells.size())
+        return false;
+    for (size_t i = 0; i < vCells.size(); i++) {
+        vCells[i].keySum ^= other.vCells[i].keySum;
+        vCells[i].checkSum ^= other.vCells[i].checkSum;
+    }
+    return true;
+}
+
+bool CReconSketch::Decode(std::vector<uint32_t>& vElements) const
+{
+    vElements.clear();
+    if (!IsValid())
+        return false;
+
+    CReconSketch work(*this);
+    auto fPure = [&work](size_t i) {
+        const Cell& cell = work.vCells[i];
+        return cell.keySum != 0 && cell.checkSum == CheckSum(cell.keySum);
+    };
+
+    std::vector<size_t> vPure;
+    for (size_t i = 0; i < work.vCells.size(); i++) {
+        if (fPure(i))
+            vPure.push_back(i);
+    }
+    while (!vPure.empty()) {
+        size_t i = vPure.back();
+        vPure.pop_back();
+        if (!fPure(i))
+            continue;
+        // A table this size cannot hold more elements than it has cells;
+        // running past that means a checksum collision faked a pure cell.
+        if (vElements.size() >= work.vCells.size())
+            return false;
+        const uint32_t id = work.vCells[i].keySum;
+        vElements.push_back(id);
+        work.Toggle(id);
+        for (unsigned int t = 0; t < SKETCH_TABLES; t++) {
+            size_t j = work.CellIndex(id, t);
+            if (fPure(j))
+                vPure.push_back(j);
+        }
+    }
+
+    for (const Cell& cell : work.vCells) {
+        if (cell.keySum != 0 || cell.checkSum != 0)
+            return false;
+    }
+    return true;
+}
+
+CTxReconState::CTxReconState(bool fInitiatorIn, uint64_t nLocalSalt, uint64_t nRemoteSalt) : fInitiator(fInitiatorIn),
+                                                                                                 nRequestSent(0),
+                                                                                                 nNextRequest(0)
+{
+    // Both sides derive the same key by ordering the salts.
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << std::string("Tx Relay Salting") << std::min(nLocalSalt, nRemoteSalt) << std::max(nLocalSalt, nRemoteSalt);
+    uint256 h = ss.GetHash();
+    k0 = h.GetUint64(0);
+    k1 = h.GetUint64(1);
+}
+
+bool CTxReconState::AddTx(const uint256& txid)
+{
+    if (mapLocalSet.size() >= MAX_RECON_SET_SIZE)
+        return false;
+    // On a short id collision the second transaction is flooded instead.
+    auto it = mapLocalSet.emplace(ComputeReconShortId(k0, k1, txid), txid).first;
+    return it->second == txid;
+}
+
+size_t CTxReconState::EstimateSketchCells(size_t nLocalSize, size_t nRemoteSize)
+{
+    const size_t nDiff = std::max(nLocalSize, nRemoteSize) - std::min(nLocalSize, nRemoteSize);
+    const size_t nEstimate = nDiff + (size_t)std::ceil(RECON_Q * std::min(nLocalSize, nRemoteSize)) + 1;
+    return CReconSketch::CellsForDifference(nEstimate);
+}
+
+CReconSketch CTxReconState::BuildSketch(const std::map<uint32_t, uint256>& mapSet, size_t nCells)
+{
+    CReconSketch sketch(nCells);
+    for (const auto& it : mapSet)
+        sketch.Add(it.first);
+    return sketch;
+}
@@ -0,0 +1,124 @@
+// Copyright (c) 2025 The Concordia Cash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXRECONCILIATION_H
+#define BITCOIN_TXRECONCILIATION_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+/** Default for -txreconciliation */
+static const bool DEFAULT_TXRECONCILIATION_ENABLE = false;
+/** Version of the reconciliation protocol announced in sendrecon */
+static const uint32_t TXRECONCILIATION_VERSION = 1;
+/** Number of outbound reconciling peers a transaction is still flooded to */
+static const int OUTBOUND_FANOUT_DESTINATIONS = 2;
+/** Average delay between reconciliation requests to one outbound peer, in seconds */
+static const int RECON_REQUEST_INTERVAL = 4;
+/** Give up on an outstanding reconciliation request after this many seconds */
+static const int RECON_RESPONSE_TIMEOUT = 60;
+/** Maximum number of transactions waiting to be reconciled with a single peer; beyond it we flood */
+static const size_t MAX_RECON_SET_SIZE = 3000;
+/** Number of sub-tables, and so of cells, every element of a sketch is stored in */
+static const unsigned int SKETCH_TABLES = 4;
+/** Maximum number of cells we are willing to build or accept in a sketch */
+static const size_t MAX_SKETCH_CELLS = SKETCH_TABLES * MAX_RECON_SET_SIZE;
+/** Expected fraction of the smaller set that is missing on the other side (q in the Erlay paper) */
+static const double RECON_Q = 0.25;
+
+/** Short transaction id used in reconciliation: 32-bit SipHash of the txid under the link key. */
+uint32_t ComputeReconShortId(uint64_t k0, uint64_t k1, const uint256& txid);
+
+/**
+ * Set sketch used for reconciliation.
+ *
+ * This is an invertible Bloom lookup table over 32-bit short ids rather than
+ * the BCH based sketches of minisketch: every id is XORed into one cell of each
+ * of SKETCH_TABLES equally sized sub-tables. XORing two sketches of the same size
+ * leaves a sketch of the symmetric difference of both sets, which can be
+ * decoded by repeatedly peeling cells that hold exactly one id.
+ */
+class CReconSketch
+{
+public:
+    struct Cell {
+        uint32_t keySum;
+        uint32_t checkSum;
+
+        Cell() : keySum(0), checkSum(0) {}
+
+        ADD_SERIALIZE_METHODS;
+
+        template <typename Stream, typename Operation>
+        inline void SerializationOp(Stream& s, Operation ser_action)
+        {
+            READWRITE(keySum);
+            READWRITE(checkSum);
+        }
+    };
+
+private:
+    std::vector<Cell> vCells;
+
+    size_t CellIndex(uint32_t id, unsigned int nTable) const;
+    void Toggle(uint32_t id);
+
+public:
+    CReconSketch() {}
+    explicit CReconSketch(size_t nCells);
+
+    /** Number of cells needed to decode a difference of about nDiff elements. */
+    static size_t CellsForDifference(size_t nDiff);
+
+    size_t Cells() const { return vCells.size(); }
+    bool IsValid() const { return vCells.size() % SKETCH_TABLES == 0 && vCells.size() <= MAX_SKETCH_CELLS; }
+
+    void Add(uint32_t id) { Toggle(id); }
+    /** Turn this into a sketch of the symmetric difference with other (same size required). */
+    bool Merge(const CReconSketch& other);
+    /** Recover the elements of a (merged) sketch. Returns false if it could not be fully decoded. */
+    bool Decode(std::vector<uint32_t>& vElements) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(vCells);
+    }
+};
+
+/** Per-peer reconciliation state, owned by CNode and guarded by its cs_inventory. */
+class CTxReconState
+{
+public:
+    //! We send reqrecon to this peer (outbound connections), otherwise we answer with sketches
+    const bool fInitiator;
+    //! SipHash key for short ids, derived from both salts
+    uint64_t k0, k1;
+    //! Transactions we would have announced to this peer, by short id
+    std::map<uint32_t, uint256> mapLocalSet;
+    //! Responder: the set a sketch was sent for, until the matching reconcildiff arrives
+    std::map<uint32_t, uint256> mapSnapshot;
+    //! Initiator: time (usec) a reqrecon was sent for which no sketch arrived yet, or 0
+    int64_t nRequestSent;
+    //! Initiator: when to send the next reqrecon
+    int64_t nNextRequest;
+
+    CTxReconState(bool fInitiatorIn, uint64_t nLocalSalt, uint64_t nRemoteSalt);
+
+    /** Queue a transaction for the next reconciliation. Returns false if it has to be flooded instead. */
+    bool AddTx(const uint256& txid);
+
+    /** Number of sketch cells to use when our set of nLocalSize is reconciled against one of nRemoteSize. */
+    static size_t EstimateSketchCells(size_t nLocalSize, size_t nRemoteSize);
+    /** Build a sketch of nCells over the given set. */
+    static CReconSketch BuildSketch(const std::map<uint32_t, uint256>& mapSet, size_t nCells);
+};
+
+#endif // BITCOIN_TXRECONCILIATION_H
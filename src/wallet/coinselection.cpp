@@ -0,0 +1,95 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Copyright (c) 2025 The Concordia Cash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/coinselection.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <limits>
+
+/** Index of the first coin from nStart on, by descending effective value, worth at most nValue */
+static size_t FirstCoinAtMost(const std::vector<CInputCoin>& vCoins, size_t nStart, const CAmount& nValue)
+{
+    return std::lower_bound(vCoins.begin() + nStart, vCoins.end(), nValue, [](const CInputCoin& coin, const CAmount& n) {
+        return coin.nEffectiveValue > n;
+    }) - vCoins.begin();
+}
+
+bool SelectCoinsBnB(const std::vector<CInputCoin>& vCoins, const CAmount& nTarget, const CAmount& nCostOfChange, std::vector<size_t>& vSelectedRet, CAmount& nValueRet)
+{
+    vSelectedRet.clear();
+    nValueRet = 0;
+
+    // Effective value of the coins from each index on
+    std::vector<CAmount> vAvailable(vCoins.size() + 1, 0);
+    for (size_t i = vCoins.size(); i > 0; i--) {
+        assert(vCoins[i - 1].nEffectiveValue > 0);
+        vAvailable[i - 1] = vAvailable[i] + vCoins[i - 1].nEffectiveValue;
+    }
+    if (vAvailable[0] < nTarget)
+        return false;
+
+    // The coins before nNext are decided on, the ones in vIncluded are in
+    std::vector<size_t> vIncluded;
+    std::vector<size_t> vBest;
+    size_t nNext = 0;
+    CAmount nSelected = 0;
+    CAmount nBestExcess = std::numeric_limits<CAmount>::max();
+    bool fFound = false;
+
+    for (size_t nTries = 0; nTries < BNB_TOTAL_TRIES; nTries++) {
+        bool fBacktrack = false;
+        if (nSelected + vAvailable[nNext] < nTarget) {
+            // The target can't be reached anymore
+            fBacktrack = true;
+        } else if (nSelected >= nTarget) {
+            // Any further coin would only add to the excess
+            if (nSelected - nTarget < nBestExcess) {
+                nBestExcess = nSelected - nTarget;
+                vBest = vIncluded;
+                fFound = true;
+                if (nBestExcess == 0)
+                    break;
+            }
+            fBacktrack = true;
+        } else {
+            // Skip the coins that overshoot the window on their own, the ones
+            // short of the target that leave no room for the smallest coin, and
+            // the ones equal to a coin just excluded, whose branch was explored
+            const CAmount nRoom = nTarget + nCostOfChange - nSelected;
+            nNext = FirstCoinAtMost(vCoins, nNext, nRoom);
+            if (nNext < vCoins.size() && vCoins[nNext].nEffectiveValue < nTarget - nSelected &&
+                    vCoins[nNext].nEffectiveValue > nRoom - vCoins.back().nEffectiveValue)
+                nNext = FirstCoinAtMost(vCoins, nNext, nRoom - vCoins.back().nEffectiveValue);
+            if (nNext > 0 && (vIncluded.empty() || vIncluded.back() != nNext - 1)) {
+                while (nNext < vCoins.size() && vCoins[nNext].nEffectiveValue == vCoins[nNext - 1].nEffectiveValue)
+                    nNext++;
+            }
+            if (nNext == vCoins.size() || nSelected + vAvailable[nNext] < nTarget) {
+                fBacktrack = true;
+            } else {
+                vIncluded.push_back(nNext);
+                nSelected += vCoins[nNext].nEffectiveValue;
+                nNext++;
+            }
+        }
+
+        if (fBacktrack) {
+            if (vIncluded.empty())
+                break; // Every branch was explored
+            // Exclude the last coin included, and go on with the ones after it
+            nNext = vIncluded.back() + 1;
+            nSelected -= vCoins[vIncluded.back()].nEffectiveValue;
+            vIncluded.pop_back();
+        }
+    }
+
+    if (!fFound)
+        return false;
+    vSelectedRet = vBest;
+    for (size_t i : vSelectedRet)
+        nValueRet += vCoins[i].nValue;
+    return true;
+}
@@ -0,0 +1,43 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Copyright (c) 2025 The Concordia Cash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_COINSELECTION_H
+#define BITCOIN_WALLET_COINSELECTION_H
+
+#include "amount.h"
+
+#include <vector>
+
+class CWalletTx;
+
+/** Serialized size of a signed pay-to-pubkey-hash input with a compressed key */
+static const unsigned int COIN_SELECTION_INPUT_SIZE = 148;
+/** Serialized size of a pay-to-pubkey-hash change output */
+static const unsigned int COIN_SELECTION_CHANGE_SIZE = 34;
+/** Steps of the branch and bound search before it gives up */
+static const size_t BNB_TOTAL_TRIES = 100000;
+
+/** A wallet output that coin selection may spend */
+struct CInputCoin {
+    const CWalletTx* tx;
+    unsigned int i;
+    CAmount nValue;
+    //! The value less the fee for spending it, at the fee rate of the selection
+    CAmount nEffectiveValue;
+    int nDepth;
+    bool fFromMe;
+};
+
+/**
+ * Depth first search for coins whose effective values add up to between
+ * nTarget and nTarget + nCostOfChange, which pays the target without a change
+ * output. vCoins must be sorted by descending effective value, all positive.
+ * The solution with the least excess is returned in vSelectedRet, as indexes
+ * into vCoins, and its value in nValueRet. Returns false if none was found
+ * within BNB_TOTAL_TRIES steps.
+ */
+bool SelectCoinsBnB(const std::vector<CInputCoin>& vCoins, const CAmount& nTarget, const CAmount& nCostOfChange, std::vector<size_t>& vSelectedRet, CAmount& nValueRet);
+
+#endif // BITCOIN_WALLET_COINSELECTION_H
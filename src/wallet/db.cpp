@@ -146,11 +146,28 @@ void CDBEnv::MakeMock()
     fMockDb = true;
 }
 
+bool CDBEnv::IsSQLite(const std::string& strFile, bool fCreate)
+{
+    const bool fSQLiteBackend = GetArg("-walletbackend", DEFAULT_WALLET_BACKEND) == "sqlite";
+    if (fMockDb)
+        return fSQLiteBackend;
+    const fs::path pathFile = fs::path(strPath) / strFile;
+    if (fs::exists(pathFile))
+        return CSQLiteDB::IsSQLiteFile(pathFile);
+    return fCreate && fSQLiteBackend;
+}
+
 CDBEnv::VerifyResult CDBEnv::Verify(std::string strFile, bool (*recoverFunc)(CDBEnv& dbenv, std::string strFile))
 {
     LOCK(cs_db);
     assert(mapFileUseCount.count(strFile) == 0);
 
+    if (IsSQLite(strFile)) {
+        // There is no salvage for SQLite files, a failed check is final
+        CSQLiteDB db((fs::path(strPath) / strFile).string());
+        return db.Open() && db.Verify() ? VERIFY_OK : RECOVER_FAIL;
+    }
+
     Db db(dbenv, 0);
     int result = db.verify(strFile.c_str(), NULL, NULL, 0);
     if (result == 0)
@@ -216,13 +233,63 @@ bool CDBEnv::Salvage(std::string strFile, bool fAggressive, std::vector<CDBEnv::
 void CDBEnv::CheckpointLSN(const std::string& strFile)
 {
     dbenv->txn_checkpoint(0, 0, 0);
-    if (fMockDb)
+    if (fMockDb || IsSQLite(strFile))
         return;
     dbenv->lsn_reset(strFile.c_str(), 0);
 }
 
 
-CDB::CDB(const std::string& strFilename, const char* pszMode, bool fFlushOnCloseIn) : pdb(NULL), activeTxn(NULL)
+namespace {
+/** Cursor on a Berkeley database */
+class CBerkeleyCursor : public CDBCursor
+{
+private:
+    Dbc* pcursor;
+
+public:
+    explicit CBerkeleyCursor(Dbc* pcursorIn) : pcursor(pcursorIn) {}
+    ~CBerkeleyCursor() { pcursor->close(); }
+
+    int Read(CDataStream& ssKey, CDataStream& ssValue, unsigned int fFlags) override
+    {
+        // Read at cursor
+        Dbt datKey;
+        if (fFlags == DB_SET || fFlags == DB_SET_RANGE || fFlags == DB_GET_BOTH || fFlags == DB_GET_BOTH_RANGE) {
+            datKey.set_data(&ssKey[0]);
+            datKey.set_size(ssKey.size());
+        }
+        Dbt datValue;
+        if (fFlags == DB_GET_BOTH || fFlags == DB_GET_BOTH_RANGE) {
+            datValue.set_data(&ssValue[0]);
+            datValue.set_size(ssValue.size());
+        }
+        datKey.set_flags(DB_DBT_MALLOC);
+        datValue.set_flags(DB_DBT_MALLOC);
+        int ret = pcursor->get(&datKey, &datValue, fFlags);
+        if (ret != 0)
+            return ret;
+        else if (datKey.get_data() == NULL || datValue.get_data() == NULL)
+            return 99999;
+
+        // Convert to streams
+        ssKey.SetType(SER_DISK);
+        ssKey.clear();
+        ssKey.write((char*)datKey.get_data(), datKey.get_size());
+        ssValue.SetType(SER_DISK);
+        ssValue.clear();
+        ssValue.write((char*)datValue.get_data(), datValue.get_size());
+
+        // Clear and free memory
+        memory_cleanse(datKey.get_data(), datKey.get_size());
+        memory_cleanse(datValue.get_data(), datValue.get_size());
+        free(datKey.get_data());
+        free(datValue.get_data());
+        return 0;
+    }
+};
+} // namespace
+
+CDB::CDB(const std::string& strFilename, const char* pszMode, bool fFlushOnCloseIn) : pdb(NULL), psqlite(NULL), activeTxn(NULL), fSQLiteTxn(false)
 {
     int ret;
     fReadOnly = (!strchr(pszMode, '+') && !strchr(pszMode, 'w'));
@@ -242,6 +309,30 @@ CDB::CDB(const std::string& strFilename, const char* pszMode, bool fFlushOnClose
 
         strFile = strFilename;
         ++bitdb.mapFileUseCount[strFile];
+        if (bitdb.IsSQLite(strFile, fCreate)) {
+            psqlite = bitdb.mapSQLiteDb[strFile];
+            if (psqlite == NULL) {
+                psqlite = new CSQLiteDB(bitdb.IsMock() ? ":memory:" : (GetDataDir() / strFile).string());
+                if (!psqlite->Open()) {
+                    delete psqlite;
+                    psqlite = NULL;
+                    --bitdb.mapFileUseCount[strFile];
+                    std::string tempCopy(strFile);
+                    strFile = "";
+                    throw std::runtime_error(strprintf("CDB : Can't open SQLite database %s", tempCopy));
+                }
+
+                if (fCreate && !Exists(std::string("version"))) {
+                    bool fTmp = fReadOnly;
+                    fReadOnly = false;
+                    WriteVersion(CLIENT_VERSION);
+                    fReadOnly = fTmp;
+                }
+
+                bitdb.mapSQLiteDb[strFile] = psqlite;
+            }
+            return;
+        }
         pdb = bitdb.mapDb[strFile];
         if (pdb == NULL) {
             pdb = new Db(bitdb.dbenv, 0);
@@ -284,7 +375,8 @@ CDB::CDB(const std::string& strFilename, const char* pszMode, bool fFlushOnClose
 
 void CDB::Flush()
 {
-    if (activeTxn)
+    // SQLite checkpoints its write-ahead log by itself
+    if (activeTxn || psqlite)
         return;
 
     // Flush database activity from memory pool to disk log
@@ -297,15 +389,19 @@ void CDB::Flush()
 
 void CDB::Close()
 {
-    if (!pdb)
+    if (!pdb && !psqlite)
         return;
     if (activeTxn)
         activeTxn->abort();
+    if (fSQLiteTxn)
+        psqlite->TxnAbort();
     activeTxn = NULL;
+    fSQLiteTxn = false;
     pdb = NULL;
 
     if (fFlushOnClose)
         Flush();
+    psqlite = NULL;
 
     {
         LOCK(bitdb.cs_db);
@@ -324,9 +420,26 @@ void CDBEnv::CloseDb(const std::string& strFile)
             delete pdb;
             mapDb[strFile] = NULL;
         }
+        if (mapSQLiteDb[strFile] != NULL) {
+            delete mapSQLiteDb[strFile];
+            mapSQLiteDb[strFile] = NULL;
+        }
     }
 }
 
+CDBCursor* CDB::GetCursor()
+{
+    if (psqlite)
+        return psqlite->GetCursor();
+    if (!pdb)
+        return NULL;
+    Dbc* pcursor = NULL;
+    int ret = pdb->cursor(NULL, &pcursor, 0);
+    if (ret != 0)
+        return NULL;
+    return new CBerkeleyCursor(pcursor);
+}
+
 bool CDBEnv::RemoveDb(const std::string& strFile)
 {
     this->CloseDb(strFile);
@@ -337,6 +450,16 @@ bool CDBEnv::RemoveDb(const std::string& strFile)
 }
 
 bool CDB::Rewrite(const std::string& strFile, const char* pszSkip)
+{
+    return RewriteAs(strFile, pszSkip, bitdb.IsSQLite(strFile), "");
+}
+
+bool CDB::MigrateToSQLite(const std::string& strFile, const std::string& strBackup)
+{
+    return RewriteAs(strFile, NULL, true, strBackup);
+}
+
+bool CDB::RewriteAs(const std::string& strFile, const char* pszSkip, bool fSQLite, const std::string& strBackup)
 {
     while (true) {
         {
@@ -347,25 +470,38 @@ bool CDB::Rewrite(const std::string& strFile, const char* pszSkip)
                 bitdb.CheckpointLSN(strFile);
                 bitdb.mapFileUseCount.erase(strFile);
 
+                const bool fSourceSQLite = bitdb.IsSQLite(strFile);
                 bool fSuccess = true;
-                LogPrintf("CDB::Rewrite : Rewriting %s...\n", strFile);
+                LogPrintf("CDB::Rewrite : Rewriting %s%s...\n", strFile, fSQLite && !fSourceSQLite ? " to SQLite" : "");
                 std::string strFileRes = strFile + ".rewrite";
                 { // surround usage of db with extra {}
                     CDB db(strFile.c_str(), "r");
-                    Db* pdbCopy = new Db(bitdb.dbenv, 0);
-
-                    int ret = pdbCopy->open(NULL, // Txn pointer
-                        strFileRes.c_str(),       // Filename
-                        "main",                   // Logical db name
-                        DB_BTREE,                 // Database type
-                        DB_CREATE,                // Flags
-                        0);
-                    if (ret > 0) {
-                        LogPrintf("CDB::Rewrite : Can't create database file %s\n", strFileRes);
-                        fSuccess = false;
+                    Db* pdbCopy = NULL;
+                    CSQLiteDB* psqliteCopy = NULL;
+                    if (fSQLite) {
+                        // Don't append to the leftovers of an earlier attempt
+                        boost::system::error_code ec;
+                        fs::remove(GetDataDir() / strFileRes, ec);
+                        psqliteCopy = new CSQLiteDB((GetDataDir() / strFileRes).string());
+                        if (!psqliteCopy->Open() || !psqliteCopy->TxnBegin()) {
+                            LogPrintf("CDB::Rewrite : Can't create database file %s\n", strFileRes);
+                            fSuccess = false;
+                        }
+                    } else {
+                        pdbCopy = new Db(bitdb.dbenv, 0);
+                        int ret = pdbCopy->open(NULL, // Txn pointer
+                            strFileRes.c_str(),       // Filename
+                            "main",                   // Logical db name
+                            DB_BTREE,                 // Database type
+                            DB_CREATE,                // Flags
+                            0);
+                        if (ret > 0) {
+                            LogPrintf("CDB::Rewrite : Can't create database file %s\n", strFileRes);
+                            fSuccess = false;
+                        }
                     }
 
-                    Dbc* pcursor = db.GetCursor();
+                    CDBCursor* pcursor = db.GetCursor();
                     if (pcursor)
                         while (fSuccess) {
                             CDataStream ssKey(SER_DISK, CLIENT_VERSION);
@@ -387,6 +523,11 @@ bool CDB::Rewrite(const std::string& strFile, const char* pszSkip)
                                 ssValue.clear();
                                 ssValue << CLIENT_VERSION;
                             }
+                            if (psqliteCopy) {
+                                if (!psqliteCopy->Write(ssKey, ssValue, false))
+                                    fSuccess = false;
+                                continue;
+                            }
                             Dbt datKey(&ssKey[0], ssKey.size());
                             Dbt datValue(&ssValue[0], ssValue.size());
                             int ret2 = pdbCopy->put(NULL, &datKey, &datValue, DB_NOOVERWRITE);
@@ -396,18 +537,47 @@ bool CDB::Rewrite(const std::string& strFile, const char* pszSkip)
                     if (fSuccess) {
                         db.Close();
                         bitdb.CloseDb(strFile);
-                        if (pdbCopy->close(0))
+                        if (psqliteCopy && !psqliteCopy->TxnCommit())
+                            fSuccess = false;
+                        if (pdbCopy && pdbCopy->close(0))
                             fSuccess = false;
                         delete pdbCopy;
                     }
+                    // Closing the SQLite copy folds its write-ahead log into the file
+                    delete psqliteCopy;
                 }
                 if (fSuccess) {
-                    Db dbA(bitdb.dbenv, 0);
-                    if (dbA.remove(strFile.c_str(), NULL, 0))
-                        fSuccess = false;
-                    Db dbB(bitdb.dbenv, 0);
-                    if (dbB.rename(strFileRes.c_str(), NULL, strFile.c_str(), 0))
+                    if (fSourceSQLite) {
+                        try {
+                            if (strBackup.empty())
+                                fs::remove(GetDataDir() / strFile);
+                            else
+                                fs::rename(GetDataDir() / strFile, GetDataDir() / strBackup);
+                        } catch (const fs::filesystem_error& e) {
+                            LogPrintf("CDB::Rewrite : %s\n", e.what());
+                            fSuccess = false;
+                        }
+                    } else if (strBackup.empty()) {
+                        Db dbA(bitdb.dbenv, 0);
+                        if (dbA.remove(strFile.c_str(), NULL, 0))
+                            fSuccess = false;
+                    } else if (bitdb.dbenv->dbrename(NULL, strFile.c_str(), NULL, strBackup.c_str(), DB_AUTO_COMMIT)) {
                         fSuccess = false;
+                    }
+                }
+                if (fSuccess) {
+                    if (fSQLite) {
+                        try {
+                            fs::rename(GetDataDir() / strFileRes, GetDataDir() / strFile);
+                        } catch (const fs::filesystem_error& e) {
+                            LogPrintf("CDB::Rewrite : %s\n", e.what());
+                            fSuccess = false;
+                        }
+                    } else {
+                        Db dbB(bitdb.dbenv, 0);
+                        if (dbB.rename(strFileRes.c_str(), NULL, strFile.c_str(), 0))
+                            fSuccess = false;
+                    }
                 }
                 if (!fSuccess)
                     LogPrintf("CDB::Rewrite : Failed to rewrite database file %s\n", strFileRes);
@@ -440,7 +610,7 @@ void CDBEnv::Flush(bool fShutdown)
                 LogPrint(BCLog::DB, "CDBEnv::Flush: %s checkpoint\n", strFile);
                 dbenv->txn_checkpoint(0, 0, 0);
                 LogPrint(BCLog::DB, "CDBEnv::Flush: %s detach\n", strFile);
-                if (!fMockDb)
+                if (!fMockDb && !IsSQLite(strFile))
                     dbenv->lsn_reset(strFile.c_str(), 0);
                 LogPrint(BCLog::DB, "CDBEnv::Flush: %s closed\n", strFile);
                 mapFileUseCount.erase(mi++);
@@ -15,6 +15,7 @@
 #include "streams.h"
 #include "sync.h"
 #include "version.h"
+#include "wallet/sqlitedb.h"
 
 #include <map>
 #include <string>
@@ -30,6 +31,20 @@ struct CBlockLocator;
 static const unsigned int DEFAULT_WALLET_DBLOGSIZE = 100;
 static const bool DEFAULT_WALLET_PRIVDB = true;
 
+/** Cursor over the records of a wallet database, in key order */
+class CDBCursor
+{
+public:
+    virtual ~CDBCursor() {}
+    /**
+     * Read the next record (DB_NEXT), or the first one whose key is not below
+     * ssKey (DB_SET_RANGE). Returns 0, DB_NOTFOUND at the end, or an error.
+     */
+    virtual int Read(CDataStream& ssKey, CDataStream& ssValue, unsigned int fFlags) = 0;
+    /** Release the cursor, like Dbc::close */
+    void close() { delete this; }
+};
+
 class CDBEnv
 {
 private:
@@ -46,6 +61,7 @@ public:
     DbEnv *dbenv;
     std::map<std::string, int> mapFileUseCount;
     std::map<std::string, Db*> mapDb;
+    std::map<std::string, CSQLiteDB*> mapSQLiteDb;
 
     CDBEnv();
     ~CDBEnv();
@@ -54,6 +70,9 @@ public:
     void MakeMock();
     bool IsMock() { return fMockDb; }
 
+    /** Whether strFile is a SQLite file, or is to be created as one (see -walletbackend) */
+    bool IsSQLite(const std::string& strFile, bool fCreate = false);
+
     /**
      * Verify that database file strFile is OK. If it is not,
      * call the callback to try to recover.
@@ -95,13 +114,15 @@ public:
 extern CDBEnv bitdb;
 
 
-/** RAII class that provides access to a Berkeley database */
+/** RAII class that provides access to a Berkeley database, or to a SQLite one */
 class CDB
 {
 protected:
     Db* pdb;
+    CSQLiteDB* psqlite;
     std::string strFile;
     DbTxn* activeTxn;
+    bool fSQLiteTxn;
     bool fReadOnly;
     bool fFlushOnClose;
 
@@ -116,17 +137,31 @@ private:
     CDB(const CDB&);
     void operator=(const CDB&);
 
+    static bool RewriteAs(const std::string& strFile, const char* pszSkip, bool fSQLite, const std::string& strBackup);
+
 protected:
     template <typename K, typename T>
     bool Read(const K& key, T& value)
     {
-        if (!pdb)
+        if (!pdb && !psqlite)
             return false;
 
         // Key
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+
+        if (psqlite) {
+            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+            if (!psqlite->Read(ssKey, ssValue))
+                return false;
+            try {
+                ssValue >> value;
+            } catch (const std::exception&) {
+                return false;
+            }
+            return true;
+        }
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Read
@@ -155,7 +190,7 @@ protected:
     template <typename K, typename T>
     bool Write(const K& key, const T& value, bool fOverwrite = true)
     {
-        if (!pdb)
+        if (!pdb && !psqlite)
             return false;
         if (fReadOnly)
             assert(!"Write called on database in read-only mode");
@@ -164,12 +199,15 @@ protected:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
-        Dbt datKey(&ssKey[0], ssKey.size());
 
         // Value
         CDataStream ssValue(SER_DISK, CLIENT_VERSION);
         ssValue.reserve(10000);
         ssValue << value;
+
+        if (psqlite)
+            return psqlite->Write(ssKey, ssValue, fOverwrite);
+        Dbt datKey(&ssKey[0], ssKey.size());
         Dbt datValue(&ssValue[0], ssValue.size());
 
         // Write
@@ -184,7 +222,7 @@ protected:
     template <typename K>
     bool Erase(const K& key)
     {
-        if (!pdb)
+        if (!pdb && !psqlite)
             return false;
         if (fReadOnly)
             assert(!"Erase called on database in read-only mode");
@@ -193,6 +231,8 @@ protected:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+        if (psqlite)
+            return psqlite->Erase(ssKey);
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Erase
@@ -206,13 +246,15 @@ protected:
     template <typename K>
     bool Exists(const K& key)
     {
-        if (!pdb)
+        if (!pdb && !psqlite)
             return false;
 
         // Key
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+        if (psqlite)
+            return psqlite->Exists(ssKey);
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Exists
@@ -223,57 +265,22 @@ protected:
         return (ret == 0);
     }
 
-    Dbc* GetCursor()
-    {
-        if (!pdb)
-            return NULL;
-        Dbc* pcursor = NULL;
-        int ret = pdb->cursor(NULL, &pcursor, 0);
-        if (ret != 0)
-            return NULL;
-        return pcursor;
-    }
+    CDBCursor* GetCursor();
 
-    int ReadAtCursor(Dbc* pcursor, CDataStream& ssKey, CDataStream& ssValue, unsigned int fFlags = DB_NEXT)
+    int ReadAtCursor(CDBCursor* pcursor, CDataStream& ssKey, CDataStream& ssValue, unsigned int fFlags = DB_NEXT)
     {
-        // Read at cursor
-        Dbt datKey;
-        if (fFlags == DB_SET || fFlags == DB_SET_RANGE || fFlags == DB_GET_BOTH || fFlags == DB_GET_BOTH_RANGE) {
-            datKey.set_data(&ssKey[0]);
-            datKey.set_size(ssKey.size());
-        }
-        Dbt datValue;
-        if (fFlags == DB_GET_BOTH || fFlags == DB_GET_BOTH_RANGE) {
-            datValue.set_data(&ssValue[0]);
-            datValue.set_size(ssValue.size());
-        }
-        datKey.set_flags(DB_DBT_MALLOC);
-        datValue.set_flags(DB_DBT_MALLOC);
-        int ret = pcursor->get(&datKey, &datValue, fFlags);
-        if (ret != 0)
-            return ret;
-        else if (datKey.get_data() == NULL || datValue.get_data() == NULL)
-            return 99999;
-
-        // Convert to streams
-        ssKey.SetType(SER_DISK);
-        ssKey.clear();
-        ssKey.write((char*)datKey.get_data(), datKey.get_size());
-        ssValue.SetType(SER_DISK);
-        ssValue.clear();
-        ssValue.write((char*)datValue.get_data(), datValue.get_size());
-
-        // Clear and free memory
-        memory_cleanse(datKey.get_data(), datKey.get_size());
-        memory_cleanse(datValue.get_data(), datValue.get_size());
-        free(datKey.get_data());
-        free(datValue.get_data());
-        return 0;
+        return pcursor->Read(ssKey, ssValue, fFlags);
     }
 
 public:
     bool TxnBegin()
     {
+        if (psqlite) {
+            if (fSQLiteTxn || !psqlite->TxnBegin())
+                return false;
+            fSQLiteTxn = true;
+            return true;
+        }
         if (!pdb || activeTxn)
             return false;
         DbTxn* ptxn = bitdb.TxnBegin();
@@ -285,6 +292,12 @@ public:
 
     bool TxnCommit()
     {
+        if (psqlite) {
+            if (!fSQLiteTxn)
+                return false;
+            fSQLiteTxn = false;
+            return psqlite->TxnCommit();
+        }
         if (!pdb || !activeTxn)
             return false;
         int ret = activeTxn->commit(0);
@@ -294,6 +307,12 @@ public:
 
     bool TxnAbort()
     {
+        if (psqlite) {
+            if (!fSQLiteTxn)
+                return false;
+            fSQLiteTxn = false;
+            return psqlite->TxnAbort();
+        }
         if (!pdb || !activeTxn)
             return false;
         int ret = activeTxn->abort();
@@ -313,6 +332,8 @@ public:
     }
 
     bool static Rewrite(const std::string& strFile, const char* pszSkip = NULL);
+    /** Copy a Berkeley DB wallet file into a SQLite one, the old file is renamed to strBackup */
+    bool static MigrateToSQLite(const std::string& strFile, const std::string& strBackup);
 };
 
 #endif // BITCOIN_DB_H
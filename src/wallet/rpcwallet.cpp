@@ -891,6 +891,7 @@ UniValue getreceivedbyaddress(const JSONRPCRequest& request)
         throw std::runtime_error(
             "getreceivedbyaddress \"CNCDaddress\" ( minconf )\n"
             "\nReturns the total amount received by the given CNCDaddress in transactions with at least minconf confirmations.\n"
+            "Transactions moved to the wallet archive (see -walletarchive) are not counted.\n"
 
             "\nArguments:\n"
             "1. \"CNCDaddress\"  (string, required) The CNCD address for transactions.\n"
@@ -954,6 +955,7 @@ UniValue getreceivedbylabel(const JSONRPCRequest& request)
         throw std::runtime_error(
             "getreceivedbylabel \"label\" ( minconf )\n"
             "\nReturns the total amount received by addresses with <label> in transactions with at least [minconf] confirmations.\n"
+            "Transactions moved to the wallet archive (see -walletarchive) are not counted.\n"
 
             "\nArguments:\n"
             "1. \"label\"      (string, required) The selected label, may be the default label using \"\".\n"
@@ -1435,10 +1437,19 @@ UniValue ListReceived(const UniValue& params, bool by_label)
         has_filtered_address = true;
     }
 
-    // Tally
+    // Tally, over the txs paying to the address when filtering
+    std::vector<const CWalletTx*> vTxs;
+    if (has_filtered_address) {
+        vTxs = pwalletMain->GetTransactionsTo(filtered_address);
+    } else {
+        vTxs.reserve(pwalletMain->mapWallet.size());
+        for (const auto& entry : pwalletMain->mapWallet)
+            vTxs.push_back(&entry.second);
+    }
+
     std::map<CTxDestination, tallyitem> mapTally;
-    for (auto it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it) {
-        const CWalletTx& wtx = (*it).second;
+    for (const CWalletTx* pwtx : vTxs) {
+        const CWalletTx& wtx = *pwtx;
 
         if (wtx.IsCoinBase() || !IsFinalTx(wtx))
             continue;
@@ -1558,6 +1569,7 @@ UniValue listreceivedbyaddress(const JSONRPCRequest& request)
         throw std::runtime_error(
             "listreceivedbyaddress ( minconf includeempty includeWatchonly addressFilter)\n"
             "\nList balances by receiving address.\n"
+            "Transactions moved to the wallet archive (see -walletarchive) are not counted.\n"
 
             "\nArguments:\n"
             "1. minconf       (numeric, optional, default=1) The minimum number of confirmations before payments are included.\n"
@@ -1603,6 +1615,7 @@ UniValue listreceivedbylabel(const JSONRPCRequest& request)
         throw std::runtime_error(
             "listreceivedbylabel ( minconf includeempty includeWatchonly)\n"
             "\nList received transactions by label.\n"
+            "Transactions moved to the wallet archive (see -walletarchive) are not counted.\n"
 
             "\nArguments:\n"
             "1. minconf      (numeric, optional, default=1) The minimum number of confirmations before payments are included.\n"
@@ -1859,44 +1872,66 @@ UniValue listtransactions(const JSONRPCRequest& request)
     if (nFrom < 0)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative from");
 
-    UniValue ret(UniValue::VARR);
+    // Entries newest to oldest, only the ones in [nFrom, nFrom + nCount) are kept
+    std::vector<UniValue> vEntries;
+    int nSkipped = 0;
+    UniValue entries(UniValue::VARR);
+    auto keepEntries = [&]() {
+        for (const UniValue& entry : entries.getValues()) {
+            if (nSkipped < nFrom)
+                nSkipped++;
+            else if ((int)vEntries.size() < nCount)
+                vEntries.push_back(entry);
+        }
+        entries.clear();
+        entries.setArray();
+        return (int)vEntries.size() >= nCount;
+    };
 
     const CWallet::TxItems & txOrdered = pwalletMain->wtxOrdered;
+    // The archived transactions, merged with the ones in memory by nOrderPos
+    const std::vector<std::pair<int64_t, int64_t> >& vArchivedOrder = pwalletMain->vArchivedOrder;
+    static const size_t ARCHIVE_PAGE = 100;
+    std::vector<CArchivedTx> vArchived;
+    size_t nArchivedNext = 0;
 
     // iterate backwards until we have nCount items to return:
-    for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it) {
-        CWalletTx* const pwtx = (*it).second.first;
-        if (pwtx != 0)
-            ListTransactions(*pwtx, strAccount, 0, true, ret, filter);
-        if (IsDeprecatedRPCEnabled("accounts")) {
-            CAccountingEntry *const pacentry = (*it).second.second;
-            if (pacentry != nullptr) AcentryToJSON(*pacentry, strAccount, ret);
+    bool fDone = nCount == 0;
+    CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin();
+    auto itArchived = vArchivedOrder.rbegin();
+    while (!fDone && (it != txOrdered.rend() || itArchived != vArchivedOrder.rend())) {
+        if (itArchived == vArchivedOrder.rend() || (it != txOrdered.rend() && it->first >= itArchived->first)) {
+            CWalletTx* const pwtx = (*it).second.first;
+            if (pwtx != 0)
+                ListTransactions(*pwtx, strAccount, 0, true, entries, filter);
+            if (IsDeprecatedRPCEnabled("accounts")) {
+                CAccountingEntry *const pacentry = (*it).second.second;
+                if (pacentry != nullptr) AcentryToJSON(*pacentry, strAccount, entries);
+            }
+            ++it;
+        } else {
+            // Read the archived transactions a page at a time
+            if (nArchivedNext == vArchived.size()) {
+                std::vector<int64_t> vIndexes;
+                for (auto itPage = itArchived; itPage != vArchivedOrder.rend() && vIndexes.size() < ARCHIVE_PAGE; ++itPage)
+                    vIndexes.push_back(itPage->second);
+                if (!pwalletMain->ReadArchivedTxs(vIndexes, vArchived))
+                    throw JSONRPCError(RPC_WALLET_ERROR, "Error reading the wallet archive");
+                nArchivedNext = 0;
+            }
+            const CWalletTx& wtx = vArchived[nArchivedNext++].wtx;
+            // A rescan brings archived transactions back until the next archive pass
+            if (!pwalletMain->mapWallet.count(wtx.GetHash()))
+                ListTransactions(wtx, strAccount, 0, true, entries, filter);
+            ++itArchived;
         }
-
-        if ((int)ret.size() >= (nCount + nFrom)) break;
+        fDone = keepEntries();
     }
-    // ret is newest to oldest
-
-    if (nFrom > (int)ret.size())
-        nFrom = ret.size();
-    if ((nFrom + nCount) > (int)ret.size())
-        nCount = ret.size() - nFrom;
-
-    std::vector<UniValue> arrTmp = ret.getValues();
-
-    std::vector<UniValue>::iterator first = arrTmp.begin();
-    std::advance(first, nFrom);
-    std::vector<UniValue>::iterator last = arrTmp.begin();
-    std::advance(last, nFrom+nCount);
-
-    if (last != arrTmp.end()) arrTmp.erase(last, arrTmp.end());
-    if (first != arrTmp.begin()) arrTmp.erase(arrTmp.begin(), first);
 
-    std::reverse(arrTmp.begin(), arrTmp.end()); // Return oldest to newest
+    std::reverse(vEntries.begin(), vEntries.end()); // Return oldest to newest
 
-    ret.clear();
-    ret.setArray();
-    ret.push_backV(arrTmp);
+    UniValue ret(UniValue::VARR);
+    ret.push_backV(vEntries);
 
     return ret;
 }
@@ -1991,6 +2026,7 @@ UniValue listsinceblock(const JSONRPCRequest& request)
         throw std::runtime_error(
             "listsinceblock ( \"blockhash\" target-confirmations includeWatchonly)\n"
             "\nGet all transactions in blocks since block [blockhash], or all transactions if omitted\n"
+            "Transactions moved to the wallet archive (see -walletarchive) are not listed.\n"
 
             "\nArguments:\n"
             "1. \"blockhash\"   (string, optional) The block hash to list transactions since\n"
@@ -2052,15 +2088,15 @@ UniValue listsinceblock(const JSONRPCRequest& request)
         if (request.params[2].get_bool())
             filter = filter | ISMINE_WATCH_ONLY;
 
-    int depth = pindex ? (1 + chainActive.Height() - pindex->nHeight) : -1;
-
     UniValue transactions(UniValue::VARR);
 
-    for (auto it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); it++) {
-        CWalletTx tx = (*it).second;
-
-        if (depth == -1 || tx.GetDepthInMainChain(false) < depth)
-            ListTransactions(tx, "*", 0, true, transactions, filter);
+    if (pindex) {
+        // Only the blocks after pindex and the unconfirmed txs are looked at
+        for (const CWalletTx* pwtx : pwalletMain->GetTransactionsSince(pindex))
+            ListTransactions(*pwtx, "*", 0, true, transactions, filter);
+    } else {
+        for (const auto& entry : pwalletMain->mapWallet)
+            ListTransactions(entry.second, "*", 0, true, transactions, filter);
     }
 
     CBlockIndex* pblockLast = chainActive[chainActive.Height() + 1 - target_confirms];
@@ -2124,9 +2160,11 @@ UniValue gettransaction(const JSONRPCRequest& request)
             filter = filter | ISMINE_WATCH_ONLY;
 
     UniValue entry(UniValue::VOBJ);
-    if (!pwalletMain->mapWallet.count(hash))
+    CArchivedTx archived;
+    auto it = pwalletMain->mapWallet.find(hash);
+    if (it == pwalletMain->mapWallet.end() && !pwalletMain->ReadArchivedTx(hash, archived))
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid or non-wallet transaction id");
-    const CWalletTx& wtx = pwalletMain->mapWallet[hash];
+    const CWalletTx& wtx = it != pwalletMain->mapWallet.end() ? it->second : archived.wtx;
 
     CAmount nCredit = wtx.GetCredit(filter);
     CAmount nDebit = wtx.GetDebit(filter);
@@ -2797,6 +2835,7 @@ UniValue getwalletinfo(const JSONRPCRequest& request)
             "  \"unconfirmed_balance\": xxx,              (numeric) the total unconfirmed balance of the wallet in CNCD\n"
             "  \"immature_balance\": xxxxxx,              (numeric) the total immature balance of the wallet in CNCD\n"
             "  \"txcount\": xxxxxxx,                      (numeric) the total number of transactions in the wallet\n"
+            "  \"archivedtxcount\": xxxxxxx,              (numeric) the number of spent transactions moved to the archive (see -walletarchive)\n"
             "  \"keypoololdest\": xxxxxx,                 (numeric) the timestamp (seconds since GMT epoch) of the oldest pre-generated key in the key pool\n"
             "  \"keypoolsize\": xxxx,                     (numeric) how many new keys are pre-generated (only counts external keys)\n"
             "  \"keypoolsize_hd_internal\": xxxx,         (numeric) how many new keys are pre-generated for internal use (used for change outputs, only appears if the wallet is using this feature, otherwise external keys are used)\n"
@@ -2817,6 +2856,7 @@ UniValue getwalletinfo(const JSONRPCRequest& request)
     obj.push_back(Pair("unconfirmed_balance", ValueFromAmount(pwalletMain->GetUnconfirmedBalance())));
     obj.push_back(Pair("immature_balance",    ValueFromAmount(pwalletMain->GetImmatureBalance())));
     obj.push_back(Pair("txcount", (int)pwalletMain->mapWallet.size()));
+    obj.push_back(Pair("archivedtxcount", pwalletMain->nArchivedTxs));
     obj.push_back(Pair("keypoololdest", pwalletMain->GetOldestKeyPoolTime()));
 
     size_t kpExternalSize = pwalletMain->KeypoolCountExternalKeys();
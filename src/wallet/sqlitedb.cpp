@@ -0,0 +1,285 @@
+// Copyright (c) 2025 The Concordia Cash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/sqlitedb.h"
+
+#include "sqlite3/sqlite3.h"
+#include "util.h"
+#include "wallet/db.h"
+
+#include <errno.h>
+#include <string.h>
+
+namespace {
+const char* StreamData(const CDataStream& ss)
+{
+    return ss.empty() ? "" : &ss[0];
+}
+
+/** Walks the records of a SQLite wallet file in key order */
+class CSQLiteCursor : public CDBCursor
+{
+private:
+    sqlite3* db;
+    RecursiveMutex& cs_stmt;
+    sqlite3_stmt* pstmt;
+
+public:
+    CSQLiteCursor(sqlite3* dbIn, RecursiveMutex& cs_stmtIn) : db(dbIn), cs_stmt(cs_stmtIn), pstmt(NULL) {}
+    ~CSQLiteCursor()
+    {
+        LOCK(cs_stmt);
+        sqlite3_finalize(pstmt);
+    }
+
+    int Read(CDataStream& ssKey, CDataStream& ssValue, unsigned int fFlags) override
+    {
+        // Each step waits for a transaction of another thread to end
+        LOCK(cs_stmt);
+        if (fFlags != DB_NEXT && fFlags != DB_SET_RANGE)
+            return EINVAL;
+
+        // A range read restarts the scan at the first key not below ssKey
+        if (fFlags == DB_SET_RANGE || !pstmt) {
+            sqlite3_finalize(pstmt);
+            pstmt = NULL;
+            const char* pszSql = fFlags == DB_SET_RANGE ? "SELECT key, value FROM main WHERE key >= ? ORDER BY key" :
+                                                          "SELECT key, value FROM main ORDER BY key";
+            int ret = sqlite3_prepare_v2(db, pszSql, -1, &pstmt, NULL);
+            if (ret != SQLITE_OK)
+                return ret;
+            if (fFlags == DB_SET_RANGE) {
+                ret = sqlite3_bind_blob(pstmt, 1, StreamData(ssKey), ssKey.size(), SQLITE_TRANSIENT);
+                if (ret != SQLITE_OK)
+                    return ret;
+            }
+        }
+
+        int ret = sqlite3_step(pstmt);
+        if (ret == SQLITE_DONE)
+            return DB_NOTFOUND;
+        if (ret != SQLITE_ROW)
+            return ret;
+
+        ssKey.SetType(SER_DISK);
+        ssKey.clear();
+        ssKey.write((const char*)sqlite3_column_blob(pstmt, 0), sqlite3_column_bytes(pstmt, 0));
+        ssValue.SetType(SER_DISK);
+        ssValue.clear();
+        ssValue.write((const char*)sqlite3_column_blob(pstmt, 1), sqlite3_column_bytes(pstmt, 1));
+        return 0;
+    }
+};
+} // namespace
+
+CSQLiteDB::CSQLiteDB(const std::string& strPathIn) : db(NULL), strPath(strPathIn), fTxn(false),
+                                                     pstmtRead(NULL), pstmtInsert(NULL), pstmtOverwrite(NULL), pstmtErase(NULL)
+{
+}
+
+CSQLiteDB::~CSQLiteDB()
+{
+    Close();
+}
+
+bool CSQLiteDB::Exec(const char* pszSql)
+{
+    int ret = sqlite3_exec(db, pszSql, NULL, NULL, NULL);
+    if (ret != SQLITE_OK)
+        return error("CSQLiteDB : %s failed on %s: %s", pszSql, strPath, sqlite3_errmsg(db));
+    return true;
+}
+
+bool CSQLiteDB::Prepare(const char* pszSql, sqlite3_stmt** ppstmt)
+{
+    int ret = sqlite3_prepare_v2(db, pszSql, -1, ppstmt, NULL);
+    if (ret != SQLITE_OK)
+        return error("CSQLiteDB : Can't prepare %s on %s: %s", pszSql, strPath, sqlite3_errmsg(db));
+    return true;
+}
+
+bool CSQLiteDB::Open()
+{
+    if (db)
+        return true;
+
+    int ret = sqlite3_open_v2(strPath.c_str(), &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_FULLMUTEX, NULL);
+    if (ret != SQLITE_OK) {
+        LogPrintf("CSQLiteDB::Open : Error %d opening %s: %s\n", ret, strPath, sqlite3_errstr(ret));
+        sqlite3_close(db);
+        db = NULL;
+        return false;
+    }
+
+    // The node is the only user of its wallet, so an exclusive lock lets
+    // the WAL index live in heap memory instead of a -shm file.
+    // secure_delete overwrites freed records, which may hold private keys.
+    bool fOk = Exec("PRAGMA locking_mode = EXCLUSIVE") &&
+               Exec("PRAGMA journal_mode = WAL") &&
+               Exec("PRAGMA synchronous = NORMAL") &&
+               Exec("PRAGMA secure_delete = ON") &&
+               Exec("CREATE TABLE IF NOT EXISTS main (key BLOB PRIMARY KEY NOT NULL, value BLOB NOT NULL) WITHOUT ROWID") &&
+               Prepare("SELECT value FROM main WHERE key = ?", &pstmtRead) &&
+               Prepare("INSERT INTO main VALUES (?, ?)", &pstmtInsert) &&
+               Prepare("INSERT OR REPLACE INTO main VALUES (?, ?)", &pstmtOverwrite) &&
+               Prepare("DELETE FROM main WHERE key = ?", &pstmtErase);
+    if (!fOk) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void CSQLiteDB::Close()
+{
+    if (!db)
+        return;
+
+    LOCK(cs_stmt);
+    if (fTxn)
+        TxnAbort();
+    for (sqlite3_stmt** ppstmt : {&pstmtRead, &pstmtInsert, &pstmtOverwrite, &pstmtErase}) {
+        sqlite3_finalize(*ppstmt);
+        *ppstmt = NULL;
+    }
+    // Closing the last connection checkpoints and removes the -wal file
+    int ret = sqlite3_close_v2(db);
+    if (ret != SQLITE_OK)
+        LogPrintf("CSQLiteDB::Close : Error %d closing %s: %s\n", ret, strPath, sqlite3_errstr(ret));
+    db = NULL;
+}
+
+bool CSQLiteDB::Read(const CDataStream& ssKey, CDataStream& ssValue)
+{
+    LOCK(cs_stmt);
+    if (!db)
+        return false;
+
+    bool fFound = false;
+    if (sqlite3_bind_blob(pstmtRead, 1, StreamData(ssKey), ssKey.size(), SQLITE_STATIC) == SQLITE_OK) {
+        int ret = sqlite3_step(pstmtRead);
+        if (ret == SQLITE_ROW) {
+            ssValue.SetType(SER_DISK);
+            ssValue.clear();
+            ssValue.write((const char*)sqlite3_column_blob(pstmtRead, 0), sqlite3_column_bytes(pstmtRead, 0));
+            fFound = true;
+        } else if (ret != SQLITE_DONE) {
+            LogPrintf("CSQLiteDB::Read : Error %d reading %s: %s\n", ret, strPath, sqlite3_errmsg(db));
+        }
+    }
+    sqlite3_reset(pstmtRead);
+    sqlite3_clear_bindings(pstmtRead);
+    return fFound;
+}
+
+bool CSQLiteDB::Exists(const CDataStream& ssKey)
+{
+    CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+    return Read(ssKey, ssValue);
+}
+
+bool CSQLiteDB::WriteRecord(sqlite3_stmt* pstmt, const CDataStream& ssKey, const CDataStream* pssValue)
+{
+    LOCK(cs_stmt);
+    if (!db)
+        return false;
+
+    int ret = sqlite3_bind_blob(pstmt, 1, StreamData(ssKey), ssKey.size(), SQLITE_STATIC);
+    if (ret == SQLITE_OK && pssValue)
+        ret = sqlite3_bind_blob(pstmt, 2, StreamData(*pssValue), pssValue->size(), SQLITE_STATIC);
+    if (ret == SQLITE_OK)
+        ret = sqlite3_step(pstmt);
+    sqlite3_reset(pstmt);
+    sqlite3_clear_bindings(pstmt);
+
+    // A constraint failure is an existing key with fOverwrite unset
+    if (ret != SQLITE_DONE && ret != SQLITE_CONSTRAINT)
+        LogPrintf("CSQLiteDB : Error %d writing %s: %s\n", ret, strPath, sqlite3_errstr(ret));
+    return ret == SQLITE_DONE;
+}
+
+bool CSQLiteDB::Write(const CDataStream& ssKey, const CDataStream& ssValue, bool fOverwrite)
+{
+    return WriteRecord(fOverwrite ? pstmtOverwrite : pstmtInsert, ssKey, &ssValue);
+}
+
+bool CSQLiteDB::Erase(const CDataStream& ssKey)
+{
+    return WriteRecord(pstmtErase, ssKey, NULL);
+}
+
+CDBCursor* CSQLiteDB::GetCursor()
+{
+    if (!db)
+        return NULL;
+    return new CSQLiteCursor(db, cs_stmt);
+}
+
+bool CSQLiteDB::TxnBegin()
+{
+    // All handles share the connection, so the transaction keeps cs_stmt
+    // until it ends and the other threads wait instead of writing into it
+    ENTER_CRITICAL_SECTION(cs_stmt);
+    if (!db || fTxn || !Exec("BEGIN")) {
+        LEAVE_CRITICAL_SECTION(cs_stmt);
+        return false;
+    }
+    fTxn = true;
+    return true;
+}
+
+bool CSQLiteDB::TxnCommit()
+{
+    LOCK(cs_stmt);
+    if (!db || !fTxn)
+        return false;
+    fTxn = false;
+    bool fOk = Exec("COMMIT");
+    LEAVE_CRITICAL_SECTION(cs_stmt);
+    return fOk;
+}
+
+bool CSQLiteDB::TxnAbort()
+{
+    LOCK(cs_stmt);
+    if (!db || !fTxn)
+        return false;
+    fTxn = false;
+    bool fOk = Exec("ROLLBACK");
+    LEAVE_CRITICAL_SECTION(cs_stmt);
+    return fOk;
+}
+
+bool CSQLiteDB::Verify()
+{
+    if (!db)
+        return false;
+
+    sqlite3_stmt* pstmt = NULL;
+    if (!Prepare("PRAGMA integrity_check", &pstmt))
+        return false;
+    bool fOk = true;
+    while (sqlite3_step(pstmt) == SQLITE_ROW) {
+        const std::string strResult((const char*)sqlite3_column_text(pstmt, 0));
+        if (strResult == "ok")
+            continue;
+        LogPrintf("CSQLiteDB::Verify : %s: %s\n", strPath, strResult);
+        fOk = false;
+    }
+    sqlite3_finalize(pstmt);
+    return fOk;
+}
+
+bool CSQLiteDB::IsSQLiteFile(const fs::path& path)
+{
+    static const char SQLITE_HEADER[16] = "SQLite format 3";
+
+    FILE* file = fsbridge::fopen(path, "rb");
+    if (!file)
+        return false;
+    char header[sizeof(SQLITE_HEADER)];
+    bool fMatch = fread(header, 1, sizeof(header), file) == sizeof(header) && memcmp(header, SQLITE_HEADER, sizeof(header)) == 0;
+    fclose(file);
+    return fMatch;
+}
@@ -0,0 +1,75 @@
+// Copyright (c) 2025 The Concordia Cash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_SQLITEDB_H
+#define BITCOIN_WALLET_SQLITEDB_H
+
+#include "fs.h"
+#include "streams.h"
+#include "sync.h"
+
+#include <string>
+
+class CDBCursor;
+struct sqlite3;
+struct sqlite3_stmt;
+
+/** Default for -walletbackend, the format of newly created wallet files */
+static const char* const DEFAULT_WALLET_BACKEND = "bdb";
+
+/**
+ * Wallet records in a SQLite file: one table of serialized keys and values,
+ * ordered like the Berkeley DB btree so cursors see the same sequence.
+ * The file runs in WAL mode, a commit appends to the -wal file and is only
+ * synced when the log is checkpointed into the database, which keeps single
+ * record writes cheap (like DB_TXN_WRITE_NOSYNC for Berkeley DB).
+ */
+class CSQLiteDB
+{
+private:
+    sqlite3* db;
+    std::string strPath;
+    bool fTxn;
+
+    //! Guards the prepared statements, shared by all CDB handles on the file;
+    //! held from TxnBegin to TxnCommit/TxnAbort by the thread in a transaction
+    RecursiveMutex cs_stmt;
+    sqlite3_stmt* pstmtRead;
+    sqlite3_stmt* pstmtInsert;
+    sqlite3_stmt* pstmtOverwrite;
+    sqlite3_stmt* pstmtErase;
+
+    bool Exec(const char* pszSql);
+    bool Prepare(const char* pszSql, sqlite3_stmt** ppstmt);
+    bool WriteRecord(sqlite3_stmt* pstmt, const CDataStream& ssKey, const CDataStream* pssValue);
+
+public:
+    /** strPathIn is the file to open, ":memory:" for a mock database */
+    explicit CSQLiteDB(const std::string& strPathIn);
+    ~CSQLiteDB();
+
+    bool Open();
+    void Close();
+
+    bool Read(const CDataStream& ssKey, CDataStream& ssValue);
+    bool Write(const CDataStream& ssKey, const CDataStream& ssValue, bool fOverwrite = true);
+    bool Erase(const CDataStream& ssKey);
+    bool Exists(const CDataStream& ssKey);
+
+    /** Cursor over all records in key order, NULL on error */
+    CDBCursor* GetCursor();
+
+    /** Start a transaction, other threads block on the file until it ends */
+    bool TxnBegin();
+    bool TxnCommit();
+    bool TxnAbort();
+
+    /** Run the SQLite integrity check on the open database */
+    bool Verify();
+
+    /** Whether the file starts with the SQLite header */
+    static bool IsSQLiteFile(const fs::path& path);
+};
+
+#endif // BITCOIN_WALLET_SQLITEDB_H
@@ -7,6 +7,7 @@
 
 #include "wallet/wallet.h"
 #include "consensus/merkle.h"
+#include "masternodeconfig.h"
 
 #include <set>
 #include <stdint.h>
@@ -305,6 +306,49 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+static CInputCoin bnb_coin(const CAmount& nEffectiveValue)
+{
+    return CInputCoin{nullptr, 0, nEffectiveValue + 10, nEffectiveValue, 6, false};
+}
+
+BOOST_AUTO_TEST_CASE(bnb_selection_tests)
+{
+    // Sorted by descending effective value, as SelectCoinsChangeless passes them
+    std::vector<CInputCoin> vCoins;
+    for (CAmount nValue : {8, 7, 5, 5, 3, 1})
+        vCoins.push_back(bnb_coin(nValue * CENT));
+    std::vector<size_t> vSelected;
+    CAmount nValueRet;
+
+    // An exact match, reported with the full value of the coins
+    BOOST_CHECK(SelectCoinsBnB(vCoins, 10 * CENT, 0, vSelected, nValueRet));
+    BOOST_CHECK_EQUAL(vSelected.size(), 2U);
+    BOOST_CHECK_EQUAL(nValueRet, 10 * CENT + 20);
+    BOOST_CHECK(SelectCoinsBnB(vCoins, 29 * CENT, 0, vSelected, nValueRet));
+    BOOST_CHECK_EQUAL(vSelected.size(), 6U);
+
+    // Nothing within the window, or not enough in the pool
+    BOOST_CHECK(!SelectCoinsBnB(vCoins, 17 * CENT + 1, CENT - 2, vSelected, nValueRet));
+    BOOST_CHECK(vSelected.empty());
+    BOOST_CHECK(!SelectCoinsBnB(vCoins, 30 * CENT, 5 * CENT, vSelected, nValueRet));
+
+    // The least excess within the window wins
+    BOOST_CHECK(SelectCoinsBnB(vCoins, 17 * CENT + 1, CENT, vSelected, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 18 * CENT + 10 * (CAmount)vSelected.size());
+
+    // A large pool of close values still finds a changeless set
+    vCoins.clear();
+    FastRandomContext insecure_rand(true);
+    for (int i = 0; i < 100000; i++)
+        vCoins.push_back(bnb_coin(COIN + insecure_rand.randrange(COIN)));
+    std::sort(vCoins.begin(), vCoins.end(), [](const CInputCoin& a, const CInputCoin& b) { return a.nEffectiveValue > b.nEffectiveValue; });
+    BOOST_CHECK(SelectCoinsBnB(vCoins, 100 * COIN, 5000, vSelected, nValueRet));
+    CAmount nEffective = 0;
+    for (size_t i : vSelected)
+        nEffective += vCoins[i].nEffectiveValue;
+    BOOST_CHECK(nEffective >= 100 * COIN && nEffective <= 100 * COIN + 5000);
+}
+
 void removeTxFromMempool(CWalletTx& wtx)
 {
     LOCK(mempool.cs);
@@ -472,4 +516,433 @@ BOOST_AUTO_TEST_CASE(cached_balances_tests)
 
 }
 
+CBlockIndex* FakeExtendChain(CBlockIndex* pprev)
+{
+    CBlock block;
+    block.hashPrevBlock = pprev->GetBlockHash();
+    CBlockIndex* fakeIndex = new CBlockIndex(block);
+    fakeIndex->pprev = pprev;
+    fakeIndex->nHeight = pprev->nHeight + 1;
+    fakeIndex->BuildSkip();
+    mapBlockIndex.insert(std::make_pair(block.GetHash(), fakeIndex));
+    fakeIndex->phashBlock = &mapBlockIndex.find(block.GetHash())->first;
+    chainActive.SetTip(fakeIndex);
+    return fakeIndex;
+}
+
+/**
+ * The balance ledger behind CWallet::GetBalances() follows the mempool, the
+ * chain tip, reorgs, the locked coins and the spends of the wallet transactions.
+ */
+BOOST_AUTO_TEST_CASE(balances_ledger_tests)
+{
+    CWallet &wallet = *pwalletMain;
+    LOCK2(cs_main, wallet.cs_wallet);
+    wallet.SetMinVersion(FEATURE_PRE_SPLIT_KEYPOOL);
+    wallet.SetupSPKM(false);
+
+    CTxDestination receivingAddr;
+    BOOST_ASSERT(wallet.getNewAddress(receivingAddr, "receiving_address").result);
+    CKey key;
+    key.MakeNewKey(true);
+    CTxOut mineOut(10 * COIN, GetScriptForDestination(receivingAddr));
+    CTxOut foreignOut(5 * COIN, GetScriptForDestination(key.GetPubKey().GetID()));
+    CWalletTx& wtxCredit = ReceiveBalanceWith({mineOut, foreignOut, mineOut}, wallet);
+
+    // Only the outputs paying to us are looked at
+    BOOST_CHECK_EQUAL(wtxCredit.GetMineOutputs().size(), 2U);
+    BOOST_CHECK_EQUAL(wtxCredit.GetMineOutputs()[1].first, 2U);
+
+    // Neither in the mempool nor in a block
+    BOOST_CHECK_EQUAL(wallet.GetUnconfirmedBalance(), 0);
+    BOOST_CHECK_EQUAL(wallet.GetAvailableBalance(), 0);
+
+    // Entering the mempool reaches the wallet through SyncTransaction
+    fakeMempoolInsertion(wtxCredit);
+    wtxCredit.MarkDirty();
+    BOOST_CHECK_EQUAL(wallet.GetUnconfirmedBalance(), 20 * COIN);
+    BOOST_CHECK_EQUAL(wallet.GetAvailableBalance(), 0);
+
+    // Leaving it may not, the mempool update counter covers that
+    removeTxFromMempool(wtxCredit);
+    mempool.AddTransactionsUpdated(1);
+    BOOST_CHECK_EQUAL(wallet.GetUnconfirmedBalance(), 0);
+    fakeMempoolInsertion(wtxCredit);
+    wtxCredit.MarkDirty();
+    BOOST_CHECK_EQUAL(wallet.GetUnconfirmedBalance(), 20 * COIN);
+
+    // A new tip
+    CBlockIndex* pindexMined = SimpleFakeMine(wtxCredit);
+    CWalletBalances balances = wallet.GetBalances();
+    BOOST_CHECK_EQUAL(balances.nUntrusted, 0);
+    BOOST_CHECK_EQUAL(balances.nTrusted, 20 * COIN);
+    BOOST_CHECK_EQUAL(balances.nLocked, 0);
+    BOOST_CHECK_EQUAL(balances.nStakeable, 0); // not deep enough yet
+
+    // Deep enough to stake, without the wallet being told about the blocks
+    const int nStakeMinDepth = Params().GetConsensus().nStakeMinDepth;
+    CBlockIndex* pindex = pindexMined;
+    while (pindex->nHeight < nStakeMinDepth - 1)
+        pindex = FakeExtendChain(pindex);
+    BOOST_CHECK_EQUAL(wallet.GetStakingBalance(), 20 * COIN);
+
+    wallet.LockCoin(COutPoint(wtxCredit.GetHash(), 0));
+    BOOST_CHECK_EQUAL(wallet.GetLockedCoins(), 10 * COIN);
+    BOOST_CHECK_EQUAL(wallet.GetAvailableBalance(), 20 * COIN);
+    BOOST_CHECK_EQUAL(wallet.GetStakingBalance(), 10 * COIN);
+    wallet.UnlockCoin(COutPoint(wtxCredit.GetHash(), 0));
+    BOOST_CHECK_EQUAL(wallet.GetLockedCoins(), 0);
+    BOOST_CHECK_EQUAL(wallet.GetStakingBalance(), 20 * COIN);
+
+    // Spending an output lowers the balance right away
+    std::vector<CTxIn> vinDebit = {CTxIn(COutPoint(wtxCredit.GetHash(), 0))};
+    std::vector<CTxOut> voutDebit = {foreignOut};
+    BuildAndLoadTxToWallet(vinDebit, voutDebit, wallet);
+    BOOST_CHECK_EQUAL(wallet.GetAvailableBalance(), 10 * COIN);
+    BOOST_CHECK_EQUAL(wallet.GetStakingBalance(), 10 * COIN);
+
+    // Same as the uncached sum
+    isminefilter filter = ISMINE_SPENDABLE;
+    BOOST_CHECK_EQUAL(wallet.GetAvailableBalance(filter, false, 1), 10 * COIN);
+
+    // A reorg makes the outputs shallow again
+    chainActive.SetTip(pindexMined);
+    balances = wallet.GetBalances();
+    BOOST_CHECK_EQUAL(balances.nTrusted, 10 * COIN);
+    BOOST_CHECK_EQUAL(balances.nStakeable, 0);
+}
+
+/**
+ * CWallet::StakeableCoins() follows new blocks, locked coins, masternode
+ * collaterals, spends and reorgs like AvailableCoins(STAKEABLE_COINS).
+ */
+BOOST_AUTO_TEST_CASE(stakeable_coins_tests)
+{
+    CWallet &wallet = *pwalletMain;
+    LOCK2(cs_main, wallet.cs_wallet);
+    wallet.SetMinVersion(FEATURE_PRE_SPLIT_KEYPOOL);
+    wallet.SetupSPKM(false);
+
+    CTxDestination receivingAddr;
+    BOOST_ASSERT(wallet.getNewAddress(receivingAddr, "receiving_address").result);
+    CTxOut mineOut(10 * COIN, GetScriptForDestination(receivingAddr));
+    CWalletTx& wtxCredit = ReceiveBalanceWith({mineOut, mineOut}, wallet);
+
+    std::vector<COutput> vStakeable, vAvailable;
+    auto checkStakeable = [&](size_t nCoins) {
+        BOOST_CHECK_EQUAL(wallet.StakeableCoins(&vStakeable), nCoins > 0);
+        BOOST_CHECK_EQUAL(wallet.StakeableCoins(), nCoins > 0);
+        wallet.AvailableCoins(&vAvailable, nullptr, STAKEABLE_COINS);
+        BOOST_CHECK_EQUAL(vStakeable.size(), nCoins);
+        BOOST_CHECK_EQUAL(vAvailable.size(), nCoins);
+    };
+
+    // Confirmed, but the outputs only stake at nStakeMinDepth confirmations
+    const int nStakeMinDepth = Params().GetConsensus().nStakeMinDepth;
+    CBlockIndex* pindex = SimpleFakeMine(wtxCredit);
+    checkStakeable(0);
+    while (pindex->nHeight < nStakeMinDepth - 2)
+        pindex = FakeExtendChain(pindex);
+    CBlockIndex* pindexShallow = pindex;
+    checkStakeable(0);
+    pindex = FakeExtendChain(pindex);
+    checkStakeable(2);
+    BOOST_CHECK_EQUAL(vStakeable[0].nDepth, nStakeMinDepth);
+    FakeExtendChain(pindex);
+    checkStakeable(2);
+    BOOST_CHECK_EQUAL(vStakeable[0].nDepth, nStakeMinDepth + 1);
+
+    // Locked coins and masternode collaterals do not stake
+    wallet.LockCoin(COutPoint(wtxCredit.GetHash(), 0));
+    checkStakeable(1);
+    wallet.UnlockCoin(COutPoint(wtxCredit.GetHash(), 0));
+    checkStakeable(2);
+    masternodeConfig.add("mn", "127.0.0.1:1", "", wtxCredit.GetHash().GetHex(), "1");
+    checkStakeable(1);
+    BOOST_CHECK_EQUAL(vStakeable[0].i, 0);
+    masternodeConfig.remove("mn");
+    checkStakeable(2);
+
+    // Spent outputs neither, unless the spend is a coinstake that left the mempool
+    CTxOut emptyOut(0, CScript());
+    std::vector<CTxIn> vinStake = {CTxIn(COutPoint(wtxCredit.GetHash(), 1))};
+    CWalletTx& wtxStake = BuildAndLoadTxToWallet(vinStake, {emptyOut, mineOut}, wallet);
+    BOOST_CHECK(wtxStake.IsCoinStake());
+    fakeMempoolInsertion(wtxStake);
+    checkStakeable(1);
+    removeTxFromMempool(wtxStake);
+    mempool.AddTransactionsUpdated(1);
+    checkStakeable(2);
+
+    std::vector<CTxIn> vinDebit = {CTxIn(COutPoint(wtxCredit.GetHash(), 0))};
+    BuildAndLoadTxToWallet(vinDebit, {mineOut}, wallet);
+    checkStakeable(1);
+
+    // A reorg makes the outputs shallow again
+    chainActive.SetTip(pindexShallow);
+    checkStakeable(0);
+}
+
+BOOST_AUTO_TEST_CASE(bulk_load_tests)
+{
+    CWallet &wallet = *pwalletMain;
+    LOCK2(cs_main, wallet.cs_wallet);
+    wallet.SetMinVersion(FEATURE_PRE_SPLIT_KEYPOOL);
+    wallet.SetupSPKM(false);
+
+    CTxDestination receivingAddr;
+    BOOST_ASSERT(wallet.getNewAddress(receivingAddr, "receiving_address").result);
+    CTxOut mineOut(10 * COIN, GetScriptForDestination(receivingAddr));
+
+    CMutableTransaction mtxCredit;
+    mtxCredit.vin.emplace_back(COutPoint(uint256(), 999));
+    mtxCredit.vout = {mineOut, mineOut};
+    const CTransaction txCredit(mtxCredit);
+
+    // Two spends of the first output, loaded before their parent
+    std::vector<CWalletTx> vWtx;
+    for (int i = 0; i < 2; i++) {
+        CMutableTransaction mtxDebit;
+        mtxDebit.vin.emplace_back(COutPoint(txCredit.GetHash(), 0));
+        mtxDebit.vout.emplace_back(i + 1, CScript() << OP_TRUE);
+        vWtx.emplace_back(&wallet, CTransaction(mtxDebit));
+    }
+    vWtx.emplace_back(&wallet, txCredit);
+    const uint256 hashDebit = vWtx[0].GetHash();
+    const uint256 hashConflict = vWtx[1].GetHash();
+    wallet.LoadToWallet(vWtx);
+
+    BOOST_CHECK(vWtx.empty());
+    BOOST_CHECK_EQUAL(wallet.mapWallet.size(), 3);
+    BOOST_CHECK(wallet.IsSpent(txCredit.GetHash(), 0));
+    BOOST_CHECK(!wallet.IsSpent(txCredit.GetHash(), 1));
+    BOOST_CHECK(wallet.GetConflicts(hashDebit).count(hashConflict));
+    BOOST_CHECK_EQUAL(wallet.mapWallet[txCredit.GetHash()].GetAvailableCredit(), 10 * COIN);
+}
+
+BOOST_AUTO_TEST_CASE(archive_spent_tests)
+{
+    CWallet &wallet = *pwalletMain;
+    LOCK2(cs_main, wallet.cs_wallet);
+    wallet.SetMinVersion(FEATURE_PRE_SPLIT_KEYPOOL);
+    wallet.SetupSPKM(false);
+
+    CTxDestination receivingAddr;
+    BOOST_ASSERT(wallet.getNewAddress(receivingAddr, "receiving_address").result);
+    CTxOut mineOut(10 * COIN, GetScriptForDestination(receivingAddr));
+    CWalletTx& wtxCredit = ReceiveBalanceWith({mineOut, mineOut}, wallet);
+    const uint256 hashCredit = wtxCredit.GetHash();
+    const int64_t nOrderPosCredit = wtxCredit.nOrderPos;
+
+    // Spend both outputs, keeping one output to us
+    std::vector<CTxIn> vinDebit = {CTxIn(COutPoint(hashCredit, 0)), CTxIn(COutPoint(hashCredit, 1))};
+    CTxOut externalOut(5 * COIN, CScript() << OP_TRUE);
+    CWalletTx& wtxDebit = BuildAndLoadTxToWallet(vinDebit, {mineOut, externalOut}, wallet);
+
+    // Nothing is archived before the spend is deeper than -maxreorg
+    CBlockIndex* pindex = SimpleFakeMine(wtxCredit);
+    wtxDebit.SetMerkleBranch(pindex, 1);
+    BOOST_CHECK_EQUAL(wallet.ArchiveSpentTransactions(), 0);
+    for (int i = 0; i < DEFAULT_MAX_REORG_DEPTH; i++)
+        pindex = FakeExtendChain(pindex);
+
+    BOOST_CHECK_EQUAL(wallet.ArchiveSpentTransactions(), 1);
+    BOOST_CHECK(!wallet.mapWallet.count(hashCredit));
+    BOOST_CHECK_EQUAL(wallet.nArchivedTxs, 1);
+    BOOST_CHECK_EQUAL(wallet.ArchiveSpentTransactions(), 0);
+
+    // The spending tx still sees its inputs
+    wtxDebit.MarkDirty();
+    BOOST_CHECK_EQUAL(wallet.IsMine(wtxDebit.vin[0]), ISMINE_SPENDABLE);
+    BOOST_CHECK_EQUAL(wtxDebit.GetDebit(ISMINE_SPENDABLE), 20 * COIN);
+
+    // And the archived one reads back with its amounts
+    CArchivedTx archived;
+    BOOST_CHECK(wallet.ReadArchivedTx(hashCredit, archived));
+    BOOST_CHECK_EQUAL(archived.wtx.GetCredit(ISMINE_SPENDABLE), 20 * COIN);
+    BOOST_CHECK_EQUAL(archived.wtx.GetDebit(ISMINE_SPENDABLE), 0);
+
+    // It is indexed by its position in the history, for listtransactions
+    BOOST_CHECK_EQUAL(wallet.vArchivedOrder.size(), 1);
+    BOOST_CHECK_EQUAL(wallet.vArchivedOrder[0].first, nOrderPosCredit);
+    std::vector<CArchivedTx> vArchived;
+    BOOST_CHECK(wallet.ReadArchivedTxs({wallet.vArchivedOrder[0].second}, vArchived));
+    BOOST_CHECK_EQUAL(vArchived.size(), 1);
+    BOOST_CHECK(vArchived[0].wtx.GetHash() == hashCredit);
+}
+
+BOOST_AUTO_TEST_CASE(listing_indexes_tests)
+{
+    CWallet &wallet = *pwalletMain;
+    LOCK2(cs_main, wallet.cs_wallet);
+    wallet.SetMinVersion(FEATURE_PRE_SPLIT_KEYPOOL);
+    wallet.SetupSPKM(false);
+
+    CTxDestination receivingAddr;
+    BOOST_ASSERT(wallet.getNewAddress(receivingAddr, "receiving_address").result);
+    CTxOut mineOut(10 * COIN, GetScriptForDestination(receivingAddr));
+    auto hashesSince = [&wallet](const CBlockIndex* pindex) {
+        std::set<uint256> setHashes;
+        for (const CWalletTx* pwtx : wallet.GetTransactionsSince(pindex))
+            setHashes.insert(pwtx->GetHash());
+        return setHashes;
+    };
+
+    // One tx in each of two blocks, and a pending one
+    CWalletTx& wtxOld = ReceiveBalanceWith({mineOut}, wallet);
+    CBlockIndex* pindexOld = SimpleFakeMine(wtxOld);
+    wallet.SyncTransaction(wtxOld, pindexOld, 0);
+    CWalletTx& wtxNew = ReceiveBalanceWith({mineOut, mineOut}, wallet);
+    CBlockIndex* pindexNew = SimpleFakeMine(wtxNew, pindexOld);
+    wallet.SyncTransaction(wtxNew, pindexNew, 0);
+    CWalletTx& wtxPending = ReceiveBalanceWith({mineOut, mineOut, mineOut}, wallet);
+
+    BOOST_CHECK(hashesSince(pindexOld) == std::set<uint256>({wtxNew.GetHash(), wtxPending.GetHash()}));
+    BOOST_CHECK(hashesSince(pindexNew) == std::set<uint256>({wtxPending.GetHash()}));
+
+    // A disconnected block's tx is unconfirmed again
+    chainActive.SetTip(pindexOld);
+    wallet.SyncTransaction(wtxNew, pindexOld, CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK);
+    BOOST_CHECK(hashesSince(pindexOld) == std::set<uint256>({wtxNew.GetHash(), wtxPending.GetHash()}));
+
+    BOOST_CHECK_EQUAL(wallet.GetTransactionsTo(receivingAddr).size(), 3U);
+    BOOST_CHECK(wallet.GetTransactionsTo(CTxDestination(CKeyID(uint160()))).empty());
+}
+
+/**
+ * A rescan finds the spends of a wallet transaction in the block that confirms
+ * it, including the ones paying nothing back to the wallet.
+ */
+BOOST_AUTO_TEST_CASE(rescan_same_block_spend_tests)
+{
+    CWallet &wallet = *pwalletMain;
+    LOCK2(cs_main, wallet.cs_wallet);
+    wallet.SetMinVersion(FEATURE_PRE_SPLIT_KEYPOOL);
+    wallet.SetupSPKM(false);
+
+    CTxDestination receivingAddr;
+    BOOST_ASSERT(wallet.getNewAddress(receivingAddr, "receiving_address").result);
+    CKey key;
+    key.MakeNewKey(true);
+    CTxOut mineOut(10 * COIN, GetScriptForDestination(receivingAddr));
+    CTxOut foreignOut(10 * COIN, GetScriptForDestination(key.GetPubKey().GetID()));
+
+    // A proof of stake block, so that its header needs no work, with a tx paying
+    // to the wallet and a tx spending it to a foreign key
+    CMutableTransaction txCoinBase;
+    txCoinBase.vin.resize(1);
+    txCoinBase.vout.resize(1);
+    CMutableTransaction txCoinStake;
+    txCoinStake.vin.emplace_back(COutPoint(GetRandHash(), 0));
+    txCoinStake.vout = {CTxOut(0, CScript()), foreignOut};
+    CMutableTransaction txParent;
+    txParent.vin.emplace_back(COutPoint(GetRandHash(), 0));
+    txParent.vout = {mineOut};
+    CMutableTransaction txChild;
+    txChild.vin.emplace_back(COutPoint(txParent.GetHash(), 0));
+    txChild.vout = {foreignOut};
+
+    CBlock block;
+    block.hashPrevBlock = chainActive.Tip()->GetBlockHash();
+    block.vtx = {txCoinBase, txCoinStake, txParent, txChild};
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    BOOST_CHECK(block.IsProofOfStake());
+    CDiskBlockPos pos(1, 0);
+    BOOST_CHECK(WriteBlockToDisk(block, pos));
+
+    CBlockIndex* pindex = new CBlockIndex(block);
+    pindex->pprev = chainActive.Tip();
+    pindex->nHeight = pindex->pprev->nHeight + 1;
+    pindex->nFile = pos.nFile;
+    pindex->nDataPos = pos.nPos;
+    pindex->nStatus |= BLOCK_HAVE_DATA;
+    pindex->BuildSkip();
+    mapBlockIndex.insert(std::make_pair(block.GetHash(), pindex));
+    pindex->phashBlock = &mapBlockIndex.find(block.GetHash())->first;
+    chainActive.SetTip(pindex);
+
+    BOOST_CHECK_EQUAL(wallet.ScanForWalletTransactions(pindex, true), 2);
+    BOOST_CHECK(wallet.mapWallet.count(txParent.GetHash()));
+    BOOST_CHECK(wallet.mapWallet.count(txChild.GetHash()));
+    BOOST_CHECK(wallet.IsSpent(txParent.GetHash(), 0));
+    BOOST_CHECK_EQUAL(wallet.GetAvailableBalance(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(bare_multisig_tests)
+{
+    CWallet &wallet = *pwalletMain;
+    LOCK2(cs_main, wallet.cs_wallet);
+    wallet.SetMinVersion(FEATURE_PRE_SPLIT_KEYPOOL);
+    wallet.SetupSPKM(false);
+
+    CPubKey pubkey;
+    BOOST_ASSERT(wallet.GetKeyFromPool(pubkey));
+    CScript scriptMultisig = GetScriptForMultisig(1, {pubkey});
+    BOOST_CHECK(!wallet.GetScriptPubKeys().count(scriptMultisig));
+
+    // Block filters can not find the outputs to it, so rescans read every block
+    BOOST_CHECK(!wallet.HasBareMultisig());
+    ReceiveBalanceWith({CTxOut(10 * COIN, scriptMultisig)}, wallet);
+    BOOST_CHECK(wallet.HasBareMultisig());
+}
+
+BOOST_AUTO_TEST_CASE(sqlite_walletdb_tests)
+{
+    // The mock environment keeps SQLite files in memory
+    mapArgs["-walletbackend"] = "sqlite";
+    BOOST_CHECK(bitdb.IsSQLite("test_sqlite.dat", true));
+    std::vector<std::string> vAddresses;
+    for (int i = 0; i < 3; i++) {
+        CKey key;
+        key.MakeNewKey(true);
+        vAddresses.push_back(EncodeDestination(key.GetPubKey().GetID()));
+    }
+    {
+        CWalletDB walletdb("test_sqlite.dat", "cr+");
+        CAccountingEntry entry;
+        for (const char* strAccount : {"b", "a", "c"}) {
+            for (CAmount nCredit = 1; nCredit <= 3; nCredit++) {
+                entry.strAccount = strAccount;
+                entry.nCreditDebit = nCredit;
+                BOOST_CHECK(walletdb.WriteAccountingEntry_Backend(entry));
+            }
+        }
+
+        // Range reads start at the account and walk the keys in order
+        std::list<CAccountingEntry> entries;
+        walletdb.ListAccountCreditDebit("a", entries);
+        BOOST_CHECK_EQUAL(entries.size(), 3U);
+        for (const CAccountingEntry& acentry : entries)
+            BOOST_CHECK_EQUAL(acentry.strAccount, "a");
+        BOOST_CHECK_EQUAL(walletdb.GetAccountCreditDebit("b"), 6);
+        entries.clear();
+        walletdb.ListAccountCreditDebit("*", entries);
+        BOOST_CHECK_EQUAL(entries.size(), 9U);
+        BOOST_CHECK_EQUAL(entries.front().strAccount, "a");
+        BOOST_CHECK_EQUAL(entries.back().strAccount, "c");
+
+        BOOST_CHECK(walletdb.WriteName(vAddresses[0], "kept"));
+        BOOST_CHECK(walletdb.TxnBegin());
+        BOOST_CHECK(!walletdb.TxnBegin());
+        BOOST_CHECK(walletdb.WriteName(vAddresses[1], "aborted"));
+        BOOST_CHECK(walletdb.TxnAbort());
+        BOOST_CHECK(walletdb.TxnBegin());
+        BOOST_CHECK(walletdb.WriteName(vAddresses[2], "committed"));
+        BOOST_CHECK(walletdb.TxnCommit());
+    }
+
+    // A wallet loads from the file like from a Berkeley database
+    CWallet wallet("test_sqlite.dat");
+    bool fFirstRun;
+    BOOST_CHECK_EQUAL(wallet.LoadWallet(fFirstRun), DB_LOAD_OK);
+    {
+        LOCK(wallet.cs_wallet);
+        std::set<std::string> setNames;
+        for (const auto& item : wallet.mapAddressBook)
+            setNames.insert(item.second.name);
+        BOOST_CHECK(setNames == std::set<std::string>({"kept", "committed"}));
+    }
+    mapArgs.erase("-walletbackend");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -9,6 +9,7 @@
 
 #include "wallet/wallet.h"
 
+#include "blockfilter.h"
 #include "coincontrol.h"
 #include "init.h"
 #include "guiinterfaceutil.h"
@@ -19,12 +20,17 @@
 #include "rewards.h"
 #include "script/sign.h"
 #include "spork.h"
+#include "txdb.h"
 #include "util.h"
 #include "utilmoneystr.h"
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
 
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
 CWallet* pwalletMain = nullptr;
 /**
  * Settings
@@ -59,14 +65,6 @@ const uint256 CMerkleTx::ABANDON_HASH(uint256S("00000000000000000000000000000000
  * @{
  */
 
-struct CompareValueOnly {
-    bool operator()(const std::pair<CAmount, std::pair<const CWalletTx*, unsigned int> >& t1,
-        const std::pair<CAmount, std::pair<const CWalletTx*, unsigned int> >& t2) const
-    {
-        return t1.first < t2.first;
-    }
-};
-
 std::string COutput::ToString() const
 {
     return strprintf("COutput(%s, %d, %d) [%s]", tx->GetHash().ToString(), i, nDepth, FormatMoney(tx->vout[i].nValue));
@@ -617,6 +615,11 @@ void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
     mapTxSpends.insert(std::make_pair(outpoint, wtxid));
     setLockedCoins.erase(outpoint);
 
+    // The credit of the spent tx changed
+    auto it = mapWallet.find(outpoint.hash);
+    if (it != mapWallet.end())
+        it->second.MarkDirty();
+
     std::pair<TxSpends::iterator, TxSpends::iterator> range;
     range = mapTxSpends.equal_range(outpoint);
     SyncMetaData(range);
@@ -867,6 +870,8 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
     //// debug print
     LogPrintf("AddToWallet %s  %s%s\n", wtxIn.GetHash().ToString(), (fInsertedNew ? "new" : ""), (fUpdated ? "update" : ""));
 
+    IndexTx(wtx, fInsertedNew);
+
     // Write to disk
     if (fInsertedNew || fUpdated) {
         if (!walletdb.WriteTx(wtx))
@@ -894,9 +899,11 @@ bool CWallet::LoadToWallet(const CWalletTx& wtxIn)
     const uint256& hash = wtxIn.GetHash();
     mapWallet[hash] = wtxIn;
     setWallet.insert(hash);
+    MarkBalancesDirty(hash);
     CWalletTx& wtx = mapWallet[hash];
     wtx.BindWallet(this);
     wtxOrdered.insert(std::make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
+    IndexTx(wtx, true);
     AddToSpends(hash);
     for (const CTxIn& txin : wtx.vin) {
         if (mapWallet.count(txin.prevout.hash)) {
@@ -909,6 +916,54 @@ bool CWallet::LoadToWallet(const CWalletTx& wtxIn)
     return true;
 }
 
+void CWallet::LoadToWallet(std::vector<CWalletTx>& vWtx)
+{
+    AssertLockHeld(cs_wallet);
+    std::vector<CWalletTx*> vLoaded;
+    vLoaded.reserve(vWtx.size());
+    mapWallet.reserve(mapWallet.size() + vWtx.size());
+    for (CWalletTx& wtxIn : vWtx) {
+        const uint256 hash = wtxIn.GetHash();
+        CWalletTx& wtx = mapWallet[hash];
+        wtx = std::move(wtxIn);
+        setWallet.insert(hash);
+        wtx.BindWallet(this);
+        wtxOrdered.insert(std::make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
+        IndexTx(wtx, true);
+        vLoaded.push_back(&wtx);
+    }
+    std::vector<CWalletTx>().swap(vWtx);
+
+    // Index the spends, then sync the metadata of conflicting ones once
+    std::set<COutPoint> setConflicts;
+    for (const CWalletTx* pwtx : vLoaded) {
+        if (pwtx->IsCoinBase())
+            continue;
+        for (const CTxIn& txin : pwtx->vin) {
+            auto it = mapTxSpends.insert(std::make_pair(txin.prevout, pwtx->GetHash()));
+            if (it != mapTxSpends.begin() && std::prev(it)->first == txin.prevout)
+                setConflicts.insert(txin.prevout);
+            setLockedCoins.erase(txin.prevout);
+        }
+    }
+    for (const COutPoint& outpoint : setConflicts)
+        SyncMetaData(mapTxSpends.equal_range(outpoint));
+    MarkBalancesDirty();
+
+    // Every parent is loaded by now, see LoadToWallet above
+    for (const CWalletTx* pwtx : vLoaded) {
+        for (const CTxIn& txin : pwtx->vin) {
+            auto it = mapWallet.find(txin.prevout.hash);
+            if (it == mapWallet.end())
+                continue;
+            // The credit of the spent tx changed
+            it->second.MarkDirty();
+            if (it->second.nIndex == -1 && !it->second.hashUnset())
+                MarkConflicted(it->second.hashBlock, pwtx->GetHash());
+        }
+    }
+}
+
 /**
  * Add a transaction to the wallet, or update it.
  * pblock is optional, but should be provided if the transaction is known to be in a block.
@@ -993,6 +1048,7 @@ bool CWallet::AbandonTransaction(const uint256& hashTx)
             wtx.setAbandoned();
             wtx.MarkDirty();
             walletdb.WriteTx(wtx);
+            IndexTx(wtx, false);
             NotifyTransactionChanged(this, wtx.GetHash(), CT_UPDATED);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them abandoned too
             TxSpends::const_iterator iter = mapTxSpends.lower_bound(COutPoint(now, 0));
@@ -1056,6 +1112,7 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
             wtx.hashBlock = hashBlock;
             wtx.MarkDirty();
             walletdb.WriteTx(wtx);
+            IndexTx(wtx, false);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them conflicted too
             TxSpends::const_iterator iter = mapTxSpends.lower_bound(COutPoint(now, 0));
             while (iter != mapTxSpends.end() && iter->first.hash == now) {
@@ -1098,6 +1155,7 @@ void CWallet::EraseFromWallet(const uint256& hash)
         LOCK(cs_wallet);
         if (mapWallet.erase(hash)) {
             setWallet.erase(hash);
+            MarkBalancesDirty(hash);
             CWalletDB(strWalletFile).EraseTx(hash);
         }
         LogPrintf("%s: Erased wtx %s from wallet\n", __func__, hash.GetHex());
@@ -1105,16 +1163,348 @@ void CWallet::EraseFromWallet(const uint256& hash)
     return;
 }
 
+static bool IsInActiveChain(const uint256& hashBlock)
+{
+    BlockMap::const_iterator mi = mapBlockIndex.find(hashBlock);
+    return mi != mapBlockIndex.end() && mi->second && chainActive.Contains(mi->second);
+}
+
+void CWallet::IndexTx(const CWalletTx& wtx, bool fNew)
+{
+    const uint256& hash = wtx.GetHash();
+    if (fNew) {
+        for (const CTxOut& txout : wtx.vout) {
+            CTxDestination dest;
+            if (!ExtractDestination(txout.scriptPubKey, dest))
+                continue;
+            std::vector<uint256>& vTxs = mapTxsByDestination[dest];
+            if (vTxs.empty() || vTxs.back() != hash)
+                vTxs.push_back(hash);
+        }
+    }
+
+    const bool fInBlock = !wtx.hashUnset() && wtx.nIndex != -1;
+    if (fInBlock) {
+        auto range = mapTxsByBlock.equal_range(wtx.hashBlock);
+        if (std::none_of(range.first, range.second, [&hash](const std::pair<const uint256, uint256>& entry) { return entry.second == hash; }))
+            mapTxsByBlock.emplace(wtx.hashBlock, hash);
+    }
+    // Disconnected blocks keep their txs' hashBlock, the tip moved already
+    if (!fInBlock || !IsInActiveChain(wtx.hashBlock))
+        setTxsMaybeUnconfirmed.insert(hash);
+}
+
+void CWallet::PruneTxIndexes()
+{
+    AssertLockHeld(cs_wallet);
+    for (auto it = mapTxsByBlock.begin(); it != mapTxsByBlock.end();)
+        it = mapWallet.count(it->second) ? std::next(it) : mapTxsByBlock.erase(it);
+    for (auto it = setTxsMaybeUnconfirmed.begin(); it != setTxsMaybeUnconfirmed.end();)
+        it = mapWallet.count(*it) ? std::next(it) : setTxsMaybeUnconfirmed.erase(it);
+    for (auto it = mapTxsByDestination.begin(); it != mapTxsByDestination.end();) {
+        std::vector<uint256>& vTxs = it->second;
+        vTxs.erase(std::remove_if(vTxs.begin(), vTxs.end(), [this](const uint256& hash) { return !mapWallet.count(hash); }), vTxs.end());
+        it = vTxs.empty() ? mapTxsByDestination.erase(it) : std::next(it);
+    }
+}
+
+std::vector<const CWalletTx*> CWallet::GetTransactionsSince(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    const int nDepth = 1 + chainActive.Height() - pindex->nHeight;
+    std::vector<const CWalletTx*> vTxs;
+
+    // Confirmed ones leave the set here, a disconnect adds them back
+    for (auto it = setTxsMaybeUnconfirmed.begin(); it != setTxsMaybeUnconfirmed.end();) {
+        auto mi = mapWallet.find(*it);
+        const int nTxDepth = mi != mapWallet.end() ? mi->second.GetDepthInMainChain(false) : 1;
+        if (nTxDepth > 0) {
+            it = setTxsMaybeUnconfirmed.erase(it);
+            continue;
+        }
+        if (nTxDepth < nDepth)
+            vTxs.push_back(&mi->second);
+        ++it;
+    }
+
+    for (int nHeight = std::max(pindex->nHeight + 1, 0); nHeight <= chainActive.Height(); nHeight++) {
+        auto range = mapTxsByBlock.equal_range(chainActive[nHeight]->GetBlockHash());
+        for (auto it = range.first; it != range.second;) {
+            auto mi = mapWallet.find(it->second);
+            if (mi == mapWallet.end() || mi->second.hashBlock != it->first || mi->second.nIndex == -1) {
+                it = mapTxsByBlock.erase(it);
+                continue;
+            }
+            vTxs.push_back(&mi->second);
+            ++it;
+        }
+    }
+    return vTxs;
+}
+
+std::vector<const CWalletTx*> CWallet::GetTransactionsTo(const CTxDestination& dest) const
+{
+    AssertLockHeld(cs_wallet);
+    std::vector<const CWalletTx*> vTxs;
+    auto it = mapTxsByDestination.find(dest);
+    if (it == mapTxsByDestination.end())
+        return vTxs;
+    for (const uint256& hash : it->second) {
+        auto mi = mapWallet.find(hash);
+        if (mi != mapWallet.end())
+            vTxs.push_back(&mi->second);
+    }
+    // A tx erased and added back before the indexes were pruned is there twice
+    std::sort(vTxs.begin(), vTxs.end());
+    vTxs.erase(std::unique(vTxs.begin(), vTxs.end()), vTxs.end());
+    return vTxs;
+}
+
+/** Transactions archived per wallet DB transaction */
+static const size_t WALLET_ARCHIVE_BATCH = 1000;
+
+/** Resident set size of the process in MiB, 0 where it can't be read */
+static size_t GetResidentMemoryMiB()
+{
+    size_t nResident = 0;
+#ifdef __linux__
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (file) {
+        unsigned long nSize, nPages;
+        if (fscanf(file, "%lu %lu", &nSize, &nPages) == 2)
+            nResident = nPages * sysconf(_SC_PAGESIZE) / (1024 * 1024);
+        fclose(file);
+    }
+#endif
+    return nResident;
+}
+
+unsigned int CWallet::ArchiveSpentTransactions()
+{
+    if (!fFileBacked)
+        return 0;
+
+    const int64_t nStart = GetTimeMillis();
+    const size_t nResidentBefore = GetResidentMemoryMiB();
+    const int nMaxReorgDepth = GetArg("-maxreorg", DEFAULT_MAX_REORG_DEPTH);
+
+    size_t nWalletTxs;
+    std::vector<uint256> vArchive;
+    {
+        LOCK2(cs_main, cs_wallet);
+        nWalletTxs = mapWallet.size();
+
+        // Deep transactions whose outputs to us were all spent deep too
+        std::vector<const CWalletTx*> vCandidates;
+        for (const auto& item : mapWallet) {
+            const CWalletTx& wtx = item.second;
+            if (wtx.GetDepthInMainChain() <= nMaxReorgDepth)
+                continue;
+            bool fSpent = true;
+            for (const auto& mineOutput : wtx.GetMineOutputs()) {
+                int nSpendDepth;
+                if (!IsSpent(item.first, mineOutput.first, nSpendDepth) || nSpendDepth <= nMaxReorgDepth) {
+                    fSpent = false;
+                    break;
+                }
+            }
+            if (fSpent)
+                vCandidates.push_back(&wtx);
+        }
+
+        // Oldest first, so parents go before the transactions spending them.
+        // A transaction with a parent left in mapWallet stays, as the parent
+        // needs it in mapTxSpends to see its outputs spent.
+        std::sort(vCandidates.begin(), vCandidates.end(), [](const CWalletTx* a, const CWalletTx* b) {
+            return a->nOrderPos < b->nOrderPos;
+        });
+        std::set<uint256> setSelected;
+        for (const CWalletTx* pwtx : vCandidates) {
+            bool fParentsArchived = true;
+            for (const CTxIn& txin : pwtx->vin) {
+                if (mapWallet.count(txin.prevout.hash) && !setSelected.count(txin.prevout.hash)) {
+                    fParentsArchived = false;
+                    break;
+                }
+            }
+            if (fParentsArchived) {
+                setSelected.insert(pwtx->GetHash());
+                vArchive.push_back(pwtx->GetHash());
+            }
+        }
+    }
+
+    // Archive in batches, parents are never in a later batch than their
+    // spenders. The locks are released between batches, so that block
+    // processing and the RPCs don't wait for the whole pass.
+    std::set<uint256> setArchived;
+    auto fSpendersArchived = [&](const COutPoint& outpoint) {
+        auto range = mapTxSpends.equal_range(outpoint);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (!setArchived.count(it->second))
+                return false;
+        }
+        return true;
+    };
+    unsigned int nArchived = 0;
+    for (size_t nBatch = 0; nBatch < vArchive.size(); nBatch += WALLET_ARCHIVE_BATCH) {
+        boost::this_thread::interruption_point();
+        LOCK2(cs_main, cs_wallet);
+
+        // The transactions may have been erased by a zap meanwhile
+        std::vector<const CWalletTx*> vBatch;
+        for (size_t i = nBatch; i < std::min(nBatch + WALLET_ARCHIVE_BATCH, vArchive.size()); i++) {
+            auto it = mapWallet.find(vArchive[i]);
+            if (it != mapWallet.end()) {
+                vBatch.push_back(&it->second);
+                setArchived.insert(vArchive[i]);
+            }
+        }
+
+        // Outputs spent by transactions staying in mapWallet are kept in
+        // mapArchivedOutputs, until their last spender is archived
+        std::map<COutPoint, CTxOut> mapAddOutputs;
+        std::set<COutPoint> setEraseOutputs;
+        for (const CWalletTx* pwtx : vBatch) {
+            for (const auto& mineOutput : pwtx->GetMineOutputs()) {
+                const COutPoint outpoint(pwtx->GetHash(), mineOutput.first);
+                if (!fSpendersArchived(outpoint))
+                    mapAddOutputs.emplace(outpoint, pwtx->vout[mineOutput.first]);
+            }
+            for (const CTxIn& txin : pwtx->vin) {
+                if (mapArchivedOutputs.count(txin.prevout) && fSpendersArchived(txin.prevout))
+                    setEraseOutputs.insert(txin.prevout);
+            }
+        }
+
+        CWalletDB walletdb(strWalletFile);
+        bool fOk = walletdb.TxnBegin();
+        int64_t nIndex = nArchivedTxs;
+        std::vector<std::pair<int64_t, int64_t> > vOrder;
+        for (auto it = vBatch.begin(); fOk && it != vBatch.end(); ++it) {
+            const CWalletTx* pwtx = *it;
+            // A rescan brings archived transactions back, they are only dropped again
+            if (!walletdb.ExistsArchivedTx(pwtx->GetHash())) {
+                vOrder.emplace_back(pwtx->nOrderPos, nIndex);
+                fOk = walletdb.WriteArchivedTx(nIndex++, CArchivedTx(*pwtx));
+            }
+            fOk = fOk && walletdb.EraseTx(pwtx->GetHash());
+        }
+        for (auto it = mapAddOutputs.begin(); fOk && it != mapAddOutputs.end(); ++it)
+            fOk = walletdb.WriteArchivedOutput(it->first, it->second);
+        for (auto it = setEraseOutputs.begin(); fOk && it != setEraseOutputs.end(); ++it)
+            fOk = walletdb.EraseArchivedOutput(*it);
+        fOk = fOk && walletdb.WriteArchivedTxCount(nIndex) && walletdb.TxnCommit();
+        if (!fOk) {
+            walletdb.TxnAbort();
+            LogPrintf("%s: Failed to write the wallet archive\n", __func__);
+            break;
+        }
+        nArchivedTxs = nIndex;
+        const size_t nOrderSize = vArchivedOrder.size();
+        vArchivedOrder.insert(vArchivedOrder.end(), vOrder.begin(), vOrder.end());
+        std::sort(vArchivedOrder.begin() + nOrderSize, vArchivedOrder.end());
+        std::inplace_merge(vArchivedOrder.begin(), vArchivedOrder.begin() + nOrderSize, vArchivedOrder.end());
+
+        for (const CWalletTx* pwtx : vBatch) {
+            const uint256 hash = pwtx->GetHash();
+            for (const CTxIn& txin : pwtx->vin) {
+                auto range = mapTxSpends.equal_range(txin.prevout);
+                for (auto itSpend = range.first; itSpend != range.second;)
+                    itSpend = itSpend->second == hash ? mapTxSpends.erase(itSpend) : std::next(itSpend);
+            }
+            auto range = wtxOrdered.equal_range(pwtx->nOrderPos);
+            for (auto itOrdered = range.first; itOrdered != range.second; ++itOrdered) {
+                if (itOrdered->second.first == pwtx) {
+                    wtxOrdered.erase(itOrdered);
+                    break;
+                }
+            }
+            setWallet.erase(hash);
+            mapWallet.erase(hash);
+            MarkBalancesDirty(hash);
+            nArchived++;
+        }
+        mapArchivedOutputs.insert(mapAddOutputs.begin(), mapAddOutputs.end());
+        for (const COutPoint& outpoint : setEraseOutputs)
+            mapArchivedOutputs.erase(outpoint);
+    }
+
+    if (nArchived > 0) {
+        LOCK2(cs_main, cs_wallet);
+        mapWallet.rehash(0);
+        setWallet.rehash(0);
+        PruneTxIndexes();
+        LogPrintf("%s: Archived %u spent transactions in %dms, %u of %u left in memory, resident memory %u MiB -> %u MiB\n",
+            __func__, nArchived, GetTimeMillis() - nStart, mapWallet.size(), nWalletTxs, nResidentBefore, GetResidentMemoryMiB());
+    }
+    return nArchived;
+}
+
+bool CWallet::ReadArchivedTxs(const std::vector<int64_t>& vIndexes, std::vector<CArchivedTx>& vArchived)
+{
+    vArchived.clear();
+    if (!fFileBacked)
+        return false;
+    CWalletDB walletdb(strWalletFile);
+    vArchived.resize(vIndexes.size());
+    for (size_t i = 0; i < vIndexes.size(); i++) {
+        if (!walletdb.ReadArchivedTx(vIndexes[i], vArchived[i]))
+            return false;
+        vArchived[i].BindWallet(this);
+    }
+    return true;
+}
+
+void CWallet::RequestArchiveSpentTransactions(int nHeight)
+{
+    boost::unique_lock<boost::mutex> lock(csArchive);
+    if (nHeight <= nLastArchiveHeight)
+        return;
+    nArchiveHeight = nHeight;
+    condArchive.notify_one();
+}
+
+void CWallet::ThreadArchiveSpentTransactions()
+{
+    while (true) {
+        {
+            boost::unique_lock<boost::mutex> lock(csArchive);
+            // Requests made during a pass are served by a single next pass
+            while (nArchiveHeight <= nLastArchiveHeight)
+                condArchive.wait(lock);
+            nLastArchiveHeight = nArchiveHeight;
+        }
+        ArchiveSpentTransactions();
+    }
+}
+
+bool CWallet::ReadArchivedTx(const uint256& hash, CArchivedTx& archived)
+{
+    if (!fFileBacked || !CWalletDB(strWalletFile).ReadArchivedTx(hash, archived))
+        return false;
+    archived.BindWallet(this);
+    return true;
+}
+
+const CTxOut* CWallet::GetPrevOut(const COutPoint& outpoint) const
+{
+    AssertLockHeld(cs_wallet);
+    auto mi = mapWallet.find(outpoint.hash);
+    if (mi != mapWallet.end())
+        return outpoint.n < mi->second.vout.size() ? &mi->second.vout[outpoint.n] : nullptr;
+    auto ai = mapArchivedOutputs.find(outpoint);
+    return ai != mapArchivedOutputs.end() ? &ai->second : nullptr;
+}
+
 isminetype CWallet::IsMine(const CTxIn& txin) const
 {
     {
         LOCK(cs_wallet);
-        auto mi = mapWallet.find(txin.prevout.hash);
-        if (mi != mapWallet.end()) {
-            const CWalletTx& prev = (*mi).second;
-            if (txin.prevout.n < prev.vout.size())
-                return IsMine(prev.vout[txin.prevout.n]);
-        }
+        const CTxOut* pprevout = GetPrevOut(txin.prevout);
+        if (pprevout)
+            return IsMine(*pprevout);
     }
     return ISMINE_NO;
 }
@@ -1144,13 +1534,9 @@ CAmount CWallet::GetDebit(const CTxIn& txin, const isminefilter& filter) const
 {
     {
         LOCK(cs_wallet);
-        auto mi = mapWallet.find(txin.prevout.hash);
-        if (mi != mapWallet.end()) {
-            const CWalletTx& prev = (*mi).second;
-            if (txin.prevout.n < prev.vout.size())
-                if (IsMine(prev.vout[txin.prevout.n]) & filter)
-                    return prev.vout[txin.prevout.n].nValue;
-        }
+        const CTxOut* pprevout = GetPrevOut(txin.prevout);
+        if (pprevout && (IsMine(*pprevout) & filter))
+            return pprevout->nValue;
     }
     return 0;
 }
@@ -1404,6 +1790,237 @@ bool CWallet::Upgrade(std::string& error, const int& prevVersion)
     return true;
 }
 
+/** Maximum number of blocks a wallet rescan reads ahead of the transactions it adds */
+static const size_t MAX_RESCAN_BLOCKS_AHEAD = 256;
+
+namespace {
+typedef boost::unordered_set<uint256, uint256CheapHasher> RescanTxids;
+typedef boost::unordered_set<COutPoint, COutPointCheapHasher> RescanOutPoints;
+
+/** A block of a wallet rescan, with the transactions that may involve the wallet */
+struct RescanBlock {
+    const CBlockIndex* pindex;
+    CBlock block;
+    bool fRead;
+    bool fDone;
+    //! The block filter matched none of the wallet scripts, the block was not read
+    bool fSkipped;
+    //! GetKeyStoreSize() when vMatch was filled or the filter was matched
+    size_t nKeyStoreSize;
+    std::vector<bool> vMatch;
+
+    explicit RescanBlock(const CBlockIndex* pindexIn) : pindex(pindexIn), fRead(false), fDone(false), fSkipped(false), nKeyStoreSize(0) {}
+};
+
+/**
+ * Reads the blocks of a wallet rescan in chain order on several threads and
+ * marks their transactions that pay to a wallet key or script, or spend or
+ * double spend a wallet transaction known when the rescan started. With
+ * -blockfilterindex, blocks whose filter matches none of the wallet scripts
+ * are not read at all, unless the wallet uses bare multisig scripts.
+ */
+class CWalletRescanner
+{
+private:
+    boost::mutex cs;
+    boost::condition_variable cond;
+    //! Blocks in chain order, the first nClaimed ones are read or being read
+    std::deque<std::unique_ptr<RescanBlock> > queue;
+    size_t nClaimed;
+    bool fStop;
+    const CWallet& wallet;
+    const RescanTxids& setTxids;
+    const RescanOutPoints& setSpent;
+    boost::thread_group threadGroup;
+    //! Whether blocks are matched against their filter before they are read (-blockfilterindex)
+    const bool fUseFilters;
+    boost::mutex csScripts;
+    //! Wallet scripts as filter elements, rebuilt when the key store grows
+    std::shared_ptr<const GCSFilter::ElementSet> pscripts;
+    size_t nScriptsKeyStoreSize;
+
+    std::shared_ptr<const GCSFilter::ElementSet> GetScripts(size_t& nKeyStoreSize)
+    {
+        boost::unique_lock<boost::mutex> lock(csScripts);
+        // Taken before the scripts, so keys added meanwhile make the caller match again
+        nKeyStoreSize = wallet.GetKeyStoreSize();
+        if (!pscripts || nScriptsKeyStoreSize != nKeyStoreSize) {
+            std::shared_ptr<GCSFilter::ElementSet> pnew = std::make_shared<GCSFilter::ElementSet>();
+            for (const CScript& script : wallet.GetScriptPubKeys())
+                pnew->emplace(script.begin(), script.end());
+            pscripts = pnew;
+            nScriptsKeyStoreSize = nKeyStoreSize;
+        }
+        return pscripts;
+    }
+
+    /** Whether the filter of the block shows that none of its scripts belong to the wallet */
+    bool FilterExcludes(RescanBlock& item)
+    {
+        if (!fUseFilters)
+            return false;
+        BlockFilter filter;
+        if (!pblockfilterdb->ReadFilter(item.pindex->GetBlockHash(), filter))
+            return false;
+        return !filter.GetFilter().MatchAny(*GetScripts(item.nKeyStoreSize));
+    }
+
+    void Thread()
+    {
+        while (true) {
+            RescanBlock* item;
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                while (!fStop && nClaimed == queue.size())
+                    cond.wait(lock);
+                if (fStop)
+                    return;
+                item = queue[nClaimed++].get();
+            }
+            Process(*item);
+            boost::unique_lock<boost::mutex> lock(cs);
+            item->fDone = true;
+            cond.notify_all();
+        }
+    }
+
+public:
+    CWalletRescanner(const CWallet& walletIn, const RescanTxids& setTxidsIn, const RescanOutPoints& setSpentIn, int nThreads, bool fUseFiltersIn) :
+        nClaimed(0), fStop(false), wallet(walletIn), setTxids(setTxidsIn), setSpent(setSpentIn),
+        fUseFilters(fUseFiltersIn), nScriptsKeyStoreSize(0)
+    {
+        for (int i = 0; i < nThreads; i++)
+            threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "rescan", boost::function<void()>(boost::bind(&CWalletRescanner::Thread, this))));
+    }
+
+    ~CWalletRescanner()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            fStop = true;
+            cond.notify_all();
+        }
+        threadGroup.interrupt_all();
+        threadGroup.join_all();
+    }
+
+    /** Fill vMatch of a block that was read */
+    void Match(RescanBlock& item) const
+    {
+        item.nKeyStoreSize = wallet.GetKeyStoreSize();
+        item.vMatch.assign(item.block.vtx.size(), false);
+        for (size_t i = 0; i < item.block.vtx.size(); i++) {
+            const CTransaction& tx = item.block.vtx[i];
+            bool fMatch = setTxids.count(tx.GetHash()) || wallet.IsMine(tx);
+            for (size_t j = 0; !fMatch && j < tx.vin.size(); j++)
+                fMatch = setTxids.count(tx.vin[j].prevout.hash) || setSpent.count(tx.vin[j].prevout);
+            item.vMatch[i] = fMatch;
+        }
+    }
+
+    /** Read and match a block unless its filter excludes it */
+    void Process(RescanBlock& item)
+    {
+        item.fSkipped = FilterExcludes(item);
+        if (item.fSkipped)
+            return;
+        try {
+            item.fRead = ReadBlockFromDisk(item.block, item.pindex);
+        } catch (const std::exception& e) {
+            LogPrintf("%s : Deserialize or I/O error - %s\n", __func__, e.what());
+            item.fRead = false;
+        }
+        if (item.fRead)
+            Match(item);
+    }
+
+    void Push(const CBlockIndex* pindex)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        queue.emplace_back(new RescanBlock(pindex));
+        cond.notify_all();
+    }
+
+    size_t Size()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        return queue.size();
+    }
+
+    /** Take the next block in chain order, reading it here if no thread started to. Returns false if none is queued. */
+    bool Pop(std::unique_ptr<RescanBlock>& item)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (queue.empty())
+            return false;
+        if (nClaimed == 0) {
+            nClaimed++;
+            RescanBlock* pitem = queue.front().get();
+            lock.unlock();
+            Process(*pitem);
+            lock.lock();
+            pitem->fDone = true;
+        }
+        while (!queue.front()->fDone)
+            cond.wait(lock);
+        item = std::move(queue.front());
+        queue.pop_front();
+        nClaimed--;
+        return true;
+    }
+};
+} // namespace
+
+size_t CWallet::GetKeyStoreSize() const
+{
+    LOCK(cs_KeyStore);
+    return mapKeys.size() + mapCryptedKeys.size() + mapScripts.size() + setWatchOnly.size();
+}
+
+std::set<CScript> CWallet::GetScriptPubKeys() const
+{
+    std::set<CScript> setScripts;
+    LOCK(cs_KeyStore);
+    std::set<CKeyID> setKeyIds;
+    GetKeys(setKeyIds);
+    for (const CKeyID& keyId : setKeyIds) {
+        setScripts.insert(GetScriptForDestination(keyId));
+        CPubKey pubkey;
+        if (GetPubKey(keyId, pubkey))
+            setScripts.insert(GetScriptForRawPubKey(pubkey));
+    }
+    for (const auto& item : mapScripts) {
+        setScripts.insert(GetScriptForDestination(CScriptID(item.second)));
+        setScripts.insert(item.second);
+    }
+    setScripts.insert(setWatchOnly.begin(), setWatchOnly.end());
+    return setScripts;
+}
+
+bool CWallet::HasBareMultisig() const
+{
+    auto isMultisig = [](const CScript& script) {
+        txnouttype type;
+        std::vector<std::vector<unsigned char> > vSolutions;
+        return Solver(script, type, vSolutions) && type == TX_MULTISIG;
+    };
+    {
+        LOCK(cs_KeyStore);
+        for (const auto& item : mapScripts) {
+            if (isMultisig(item.second))
+                return true;
+        }
+    }
+    LOCK(cs_wallet);
+    for (const auto& item : mapWallet) {
+        for (const CTxOut& txout : item.second.vout) {
+            if (isMultisig(txout.scriptPubKey) && IsMine(txout) != ISMINE_NO)
+                return true;
+        }
+    }
+    return false;
+}
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
@@ -1414,12 +2031,14 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate, b
 {
     int ret = 0;
     int64_t nNow = GetTime();
+    const int64_t nStart = GetTimeMicros();
+    const int nThreads = std::max(0, std::min((int)GetArg("-rescanthreads", DEFAULT_RESCAN_THREADS), MAX_RESCAN_THREADS));
 
-    const Consensus::Params& consensus = Params().GetConsensus();
-
-    CBlockIndex* pindex = pindexStart;
+    const CBlockIndex* pindex = pindexStart;
+    double dProgressStart;
+    double dProgressTip;
     {
-        LOCK2(cs_main, cs_wallet);
+        LOCK(cs_main);
 
         // no need to read and scan block, if block was created before
         // our wallet birthday (as adjusted for block time variability)
@@ -1427,58 +2046,158 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate, b
                 (pindex->nHeight < 1))
             pindex = chainActive.Next(pindex);
 
-        ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
-        double dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
-        std::set<uint256> setAddedToWallet;
-        while (pindex) {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+        dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
+        dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
+    }
 
-            if (fromStartup && ShutdownRequested()) {
-                return -1;
+    // Transactions and spends the wallet knows now can be matched by the rescan threads
+    RescanTxids setTxids;
+    RescanOutPoints setSpent;
+    {
+        LOCK(cs_wallet);
+        for (const auto& item : mapWallet)
+            setTxids.insert(item.first);
+        for (const auto& item : mapTxSpends)
+            setSpent.insert(item.first);
+    }
+    // The ones added by this rescan are only known here
+    RescanTxids setTxidsFound;
+    RescanOutPoints setSpentFound;
+
+    ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
+    // Bare multisig outputs paying to the wallet keys do not match the filters of these keys
+    bool fUseFilters = fBlockFilterIndex && pblockfilterdb;
+    if (fUseFilters && HasBareMultisig()) {
+        LogPrintf("%s : the wallet uses bare multisig scripts, reading every block\n", __func__);
+        fUseFilters = false;
+    }
+    CWalletRescanner rescanner(*this, setTxids, setSpent, nThreads, fUseFilters);
+    const CBlockIndex* pindexQueued = nullptr;
+    std::unique_ptr<RescanBlock> item;
+    uint64_t nBlocks = 0;
+    uint64_t nSkipped = 0;
+    while (true) {
+        if (rescanner.Size() <= MAX_RESCAN_BLOCKS_AHEAD / 2) {
+            LOCK(cs_main);
+            while (rescanner.Size() < MAX_RESCAN_BLOCKS_AHEAD) {
+                // Continue from the fork point if the chain was reorganized
+                const CBlockIndex* pindexNext = pindexQueued ? chainActive.Next(chainActive.FindFork(pindexQueued)) : pindex;
+                if (!pindexNext)
+                    break;
+                rescanner.Push(pindexNext);
+                pindexQueued = pindexNext;
             }
+        }
+        if (!rescanner.Pop(item))
+            break;
+        pindex = item->pindex;
+        nBlocks++;
+
+        if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
+            ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+
+        if (fromStartup && ShutdownRequested()) {
+            return -1;
+        }
+
+        if (GetTime() >= nNow + 60) {
+            nNow = GetTime();
+            LogPrintf("Still rescanning. At block %d. Progress=%f (%.1f blocks/s)\n", pindex->nHeight,
+                    Checkpoints::GuessVerificationProgress(pindex), nBlocks / (std::max(GetTimeMicros() - nStart, (int64_t)1) * 0.000001));
+        }
+
+        // A keypool top up may have added keys the block was not matched against
+        if (item->fSkipped && item->nKeyStoreSize != GetKeyStoreSize())
+            rescanner.Process(*item);
+        if (item->fSkipped)
+            nSkipped++;
+        if (!item->fRead)
+            continue;
+        if (item->nKeyStoreSize != GetKeyStoreSize())
+            rescanner.Match(*item);
 
-            CBlock block;
-            ReadBlockFromDisk(block, pindex);
-            int posInBlock;
-            for (posInBlock = 0; posInBlock < (int)block.vtx.size(); posInBlock++) {
-                if (AddToWalletIfInvolvingMe(block.vtx[posInBlock], pindex, posInBlock, fUpdate))
-                    ret++;
+        // Whether the transaction involves one found earlier by this rescan
+        auto isFound = [&setTxidsFound, &setSpentFound](const CTransaction& tx) {
+            if (setTxidsFound.empty() && setSpentFound.empty())
+                return false;
+            if (setTxidsFound.count(tx.GetHash()))
+                return true;
+            for (const CTxIn& txin : tx.vin) {
+                if (setTxidsFound.count(txin.prevout.hash) || setSpentFound.count(txin.prevout))
+                    return true;
             }
+            return false;
+        };
+
+        // A block can only involve a transaction it adds if it matches another one first
+        const std::vector<CTransaction>& vtx = item->block.vtx;
+        bool fAnyMatch = false;
+        for (size_t i = 0; !fAnyMatch && i < vtx.size(); i++)
+            fAnyMatch = item->vMatch[i] || isFound(vtx[i]);
+        if (!fAnyMatch)
+            continue;
 
-            pindex = chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
+        LOCK2(cs_main, cs_wallet);
+        // Transactions of a block disconnected since it was queued come back through SyncTransaction
+        if (!chainActive.Contains(pindex))
+            continue;
+        for (size_t i = 0; i < vtx.size(); i++) {
+            // Checked in block order, so the spends of transactions found earlier in the block are seen
+            if (!item->vMatch[i] && !isFound(vtx[i]))
+                continue;
+            if (AddToWalletIfInvolvingMe(vtx[i], pindex, i, fUpdate))
+                ret++;
+            const uint256& hash = vtx[i].GetHash();
+            if (!setTxids.count(hash) && mapWallet.count(hash)) {
+                setTxidsFound.insert(hash);
+                for (const CTxIn& txin : vtx[i].vin)
+                    setSpentFound.insert(txin.prevout);
             }
         }
-        ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     }
+    ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+
+    const double dSeconds = std::max(GetTimeMicros() - nStart, (int64_t)1) * 0.000001;
+    LogPrintf("Rescanned %u blocks in %.1fs (%.1f blocks/s) with %d reader threads, %u skipped by block filters, %d transactions added\n",
+            nBlocks, dSeconds, nBlocks / dSeconds, nThreads, nSkipped, ret);
     return ret;
 }
 
 void CWallet::ReacceptWalletTransactions(bool fFirstLoad)
 {
-    LOCK2(cs_main, cs_wallet);
-    std::map<int64_t, CWalletTx*> mapSorted;
+    int64_t nStart = GetTimeMillis();
+    std::vector<uint256> vHashes;
+    {
+        LOCK2(cs_main, cs_wallet);
+        std::map<int64_t, uint256> mapSorted;
 
-    // Sort pending wallet transactions based on their initial wallet insertion order
-    for (PAIRTYPE(const uint256, CWalletTx)& item: mapWallet) {
-        const uint256& wtxid = item.first;
-        CWalletTx& wtx = item.second;
-        assert(wtx.GetHash() == wtxid);
+        // Sort pending wallet transactions based on their initial wallet insertion order
+        for (PAIRTYPE(const uint256, CWalletTx)& item: mapWallet) {
+            const uint256& wtxid = item.first;
+            CWalletTx& wtx = item.second;
+            assert(wtx.GetHash() == wtxid);
 
-        int nDepth = wtx.GetDepthInMainChain();
-        if (!wtx.IsCoinBase() && !wtx.IsCoinStake() && nDepth == 0  && !wtx.isAbandoned()) {
-            mapSorted.insert(std::make_pair(wtx.nOrderPos, &wtx));
+            int nDepth = wtx.GetDepthInMainChain();
+            if (!wtx.IsCoinBase() && !wtx.IsCoinStake() && nDepth == 0  && !wtx.isAbandoned()) {
+                mapSorted.insert(std::make_pair(wtx.nOrderPos, wtxid));
+            }
         }
+        for (const auto& item : mapSorted)
+            vHashes.push_back(item.second);
     }
 
-    // Try to add wallet transactions to memory pool
-    for (PAIRTYPE(const int64_t, CWalletTx*)& item: mapSorted)
+    // Try to add wallet transactions to memory pool. The locks are taken per
+    // transaction, so the first load can run while the node serves requests.
+    for (const uint256& hash : vHashes)
     {
-        CWalletTx& wtx = *(item.second);
+        boost::this_thread::interruption_point();
+        LOCK2(cs_main, cs_wallet);
+        auto it = mapWallet.find(hash);
+        if (it == mapWallet.end())
+            continue;
+        CWalletTx& wtx = it->second;
+        if (wtx.GetDepthInMainChain() != 0 || wtx.isAbandoned())
+            continue;
 
         LOCK(mempool.cs);
         bool fSuccess = wtx.AcceptToMemoryPool(false);
@@ -1488,6 +2207,8 @@ void CWallet::ReacceptWalletTransactions(bool fFirstLoad)
             AbandonTransaction(wtx.GetHash());
         }
     }
+    if (fFirstLoad)
+        LogPrintf("Reaccepted %u wallet transactions in %dms\n", vHashes.size(), GetTimeMillis() - nStart);
 }
 
 bool CWalletTx::InMempool() const
@@ -1540,6 +2261,10 @@ bool CWallet::Verify()
     if (walletFile != wallet_file_path.filename().string())
         return UIError(strprintf(_("Wallet %s resides outside data directory %s"), walletFile, strDataDir));
 
+    const std::string strBackend = GetArg("-walletbackend", DEFAULT_WALLET_BACKEND);
+    if (strBackend != "bdb" && strBackend != "sqlite")
+        return UIError(strprintf(_("Unknown wallet backend %s"), strBackend));
+
     LogPrintf("Using wallet %s\n", walletFile);
     uiInterface.InitMessage(_("Verifying wallet..."));
 
@@ -1580,6 +2305,14 @@ bool CWallet::Verify()
             return UIError(strprintf(_("%s corrupt, salvage failed"), walletFile));
     }
 
+    if (GetBoolArg("-migratewallet", false) && fs::exists(GetDataDir() / walletFile) && !bitdb.IsSQLite(walletFile)) {
+        uiInterface.InitMessage(_("Migrating wallet..."));
+        const std::string strBackup = strprintf("wallet.%d.bdb.bak", GetTime());
+        if (!CDB::MigrateToSQLite(walletFile, strBackup))
+            return UIError(strprintf(_("Failed to migrate %s to SQLite"), walletFile));
+        LogPrintf("Migrated %s to SQLite, the Berkeley DB file is kept as %s\n", walletFile, strBackup);
+    }
+
     return true;
 }
 
@@ -1645,14 +2378,141 @@ CAmount CWallet::loopTxsBalance(std::function<void(const uint256&, const CWallet
     return nTotal;
 }
 
+CWalletBalances& CWalletBalances::operator+=(const CWalletBalances& other)
+{
+    nTrusted += other.nTrusted;
+    nUntrusted += other.nUntrusted;
+    nImmature += other.nImmature;
+    nStakeable += other.nStakeable;
+    nLocked += other.nLocked;
+    nWatchOnlyTrusted += other.nWatchOnlyTrusted;
+    nWatchOnlyUntrusted += other.nWatchOnlyUntrusted;
+    nWatchOnlyImmature += other.nWatchOnlyImmature;
+    return *this;
+}
+
+CWalletBalances& CWalletBalances::operator-=(const CWalletBalances& other)
+{
+    nTrusted -= other.nTrusted;
+    nUntrusted -= other.nUntrusted;
+    nImmature -= other.nImmature;
+    nStakeable -= other.nStakeable;
+    nLocked -= other.nLocked;
+    nWatchOnlyTrusted -= other.nWatchOnlyTrusted;
+    nWatchOnlyUntrusted -= other.nWatchOnlyUntrusted;
+    nWatchOnlyImmature -= other.nWatchOnlyImmature;
+    return *this;
+}
+
+void CWallet::UpdateTxBalances(const uint256& hash) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    auto itOld = mapTxBalances.find(hash);
+    if (itOld != mapTxBalances.end()) {
+        balancesTotal -= itOld->second.balances;
+        setTxBalancesByHeight.erase(std::make_pair(itOld->second.nHeight, hash));
+        mapTxBalances.erase(itOld);
+    }
+
+    auto it = mapWallet.find(hash);
+    if (it == mapWallet.end() || !setWallet.count(hash))
+        return;
+    const CWalletTx& pcoin = it->second;
+
+    // Outside of the chain and the mempool a tx counts in none of the buckets
+    const int nChainDepth = pcoin.GetDepthInMainChain(false);
+    int nHeight;
+    if (nChainDepth > 0)
+        nHeight = chainActive.Height() - nChainDepth + 1;
+    else if (nChainDepth == 0 && pcoin.InMempool())
+        nHeight = std::numeric_limits<int>::max();
+    else
+        return;
+
+    CWalletBalances balances;
+    bool fConflicted;
+    int nDepth = 0;
+    if (pcoin.IsTrusted(nDepth, fConflicted)) {
+        const CAmount nAvailable = pcoin.GetAvailableCredit();
+        balances.nTrusted = nAvailable;
+        balances.nWatchOnlyTrusted = pcoin.GetAvailableWatchOnlyCredit();
+        if (nDepth > 0) {
+            const CAmount nLocked = pcoin.GetLockedCredit();
+            if (!fLiteMode)
+                balances.nLocked = nLocked;
+            if (nDepth >= Params().GetConsensus().nStakeMinDepth)
+                balances.nStakeable = nAvailable - nLocked;
+        }
+    } else if (nChainDepth == 0) {
+        balances.nUntrusted = pcoin.GetAvailableCredit();
+        balances.nWatchOnlyUntrusted = pcoin.GetAvailableWatchOnlyCredit();
+    }
+    balances.nImmature = pcoin.GetImmatureCredit(false);
+    balances.nWatchOnlyImmature = pcoin.GetImmatureWatchOnlyCredit();
+
+    mapTxBalances[hash] = CTxBalances{balances, nHeight};
+    setTxBalancesByHeight.insert(std::make_pair(nHeight, hash));
+    balancesTotal += balances;
+}
+
+CWalletBalances CWallet::GetBalances() const
+{
+    LOCK2(cs_main, cs_wallet);
+
+    std::set<uint256> setDirty;
+    bool fReload;
+    {
+        LOCK(cs_balancesDirty);
+        setDirty.swap(setTxBalancesDirty);
+        fReload = !fBalancesLoaded;
+        fBalancesLoaded = true;
+    }
+
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    const unsigned int nMempoolUpdated = mempool.GetTransactionsUpdated();
+    if (fReload) {
+        mapTxBalances.clear();
+        setTxBalancesByHeight.clear();
+        balancesTotal = CWalletBalances();
+        setDirty.insert(setWallet.begin(), setWallet.end());
+    } else if (pindexTip != pBalancesTip) {
+        // Past the stake depth and the maturity a deeper tx stays in the same
+        // buckets, so only the txs above the fork with the last tip or less
+        // deep than that below it can move. This includes the mempool.
+        const Consensus::Params& consensus = Params().GetConsensus();
+        const int nMaxDepth = std::max(consensus.nStakeMinDepth, consensus.nCoinbaseMaturity + 1);
+        const CBlockIndex* pindexFork = pBalancesTip ? chainActive.FindFork(pBalancesTip) : nullptr;
+        const int nFromHeight = pindexFork ? pindexFork->nHeight - nMaxDepth + 1 : std::numeric_limits<int>::min();
+        for (auto it = setTxBalancesByHeight.lower_bound(std::make_pair(nFromHeight, uint256())); it != setTxBalancesByHeight.end(); ++it)
+            setDirty.insert(it->second);
+    } else if (nMempoolUpdated != nBalancesMempoolUpdated) {
+        // Txs can leave the mempool without the wallet being told
+        for (auto it = setTxBalancesByHeight.lower_bound(std::make_pair(std::numeric_limits<int>::max(), uint256())); it != setTxBalancesByHeight.end(); ++it)
+            setDirty.insert(it->second);
+    }
+    pBalancesTip = pindexTip;
+    nBalancesMempoolUpdated = nMempoolUpdated;
+
+    for (const uint256& hash : setDirty)
+        UpdateTxBalances(hash);
+
+    CWalletBalances balances = balancesTotal;
+    balances.nStakeable = std::max(CAmount(0), balances.nStakeable);
+    return balances;
+}
+
 CAmount CWallet::GetAvailableBalance() const
 {
-    isminefilter filter = ISMINE_SPENDABLE;
-    return GetAvailableBalance(filter, true, 0);
+    return GetBalances().nTrusted;
 }
 
 CAmount CWallet::GetAvailableBalance(isminefilter& filter, bool useCache, int minDepth) const
 {
+    if (filter == ISMINE_SPENDABLE && minDepth <= 0)
+        return GetBalances().nTrusted;
+
     return loopTxsBalance([filter, useCache, minDepth](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal){
         bool fConflicted;
         int depth;
@@ -1664,73 +2524,37 @@ CAmount CWallet::GetAvailableBalance(isminefilter& filter, bool useCache, int mi
 
 CAmount CWallet::GetStakingBalance() const
 {
-    const auto nHeight = chainActive.Height();
-    const auto& params = Params();
-    const auto& consensus = params.GetConsensus();
-    const auto nStakeMinDepth = consensus.nStakeMinDepth;
- 
-    return 
-        std::max(
-            CAmount(0), 
-            loopTxsBalance(
-                [nStakeMinDepth](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) 
-                {
-                    if (pcoin.IsTrusted() && pcoin.GetDepthInMainChain() >= nStakeMinDepth) 
-                    {
-                        nTotal += pcoin.GetAvailableCredit();       // available coins
-                        nTotal -= pcoin.GetLockedCredit();          // minus locked coins, if any
-                    }
-                }
-            )
-        );
+    return GetBalances().nStakeable;
 }
 
 CAmount CWallet::GetLockedCoins() const
 {
-    if (fLiteMode) return 0;
-
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            if (pcoin.IsTrusted() && pcoin.GetDepthInMainChain() > 0)
-                nTotal += pcoin.GetLockedCredit();
-    });
+    return GetBalances().nLocked;
 }
 
 CAmount CWallet::GetUnconfirmedBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            if (!pcoin.IsTrusted() && pcoin.GetDepthInMainChain() == 0 && pcoin.InMempool())
-                nTotal += pcoin.GetAvailableCredit();
-    });
+    return GetBalances().nUntrusted;
 }
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            nTotal += pcoin.GetImmatureCredit(false);
-    });
+    return GetBalances().nImmature;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            if (pcoin.IsTrusted())
-                nTotal += pcoin.GetAvailableWatchOnlyCredit();
-    });
+    return GetBalances().nWatchOnlyTrusted;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            if (!pcoin.IsTrusted() && pcoin.GetDepthInMainChain() == 0 && pcoin.InMempool())
-                nTotal += pcoin.GetAvailableWatchOnlyCredit();
-    });
+    return GetBalances().nWatchOnlyUntrusted;
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            nTotal += pcoin.GetImmatureWatchOnlyCredit();
-    });
+    return GetBalances().nWatchOnlyImmature;
 }
 
 // Calculate total balance in a different way from GetBalance. The biggest
@@ -1915,16 +2739,15 @@ bool CWallet::AvailableCoins(std::vector<COutput>* pCoins,      // --> populates
             int nMine = 0;
             int nMineSpent = 0;
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
+            // Only the outputs paying to us, their IsMine() is cached in the tx
+            for (const auto& mineOutput : pcoin->GetMineOutputs()) {
+                const unsigned int i = mineOutput.first;
+                const isminetype mine = mineOutput.second;
+
+                nMine++;
 
                 int nSpendDepth;
                 bool spent = IsSpent(wtxid, i, nSpendDepth);
-                isminetype mine = IsMine(pcoin->vout[i]);
-
-                // Check If not mine
-                if (mine == ISMINE_NO) continue;
-
-                nMine++;
 
                 // Check if the utxo was spent.
                 if (spent) {
@@ -1969,6 +2792,7 @@ bool CWallet::AvailableCoins(std::vector<COutput>* pCoins,      // --> populates
     if(vErase.size() > 0) {
         for (auto& h : vErase) {
             setWallet.erase(h);
+            MarkBalancesDirty(h);
         }
         setWallet.rehash(0);
     }
@@ -2000,9 +2824,14 @@ std::map<CTxDestination , std::vector<COutput> > CWallet::AvailableCoinsByAddres
     return mapCoins;
 }
 
-static void ApproximateBestSubset(std::vector<std::pair<CAmount, std::pair<const CWalletTx*, unsigned int> > > vValue, const CAmount& nTotalLower, const CAmount& nTargetValue, std::vector<char>& vfBest, CAmount& nBest, int iterations = 1000)
+/** Coins looked at by one ApproximateBestSubset call, fewer iterations are run over large sets */
+static const size_t KNAPSACK_MAX_STEPS = 10000000;
+
+static void ApproximateBestSubset(const std::vector<std::pair<CAmount, std::pair<const CWalletTx*, unsigned int> > >& vValue, const CAmount& nTotalLower, const CAmount& nTargetValue, std::vector<char>& vfBest, CAmount& nBest, int iterations = 1000)
 {
     std::vector<char> vfIncluded;
+    if (!vValue.empty())
+        iterations = std::max(std::min(iterations, (int)(KNAPSACK_MAX_STEPS / vValue.size())), 10);
 
     vfBest.assign(vValue.size(), true);
     nBest = nTotalLower;
@@ -2040,53 +2869,147 @@ static void ApproximateBestSubset(std::vector<std::pair<CAmount, std::pair<const
 }
 
 
-bool CWallet::StakeableCoins(std::vector<COutput>* pCoins)
+void CWallet::BuildStakeCandidates()
 {
-    return AvailableCoins(pCoins,
-            nullptr,            // coin control
-            STAKEABLE_COINS);  // coin type
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    const Consensus::Params& consensus = Params().GetConsensus();
+    const int nTipHeight = chainActive.Height();
+    vStakeCandidates.clear();
+    for (const uint256& wtxid : setWallet) {
+        auto it = mapWallet.find(wtxid);
+        if (it == mapWallet.end())
+            continue;
+        const CWalletTx* pcoin = &it->second;
+
+        // Only confirmed transactions can get deep enough, which also makes them final and trusted
+        const int nDepth = pcoin->GetDepthInMainChain(false);
+        if (nDepth <= 0)
+            continue;
+        const int nHeight = nTipHeight - nDepth + 1;
+        int nStakeHeight = nHeight + consensus.nStakeMinDepth - 1;
+        if (pcoin->IsCoinBase() || pcoin->IsCoinStake())
+            nStakeHeight = std::max(nStakeHeight, nHeight + consensus.nCoinbaseMaturity);
+
+        for (const auto& mineOutput : pcoin->GetMineOutputs()) {
+            const unsigned int i = mineOutput.first;
+            const isminetype mine = mineOutput.second;
+            if (IsSpent(wtxid, i) || IsLockedCoin(wtxid, i) || masternodeConfig.contains(COutPoint(wtxid, i)))
+                continue;
+            if (pcoin->vout[i].nValue <= 0)
+                continue;
+            const bool fSolvable = IsSolvable(*this, pcoin->vout[i].scriptPubKey);
+            const bool fSpendable = (mine & ISMINE_SPENDABLE) != ISMINE_NO;
+            vStakeCandidates.push_back(CStakeCandidate{pcoin, i, nHeight, nStakeHeight, fSpendable, fSolvable});
+        }
+    }
+    std::stable_sort(vStakeCandidates.begin(), vStakeCandidates.end(), [](const CStakeCandidate& a, const CStakeCandidate& b) {
+        return a.nStakeHeight < b.nStakeHeight;
+    });
 }
 
-bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const
+bool CWallet::StakeableCoins(std::vector<COutput>* pCoins)
 {
-    setCoinsRet.clear();
-    nValueRet = 0;
-
-    // List of values less than target
-    std::pair<CAmount, std::pair<const CWalletTx*, unsigned int> > coinLowestLarger;
-    coinLowestLarger.first = std::numeric_limits<CAmount>::max();
-    coinLowestLarger.second.first = NULL;
-    std::vector<std::pair<CAmount, std::pair<const CWalletTx*, unsigned int> > > vValue;
-    CAmount nTotalLower = 0;
+    if (pCoins) pCoins->clear();
 
-    random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
+    LOCK2(cs_main, cs_wallet);
 
+    // Blocks connected on top of the cached tip leave the confirmation heights unchanged
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    const uint64_t nGeneration = nBalancesGeneration;
+    const uint64_t nMasternodes = masternodeConfig.GetUpdateCount();
+    // Spends can leave the mempool without the wallet being told
+    const unsigned int nMempoolUpdated = mempool.GetTransactionsUpdated();
+    if (!fStakeCandidatesCached || nStakeCandidatesGeneration != nGeneration || nStakeCandidatesMasternodes != nMasternodes ||
+            nStakeCandidatesMempoolUpdated != nMempoolUpdated ||
+            !pStakeCandidatesTip || !pindexTip || pindexTip->GetAncestor(pStakeCandidatesTip->nHeight) != pStakeCandidatesTip) {
+        BuildStakeCandidates();
+        fStakeCandidatesCached = true;
+        pStakeCandidatesTip = pindexTip;
+        nStakeCandidatesGeneration = nGeneration;
+        nStakeCandidatesMasternodes = nMasternodes;
+        nStakeCandidatesMempoolUpdated = nMempoolUpdated;
+    }
+
+    const int nTipHeight = chainActive.Height();
+    std::vector<CStakeCandidate>::const_iterator itEnd = std::upper_bound(vStakeCandidates.begin(), vStakeCandidates.end(), nTipHeight,
+            [](int nHeight, const CStakeCandidate& candidate) { return nHeight < candidate.nStakeHeight; });
+    if (!pCoins)
+        return itEnd != vStakeCandidates.begin();
+
+    pCoins->reserve(itEnd - vStakeCandidates.begin());
+    for (std::vector<CStakeCandidate>::const_iterator it = vStakeCandidates.begin(); it != itEnd; ++it)
+        pCoins->emplace_back(COutput(it->tx, it->i, nTipHeight - it->nHeight + 1, it->fSpendable, it->fSolvable));
+    return !pCoins->empty();
+}
+
+std::vector<CInputCoin> MakeCoinPool(const std::vector<COutput>& vCoins, const CFeeRate& feeRate)
+{
+    const CAmount nInputFee = feeRate.GetFee(COIN_SELECTION_INPUT_SIZE);
+    std::vector<CInputCoin> vCoinPool;
+    vCoinPool.reserve(vCoins.size());
     for (const COutput& output : vCoins) {
         if (!output.fSpendable)
             continue;
-
-        const CWalletTx* pcoin = output.tx;
-
-        if (output.nDepth < (pcoin->IsFromMe(ISMINE_ALL) ? nConfMine : nConfTheirs))
+        const CAmount nValue = output.Value();
+        if (nInputFee > 0 && nValue <= nInputFee)
             continue;
+        vCoinPool.push_back(CInputCoin{output.tx, (unsigned int)output.i, nValue, nValue - nInputFee, output.nDepth, output.tx->IsFromMe(ISMINE_ALL)});
+    }
 
-        int i = output.i;
-        CAmount n = pcoin->vout[i].nValue;
+    // Shuffled first, so that coins of the same value come in random order
+    random_shuffle(vCoinPool.begin(), vCoinPool.end(), GetRandInt);
+    std::sort(vCoinPool.begin(), vCoinPool.end(), [](const CInputCoin& a, const CInputCoin& b) { return a.nValue < b.nValue; });
+    return vCoinPool;
+}
+
+bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, const std::vector<COutput>& vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const
+{
+    return SelectCoinsMinConf(nTargetValue, nConfMine, nConfTheirs, MakeCoinPool(vCoins, CFeeRate()), setCoinsRet, nValueRet);
+}
 
-        std::pair<CAmount, std::pair<const CWalletTx*, unsigned int> > coin = std::make_pair(n, std::make_pair(pcoin, i));
+bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, const std::vector<CInputCoin>& vCoinPool, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const
+{
+    setCoinsRet.clear();
+    nValueRet = 0;
 
-        if (n == nTargetValue) {
-            setCoinsRet.insert(coin.second);
-            nValueRet += coin.first;
+    auto isEligible = [nConfMine, nConfTheirs](const CInputCoin& coin) {
+        return coin.nDepth >= (coin.fFromMe ? nConfMine : nConfTheirs);
+    };
+    auto isLower = [](const CInputCoin& coin, const CAmount& nValue) { return coin.nValue < nValue; };
+
+    // The coins below target + CENT are a prefix of the pool, an exact match
+    // ends it and the smallest larger coin comes right after it
+    const std::vector<CInputCoin>::const_iterator itLarger = std::lower_bound(vCoinPool.begin(), vCoinPool.end(), nTargetValue + CENT, isLower);
+    for (auto it = std::lower_bound(vCoinPool.begin(), itLarger, nTargetValue, isLower); it != itLarger && it->nValue == nTargetValue; ++it) {
+        if (isEligible(*it)) {
+            setCoinsRet.insert(std::make_pair(it->tx, it->i));
+            nValueRet += it->nValue;
             return true;
-        } else if (n < nTargetValue + CENT) {
-            vValue.push_back(coin);
-            nTotalLower += n;
-        } else if (n < coinLowestLarger.first) {
-            coinLowestLarger = coin;
         }
     }
 
+    std::pair<CAmount, std::pair<const CWalletTx*, unsigned int> > coinLowestLarger;
+    coinLowestLarger.first = std::numeric_limits<CAmount>::max();
+    coinLowestLarger.second.first = NULL;
+    for (auto it = itLarger; it != vCoinPool.end(); ++it) {
+        if (isEligible(*it)) {
+            coinLowestLarger = std::make_pair(it->nValue, std::make_pair(it->tx, it->i));
+            break;
+        }
+    }
+
+    // List of values less than target, largest first
+    std::vector<std::pair<CAmount, std::pair<const CWalletTx*, unsigned int> > > vValue;
+    CAmount nTotalLower = 0;
+    for (std::vector<CInputCoin>::const_reverse_iterator it(itLarger); it != vCoinPool.rend(); ++it) {
+        if (!isEligible(*it))
+            continue;
+        vValue.emplace_back(it->nValue, std::make_pair(it->tx, it->i));
+        nTotalLower += it->nValue;
+    }
+
     if (nTotalLower == nTargetValue) {
         for (unsigned int i = 0; i < vValue.size(); ++i) {
             setCoinsRet.insert(vValue[i].second);
@@ -2104,7 +3027,6 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int
     }
 
     // Solve subset sum by stochastic approximation
-    std::sort(vValue.rbegin(), vValue.rend(), CompareValueOnly());
     std::vector<char> vfBest;
     CAmount nBest;
 
@@ -2112,6 +3034,18 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int
     if (nBest != nTargetValue && nTotalLower >= nTargetValue + CENT)
         ApproximateBestSubset(vValue, nTotalLower, nTargetValue + CENT, vfBest, nBest, 1000);
 
+    // A subset too large for a standard transaction is replaced by the largest
+    // coins, which reach the target with the fewest inputs
+    if ((size_t)std::count(vfBest.begin(), vfBest.end(), true) * COIN_SELECTION_INPUT_SIZE >= MAX_STANDARD_TX_SIZE) {
+        CAmount nTotal = 0;
+        for (unsigned int i = 0; i < vValue.size(); i++) {
+            vfBest[i] = nTotal < nTargetValue;
+            if (vfBest[i])
+                nTotal += vValue[i].first;
+        }
+        nBest = nTotal;
+    }
+
     // If we have a bigger coin and (either the stochastic approximation didn't find a good solution,
     //                                   or the next bigger coin is closer), return the bigger coin
     if (coinLowestLarger.second.first &&
@@ -2133,19 +3067,38 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int
     return true;
 }
 
-bool CWallet::SelectCoinsToSpend(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl) const
+bool CWallet::SelectCoinsChangeless(const std::vector<CInputCoin>& vCoinPool, const CAmount& nValue, const CMutableTransaction& txNoInputs, const CFeeRate& feeRate, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const
+{
+    setCoinsRet.clear();
+    nValueRet = 0;
+
+    // The coins of the first SelectCoinsToSpend pass, largest first
+    std::vector<CInputCoin> vCoins;
+    for (auto it = vCoinPool.rbegin(); it != vCoinPool.rend(); ++it) {
+        if (it->nEffectiveValue > 0 && it->nDepth >= (it->fFromMe ? 1 : 6))
+            vCoins.push_back(*it);
+    }
+
+    const CAmount nTarget = nValue + feeRate.GetFee(::GetSerializeSize(txNoInputs, SER_NETWORK, PROTOCOL_VERSION));
+    // Leaving the excess to the fee beats paying for a change output and spending it later
+    const CAmount nCostOfChange = feeRate.GetFee(COIN_SELECTION_CHANGE_SIZE) + feeRate.GetFee(COIN_SELECTION_INPUT_SIZE);
+    std::vector<size_t> vSelected;
+    if (!SelectCoinsBnB(vCoins, nTarget, nCostOfChange, vSelected, nValueRet))
+        return false;
+    for (size_t n : vSelected)
+        setCoinsRet.insert(std::make_pair(vCoins[n].tx, vCoins[n].i));
+    return true;
+}
+
+bool CWallet::SelectCoinsToSpend(const std::vector<CInputCoin>& vCoinPool, const CAmount& nTargetValue, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl) const
 {
     // Note: this function should never be used for "always free" tx types like dstx
-    std::vector<COutput> vCoins(vAvailableCoins);
 
     // coin control -> return all selected outputs (we want all selected to go into the transaction for sure)
     if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs) {
-        for (const COutput& out : vCoins) {
-            if (!out.fSpendable)
-                continue;
-
-            nValueRet += out.tx->vout[out.i].nValue;
-            setCoinsRet.insert(std::make_pair(out.tx, out.i));
+        for (const CInputCoin& coin : vCoinPool) {
+            nValueRet += coin.nValue;
+            setCoinsRet.insert(std::make_pair(coin.tx, coin.i));
         }
         return (nValueRet >= nTargetValue);
     }
@@ -2170,13 +3123,15 @@ bool CWallet::SelectCoinsToSpend(const std::vector<COutput>& vAvailableCoins, co
             return false; // TODO: Allow non-wallet inputs
     }
 
-    // remove preset inputs from vCoins
-    for (std::vector<COutput>::iterator it = vCoins.begin(); it != vCoins.end() && coinControl && coinControl->HasSelected();) {
-        if (setPresetCoins.count(std::make_pair(it->tx, it->i)))
-            it = vCoins.erase(it);
-        else
-            ++it;
+    // remove preset inputs from the pool
+    std::vector<CInputCoin> vCoinPoolOthers;
+    if (!setPresetCoins.empty()) {
+        for (const CInputCoin& coin : vCoinPool) {
+            if (!setPresetCoins.count(std::make_pair(coin.tx, coin.i)))
+                vCoinPoolOthers.push_back(coin);
+        }
     }
+    const std::vector<CInputCoin>& vCoins = setPresetCoins.empty() ? vCoinPool : vCoinPoolOthers;
 
     bool res = nTargetValue <= nValueFromPresetInputs ||
         SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 6, vCoins, setCoinsRet, nValueRet) ||
@@ -2277,6 +3232,15 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend,
                 true                  // fOnlyConfirmed
             );
 
+            // Sorted once for every pass of the fee loop. Coins worth less than
+            // their input's fee are left out, unless the user picked them
+            const CFeeRate feeRate = coinControl && coinControl->fOverrideFeeRate ? coinControl->nFeeRate :
+                                                                                    CFeeRate(GetMinimumFee(1000, nTxConfirmTarget, mempool));
+            const bool fPickedCoins = coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs;
+            const std::vector<CInputCoin> vCoinPool = MakeCoinPool(vAvailableCoins, fPickedCoins ? CFeeRate() : feeRate);
+            // A solution without change is looked for on the first pass only
+            bool fTryChangeless = !(coinControl && coinControl->HasSelected()) && nFeePay <= 0;
+
             nFeeRet = 0;
             if (nFeePay > 0) nFeeRet = nFeePay;
             while (true) {
@@ -2322,12 +3286,17 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend,
                 std::set<std::pair<const CWalletTx*, unsigned int> > setCoins;
                 CAmount nValueIn = 0;
 
-                if (!SelectCoinsToSpend(vAvailableCoins, nTotalValue, setCoins, nValueIn, coinControl)) {
+                if (fTryChangeless && SelectCoinsChangeless(vCoinPool, nValue, txNew, feeRate, setCoins, nValueIn)) {
+                    // The excess, less than the cost of change, goes to the fee
+                    nFeeRet = nValueIn - nValue;
+                    nChangePosInOut = -1;
+                } else if (!SelectCoinsToSpend(vCoinPool, nTotalValue, setCoins, nValueIn, coinControl)) {
                     if (coin_type == ALL_COINS) {
                         strFailReason = _("Insufficient funds.");
                     }
                     return false;
                 }
+                fTryChangeless = false;
 
 
                 for (PAIRTYPE(const CWalletTx*, unsigned int) pcoin : setCoins) {
@@ -2773,6 +3742,8 @@ DBErrors CWallet::LoadWallet(bool& fFirstRunRet)
     if (nLoadWalletRet != DB_LOAD_OK)
         return nLoadWalletRet;
 
+    std::sort(vArchivedOrder.begin(), vArchivedOrder.end());
+
     uiInterface.LoadWallet(this);
 
     return DB_LOAD_OK;
@@ -2920,8 +3891,8 @@ std::map<CTxDestination, CAmount> CWallet::GetAddressBalances()
 
     {
         LOCK(cs_wallet);
-        for (PAIRTYPE(uint256, CWalletTx) walletEntry : mapWallet) {
-            CWalletTx* pcoin = &walletEntry.second;
+        for (const auto& walletEntry : mapWallet) {
+            const CWalletTx* pcoin = &walletEntry.second;
 
             if (!IsFinalTx(*pcoin) || !pcoin->IsTrusted())
                 continue;
@@ -2936,10 +3907,9 @@ std::map<CTxDestination, CAmount> CWallet::GetAddressBalances()
             if (nDepth < (pcoin->IsFromMe(ISMINE_ALL) ? 0 : 1))
                 continue;
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
+            for (const auto& mineOutput : pcoin->GetMineOutputs()) {
+                const unsigned int i = mineOutput.first;
                 CTxDestination addr;
-                if (!IsMine(pcoin->vout[i]))
-                    continue;
                 if (!ExtractDestination(pcoin->vout[i].scriptPubKey, addr))
                     continue;
 
@@ -2961,17 +3931,18 @@ std::set<std::set<CTxDestination> > CWallet::GetAddressGroupings()
     std::set<std::set<CTxDestination> > groupings;
     std::set<CTxDestination> grouping;
 
-    for (PAIRTYPE(uint256, CWalletTx) walletEntry : mapWallet) {
-        CWalletTx* pcoin = &walletEntry.second;
+    for (const auto& walletEntry : mapWallet) {
+        const CWalletTx* pcoin = &walletEntry.second;
 
         if (pcoin->vin.size() > 0) {
             bool any_mine = false;
             // group all input addresses with each other
-            for (CTxIn txin : pcoin->vin) {
+            for (const CTxIn& txin : pcoin->vin) {
                 CTxDestination address;
-                if (!IsMine(txin)) /* If this input isn't mine, ignore it */
+                const CTxOut* pprevout = GetPrevOut(txin.prevout);
+                if (!pprevout || !IsMine(*pprevout)) /* If this input isn't mine, ignore it */
                     continue;
-                if (!ExtractDestination(mapWallet[txin.prevout.hash].vout[txin.prevout.n].scriptPubKey, address))
+                if (!ExtractDestination(pprevout->scriptPubKey, address))
                     continue;
                 grouping.insert(address);
                 any_mine = true;
@@ -2979,7 +3950,7 @@ std::set<std::set<CTxDestination> > CWallet::GetAddressGroupings()
 
             // group change with input addresses
             if (any_mine) {
-                for (CTxOut txout : pcoin->vout)
+                for (const CTxOut& txout : pcoin->vout)
                     if (IsChange(txout)) {
                         CTxDestination txoutAddr;
                         if (!ExtractDestination(txout.scriptPubKey, txoutAddr))
@@ -2994,15 +3965,14 @@ std::set<std::set<CTxDestination> > CWallet::GetAddressGroupings()
         }
 
         // group lone addrs by themselves
-        for (unsigned int i = 0; i < pcoin->vout.size(); i++)
-            if (IsMine(pcoin->vout[i])) {
-                CTxDestination address;
-                if (!ExtractDestination(pcoin->vout[i].scriptPubKey, address))
-                    continue;
-                grouping.insert(address);
-                groupings.insert(grouping);
-                grouping.clear();
-            }
+        for (const auto& mineOutput : pcoin->GetMineOutputs()) {
+            CTxDestination address;
+            if (!ExtractDestination(pcoin->vout[mineOutput.first].scriptPubKey, address))
+                continue;
+            grouping.insert(address);
+            groupings.insert(grouping);
+            grouping.clear();
+        }
     }
 
     std::set<std::set<CTxDestination>*> uniqueGroupings;        // a set of pointers to groups of addresses
@@ -3122,18 +4092,25 @@ void CWallet::LockCoin(const COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.insert(output);
+    setCombineDustCoins.erase(output);
+    MarkBalancesDirty(output.hash);
 }
 
 void CWallet::UnlockCoin(const COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.erase(output);
+    setCombineDustCoins.erase(output);
+    MarkBalancesDirty(output.hash);
 }
 
 void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
+    for (const COutPoint& output : setLockedCoins)
+        MarkBalancesDirty(output.hash);
     setLockedCoins.clear();
+    setCombineDustCoins.clear();
 }
 
 bool CWallet::IsLockedCoin(const uint256& hash, unsigned int n) const
@@ -3283,105 +4260,216 @@ bool CWallet::LoadDestData(const CTxDestination& dest, const std::string& key, c
     return true;
 }
 
+/** Size estimates of a dust combining transaction, around 180 bytes per input and 190 to be certain */
+static const unsigned int COMBINE_DUST_INPUT_SIZE = 190;
+static const unsigned int COMBINE_DUST_OUTPUT_SIZE = 34;
+static const unsigned int COMBINE_DUST_TX_OVERHEAD = 10;
+/** We don't want the combining transactions to be refused for being too large */
+static const unsigned int COMBINE_DUST_MAX_TX_SIZE = MAX_STANDARD_TX_SIZE - 200;
+
+namespace {
+/** A dust combining transaction, with the outputs it spends in input order */
+struct CCombineDustTx {
+    CMutableTransaction tx;
+    std::vector<CTxOut> vPrevOuts;
+    unsigned int nSize = COMBINE_DUST_TX_OVERHEAD;
+    bool fSigned = false;
+};
+}
+
+/** Signs the transactions on up to one thread per core, without holding the wallet lock */
+static void SignCombineDustTxs(const CKeyStore& keystore, std::vector<CCombineDustTx>& vTxs)
+{
+    std::atomic<size_t> nNext(0);
+    auto signTxs = [&keystore, &vTxs, &nNext]() {
+        size_t i;
+        while ((i = nNext++) < vTxs.size()) {
+            CCombineDustTx& combineTx = vTxs[i];
+            const CTransaction txConst(combineTx.tx);
+            combineTx.fSigned = true;
+            for (unsigned int nIn = 0; nIn < combineTx.tx.vin.size() && combineTx.fSigned; nIn++) {
+                const CTxOut& prevout = combineTx.vPrevOuts[nIn];
+                SignatureData sigdata;
+                combineTx.fSigned = ProduceSignature(TransactionSignatureCreator(&keystore, &txConst, nIn, prevout.nValue, SIGHASH_ALL),
+                                                     prevout.scriptPubKey, sigdata);
+                if (combineTx.fSigned)
+                    UpdateTransaction(combineTx.tx, nIn, sigdata);
+            }
+        }
+    };
+
+    boost::thread_group threadGroup;
+    const int nThreads = std::min((int)vTxs.size(), std::max(GetNumCores(), 1));
+    for (int i = 1; i < nThreads; i++)
+        threadGroup.create_thread(signTxs);
+    signTxs();
+    threadGroup.join_all();
+}
+
 void CWallet::AutoCombineDust(CConnman* connman)
 {
-    LOCK2(cs_main, cs_wallet);
-    const auto tip = chainActive.Tip();
-    if (tip->nTime < (GetAdjustedTime() - 300) || IsLocked()) {
-        return;
-    }
+    // Plan the transactions: the dust of each address is combined back to the
+    // address, in transactions shared by as many addresses as fit.
+    std::vector<CCombineDustTx> vTxs;
+    {
+        LOCK2(cs_main, cs_wallet);
+        const auto tip = chainActive.Tip();
+        if (tip->nTime < (GetAdjustedTime() - 300) || IsLocked()) {
+            return;
+        }
 
-    // Make sure we don't break the settings saved in the old wallets where the autocombine threshold was saved incorrectly.
-    CAmount adjustedAutoCombineThreshold = nAutoCombineThreshold;
-    if (nAutoCombineThreshold < COIN) {
-        adjustedAutoCombineThreshold = nAutoCombineThreshold * COIN;
-    }
+        // Make sure we don't break the settings saved in the old wallets where the autocombine threshold was saved incorrectly.
+        CAmount adjustedAutoCombineThreshold = nAutoCombineThreshold;
+        if (nAutoCombineThreshold < COIN) {
+            adjustedAutoCombineThreshold = nAutoCombineThreshold * COIN;
+        }
 
-    std::map<CTxDestination, std::vector<COutput> > mapCoinsByAddress = AvailableCoinsByAddress(true, adjustedAutoCombineThreshold);
+        const CFeeRate feeRate(GetMinimumFee(1000, nTxConfirmTarget, mempool));
+        const size_t nMaxTxs = std::max((int64_t)1, GetArg("-combinedustmaxtxs", DEFAULT_COMBINE_DUST_MAX_TXS));
+        std::map<CTxDestination, std::vector<COutput> > mapCoinsByAddress = AvailableCoinsByAddress(true, adjustedAutoCombineThreshold);
+
+        //coins are sectioned by address. This combination code only wants to combine inputs that belong to the same address
+        for (auto it = mapCoinsByAddress.begin(); it != mapCoinsByAddress.end(); it++) {
+            std::vector<const COutput*> vRewardCoins;
+            unsigned int nSize = COMBINE_DUST_OUTPUT_SIZE;
+            CAmount nTotalRewardsValue = 0;
+            for (const COutput& out : it->second) {
+                if (!out.fSpendable)
+                    continue;
+                //no coins should get this far if they dont have proper maturity, this is double checking
+                if (out.tx->IsCoinStake() && out.nDepth < Params().GetConsensus().nCoinbaseMaturity + 1)
+                    continue;
+                if (COMBINE_DUST_TX_OVERHEAD + nSize + COMBINE_DUST_INPUT_SIZE >= COMBINE_DUST_MAX_TX_SIZE)
+                    break;
 
-    //coins are sectioned by address. This combination code only wants to combine inputs that belong to the same address
-    for (auto it = mapCoinsByAddress.begin(); it != mapCoinsByAddress.end(); it++) {
-        std::vector<COutput> vCoins, vRewardCoins;
-        vCoins = it->second;
+                vRewardCoins.push_back(&out);
+                nTotalRewardsValue += out.Value();
+                nSize += COMBINE_DUST_INPUT_SIZE;
 
-        // We don't want the tx to be refused for being too large
-        // we use 50 bytes as a base tx size (2 output: 2*34 + overhead: 10 -> 90 to be certain)
-        unsigned int txSizeEstimate = 90;
+                // Combine to the threshold and not way above
+                if (nTotalRewardsValue > adjustedAutoCombineThreshold)
+                    break;
+            }
 
-        //find masternode rewards that need to be combined
-        CCoinControl* coinControl = new CCoinControl();
-        CAmount nTotalRewardsValue = 0;
-        for (const COutput& out : vCoins) {
-            if (!out.fSpendable)
-                continue;
-            //no coins should get this far if they dont have proper maturity, this is double checking
-            if (out.tx->IsCoinStake() && out.tx->GetDepthInMainChain() < Params().GetConsensus().nCoinbaseMaturity + 1)
+            //we cannot combine one coin with itself
+            if (vRewardCoins.size() <= 1)
                 continue;
 
-            COutPoint outpt(out.tx->GetHash(), out.i);
-            coinControl->Select(outpt);
-            vRewardCoins.push_back(out);
-            nTotalRewardsValue += out.Value();
+            // Start a new transaction when this address doesn't fit in the last one
+            if (vTxs.empty() || vTxs.back().nSize + nSize >= COMBINE_DUST_MAX_TX_SIZE) {
+                if (vTxs.size() >= nMaxTxs)
+                    break;
+                vTxs.emplace_back();
+            }
+            CCombineDustTx& combineTx = vTxs.back();
 
-            // Combine to the threshold and not way above
-            if (nTotalRewardsValue > adjustedAutoCombineThreshold)
-                break;
+            //we don't combine below the threshold unless the fees are 0 to avoid paying fees over fees over fees
+            const CAmount nFee = feeRate.GetFee(nSize + (combineTx.tx.vout.empty() ? COMBINE_DUST_TX_OVERHEAD : 0));
+            if (nTotalRewardsValue < adjustedAutoCombineThreshold && nFee > 0)
+                continue;
+            const CTxOut txout(nTotalRewardsValue - nFee, GetScriptForDestination(it->first));
+            if (txout.IsDust(::minRelayTxFee))
+                continue;
 
-            // Around 180 bytes per input. We use 190 to be certain
-            txSizeEstimate += 190;
-            if (txSizeEstimate >= MAX_STANDARD_TX_SIZE - 200) {
-                break;
+            for (const COutput* out : vRewardCoins) {
+                combineTx.tx.vin.emplace_back(out->tx->GetHash(), out->i);
+                combineTx.vPrevOuts.push_back(out->tx->vout[out->i]);
+                // Keep the coins out of other transactions until the round is over,
+                // unless their lock is changed meanwhile
+                LockCoin(combineTx.tx.vin.back().prevout);
+                setCombineDustCoins.insert(combineTx.tx.vin.back().prevout);
             }
+            combineTx.tx.vout.push_back(txout);
+            combineTx.nSize += nSize;
         }
+        if (!vTxs.empty() && vTxs.back().tx.vout.empty())
+            vTxs.pop_back();
+    }
+    if (vTxs.empty())
+        return;
 
-        //if no inputs found then return
-        if (!coinControl->HasSelected())
-            continue;
-
-        //we cannot combine one coin with itself
-        if (vRewardCoins.size() <= 1)
-            continue;
-
-        std::vector<CRecipient> vecSend;
-        CScript scriptPubKey = GetScriptForDestination(it->first);
-        vecSend.emplace_back(scriptPubKey, nTotalRewardsValue, false);
+    const int64_t nStart = GetTimeMillis();
+    SignCombineDustTxs(*this, vTxs);
+    const int64_t nSignTime = GetTimeMillis() - nStart;
 
-        //Send change to same address
-        CTxDestination destMyAddress;
-        if (!ExtractDestination(scriptPubKey, destMyAddress)) {
-            LogPrintf("AutoCombineDust: failed to extract destination\n");
-            continue;
+    // Commit the signed transactions in one go, the wallet database is
+    // flushed once after the last one
+    LOCK2(cs_main, cs_wallet);
+    std::vector<CWalletTx> vWtx;
+    for (CCombineDustTx& combineTx : vTxs) {
+        bool fUnspent = true;
+        for (const CTxIn& txin : combineTx.tx.vin) {
+            // Only release the locks of the round, a coin locked by the user meanwhile stays locked and unspent
+            if (setCombineDustCoins.count(txin.prevout))
+                UnlockCoin(txin.prevout);
+            fUnspent &= mapWallet.count(txin.prevout.hash) && !IsSpent(txin.prevout.hash, txin.prevout.n) &&
+                        !IsLockedCoin(txin.prevout.hash, txin.prevout.n);
         }
-        coinControl->destChange = destMyAddress;
-
-        // Create the transaction and commit it to the network
-        CWalletTx wtx;
-        CReserveKey keyChange(this); // this change address does not end up being used, because change is returned with coin control switch
-        std::string strErr;
-        CAmount nFeeRet = 0;
-        int nChangePosInOut = -1;
-
-        // 10% safety margin to avoid "Insufficient funds" errors
-        vecSend[0].nAmount = nTotalRewardsValue - (nTotalRewardsValue / 10);
-
-        if (!CreateTransaction(vecSend, wtx, keyChange, nFeeRet, nChangePosInOut, strErr, coinControl, ALL_COINS, true, CAmount(0))) {
-            LogPrintf("AutoCombineDust createtransaction failed, reason: %s\n", strErr);
+        if (!combineTx.fSigned || !fUnspent) {
+            LogPrintf("AutoCombineDust: dropped transaction, %s\n", combineTx.fSigned ? "its inputs were spent or locked" : "signing failed");
             continue;
         }
+        CWalletTx wtx(this, combineTx.tx);
+        wtx.fTimeReceivedIsTxTime = true;
+        wtx.fFromMe = true;
+        vWtx.push_back(std::move(wtx));
+    }
+
+    std::vector<CTransaction> vtx;
+    for (size_t i = 0; i < vWtx.size(); i++) {
+        CWalletTx& wtx = vWtx[i];
+        AddToWallet(wtx, i + 1 == vWtx.size());
+        vtx.push_back(wtx);
+
+        // Notify that old coins are spent
+        std::set<uint256> updated_hashes;
+        for (const CTxIn& txin : wtx.vin) {
+            if (updated_hashes.insert(txin.prevout.hash).second)
+                NotifyTransactionChanged(this, txin.prevout.hash, CT_UPDATED);
+        }
+    }
 
-        //we don't combine below the threshold unless the fees are 0 to avoid paying fees over fees over fees
-        if (nTotalRewardsValue < adjustedAutoCombineThreshold && nFeeRet > 0)
-            continue;
-
-        const CWallet::CommitResult& res = CommitTransaction(wtx, keyChange, connman);
-        if (res.status != CWallet::CommitStatus::OK) {
-            LogPrintf("AutoCombineDust transaction commit failed\n");
+    // The transactions spend distinct coins, so they are admitted as one batch
+    std::vector<CTxAdmission> vResults;
+    AcceptToMemoryPoolBatch(mempool, vtx, vResults, false, nullptr, true);
+    unsigned int nSent = 0;
+    for (size_t i = 0; i < vWtx.size(); i++) {
+        CWalletTx& wtx = vWtx[i];
+        if (!vResults[i].fAccepted) {
+            LogPrintf("AutoCombineDust: transaction %s rejected, %s\n", wtx.GetHash().ToString(), FormatStateMessage(vResults[i].state));
+            AbandonTransaction(wtx.GetHash());
             continue;
         }
+        wtx.RelayWalletTransaction(connman);
+        nSent++;
+    }
 
-        LogPrintf("AutoCombineDust sent transaction\n");
+    LogPrintf("AutoCombineDust sent %u transaction(s) of %u planned, signed in %dms\n", nSent, vTxs.size(), nSignTime);
+}
 
-        delete coinControl;
+void CWallet::RequestCombineDust(int nHeight, CConnman* connman)
+{
+    boost::unique_lock<boost::mutex> lock(csCombineDust);
+    if (nHeight <= nLastCombineDustHeight)
+        return;
+    nCombineDustHeight = nHeight;
+    pCombineDustConnman = connman;
+    condCombineDust.notify_one();
+}
+
+void CWallet::ThreadCombineDust()
+{
+    while (true) {
+        CConnman* connman;
+        {
+            boost::unique_lock<boost::mutex> lock(csCombineDust);
+            // Requests made during a round are served by a single next round
+            while (nCombineDustHeight <= nLastCombineDustHeight)
+                condCombineDust.wait(lock);
+            nLastCombineDustHeight = nCombineDustHeight;
+            connman = pCombineDustConnman;
+        }
+        AutoCombineDust(connman);
     }
 }
 
@@ -3518,14 +4606,18 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     strUsage += HelpMessageOpt("-keypool=<n>", strprintf(_("Set key pool size to <n> (default: %u)"), DEFAULT_KEYPOOL_SIZE));
     strUsage += HelpMessageOpt("-legacywallet", _("On first run, create a legacy wallet instead of a HD wallet"));
     strUsage += HelpMessageOpt("-maxtxfee=<amt>", strprintf(_("Maximum total fees to use in a single wallet transaction, setting too low may abort large transactions (default: %s)"), FormatMoney(maxTxFee)));
+    strUsage += HelpMessageOpt("-migratewallet", _("Convert a Berkeley DB wallet file to SQLite, keeping the old file as a backup") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-mintxfee=<amt>", strprintf(_("Fees (in %s/Kb) smaller than this are considered zero fee for transaction creation (default: %s)"), CURRENCY_UNIT, FormatMoney(CWallet::minTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-paytxfee=<amt>", strprintf(_("Fee (in %s/kB) to add to transactions you send (default: %s)"), CURRENCY_UNIT, FormatMoney(payTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-rescan", _("Rescan the block chain for missing wallet transactions") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-rescanthreads=<n>", strprintf(_("Set the number of threads reading blocks ahead of a wallet rescan (0 to %d, 0 = read them on the rescanning thread, default: %d)"), MAX_RESCAN_THREADS, DEFAULT_RESCAN_THREADS));
     strUsage += HelpMessageOpt("-salvagewallet", _("Attempt to recover private keys from a corrupt wallet file") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-sendfreetransactions", strprintf(_("Send transactions as zero-fee transactions if possible (default: %u)"), DEFAULT_SEND_FREE_TRANSACTIONS));
     strUsage += HelpMessageOpt("-txconfirmtarget=<n>", strprintf(_("If paytxfee is not set, include enough fee so transactions begin confirmation on average within n blocks (default: %u)"), 1));
     strUsage += HelpMessageOpt("-upgradewallet", _("Upgrade wallet to latest format") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-wallet=<file>", _("Specify wallet file (within data directory)") + " " + strprintf(_("(default: %s)"), DEFAULT_WALLET_DAT));
+    strUsage += HelpMessageOpt("-walletarchive", strprintf(_("Move transactions whose outputs were all spent more than -maxreorg blocks deep out of memory, into an archive in the wallet file (default: %u)"), DEFAULT_WALLET_ARCHIVE));
+    strUsage += HelpMessageOpt("-walletbackend=<backend>", strprintf(_("Database format of a newly created wallet file, existing files keep theirs (bdb or sqlite, default: %s)"), DEFAULT_WALLET_BACKEND));
     strUsage += HelpMessageOpt("-walletnotify=<cmd>", _("Execute command when a wallet transaction changes (%s in cmd is replaced by TxID)"));
     strUsage += HelpMessageOpt("-zapwallettxes=<mode>", _("Delete all wallet transactions and only recover those parts of the blockchain through -rescan on startup") +
         " " + _("(1 = keep tx meta data e.g. account owner and payment request information, 2 = drop tx meta data)"));
@@ -3536,6 +4628,7 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     strUsage += HelpMessageOpt("-staking=<n>", strprintf(_("Enable staking functionality (0-1, default: %u)"), DEFAULT_STAKING));
     if (showDebug) {
         strUsage += HelpMessageGroup(_("Wallet debugging/testing options:"));
+        strUsage += HelpMessageOpt("-combinedustmaxtxs=<n>", strprintf(_("Maximum number of transactions a dust combining round creates (default: %u)"), DEFAULT_COMBINE_DUST_MAX_TXS));
         strUsage += HelpMessageOpt("-dblogsize=<n>", strprintf(_("Flush database activity from memory pool to disk log every <n> megabytes (default: %u)"), DEFAULT_WALLET_DBLOGSIZE));
         strUsage += HelpMessageOpt("-flushwallet", strprintf(_("Run a thread to flush wallet periodically (default: %u)"), DEFAULT_FLUSHWALLET));
         strUsage += HelpMessageOpt("-printcoinstake", _("Display verbose coin stake messages in the debug.log file."));
@@ -3749,8 +4842,15 @@ std::atomic<bool> CWallet::fFlushThreadRunning(false);
 
 void CWallet::postInitProcess(boost::thread_group& threadGroup)
 {
-    // Add wallet transactions that aren't already in a block to mapTransactions
-    ReacceptWalletTransactions(/*fFirstLoad*/true);
+    // Add wallet transactions that aren't already in a block to mapTransactions,
+    // in the background as the RPC server is already up
+    threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "reaccept", boost::function<void()>(boost::bind(&CWallet::ReacceptWalletTransactions, this, /*fFirstLoad*/true))));
+
+    // Archive spent transactions away from block processing, see RequestArchiveSpentTransactions
+    threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "walletarchive", boost::function<void()>(boost::bind(&CWallet::ThreadArchiveSpentTransactions, this))));
+
+    // Combine dust away from block processing, see RequestCombineDust
+    threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "combinedust", boost::function<void()>(boost::bind(&CWallet::ThreadCombineDust, this))));
 
     // Run a thread to flush wallet periodically
     if (!CWallet::fFlushThreadRunning.exchange(true)) {
@@ -3882,9 +4982,31 @@ void CWallet::SetNull()
     nOrderPosNext = 0;
     nNextResend = 0;
     nLastResend = 0;
+    nArchivedTxs = 0;
+    vArchivedOrder.clear();
+    nArchiveHeight = 0;
+    nLastArchiveHeight = 0;
+    nCombineDustHeight = 0;
+    nLastCombineDustHeight = 0;
+    pCombineDustConnman = nullptr;
     nTimeFirstKey = 0;
     fWalletUnlockStaking = false;
 
+    mapTxBalances.clear();
+    setTxBalancesByHeight.clear();
+    setTxBalancesDirty.clear();
+    balancesTotal = CWalletBalances();
+    fBalancesLoaded = false;
+    pBalancesTip = nullptr;
+    nBalancesMempoolUpdated = 0;
+    nBalancesGeneration = 0;
+
+    fStakeCandidatesCached = false;
+    pStakeCandidatesTip = nullptr;
+    nStakeCandidatesGeneration = 0;
+    nStakeCandidatesMasternodes = 0;
+    nStakeCandidatesMempoolUpdated = 0;
+
     // Staker status (last hashed block and time)
     if (pStakerStatus) {
         pStakerStatus->SetNull();
@@ -4053,6 +5175,8 @@ void CWalletTx::Init(const CWallet* pwalletIn)
     strFromAccount.clear();
     fChangeCached = false;
     nChangeCached = 0;
+    vMineOutputs.clear();
+    fMineOutputsCached = false;
     nOrderPos = -1;
 }
 
@@ -4117,6 +5241,10 @@ void CWalletTx::MarkDirty()
     m_amounts[AVAILABLE_CREDIT].Reset();
     nChangeCached = 0;
     fChangeCached = false;
+    vMineOutputs.clear();
+    fMineOutputsCached = false;
+    if (pwallet)
+        pwallet->MarkBalancesDirty(GetHash());
 }
 
 void CWalletTx::BindWallet(CWallet* pwalletIn)
@@ -4134,6 +5262,20 @@ CAmount CWalletTx::GetChange() const
     return nChangeCached;
 }
 
+const std::vector<std::pair<unsigned int, isminetype> >& CWalletTx::GetMineOutputs() const
+{
+    if (fMineOutputsCached)
+        return vMineOutputs;
+    vMineOutputs.clear();
+    for (unsigned int i = 0; i < vout.size(); i++) {
+        isminetype mine = pwallet->IsMine(vout[i]);
+        if (mine != ISMINE_NO)
+            vMineOutputs.emplace_back(i, mine);
+    }
+    fMineOutputsCached = true;
+    return vMineOutputs;
+}
+
 bool CWalletTx::IsFromMe(const isminefilter& filter) const
 {
     return (GetDebit(filter) > 0);
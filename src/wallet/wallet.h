@@ -27,6 +27,7 @@
 #include "util/memory.h"
 #include "validationinterface.h"
 #include "script/ismine.h"
+#include "wallet/coinselection.h"
 #include "wallet/scriptpubkeyman.h"
 #include "wallet/walletdb.h"
 
@@ -40,6 +41,8 @@
 #include <utility>
 #include <vector>
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/unordered_map.hpp>
 #include <boost/unordered_set.hpp>
 
@@ -83,6 +86,18 @@ static const unsigned int DEFAULT_GENERATE_PROCLIMIT = 1;
 static const unsigned int DEFAULT_CREATEWALLETBACKUPS = 10;
 //! Default for -disablewallet
 static const bool DEFAULT_DISABLE_WALLET = false;
+//! Default for -rescanthreads
+static const int DEFAULT_RESCAN_THREADS = 2;
+//! Maximum number of -rescanthreads
+static const int MAX_RESCAN_THREADS = 8;
+//! Default for -walletarchive
+static const bool DEFAULT_WALLET_ARCHIVE = false;
+//! Blocks between two passes moving spent transactions to the archive
+static const int WALLET_ARCHIVE_INTERVAL = 100;
+//! Blocks between two dust combining rounds
+static const int COMBINE_DUST_INTERVAL = 10;
+//! Default for -combinedustmaxtxs, the maximum number of transactions a dust combining round creates
+static const unsigned int DEFAULT_COMBINE_DUST_MAX_TXS = 20;
 
 extern const char * DEFAULT_WALLET_DAT;
 
@@ -92,6 +107,7 @@ extern const char * DEFAULT_WALLET_DAT;
 #define MAX_AMOUNT_LOADED_RECORDS 100000
 
 class CAccountingEntry;
+class CArchivedTx;
 class CCoinControl;
 class COutput;
 class CReserveKey;
@@ -230,6 +246,21 @@ struct CRecipient
 };
 
 
+/** Balances of a wallet, or the part one wallet transaction contributes to them */
+struct CWalletBalances {
+    CAmount nTrusted{0};             //!< GetAvailableBalance()
+    CAmount nUntrusted{0};           //!< GetUnconfirmedBalance()
+    CAmount nImmature{0};            //!< GetImmatureBalance()
+    CAmount nStakeable{0};           //!< GetStakingBalance()
+    CAmount nLocked{0};              //!< GetLockedCoins()
+    CAmount nWatchOnlyTrusted{0};    //!< GetWatchOnlyBalance()
+    CAmount nWatchOnlyUntrusted{0};  //!< GetUnconfirmedWatchOnlyBalance()
+    CAmount nWatchOnlyImmature{0};   //!< GetImmatureWatchOnlyBalance()
+
+    CWalletBalances& operator+=(const CWalletBalances& other);
+    CWalletBalances& operator-=(const CWalletBalances& other);
+};
+
 /**
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
@@ -271,6 +302,80 @@ private:
 
     bool IsKeyUsed(const CPubKey& vchPubKey);
 
+    /**
+     * Balance ledger: what each wallet tx contributes to the balances, keyed
+     * by the height of its block (INT_MAX while in the mempool), and the sum.
+     * Txs that are neither confirmed nor in the mempool contribute nothing
+     * and are not kept. GetBalances() re-evaluates only the txs marked dirty
+     * and, after a new tip, the ones young enough for their depth to move
+     * them between buckets.
+     */
+    struct CTxBalances {
+        CWalletBalances balances;
+        int nHeight;
+    };
+    mutable std::map<uint256, CTxBalances> mapTxBalances;
+    mutable std::set<std::pair<int, uint256> > setTxBalancesByHeight;
+    mutable CWalletBalances balancesTotal;
+    //! Guards the two below, as wallet txs can be bound and marked dirty without cs_wallet
+    mutable RecursiveMutex cs_balancesDirty;
+    mutable std::set<uint256> setTxBalancesDirty;
+    mutable bool fBalancesLoaded;
+    mutable const CBlockIndex* pBalancesTip;
+    mutable unsigned int nBalancesMempoolUpdated;
+    //! Raised by every change to the wallet transactions, their spends or the locked coins
+    mutable std::atomic<uint64_t> nBalancesGeneration;
+
+    //! Replace the contribution of a wallet tx to balancesTotal with its current one
+    void UpdateTxBalances(const uint256& hash) const;
+
+    //! A confirmed output that can stake once the tip reaches nStakeHeight
+    struct CStakeCandidate {
+        const CWalletTx* tx;
+        unsigned int i;
+        int nHeight;       //!< Height of the block holding the tx
+        int nStakeHeight;  //!< First tip height at which the output is deep and mature enough
+        bool fSpendable;
+        bool fSolvable;
+    };
+    /**
+     * Stakeable outputs sorted by nStakeHeight, as of the last
+     * StakeableCoins() call. New blocks only move the cut between the ones
+     * deep enough and the rest; the list is rebuilt when the wallet
+     * generation, the masternode config or the mempool changes, or after a
+     * reorg.
+     */
+    std::vector<CStakeCandidate> vStakeCandidates;
+    bool fStakeCandidatesCached;
+    const CBlockIndex* pStakeCandidatesTip;
+    uint64_t nStakeCandidatesGeneration;
+    uint64_t nStakeCandidatesMasternodes;
+    unsigned int nStakeCandidatesMempoolUpdated;
+
+    void BuildStakeCandidates();
+
+    /**
+     * Outputs of archived transactions that are spent by transactions still
+     * in mapWallet, so IsMine() and GetDebit() keep seeing their inputs.
+     */
+    std::map<COutPoint, CTxOut> mapArchivedOutputs;
+    //! The output spent by outpoint, from mapWallet or the archive, NULL if not ours
+    const CTxOut* GetPrevOut(const COutPoint& outpoint) const;
+
+    /**
+     * Indexes over mapWallet for the listing RPCs, filled as transactions
+     * are loaded, added or change block. Readers skip (and drop) the entries
+     * of transactions that left mapWallet or the block they were indexed in.
+     */
+    //! Transactions confirmed in each block
+    std::multimap<uint256, uint256> mapTxsByBlock;
+    //! Transactions that may be outside the active chain: unconfirmed, abandoned, conflicted or disconnected
+    std::set<uint256> setTxsMaybeUnconfirmed;
+    //! Transactions with outputs to each destination
+    std::map<CTxDestination, std::vector<uint256> > mapTxsByDestination;
+    void IndexTx(const CWalletTx& wtx, bool fNew);
+    void PruneTxIndexes();
+
 
 public:
 
@@ -334,6 +439,12 @@ public:
     // Auto Combine Inputs
     bool fCombineDust;
     CAmount nAutoCombineThreshold;
+    //! Chain height of the last dust combining round requested, and of the last one run
+    int nCombineDustHeight;
+    int nLastCombineDustHeight;
+    CConnman* pCombineDustConnman;
+    boost::mutex csCombineDust;
+    boost::condition_variable condCombineDust;
 
     // MAX_AMOUNT_LOADED_RECORDS
     int nLoadedRecordsMaxCount;
@@ -359,6 +470,18 @@ public:
     std::map<CTxDestination, AddressBook::CAddressBookData> mapAddressBook;
 
     std::set<COutPoint> setLockedCoins;
+    //! Coins locked by the running dust combining round, until the user changes their lock
+    std::set<COutPoint> setCombineDustCoins;
+
+    //! Number of transactions in the archive, see ArchiveSpentTransactions
+    int64_t nArchivedTxs;
+    //! nOrderPos and archive index of the archived transactions, sorted, to list them along wtxOrdered
+    std::vector<std::pair<int64_t, int64_t> > vArchivedOrder;
+    //! Chain height of the last archive pass requested, and of the last one run
+    int nArchiveHeight;
+    int nLastArchiveHeight;
+    boost::mutex csArchive;
+    boost::condition_variable condArchive;
 
     int64_t nTimeFirstKey;
 
@@ -377,9 +500,13 @@ public:
                         bool fOnlyConfirmed             = true
                         ) const;
     //! >> Available coins (spending)
-    bool SelectCoinsToSpend(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl = nullptr) const;
-    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
-    //! >> Available coins (staking)
+    bool SelectCoinsToSpend(const std::vector<CInputCoin>& vCoinPool, const CAmount& nTargetValue, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl = nullptr) const;
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, const std::vector<COutput>& vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
+    //! vCoinPool is sorted by value, see MakeCoinPool
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, const std::vector<CInputCoin>& vCoinPool, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
+    //! Confirmed coins paying nValue and the fee of txNoInputs exactly, give or take the cost of a change output
+    bool SelectCoinsChangeless(const std::vector<CInputCoin>& vCoinPool, const CAmount& nValue, const CMutableTransaction& txNoInputs, const CFeeRate& feeRate, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
+    //! >> Available coins (staking), same as AvailableCoins(STAKEABLE_COINS) but from the maintained candidate list
     bool StakeableCoins(std::vector<COutput>* pCoins = nullptr);
 
     std::map<CTxDestination, std::vector<COutput> > AvailableCoinsByAddress(bool fConfirmed = true, CAmount maxCoinValue = 0);
@@ -459,6 +586,32 @@ public:
     void MarkDirty();
     bool AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose = true);
     bool LoadToWallet(const CWalletTx& wtxIn);
+    //! Load many transactions at once, indexing their spends in one pass. Empties vWtx.
+    void LoadToWallet(std::vector<CWalletTx>& vWtx);
+    void LoadArchivedOutput(const COutPoint& outpoint, const CTxOut& txout) { mapArchivedOutputs[outpoint] = txout; }
+    void LoadArchivedOrder(int64_t nIndex, int64_t nOrderPos) { vArchivedOrder.emplace_back(nOrderPos, nIndex); }
+    /**
+     * Move the transactions whose outputs to us were all spent deeper than
+     * -maxreorg, and whose inputs are not in mapWallet, to the archive.
+     * The wallet lock is taken per batch of WALLET_ARCHIVE_BATCH transactions.
+     * Returns the number of archived transactions.
+     */
+    unsigned int ArchiveSpentTransactions();
+    //! Asks ThreadArchiveSpentTransactions for an archive pass at the block of height nHeight
+    void RequestArchiveSpentTransactions(int nHeight);
+    //! Runs the passes asked with RequestArchiveSpentTransactions, at most one per block, until interrupted
+    void ThreadArchiveSpentTransactions();
+    //! Read the archived transactions at the given archive indexes
+    bool ReadArchivedTxs(const std::vector<int64_t>& vIndexes, std::vector<CArchivedTx>& vArchived);
+    bool ReadArchivedTx(const uint256& hash, CArchivedTx& archived);
+
+    /**
+     * The transactions listsinceblock reports for pindex (in the active
+     * chain): those confirmed after it and those outside the active chain.
+     */
+    std::vector<const CWalletTx*> GetTransactionsSince(const CBlockIndex* pindex);
+    //! The transactions with an output to dest
+    std::vector<const CWalletTx*> GetTransactionsTo(const CTxDestination& dest) const;
     void SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex, int posInBlock);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlockIndex* pIndex, int posInBlock, bool fUpdate);
     void EraseFromWallet(const uint256& hash);
@@ -468,11 +621,42 @@ public:
      */
     bool Upgrade(std::string& error, const int& prevVersion);
 
+    /**
+     * Scan the active chain from pindexStart for transactions involving the
+     * wallet. Blocks are read and matched against the wallet ahead of time on
+     * -rescanthreads threads; cs_main and cs_wallet are only taken to queue
+     * blocks and to add the transactions found.
+     */
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false, bool fromStartup = false);
+    //! Number of keys, scripts and watch-only scripts, to notice keypool top ups during a rescan
+    size_t GetKeyStoreSize() const;
+    //! Output scripts paying to the wallet keys, scripts and watch-only scripts, to match block filters
+    std::set<CScript> GetScriptPubKeys() const;
+    //! Whether a wallet script or a wallet output is a bare multisig, which GetScriptPubKeys() can not list
+    bool HasBareMultisig() const;
     void ReacceptWalletTransactions(bool fFirstLoad = false);
     void ResendWalletTransactions(CConnman* connman);
 
     CAmount loopTxsBalance(std::function<void(const uint256&, const CWalletTx&, CAmount&)>method) const;
+    //! All the balances below, from the balance ledger
+    CWalletBalances GetBalances() const;
+    //! Have GetBalances() re-evaluate one wallet tx, or all of them
+    void MarkBalancesDirty(const uint256& hash) const
+    {
+        {
+            LOCK(cs_balancesDirty);
+            setTxBalancesDirty.insert(hash);
+        }
+        nBalancesGeneration++;
+    }
+    void MarkBalancesDirty() const
+    {
+        {
+            LOCK(cs_balancesDirty);
+            fBalancesLoaded = false;
+        }
+        nBalancesGeneration++;
+    }
     CAmount GetAvailableBalance() const;
     CAmount GetAvailableBalance(isminefilter& filter, bool useCache = false, int minDepth = 1) const;
     CAmount GetStakingBalance() const;
@@ -526,7 +710,15 @@ public:
                          int64_t& nTxNewTime,
                          std::vector<COutput>* availableCoins);
     bool MultiSend();
+    /**
+     * Combines the dust of each address back to it, in transactions shared by
+     * several addresses and signed in parallel without holding the wallet lock.
+     */
     void AutoCombineDust(CConnman* connman);
+    //! Asks ThreadCombineDust for a dust combining round at the block of height nHeight
+    void RequestCombineDust(int nHeight, CConnman* connman);
+    //! Runs the rounds asked with RequestCombineDust, at most one per block, until interrupted
+    void ThreadCombineDust();
 
     static CFeeRate minTxFee;
     /**
@@ -790,6 +982,9 @@ public:
     mutable CachableAmount m_amounts[AMOUNTTYPE_ENUM_ELEMENTS];
     mutable bool fChangeCached;
     mutable CAmount nChangeCached;
+    //! Outputs paying to the wallet and how, filled by GetMineOutputs()
+    mutable std::vector<std::pair<unsigned int, isminetype> > vMineOutputs;
+    mutable bool fMineOutputsCached;
 
     CWalletTx();
     CWalletTx(const CWallet* pwalletIn);
@@ -857,6 +1052,8 @@ public:
     CAmount GetImmatureWatchOnlyCredit(const bool& fUseCache = true) const;
     CAmount GetAvailableWatchOnlyCredit(const bool& fUseCache = true) const;
     CAmount GetChange() const;
+    //! The outputs IsMine() for, cached until MarkDirty()
+    const std::vector<std::pair<unsigned int, isminetype> >& GetMineOutputs() const;
 
     void GetAmounts(std::list<COutputEntry>& listReceived,
         std::list<COutputEntry>& listSent,
@@ -880,6 +1077,43 @@ public:
     std::set<uint256> GetConflicts() const;
 };
 
+/**
+ * A fully spent transaction moved out of mapWallet into the wallet file.
+ * Its inputs are usually archived too, so the debit is kept with it.
+ */
+class CArchivedTx
+{
+public:
+    CWalletTx wtx;
+    CAmount nDebit;
+    CAmount nWatchOnlyDebit;
+
+    CArchivedTx() : nDebit(0), nWatchOnlyDebit(0) {}
+    explicit CArchivedTx(const CWalletTx& wtxIn) : wtx(wtxIn)
+    {
+        nDebit = wtx.GetDebit(ISMINE_SPENDABLE);
+        nWatchOnlyDebit = wtx.GetDebit(ISMINE_WATCH_ONLY);
+    }
+
+    //! Bind the tx to pwallet with its stored debit
+    void BindWallet(CWallet* pwallet)
+    {
+        wtx.BindWallet(pwallet);
+        wtx.m_amounts[CWalletTx::DEBIT].Set(ISMINE_SPENDABLE, nDebit);
+        wtx.m_amounts[CWalletTx::DEBIT].Set(ISMINE_WATCH_ONLY, nWatchOnlyDebit);
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(wtx);
+        READWRITE(nDebit);
+        READWRITE(nWatchOnlyDebit);
+    }
+};
+
 
 class COutput
 {
@@ -897,6 +1131,13 @@ public:
     std::string ToString() const;
 };
 
+/**
+ * The spendable coins of vCoins sorted by value, for the coin selection of a
+ * transaction. Coins that cost more in fee than they are worth at feeRate
+ * are left out.
+ */
+std::vector<CInputCoin> MakeCoinPool(const std::vector<COutput>& vCoins, const CFeeRate& feeRate);
+
 
 /** Private key that includes an expiration date in case it never gets used. */
 class CWalletKey
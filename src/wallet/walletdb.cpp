@@ -12,6 +12,7 @@
 #include "fs.h"
 
 #include "base58.h"
+#include "compat/endian.h"
 #include "protocol.h"
 #include "serialize.h"
 #include "sync.h"
@@ -72,6 +73,55 @@ bool CWalletDB::EraseTx(uint256 hash)
     return Erase(std::make_pair(std::string("tx"), hash));
 }
 
+/** Key of the archived tx at nIndex, big endian so the records sort by index */
+static std::pair<std::string, uint64_t> ArchivedTxKey(int64_t nIndex)
+{
+    return std::make_pair(std::string("atx"), htobe64((uint64_t)nIndex));
+}
+
+bool CWalletDB::WriteArchivedTx(int64_t nIndex, const CArchivedTx& archived)
+{
+    nWalletDBUpdateCounter++;
+    return Write(ArchivedTxKey(nIndex), archived) &&
+           Write(std::make_pair(std::string("atxpos"), archived.wtx.GetHash()), nIndex) &&
+           Write(std::make_pair(std::string("atxorder"), nIndex), archived.wtx.nOrderPos);
+}
+
+bool CWalletDB::ReadArchivedTx(const uint256& hash, CArchivedTx& archived)
+{
+    int64_t nIndex;
+    return Read(std::make_pair(std::string("atxpos"), hash), nIndex) &&
+           Read(ArchivedTxKey(nIndex), archived);
+}
+
+bool CWalletDB::ExistsArchivedTx(const uint256& hash)
+{
+    return Exists(std::make_pair(std::string("atxpos"), hash));
+}
+
+bool CWalletDB::ReadArchivedTx(int64_t nIndex, CArchivedTx& archived)
+{
+    return Read(ArchivedTxKey(nIndex), archived);
+}
+
+bool CWalletDB::WriteArchivedTxCount(int64_t nArchivedTxs)
+{
+    nWalletDBUpdateCounter++;
+    return Write(std::string("archivedtxs"), nArchivedTxs);
+}
+
+bool CWalletDB::WriteArchivedOutput(const COutPoint& outpoint, const CTxOut& txout)
+{
+    nWalletDBUpdateCounter++;
+    return Write(std::make_pair(std::string("archout"), outpoint), txout);
+}
+
+bool CWalletDB::EraseArchivedOutput(const COutPoint& outpoint)
+{
+    nWalletDBUpdateCounter++;
+    return Erase(std::make_pair(std::string("archout"), outpoint));
+}
+
 bool CWalletDB::WriteKey(const CPubKey& vchPubKey, const CPrivKey& vchPrivKey, const CKeyMetadata& keyMeta)
 {
     nWalletDBUpdateCounter++;
@@ -346,7 +396,7 @@ void CWalletDB::ListAccountCreditDebit(const std::string& strAccount, std::list<
 {
     bool fAllAccounts = (strAccount == "*");
 
-    Dbc* pcursor = GetCursor();
+    CDBCursor* pcursor = GetCursor();
     if (!pcursor)
         throw std::runtime_error("CWalletDB::ListAccountCreditDebit() : cannot create DB cursor");
     unsigned int fFlags = DB_SET_RANGE;
@@ -469,6 +519,34 @@ public:
     }
 };
 
+/** Read a "tx" record whose type was already taken from ssKey, throws if it is malformed */
+static bool ReadTxRecord(CDataStream& ssKey, CDataStream& ssValue, CWalletTx& wtx, bool& fUpgraded, std::string& strErr)
+{
+    uint256 hash;
+    ssKey >> hash;
+    ssValue >> wtx;
+    if (wtx.GetHash() != hash)
+        return false;
+
+    // Undo serialize changes in 31600
+    fUpgraded = false;
+    if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703) {
+        if (!ssValue.empty()) {
+            char fTmp;
+            char fUnused;
+            ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
+            strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
+                wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = fTmp;
+        } else {
+            strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = 0;
+        }
+        fUpgraded = true;
+    }
+    return true;
+}
+
 bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue, CWalletScanState& wss, std::string& strType, std::string& strErr)
 {
     try {
@@ -485,29 +563,12 @@ bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue, CW
             ssKey >> strAddress;
             ssValue >> pwallet->mapAddressBook[DecodeDestination(strAddress)].purpose;
         } else if (strType == "tx") {
-            uint256 hash;
-            ssKey >> hash;
             CWalletTx wtx;
-            ssValue >> wtx;
-            if (wtx.GetHash() != hash)
+            bool fUpgraded;
+            if (!ReadTxRecord(ssKey, ssValue, wtx, fUpgraded, strErr))
                 return false;
-
-            // Undo serialize changes in 31600
-            if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703) {
-                if (!ssValue.empty()) {
-                    char fTmp;
-                    char fUnused;
-                    ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
-                    strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
-                        wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = fTmp;
-                } else {
-                    strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = 0;
-                }
-                wss.vWalletUpgrade.push_back(hash);
-            }
-
+            if (fUpgraded)
+                wss.vWalletUpgrade.push_back(wtx.GetHash());
             if (wtx.nOrderPos == -1)
                 wss.fAnyUnordered = true;
 
@@ -711,6 +772,19 @@ bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue, CW
             CHDChain chain;
             ssValue >> chain;
             pwallet->GetScriptPubKeyMan()->SetHDChain(chain, true);
+        } else if (strType == "archivedtxs") {
+            ssValue >> pwallet->nArchivedTxs;
+        } else if (strType == "atxorder") {
+            int64_t nIndex, nOrderPos;
+            ssKey >> nIndex;
+            ssValue >> nOrderPos;
+            pwallet->LoadArchivedOrder(nIndex, nOrderPos);
+        } else if (strType == "archout") {
+            COutPoint outpoint;
+            CTxOut txout;
+            ssKey >> outpoint;
+            ssValue >> txout;
+            pwallet->LoadArchivedOutput(outpoint, txout);
         }
     } catch (...) {
         return false;
@@ -725,6 +799,59 @@ static bool IsKeyType(std::string strType)
             strType == "sapzkey" || strType == "csapzkey");
 }
 
+/** Up to this many threads deserialize the transactions of a loading wallet */
+static const int MAX_WALLET_LOAD_THREADS = 8;
+/** Transaction records taken by a loading thread at a time */
+static const size_t WALLET_LOAD_BATCH = 256;
+
+namespace {
+/** A "tx" record set aside while the other records load */
+struct CWalletTxRecord {
+    CDataStream ssKey;
+    CDataStream ssValue;
+    CWalletTx wtx;
+    bool fRead;
+    bool fUpgraded;
+    std::string strErr;
+
+    CWalletTxRecord(CDataStream&& ssKeyIn, CDataStream&& ssValueIn)
+        : ssKey(std::move(ssKeyIn)), ssValue(std::move(ssValueIn)), fRead(false), fUpgraded(false) {}
+};
+} // namespace
+
+static bool IsTxRecord(const CDataStream& ssKey)
+{
+    // The key starts with the serialized string "tx"
+    return ssKey.size() > 3 && ssKey[0] == 2 && ssKey[1] == 't' && ssKey[2] == 'x';
+}
+
+static void ReadTxRecords(std::vector<CWalletTxRecord>& vRecords, int nThreads)
+{
+    std::atomic<size_t> nNext(0);
+    auto readBatches = [&vRecords, &nNext]() {
+        size_t nStart;
+        while ((nStart = nNext.fetch_add(WALLET_LOAD_BATCH)) < vRecords.size()) {
+            const size_t nEnd = std::min(nStart + WALLET_LOAD_BATCH, vRecords.size());
+            for (size_t i = nStart; i < nEnd; i++) {
+                CWalletTxRecord& record = vRecords[i];
+                try {
+                    std::string strType;
+                    record.ssKey >> strType;
+                    record.fRead = ReadTxRecord(record.ssKey, record.ssValue, record.wtx, record.fUpgraded, record.strErr);
+                } catch (...) {
+                    record.fRead = false;
+                }
+            }
+        }
+    };
+
+    boost::thread_group threadGroup;
+    for (int i = 1; i < nThreads; i++)
+        threadGroup.create_thread(readBatches);
+    readBatches();
+    threadGroup.join_all();
+}
+
 DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
 {
     CWalletScanState wss;
@@ -741,12 +868,16 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
         }
 
         // Get cursor
-        Dbc* pcursor = GetCursor();
+        CDBCursor* pcursor = GetCursor();
         if (!pcursor) {
             LogPrintf("Error getting wallet database cursor\n");
             return DB_CORRUPT;
         }
 
+        // Keys, settings and the address book load as they are read,
+        // transactions are deserialized on several threads afterwards
+        int64_t nStart = GetTimeMillis();
+        std::vector<CWalletTxRecord> vTxRecords;
         while (true) {
             // Read next record
             CDataStream ssKey(SER_DISK, CLIENT_VERSION);
@@ -759,6 +890,11 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
                 return DB_CORRUPT;
             }
 
+            if (IsTxRecord(ssKey)) {
+                vTxRecords.emplace_back(std::move(ssKey), std::move(ssValue));
+                continue;
+            }
+
             // Try to be tolerant of single corrupt records:
             std::string strType, strErr;
             if (!ReadKeyValue(pwallet, ssKey, ssValue, wss, strType, strErr)) {
@@ -779,6 +915,37 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
                 LogPrintf("%s\n", strErr);
         }
         pcursor->close();
+        const int64_t nRecordsTime = GetTimeMillis() - nStart;
+
+        nStart = GetTimeMillis();
+        const size_t nTxRecords = vTxRecords.size();
+        const int nThreads = std::max(1, std::min(GetNumCores(), MAX_WALLET_LOAD_THREADS));
+        ReadTxRecords(vTxRecords, nThreads);
+        std::vector<CWalletTx> vWtx;
+        vWtx.reserve(nTxRecords);
+        for (CWalletTxRecord& record : vTxRecords) {
+            if (!record.fRead) {
+                std::cout << "tx - " << record.strErr << std::endl;
+                fNoncriticalErrors = true;
+                // Rescan if there is a bad transaction record:
+                SoftSetBoolArg("-rescan", true);
+            } else {
+                if (record.fUpgraded)
+                    wss.vWalletUpgrade.push_back(record.wtx.GetHash());
+                if (record.wtx.nOrderPos == -1)
+                    wss.fAnyUnordered = true;
+                vWtx.push_back(std::move(record.wtx));
+            }
+            if (!record.strErr.empty())
+                LogPrintf("%s\n", record.strErr);
+        }
+        std::vector<CWalletTxRecord>().swap(vTxRecords);
+        const int64_t nTxReadTime = GetTimeMillis() - nStart;
+
+        nStart = GetTimeMillis();
+        pwallet->LoadToWallet(vWtx);
+        LogPrintf("Wallet records read in %dms, %u transactions deserialized in %dms on %d threads and indexed in %dms\n",
+            nRecordsTime, nTxRecords, nTxReadTime, nThreads, GetTimeMillis() - nStart);
     } catch (const boost::thread_interrupted&) {
         throw;
     } catch (...) {
@@ -842,7 +1009,7 @@ DBErrors CWalletDB::FindWalletTx(CWallet* pwallet, std::vector<uint256>& vTxHash
         }
 
         // Get cursor
-        Dbc* pcursor = GetCursor();
+        CDBCursor* pcursor = GetCursor();
         if (!pcursor) {
             LogPrintf("Error getting wallet database cursor\n");
             return DB_CORRUPT;
@@ -1114,6 +1281,10 @@ bool CWalletDB::Recover(CDBEnv& dbenv, std::string filename, bool fOnlyKeys)
     // Rewrite salvaged data to fresh wallet file.
     // Set -rescan so any missing transactions will be
     // found.
+    if (dbenv.IsSQLite(filename)) {
+        LogPrintf("%s is a SQLite file, there is nothing to salvage\n", filename);
+        return true;
+    }
     int64_t now = GetTime();
     std::string newFilename = strprintf("wallet.%d.bak", now);
 
@@ -26,10 +26,13 @@ static const bool DEFAULT_FLUSHWALLET = true;
 
 class CAccount;
 class CAccountingEntry;
+class CArchivedTx;
 struct CBlockLocator;
 class CKeyPool;
 class CMasterKey;
+class COutPoint;
 class CScript;
+class CTxOut;
 class CWallet;
 class CWalletTx;
 class uint160;
@@ -113,6 +116,15 @@ public:
     bool WriteTx(const CWalletTx& wtx);
     bool EraseTx(uint256 hash);
 
+    //! Spent history moved out of mapWallet, see CWallet::ArchiveSpentTransactions
+    bool WriteArchivedTx(int64_t nIndex, const CArchivedTx& archived);
+    bool ReadArchivedTx(const uint256& hash, CArchivedTx& archived);
+    bool ExistsArchivedTx(const uint256& hash);
+    bool ReadArchivedTx(int64_t nIndex, CArchivedTx& archived);
+    bool WriteArchivedTxCount(int64_t nArchivedTxs);
+    bool WriteArchivedOutput(const COutPoint& outpoint, const CTxOut& txout);
+    bool EraseArchivedOutput(const COutPoint& outpoint);
+
     bool WriteKey(const CPubKey& vchPubKey, const CPrivKey& vchPrivKey, const CKeyMetadata& keyMeta);
     bool WriteKeyMetadata(const CPubKey& vchPubKey, const CKeyMetadata& keyMeta);
     bool WriteCryptedKey(const CPubKey& vchPubKey, const std::vector<unsigned char>& vchCryptedSecret, const CKeyMetadata& keyMeta);
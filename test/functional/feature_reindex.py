@@ -6,7 +6,7 @@
 
 - Start a single node and generate 3 blocks.
 - Stop the node and restart it with -reindex. Verify that the node has reindexed up to block 3.
-- Stop the node and restart it with -reindex-chainstate. Verify that the node has reindexed up to block 3.
+- Do it again with the block files read on the import thread (-reindexthreads=0).
 """
 
 from test_framework.test_framework import PivxTestFramework
@@ -19,19 +19,20 @@ class ReindexTest(PivxTestFramework):
         self.setup_clean_chain = True
         self.num_nodes = 1
 
-    def reindex(self):
+    def reindex(self, reindex_threads):
         self.nodes[0].generate(3)
         blockcount = self.nodes[0].getblockcount()
         self.stop_nodes()
         time.sleep(5)
-        extra_args = [["-reindex", "-checkblockindex=1"]]
+        extra_args = [["-reindex", "-checkblockindex=1", "-reindexthreads=%d" % reindex_threads]]
         self.start_nodes(extra_args)
         time.sleep(15)
         wait_until(lambda: self.nodes[0].getblockcount() == blockcount)
-        self.log.info("Success")
+        self.log.info("Success with %d reader threads" % reindex_threads)
 
     def run_test(self):
-        self.reindex()
+        self.reindex(2)
+        self.reindex(0)
 
 if __name__ == '__main__':
     ReindexTest().main()
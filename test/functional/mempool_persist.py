@@ -15,9 +15,11 @@ Test is as follows:
     are not sent to node0 or node1 addresses because we don't want
     them to be saved in the wallet.
   - check that node0 and node1 have 5 transactions in their mempools
+  - prioritise one of them on node0
   - shutdown all nodes.
   - startup node0. Verify that it still has 5 transactions
-    in its mempool. Shutdown node0. This tests that by default the
+    in its mempool, with their original entry times and the fee
+    delta. Shutdown node0. This tests that by default the
     mempool is persistent.
   - startup node1. Verify that its mempool is empty. Shutdown node1.
     This tests that with -persistmempool=0, the mempool is not
@@ -64,19 +66,30 @@ class MempoolPersistTest(PivxTestFramework):
         assert_equal(len(self.nodes[0].getrawmempool()), 5)
         assert_equal(len(self.nodes[1].getrawmempool()), 5)
 
+        self.log.debug("Prioritise one transaction on node0")
+        prioritised = self.nodes[0].getrawmempool()[0]
+        self.nodes[0].prioritisetransaction(prioritised, 0, 12345)
+        mempool0 = self.nodes[0].getrawmempool(True)
+
         self.log.debug("Stop-start the nodes. Verify that node0 has the transactions in its mempool and node1 does not. Verify that node2 calculates its balance correctly after loading wallet transactions.")
         self.stop_nodes()
         self.start_node(1)  # Give this one a head-start, so we can be "extra-sure" that it didn't load anything later
         self.start_node(0)
         self.start_node(2)
-        # Give bitcoind a second to reload the mempool
-        wait_until(lambda: len(self.nodes[0].getrawmempool()) == 5, timeout=1)
-        wait_until(lambda: len(self.nodes[2].getrawmempool()) == 5, timeout=1)
+        # The mempool is reloaded in the background
+        wait_until(lambda: len(self.nodes[0].getrawmempool()) == 5, timeout=10)
+        wait_until(lambda: len(self.nodes[2].getrawmempool()) == 5, timeout=10)
         # The others have loaded their mempool. If node_1 loaded anything, we'd probably notice by now:
         assert_equal(len(self.nodes[1].getrawmempool()), 0)
 
+        # Entry times and fee deltas survive the restart
+        reloaded0 = self.nodes[0].getrawmempool(True)
+        for txid, entry in mempool0.items():
+            assert_equal(reloaded0[txid]['time'], entry['time'])
+            assert_equal(reloaded0[txid]['modifiedfee'], entry['modifiedfee'])
+        assert_equal(reloaded0[prioritised]['modifiedfee'], reloaded0[prioritised]['fee'] + Decimal("0.00012345"))
+
         # Verify accounting of mempool transactions after restart is correct
-        self.nodes[2].syncwithvalidationinterfacequeue()  # Flush mempool to wallet
         assert_equal(node2_balance, self.nodes[2].getbalance())
 
         self.log.debug("Stop-start node0 with -persistmempool=0. Verify that it doesn't load its mempool.dat file.")
@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+# Copyright (c) 2025 The Concordia Cash Developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test reconciliation based transaction relay.
+
+Relays the same number of transactions through a fully connected network,
+first with flooding and then with -txreconciliation, and compares the bytes
+spent announcing each transaction.
+"""
+
+from test_framework.test_framework import PivxTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_greater_than,
+    connect_nodes,
+    sync_blocks,
+    sync_mempools,
+    wait_until,
+)
+
+ANNOUNCE_MSGS = ['inv', 'reqrecon', 'sketch', 'reconcildiff']
+NUM_TXS = 20
+
+class TxReconciliationTest(PivxTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 6
+
+    def setup_network(self):
+        self.setup_nodes()
+
+    def connect_mesh(self):
+        # Node a opens the outbound connection to every node b > a
+        for a in range(self.num_nodes):
+            for b in range(a + 1, self.num_nodes):
+                connect_nodes(self.nodes[a], b)
+
+    def announcement_bytes(self):
+        total = 0
+        for node in self.nodes:
+            for peer in node.getpeerinfo():
+                total += sum(peer['bytessent_per_msg'].get(msg, 0) for msg in ANNOUNCE_MSGS)
+        return total
+
+    def relay_round(self, reconcile):
+        self.log.info("Relaying %d transactions with%s reconciliation" % (NUM_TXS, "" if reconcile else "out"))
+        for i in range(self.num_nodes):
+            self.restart_node(i, ["-txreconciliation=%d" % reconcile])
+        self.connect_mesh()
+        for node in self.nodes:
+            wait_until(lambda: len(node.getpeerinfo()) == self.num_nodes - 1, timeout=30)
+            wait_until(lambda: all(p['txreconciliation'] == bool(reconcile) for p in node.getpeerinfo()), timeout=30)
+
+        before = self.announcement_bytes()
+        for i in range(NUM_TXS):
+            sender = self.nodes[i % 4]
+            sender.sendtoaddress(self.nodes[(i + 1) % self.num_nodes].getnewaddress(), 1)
+        sync_mempools(self.nodes, timeout=120)
+        assert_equal(len(self.nodes[0].getrawmempool()), NUM_TXS)
+        # Let pending reconciliation sets drain before taking the measurement
+        for node in self.nodes:
+            wait_until(lambda: all(p['recon_set'] == 0 for p in node.getpeerinfo()), timeout=60)
+        used = self.announcement_bytes() - before
+        self.log.info("Announcement bytes per transaction: %.1f" % (used / NUM_TXS))
+
+        # Confirm the transactions so the next round starts from empty mempools
+        self.nodes[0].generate(1)
+        sync_blocks(self.nodes)
+        return used
+
+    def run_test(self):
+        flood_bytes = self.relay_round(False)
+        recon_bytes = self.relay_round(True)
+        self.log.info("Reconciliation used %.1f%% of the flooding announcement bytes" % (100.0 * recon_bytes / flood_bytes))
+        assert_greater_than(flood_bytes, recon_bytes)
+
+if __name__ == '__main__':
+    TxReconciliationTest().main()
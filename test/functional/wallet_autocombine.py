@@ -9,7 +9,9 @@ import time
 from test_framework.test_framework import PivxTestFramework
 from test_framework.util import (
     assert_equal,
-    assert_raises_rpc_error
+    assert_greater_than,
+    assert_raises_rpc_error,
+    wait_until,
 )
 
 
@@ -17,6 +19,20 @@ class AutoCombineTest(PivxTestFramework):
     def set_test_params(self):
         self.num_nodes = 1
         self.setup_clean_chain = True
+        # A single transaction per round, so that the batch below takes two rounds
+        self.extra_args = [['-combinedustmaxtxs=1']]
+
+    def generate_to_combine_height(self):
+        """Mine up to the next block starting a dust combining round"""
+        self.nodes[0].generate(10 - self.nodes[0].getblockcount() % 10)
+
+    def get_combined_addresses(self, txid):
+        tx = self.nodes[0].getrawtransaction(txid, True)
+        addresses = [out['scriptPubKey']['addresses'][0] for out in tx['vout']]
+        # One output per address, paid by the two dust coins of the address
+        assert_equal(len(set(addresses)), len(addresses))
+        assert_equal(len(tx['vin']), 2 * len(addresses))
+        return set(addresses)
 
     def run_test(self):
         # Check that there's no UTXOs
@@ -99,7 +115,32 @@ class AutoCombineTest(PivxTestFramework):
         assert_equal(walletinfo['balance'], 250 + 250 + 750 - nFee)
         assert_equal(walletinfo['txcount'], 106)
 
+        self.log.info("Send two dust coins to each of 300 addresses")
+        addresses = [self.nodes[0].getnewaddress() for _ in range(300)]
+        for _ in range(2):
+            self.nodes[0].sendmany("", {address: 0.6 for address in addresses})
+        self.nodes[0].generate(1)
+        assert_equal(len(self.nodes[0].getrawmempool()), 0)
+
+        self.log.info("Set autocombine to 1 PIV and mine up to the next round")
+        self.nodes[0].setautocombinethreshold(True, 1)
+        self.generate_to_combine_height()
+        wait_until(lambda: len(self.nodes[0].getrawmempool()) == 1, timeout=30)
+
+        # The addresses share the transaction, up to its size limit
+        combined = self.get_combined_addresses(self.nodes[0].getrawmempool()[0])
+        assert combined.issubset(addresses)
+        assert_greater_than(len(combined), 1)
+        assert_greater_than(len(addresses), len(combined))
+
+        self.log.info("Mine up to the next round for the addresses left over")
+        self.generate_to_combine_height()
+        wait_until(lambda: len(self.nodes[0].getrawmempool()) == 1, timeout=30)
+        combined_next = self.get_combined_addresses(self.nodes[0].getrawmempool()[0])
+        assert_equal(combined_next, set(addresses) - combined)
+
+        self.nodes[0].setautocombinethreshold(False)
+
 
 if __name__ == '__main__':
     AutoCombineTest().main()
-    
\ No newline at end of file
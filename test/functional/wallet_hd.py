@@ -95,6 +95,11 @@ class WalletHDTest(PivxTestFramework):
         self.start_node(1, extra_args=self.extra_args[1] + ['-rescan'])
         assert_equal(self.nodes[1].getbalance(), NUM_HD_ADDS + 1)
 
+        # Same without rescan threads
+        self.stop_node(1)
+        self.start_node(1, extra_args=self.extra_args[1] + ['-rescan', '-rescanthreads=0'])
+        assert_equal(self.nodes[1].getbalance(), NUM_HD_ADDS + 1)
+
         # Try a RPC based rescan
         self.stop_node(1)
         shutil.rmtree(os.path.join(self.nodes[1].datadir, "regtest", "blocks"))